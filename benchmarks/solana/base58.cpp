@@ -0,0 +1,102 @@
+// clang++ base58.cpp -o base58 -std=c++17 -O3 -I ../../src/ -lssl -lcrypto -lsodium
+//
+// Compares the fixed-width base58 codec with the generic b58enc/b58tobin path for
+// 32-byte public keys and 64-byte signatures, one value at a time and in batches,
+// then PublicKey::to_base58() with and without the Base58Cache on a hot working set.
+//
+// ./base58 [values]
+
+#include <random>
+
+#include "solana.hpp"
+
+using namespace solana;
+
+template <typename F>
+double nanoseconds_per_value(size_t count, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < 10; round++) {
+    f();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / (10 * count);
+}
+
+template <size_t N>
+void run(size_t count) {
+  std::vector<uint8_t> values(count * N);
+  for (size_t i = 0; i < values.size(); i++) {
+    values[i] = (uint8_t)(i * 167 + (i >> 5));
+  }
+  std::vector<std::string> texts(count);
+  base58::encode_batch<N>(values.data(), count, texts.data());
+  std::vector<uint8_t> decoded(count * N);
+
+  double generic_encode = nanoseconds_per_value(count, [&]() {
+    char buffer[N * 138 / 100 + 2];
+    for (size_t i = 0; i < count; i++) {
+      size_t size = sizeof(buffer);
+      base58::b58enc(buffer, &size, values.data() + i * N, N);
+      texts[i].assign(buffer, size - 1);
+    }
+  });
+  double fixed_encode = nanoseconds_per_value(count, [&]() {
+    char buffer[base58::FixedWidth<N>::MAX_ENCODED_SIZE];
+    for (size_t i = 0; i < count; i++) {
+      texts[i].assign(buffer, base58::encode_fixed<N>(values.data() + i * N, buffer));
+    }
+  });
+  double batch_encode = nanoseconds_per_value(count, [&]() {
+    base58::encode_batch<N>(values.data(), count, texts.data());
+  });
+
+  double generic_decode = nanoseconds_per_value(count, [&]() {
+    for (size_t i = 0; i < count; i++) {
+      size_t size = N;
+      base58::b58tobin(decoded.data() + i * N, &size, texts[i].c_str(), 0);
+    }
+  });
+  double batch_decode = nanoseconds_per_value(count, [&]() {
+    base58::decode_batch<N>(texts.data(), count, decoded.data());
+  });
+  ASSERT(decoded == values);
+
+  printf("%zu bytes  encode: generic %6.0f ns  fixed %6.0f ns  batch %6.0f ns (%.1fx)\n",
+    N, generic_encode, fixed_encode, batch_encode, generic_encode / batch_encode);
+  printf("%zu bytes  decode: generic %6.0f ns  batch %6.0f ns (%.1fx)\n",
+    N, generic_decode, batch_decode, generic_decode / batch_decode);
+}
+
+void run_cache(size_t count, size_t working_set) {
+  // Real keys are hashes or curve points, so use uniformly random bytes
+  std::mt19937_64 random(42);
+  std::vector<PublicKey> keys(working_set);
+  for (auto& key : keys) {
+    for (auto& byte : key.bytes) {
+      byte = (uint8_t)random();
+    }
+  }
+  size_t length = 0;
+  auto encode_all = [&]() {
+    for (size_t i = 0; i < count; i++) {
+      length += keys[i % working_set].to_base58().size();
+    }
+  };
+
+  double uncached = nanoseconds_per_value(count, encode_all);
+  Base58Cache::enable(2 * working_set);
+  double cached = nanoseconds_per_value(count, encode_all);
+  Base58Cache::disable();
+
+  printf("to_base58 (%zu keys)  uncached %6.0f ns  cached %6.0f ns (%.1fx)\n",
+    working_set, uncached, cached, uncached / cached);
+  ASSERT(length > 0);
+}
+
+int main(int argc, char** argv) {
+  size_t count = argc > 1 ? std::stoul(argv[1]) : 100000;
+  run<32>(count);
+  run<64>(count);
+  run_cache(count, 4096);
+  return 0;
+}
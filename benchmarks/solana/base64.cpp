@@ -0,0 +1,62 @@
+// clang++ base64.cpp -o base64 -std=c++17 -O3 -I ../../src/ -lssl -lcrypto -lsodium
+//
+// Measures base64 encode and decode throughput for each kernel the CPU supports,
+// at the sizes seen on the hot paths: a public key, a token account, a typical
+// transaction or program account, and a large getProgramAccounts blob.
+//
+// ./base64 [seconds per case]
+
+#include "solana.hpp"
+
+using namespace solana;
+
+template <typename F>
+double throughput(size_t bytes, double seconds, F f) {
+  size_t iterations = 0;
+  auto start = std::chrono::steady_clock::now();
+  auto end = start;
+  do {
+    for (int i = 0; i < 16; i++) {
+      f();
+    }
+    iterations += 16;
+    end = std::chrono::steady_clock::now();
+  } while (std::chrono::duration<double>(end - start).count() < seconds);
+  return bytes * iterations / std::chrono::duration<double>(end - start).count() / (1 << 20);
+}
+
+int main(int argc, char** argv) {
+  double seconds = argc > 1 ? std::stod(argv[1]) : 0.5;
+  const std::pair<base64::Kernel, const char*> kernels[] = {
+    { base64::Kernel::Scalar, "scalar" },
+    { base64::Kernel::SSE41, "sse4.1" },
+    { base64::Kernel::AVX2, "avx2" },
+  };
+
+  std::cout << "size      kernel   encode MiB/s  decode MiB/s" << std::endl;
+  for (size_t size : { 32, 165, 10 * 1024, 10 * 1024 * 1024 }) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++) {
+      data[i] = (uint8_t)(i * 167 + (i >> 7));
+    }
+    std::string text = base64::encode(data);
+    std::vector<char> decoded(size);
+
+    for (auto& [kernel, name] : kernels) {
+      if (!base64::kernel_supported(kernel)) {
+        continue;
+      }
+      base64::kernel() = kernel;
+      double encode = throughput(size, seconds, [&]() {
+        base64::encode(data.data(), data.size(), text.data(), text.size());
+      });
+      double decode = throughput(size, seconds, [&]() {
+        base64::decode(text.data(), text.size(), decoded.data(), decoded.size());
+      });
+      ASSERT(memcmp(decoded.data(), data.data(), size) == 0);
+      printf("%-9zu %-8s %12.0f  %12.0f\n", size, name, encode, decode);
+    }
+  }
+
+  return 0;
+}
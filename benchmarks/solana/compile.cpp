@@ -0,0 +1,41 @@
+// clang++ compile.cpp -o compile -std=c++17 -O3 -I ../../src/ -lssl -lcrypto -lsodium
+//
+// Measures Transaction::Message::compile on a swap-sized transaction: 30 accounts
+// referenced by 10 instructions.
+//
+// ./compile [iterations]
+
+#include "solana.hpp"
+
+using namespace solana;
+
+int main(int argc, char** argv) {
+  size_t count = argc > 1 ? std::stoul(argv[1]) : 100000;
+
+  Keypair payer = Keypair::generate();
+  std::vector<PublicKey> accounts(30);
+  for (auto& account : accounts) {
+    randombytes_buf(account.bytes.data(), account.bytes.size());
+  }
+
+  Transaction transaction;
+  for (size_t i = 0; i < 10; i++) {
+    std::vector<Transaction::Message::Instruction::AccountMeta> metas;
+    for (size_t j = 0; j < 8; j++) {
+      metas.push_back({ accounts[(i * 3 + j * 7) % accounts.size()], false, (i + j) % 3 == 0 });
+    }
+    metas.push_back({ payer.public_key, true, true });
+    transaction.add({ accounts[i % 4], metas, std::vector<uint8_t>(32, (uint8_t)i) });
+  }
+
+  size_t keys = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; i++) {
+    keys += transaction.message.compile({ payer }).account_keys.size();
+  }
+  auto end = std::chrono::steady_clock::now();
+  std::cout << "compile: " << std::chrono::duration<double, std::nano>(end - start).count() / count << " ns ("
+    << keys / count << " accounts)" << std::endl;
+
+  return 0;
+}
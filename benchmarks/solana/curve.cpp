@@ -0,0 +1,60 @@
+// clang++ curve.cpp -o curve -std=c++17 -O3 -I ../../src/ -lssl -lcrypto -lsodium
+//
+// Measures the curve checks behind program derived addresses: PublicKey::is_on_curve,
+// PublicKey::find_program_address and token::get_associated_token_address.
+// Build a second binary with -DMANY_FE25519_REF10 to compare the 64-bit radix-2^51
+// field against the 32-bit ref10 one.
+//
+// ./curve [iterations]
+
+#include "solana.hpp"
+
+using namespace solana;
+
+template <typename F>
+double nanoseconds(size_t count, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; i++) {
+    f(i);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / count;
+}
+
+int main(int argc, char** argv) {
+  size_t count = argc > 1 ? std::stoul(argv[1]) : 20000;
+
+#ifdef MANY_FE25519_51
+  std::cout << "field: radix 2^51" << std::endl;
+#else
+  std::cout << "field: ref10 radix 2^25.5" << std::endl;
+#endif
+
+  std::vector<PublicKey> keys(1024);
+  for (auto& key : keys) {
+    randombytes_buf(key.bytes.data(), key.bytes.size());
+  }
+  size_t on_curve = 0;
+  double curve_ns = nanoseconds(count, [&](size_t i) {
+    on_curve += keys[i % keys.size()].is_on_curve();
+  });
+  std::cout << "is_on_curve:                  " << curve_ns << " ns (" << on_curve * 100 / count << "% on curve)" << std::endl;
+
+  size_t bumps = 0;
+  double pda_ns = nanoseconds(count / 10, [&](size_t i) {
+    bumps += 256 - std::get<1>(PublicKey::find_program_address({ keys[i % keys.size()].to_buffer() }, TOKEN_PROGRAM_ID));
+  });
+  std::cout << "find_program_address:         " << pda_ns << " ns (" << (double)bumps / (count / 10) << " candidates)" << std::endl;
+
+  std::vector<PublicKey> owners;
+  for (size_t i = 0; owners.size() < 256; i++) {
+    auto keypair = Keypair::generate();
+    owners.push_back(keypair.public_key);
+  }
+  double ata_ns = nanoseconds(count / 10, [&](size_t i) {
+    token::get_associated_token_address(NATIVE_MINT, owners[i % owners.size()]);
+  });
+  std::cout << "get_associated_token_address: " << ata_ns << " ns" << std::endl;
+
+  return 0;
+}
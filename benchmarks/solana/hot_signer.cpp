@@ -0,0 +1,55 @@
+// clang++ hot_signer.cpp -o hot_signer -std=c++17 -O3 -I ../../src/ -lssl -lcrypto -lsodium
+//
+// Compares signing throughput of Keypair::sign (crypto_sign_detached, which expands
+// the seed on every call and returns a std::string) with HotSigner on an order-sized
+// transaction message.
+//
+// ./hot_signer [message bytes] [signatures]
+
+#include "solana.hpp"
+
+using namespace solana;
+
+template <typename F>
+double seconds(size_t count, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; i++) {
+    f(i);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char** argv) {
+  size_t size = argc > 1 ? std::stoul(argv[1]) : 400;
+  size_t count = argc > 2 ? std::stoul(argv[2]) : 50000;
+
+  auto keypair = Keypair::generate();
+  HotSigner signer(keypair);
+  std::vector<uint8_t> message(size);
+  for (size_t i = 0; i < size; i++) {
+    message[i] = (uint8_t)(i * 31);
+  }
+
+  // Alternate short rounds so both signers see the same clock speed
+  size_t checksum = 0;
+  double libsodium = 0, hot = 0;
+  uint8_t signature[crypto_sign_BYTES];
+  for (size_t round = 0; round < 10; round++) {
+    libsodium += seconds(count / 10, [&](size_t i) {
+      message[0] = (uint8_t)i;
+      checksum += keypair.sign(message)[0];
+    });
+    hot += seconds(count / 10, [&](size_t i) {
+      message[0] = (uint8_t)i;
+      signer.sign(message.data(), message.size(), signature);
+      checksum += signature[0];
+    });
+  }
+
+  ASSERT(std::string((char*)signature, sizeof(signature)) == keypair.sign(message));
+  printf("%zu byte messages\n", size);
+  printf("Keypair::sign: %8.0f signatures/s\n", count / libsodium);
+  printf("HotSigner:     %8.0f signatures/s (%.2fx)\n", count / hot, libsodium / hot);
+  return checksum == 0;
+}
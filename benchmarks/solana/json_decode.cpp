@@ -0,0 +1,82 @@
+// clang++ json_decode.cpp -o json_decode -std=c++17 -O3 -I ../../src/ -lssl -lcrypto -lsodium
+//
+// Compares decoding a getProgramAccounts response through a json DOM (json::parse
+// and from_json) with the on-demand sax::decode path used by Connection, which
+// parses inside an arena as http::post does.
+//
+// ./json_decode [recorded response.json] [iterations]
+//
+// Record a response with this command, joined into one line:
+// curl https://api.mainnet-beta.solana.com -X POST -H "Content-Type: application/json"
+//   -d '{"jsonrpc":"2.0","id":1,"method":"getProgramAccounts","params":["<program id>",{"encoding":"base64"}]}' > response.json
+//
+// Without a recording, a response with 20000 token-sized accounts is generated.
+
+#include "solana.hpp"
+
+using namespace solana;
+
+std::string generate_response(size_t accounts) {
+  std::vector<uint8_t> data(165);
+  std::string response = R"({"jsonrpc":"2.0","result":[)";
+  for (size_t i = 0; i < accounts; i++) {
+    for (size_t j = 0; j < data.size(); j++) {
+      data[j] = (uint8_t)(i * 31 + j);
+    }
+    PublicKey pubkey;
+    memcpy(pubkey.bytes.data(), &i, sizeof(i));
+    if (i > 0) {
+      response += ",";
+    }
+    response += R"({"account":{"data":[")" + base64::encode(data) + R"(","base64"],"executable":false,"lamports":2039280,)"
+      R"("owner":"TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA","rentEpoch":361,"space":165},"pubkey":")" + pubkey.to_base58() + R"("})";
+  }
+  response += R"(],"id":1})";
+  return response;
+}
+
+template <typename F>
+double measure(int iterations, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    f();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+int main(int argc, char** argv) {
+  std::string response;
+  if (argc > 1) {
+    std::ifstream file(argv[1]);
+    response.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  } else {
+    response = generate_response(20000);
+  }
+  int iterations = argc > 2 ? std::stoi(argv[2]) : 10;
+
+  size_t dom_count = 0;
+  double dom_ms = measure(iterations, [&]() {
+    auto result = json::parse(response).get<Result<std::vector<AccountInfo>>>();
+    dom_count = result._result->size();
+  });
+
+  size_t sax_count = 0;
+  Arena arena;
+  double sax_ms = measure(iterations, [&]() {
+    Result<std::vector<AccountInfo>> result;
+    {
+      Arena::Scope scope(arena);
+      sax::decode(response.data(), response.size(), result);
+    }
+    sax_count = result._result->size();
+  });
+
+  std::cout << response.size() / 1024 << " KiB, " << dom_count << " accounts" << std::endl;
+  std::cout << "dom:       " << dom_ms << " ms" << std::endl;
+  std::cout << "on-demand: " << sax_ms << " ms (" << dom_ms / sax_ms << "x)" << std::endl;
+  std::cout << "arena:     " << arena.stats().last_cycle_bytes << " bytes per response" << std::endl;
+  ASSERT(dom_count == sax_count);
+
+  return 0;
+}
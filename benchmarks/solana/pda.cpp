@@ -0,0 +1,97 @@
+// clang++ pda.cpp -o pda -std=c++17 -O3 -I ../../src/ -lssl -lcrypto -lsodium
+//
+// Measures program address derivation: the SHA-256 kernels, find_program_address with
+// byte-vector seeds against PublicKey::Seed views, and get_associated_token_address with
+// and without ProgramAddressCache, and a cold bulk derivation with
+// get_associated_token_addresses.
+//
+// ./pda [iterations] [bulk pairs] [threads]
+
+#include "solana.hpp"
+
+using namespace solana;
+
+template <typename F>
+double nanoseconds(size_t count, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; i++) {
+    f(i);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / count;
+}
+
+int main(int argc, char** argv) {
+  size_t count = argc > 1 ? std::stoul(argv[1]) : 20000;
+
+  // Three keys, a bump and the program id: the message an associated token account hashes
+  uint8_t message[150];
+  randombytes_buf(message, sizeof(message));
+  uint8_t digest[32];
+  double sodium_ns = nanoseconds(count * 10, [&](size_t i) {
+    message[0] = (uint8_t)i;
+    crypto_hash_sha256(digest, message, sizeof(message));
+  });
+  std::cout << "crypto_hash_sha256:           " << sodium_ns << " ns" << std::endl;
+  for (auto kernel : { many::sha256::Kernel::Scalar, many::sha256::Kernel::SHANI }) {
+    if (!many::sha256::kernel_supported(kernel)) {
+      continue;
+    }
+    auto previous = many::sha256::kernel();
+    many::sha256::kernel() = kernel;
+    double ns = nanoseconds(count * 10, [&](size_t i) {
+      message[0] = (uint8_t)i;
+      many::sha256::hash(message, sizeof(message), digest);
+    });
+    many::sha256::kernel() = previous;
+    std::cout << "sha256::hash " << (kernel == many::sha256::Kernel::SHANI ? "(sha-ni): " : "(scalar): ") << "      " << ns << " ns" << std::endl;
+  }
+
+  // Token owners must be on the curve, so take them from real keypairs
+  std::vector<PublicKey> owners;
+  while (owners.size() < 1024) {
+    owners.push_back(Keypair::generate().public_key);
+  }
+  double vector_ns = nanoseconds(count / 10, [&](size_t i) {
+    const PublicKey& owner = owners[i % owners.size()];
+    PublicKey::find_program_address({ owner.to_buffer(), TOKEN_PROGRAM_ID.to_buffer(), NATIVE_MINT.to_buffer() }, ASSOCIATED_TOKEN_PROGRAM_ID);
+  });
+  std::cout << "find_program_address vectors: " << vector_ns << " ns" << std::endl;
+  double seed_ns = nanoseconds(count / 10, [&](size_t i) {
+    const PublicKey& owner = owners[i % owners.size()];
+    PublicKey::find_program_address({ owner, TOKEN_PROGRAM_ID, NATIVE_MINT }, ASSOCIATED_TOKEN_PROGRAM_ID);
+  });
+  std::cout << "find_program_address seeds:   " << seed_ns << " ns" << std::endl;
+
+  double uncached_ns = nanoseconds(count, [&](size_t i) {
+    token::get_associated_token_address(NATIVE_MINT, owners[i % owners.size()]);
+  });
+  std::cout << "get_associated_token_address: " << uncached_ns << " ns" << std::endl;
+  size_t pairs = argc > 2 ? std::stoul(argv[2]) : 100000;
+  size_t threads = argc > 3 ? std::stoul(argv[3]) : 0;
+  std::vector<std::pair<PublicKey, PublicKey>> owners_and_mints(pairs);
+  std::vector<PublicKey> addresses(pairs);
+  for (size_t i = 0; i < pairs; i++) {
+    PublicKey mint;
+    randombytes_buf(mint.bytes.data(), mint.bytes.size());
+    owners_and_mints[i] = { owners[i % owners.size()], mint };
+  }
+  auto start = std::chrono::steady_clock::now();
+  token::get_associated_token_addresses(owners_and_mints.data(), pairs, addresses.data(), false, TOKEN_PROGRAM_ID, ASSOCIATED_TOKEN_PROGRAM_ID, threads);
+  auto end = std::chrono::steady_clock::now();
+  std::cout << "get_associated_token_addresses: " << pairs << " pairs in "
+    << std::chrono::duration<double, std::milli>(end - start).count() << " ms on "
+    << (threads ? threads : std::max(1u, std::thread::hardware_concurrency())) << " threads" << std::endl;
+
+  ProgramAddressCache::enable(owners.size() * 2);
+  for (const PublicKey& owner : owners) {
+    token::get_associated_token_address(NATIVE_MINT, owner);
+  }
+  uint64_t misses = ProgramAddressCache::global().misses();
+  double cached_ns = nanoseconds(count, [&](size_t i) {
+    token::get_associated_token_address(NATIVE_MINT, owners[i % owners.size()]);
+  });
+  std::cout << "  with ProgramAddressCache:   " << cached_ns << " ns (" << ProgramAddressCache::global().misses() - misses << " misses)" << std::endl;
+
+  return 0;
+}
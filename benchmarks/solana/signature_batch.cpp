@@ -0,0 +1,50 @@
+// clang++ signature_batch.cpp -o signature_batch -std=c++17 -O3 -I ../../src/ -lssl -lcrypto -lsodium
+//
+// Compares verifying transaction-sized signatures one by one with
+// crypto_sign_verify_detached against SignatureBatch, for several batch sizes.
+//
+// ./signature_batch [message bytes] [rounds]
+
+#include "solana.hpp"
+
+using namespace solana;
+
+int main(int argc, char** argv) {
+  size_t size = argc > 1 ? std::stoul(argv[1]) : 400;
+  int rounds = argc > 2 ? std::stoi(argv[2]) : 5;
+
+  std::vector<std::vector<uint8_t>> messages;
+  std::vector<std::string> signatures;
+  std::vector<PublicKey> keys;
+  for (size_t i = 0; i < 1024; i++) {
+    auto keypair = Keypair::generate();
+    std::vector<uint8_t> message(size);
+    randombytes_buf(message.data(), message.size());
+    signatures.push_back(keypair.sign(message));
+    keys.push_back(keypair.public_key);
+    messages.push_back(std::move(message));
+  }
+
+  for (size_t count : { 1, 8, 64, 256, 1024 }) {
+    double single = 0, batched = 0;
+    for (int round = 0; round < rounds; round++) {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < count; i++) {
+        ASSERT(crypto_sign_verify_detached((const uint8_t*)signatures[i].data(), messages[i].data(), messages[i].size(), keys[i].bytes.data()) == 0);
+      }
+      auto middle = std::chrono::steady_clock::now();
+      SignatureBatch batch;
+      for (size_t i = 0; i < count; i++) {
+        batch.add((const uint8_t*)signatures[i].data(), keys[i], messages[i]);
+      }
+      ASSERT(batch.verify());
+      auto end = std::chrono::steady_clock::now();
+      single += std::chrono::duration<double, std::micro>(middle - start).count();
+      batched += std::chrono::duration<double, std::micro>(end - middle).count();
+    }
+    std::cout << count << " signatures: " << single / rounds / count << " us each one by one, "
+      << batched / rounds / count << " us batched (" << single / batched << "x)" << std::endl;
+  }
+
+  return 0;
+}
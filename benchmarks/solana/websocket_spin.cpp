@@ -0,0 +1,73 @@
+// clang++ websocket_spin.cpp -o websocket_spin -std=c++17 -O3 -I ../../src/ -lssl -lcrypto -lsodium -lpthread
+//
+// Measures wakeup-to-callback latency (kernel receive timestamp to callback start)
+// for slot and account notifications, first with the select() poll loop and then
+// in spin mode.
+//
+// ./websocket_spin [rpc url] [cpu] [seconds]
+
+#include "solana.hpp"
+
+using namespace solana;
+
+std::vector<uint64_t> measure(const std::string& url, bool spin, int cpu, int seconds) {
+  Connection connection(url, Commitment::Processed);
+  connection.set_receive_timestamps(true);
+  connection.set_spin(spin);
+
+  std::vector<uint64_t> samples;
+  samples.reserve(1 << 20);
+
+  connection.on_slot_change([&](Result<SlotInfo> result) {
+    samples.push_back(result._stamps.callback_start_ns - result._stamps.recv_ns);
+  });
+  connection.on_account_change(SYSVAR_CLOCK_PUBKEY, [&](Result<Account> result) {
+    samples.push_back(result._stamps.callback_start_ns - result._stamps.recv_ns);
+  });
+
+  std::atomic<bool> running(true);
+  std::thread timer([&]() {
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    running = false;
+  });
+
+  if (spin) {
+    connection.spin(running, cpu);
+  } else {
+    if (cpu >= 0) {
+      pin_thread(cpu);
+    }
+    while (running) {
+      connection.poll();
+    }
+  }
+
+  timer.join();
+  return samples;
+}
+
+void report(const char* name, std::vector<uint64_t> samples) {
+  if (samples.empty()) {
+    std::cout << name << ": no samples" << std::endl;
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto percentile = [&](double p) {
+    return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))] / 1000.0;
+  };
+  std::cout << name << ": n = " << samples.size()
+    << ", p50 = " << percentile(0.50) << " us"
+    << ", p99 = " << percentile(0.99) << " us"
+    << ", max = " << samples.back() / 1000.0 << " us" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  std::string url = argc > 1 ? argv[1] : cluster_api_url(Cluster::Localnet);
+  int cpu = argc > 2 ? std::stoi(argv[2]) : -1;
+  int seconds = argc > 3 ? std::stoi(argv[3]) : 10;
+
+  report("select poll", measure(url, false, cpu, seconds));
+  report("spin", measure(url, true, cpu, seconds));
+
+  return 0;
+}
@@ -19,7 +19,7 @@ int main() {
   for (Account account : accounts) {
     std::cout << "owner = " << account.owner.to_base58() << std::endl;
     std::cout << "lamports = " << account.lamports << std::endl;
-    std::cout << "data = " << account.data[0] << std::endl;
+    std::cout << "data size = " << account.data.size() << std::endl;
     std::cout << "executable = " << (account.executable ? "true" : "false") << std::endl;
     std::cout << std::endl;
   }
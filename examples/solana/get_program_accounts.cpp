@@ -16,7 +16,7 @@ int main() {
   for (AccountInfo program_account : program_accounts) {
     std::cout << "owner = " << program_account.account.owner.to_base58() << std::endl;
     std::cout << "lamports = " << program_account.account.lamports << std::endl;
-    std::cout << "data = " << program_account.account.data[0] << std::endl;
+    std::cout << "data size = " << program_account.account.data.size() << std::endl;
     std::cout << "executable = " << (program_account.account.executable ? "true" : "false") << std::endl;
   }
 
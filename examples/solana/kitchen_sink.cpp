@@ -7,7 +7,7 @@
 
 using namespace solana;
 
-#define USDC_MINT PublicKey("EPjFWdd5AufqSSqeM2qN1xzybapC8G4wEGGkZwyTDt1v")
+constexpr PublicKey USDC_MINT = "EPjFWdd5AufqSSqeM2qN1xzybapC8G4wEGGkZwyTDt1v"_pk;
 
 bool json_includes_pubkey(const std::vector<json>& array, const PublicKey& pubkey) {
   for (auto& item : array) {
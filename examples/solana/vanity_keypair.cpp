@@ -1,15 +1,19 @@
 // clang++ vanity_keypair.cpp -o vanity_keypair -std=c++17 -I ../../src/ -lssl -lcrypto -lsodium
+//
+// ./vanity_keypair [prefix] [suffix] [-i]
 
 #include "solana.hpp"
 
 using namespace solana;
 
-int main() {
-  auto key_pair = Keypair::generate();
+int main(int argc, char** argv) {
+  std::string prefix = argc > 1 ? argv[1] : "A";
+  std::string suffix = argc > 2 ? argv[2] : "";
+  bool case_insensitive = argc > 3 && std::string(argv[3]) == "-i";
 
-  while (key_pair.public_key.to_base58().substr(0, 1) != "A") {
-    key_pair = Keypair::generate();
-  }
+  auto key_pair = vanity::search(prefix, suffix, case_insensitive, 0, [](const vanity::Progress& progress) {
+    std::cout << progress.attempts << " keypairs in " << progress.seconds << " s (" << (uint64_t)progress.rate << "/s)" << std::endl;
+  });
 
   std::cout << "Created Keypair with Public Key: " << key_pair.public_key.to_base58() << std::endl;
 }
@@ -444,7 +444,12 @@ namespace anchor {
     }
 
     json decode(std::string b64) const {
-      auto buffer = base64::decode(b64);
+      return decode(AccountData::from_base64(b64));
+    }
+
+    json decode(const AccountData& data) const {
+      // Decoded once by AccountData, and read in place
+      const uint8_t* buffer = data.data();
       json account = json::object();
       int offset = 0;
       // check discriminator
@@ -453,7 +458,7 @@ namespace anchor {
       // }
       offset += 8;
       for (auto field : accountDef.type.fields) {
-        account[field.name] = decode_field(field, buffer.data(), offset, buffer.size());
+        account[field.name] = decode_field(field, buffer, offset, data.size());
       }
       return account;
     }
@@ -467,7 +472,7 @@ namespace anchor {
     }
 
   private:
-    json decode_field(IdlField field, uint8_t* buffer, int& offset, int length) const {
+    json decode_field(IdlField field, const uint8_t* buffer, int& offset, int length) const {
       switch (field.type) {
         case IdlType::boolean: {
           bool value = buffer[0] == 1;
@@ -14,25 +14,55 @@
 #include <algorithm>
 #include <arpa/inet.h>
 #include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <errno.h>
 #include <fcntl.h>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <netdb.h>
+#include <optional>
 #include <openssl/err.h>
 #include <openssl/sha.h>
 #include <openssl/ssl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <set>
 #include <sodium.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <string_view>
 #include <string.h>
 #include <sys/socket.h>
+#include <thread>
+#include <type_traits>
+#include <typeinfo>
 #include <unistd.h>
+#include <variant>
 #include <vector>
 
+#ifdef MANY_PERMESSAGE_DEFLATE
+  #include <zlib.h>
+#endif
+
+#ifdef __linux__
+  #include <linux/net_tstamp.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+#endif
+
 namespace many {
 
 #define ASSERT(x)                                               \
@@ -237,7 +267,7 @@ namespace many {
       return binc[0];
     }
 
-    static const char b58digits_ordered[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+    static constexpr char b58digits_ordered[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
 
     bool b58enc(char *b58, size_t *b58sz, const void *data, size_t binsz) {
       const uint8_t *bin = (const uint8_t *)data;
@@ -319,18 +349,478 @@ namespace many {
         return std::string();
     }
 
+    /**
+     * Returns the value of a base58 digit, or -1 if c is not one.
+     */
+    constexpr int digit_value(char c) {
+      for (int i = 0; i < 58; i++) {
+        if (b58digits_ordered[i] == c) {
+          return i;
+        }
+      }
+      return -1;
+    }
+
+    /**
+     * Tables for the fixed-width codecs of N-byte values (32 for public keys and
+     * blockhashes, 64 for signatures). The value is handled as big-endian 32-bit limbs
+     * on one side and limbs of 58^5 on the other, so converting between the two is a
+     * fixed number of multiply-adds with precomputed powers instead of a byte-at-a-time
+     * big number loop.
+     */
+    template <size_t N>
+    struct FixedWidth {
+      static_assert(N == 32 || N == 64, "Fixed-width base58 supports 32 and 64 byte values");
+
+      /** 58^5, the radix of the intermediate limbs */
+      static constexpr uint64_t R = 656356768;
+      static constexpr size_t BINARY_SIZE = N / 4;
+      static constexpr size_t INTERMEDIATE_SIZE = N == 32 ? 9 : 18;
+      static constexpr size_t RAW_SIZE = INTERMEDIATE_SIZE * 5;
+      /** The longest canonical encoding */
+      static constexpr size_t MAX_ENCODED_SIZE = N == 32 ? 44 : 88;
+
+      /** encode[i][k] is limb k of 2^(32 * (BINARY_SIZE - 1 - i)) in base 58^5 */
+      std::array<std::array<uint32_t, INTERMEDIATE_SIZE>, BINARY_SIZE> encode{};
+      /** decode[k][j] is limb j of (58^5)^(INTERMEDIATE_SIZE - 1 - k) in base 2^32 */
+      std::array<std::array<uint32_t, BINARY_SIZE>, INTERMEDIATE_SIZE> decode{};
+
+      constexpr FixedWidth() {
+        std::array<uint64_t, INTERMEDIATE_SIZE> power{};
+        power[INTERMEDIATE_SIZE - 1] = 1;
+        for (size_t i = BINARY_SIZE; i-- > 0; ) {
+          for (size_t k = 0; k < INTERMEDIATE_SIZE; k++) {
+            encode[i][k] = (uint32_t)power[k];
+          }
+          uint64_t carry = 0;
+          for (size_t k = INTERMEDIATE_SIZE; k-- > 0; ) {
+            uint64_t value = (power[k] << 32) + carry;
+            power[k] = value % R;
+            carry = value / R;
+          }
+        }
+
+        std::array<uint64_t, BINARY_SIZE> radix{};
+        radix[BINARY_SIZE - 1] = 1;
+        for (size_t k = INTERMEDIATE_SIZE; k-- > 0; ) {
+          for (size_t j = 0; j < BINARY_SIZE; j++) {
+            decode[k][j] = (uint32_t)radix[j];
+          }
+          uint64_t carry = 0;
+          for (size_t j = BINARY_SIZE; j-- > 0; ) {
+            uint64_t value = radix[j] * R + carry;
+            radix[j] = value & 0xFFFFFFFF;
+            carry = value >> 32;
+          }
+        }
+      }
+    };
+
+    template <size_t N>
+    constexpr FixedWidth<N> fixed_width_tables = FixedWidth<N>();
+
+    /**
+     * Decodes the canonical base58 text of exactly N bytes in a constant expression.
+     * Invalid text throws, which makes it a compile error when the result is needed
+     * at compile time. Text is only canonical when it is not empty, is no longer than
+     * MAX_ENCODED_SIZE, and has one leading '1' for each leading zero byte, so every
+     * value has exactly one literal.
+     */
+    template <size_t N>
+    constexpr std::array<uint8_t, N> decode_constexpr(const char *b58, size_t size) {
+      if (size == 0 || size > FixedWidth<N>::MAX_ENCODED_SIZE) {
+        throw std::invalid_argument("Invalid base58 length");
+      }
+      std::array<uint8_t, N> result{};
+      for (size_t i = 0; i < size; i++) {
+        int digit = digit_value(b58[i]);
+        if (digit < 0) {
+          throw std::invalid_argument("Invalid base58 digit");
+        }
+        uint32_t carry = digit;
+        for (size_t j = N; j-- > 0; ) {
+          carry += result[j] * 58u;
+          result[j] = (uint8_t)carry;
+          carry >>= 8;
+        }
+        if (carry) {
+          throw std::invalid_argument("Base58 value too large");
+        }
+      }
+      size_t ones = 0;
+      while (ones < size && b58[ones] == '1') {
+        ones++;
+      }
+      size_t zeros = 0;
+      while (zeros < N && result[zeros] == 0) {
+        zeros++;
+      }
+      if (ones != zeros) {
+        throw std::invalid_argument("Base58 leading '1's do not match the leading zero bytes");
+      }
+      return result;
+    }
+
+    /**
+     * Encodes exactly N bytes, writing at most FixedWidth<N>::MAX_ENCODED_SIZE characters
+     * (no terminator) to output.
+     *
+     * @return The number of characters written
+     */
+    template <size_t N>
+    size_t encode_fixed(const uint8_t *data, char *output) {
+      using W = FixedWidth<N>;
+      const auto& tables = fixed_width_tables<N>;
+
+      uint64_t intermediate[W::INTERMEDIATE_SIZE] = {};
+      for (size_t i = 0; i < W::BINARY_SIZE; i++) {
+        uint64_t limb = ((uint64_t)data[4 * i] << 24) | ((uint64_t)data[4 * i + 1] << 16) | ((uint64_t)data[4 * i + 2] << 8) | data[4 * i + 3];
+        for (size_t k = 0; k < W::INTERMEDIATE_SIZE; k++) {
+          intermediate[k] += limb * tables.encode[i][k];
+        }
+        // Each product is below 2^62, so four can accumulate before carrying
+        if (i % 4 == 3) {
+          for (size_t k = W::INTERMEDIATE_SIZE - 1; k > 0; k--) {
+            intermediate[k - 1] += intermediate[k] / W::R;
+            intermediate[k] %= W::R;
+          }
+        }
+      }
+
+      uint8_t raw[W::RAW_SIZE];
+      for (size_t k = 0; k < W::INTERMEDIATE_SIZE; k++) {
+        uint32_t value = (uint32_t)intermediate[k];
+        for (size_t j = 5; j-- > 0; ) {
+          raw[5 * k + j] = value % 58;
+          value /= 58;
+        }
+      }
+
+      size_t leading_zeros = 0;
+      while (leading_zeros < N && data[leading_zeros] == 0) {
+        leading_zeros++;
+      }
+      size_t raw_zeros = 0;
+      while (raw_zeros < W::RAW_SIZE && raw[raw_zeros] == 0) {
+        raw_zeros++;
+      }
+      // Each leading zero byte is kept as a '1'
+      size_t skip = raw_zeros - leading_zeros;
+      for (size_t i = skip; i < W::RAW_SIZE; i++) {
+        output[i - skip] = b58digits_ordered[raw[i]];
+      }
+      return W::RAW_SIZE - skip;
+    }
+
+    /**
+     * Decodes base58 text into exactly N bytes. output is only written on success.
+     *
+     * @return False if the text has an invalid digit or does not fit in N bytes
+     */
+    template <size_t N>
+    bool decode_fixed(const char *b58, size_t size, uint8_t *output) {
+      using W = FixedWidth<N>;
+      const auto& tables = fixed_width_tables<N>;
+
+      // Extra leading '1's are zero digits and do not change the value
+      while (size > W::RAW_SIZE && *b58 == '1') {
+        b58++;
+        size--;
+      }
+      if (size > W::RAW_SIZE) {
+        return false;
+      }
+
+      uint8_t raw[W::RAW_SIZE] = {};
+      size_t padding = W::RAW_SIZE - size;
+      for (size_t i = 0; i < size; i++) {
+        unsigned char c = b58[i];
+        if (c & 0x80 || b58digits_map[c] == -1) {
+          return false;
+        }
+        raw[padding + i] = b58digits_map[c];
+      }
+
+      uint64_t binary[W::BINARY_SIZE] = {};
+      for (size_t k = 0; k < W::INTERMEDIATE_SIZE; k++) {
+        const uint8_t *digits = raw + 5 * k;
+        uint64_t limb = (((digits[0] * 58ull + digits[1]) * 58 + digits[2]) * 58 + digits[3]) * 58 + digits[4];
+        for (size_t j = 0; j < W::BINARY_SIZE; j++) {
+          binary[j] += limb * tables.decode[k][j];
+        }
+        if (k % 4 == 3 || k == W::INTERMEDIATE_SIZE - 1) {
+          for (size_t j = W::BINARY_SIZE - 1; j > 0; j--) {
+            binary[j - 1] += binary[j] >> 32;
+            binary[j] &= 0xFFFFFFFF;
+          }
+        }
+      }
+      if (binary[0] > 0xFFFFFFFF) {
+        return false;
+      }
+
+      for (size_t j = 0; j < W::BINARY_SIZE; j++) {
+        output[4 * j] = (uint8_t)(binary[j] >> 24);
+        output[4 * j + 1] = (uint8_t)(binary[j] >> 16);
+        output[4 * j + 2] = (uint8_t)(binary[j] >> 8);
+        output[4 * j + 3] = (uint8_t)binary[j];
+      }
+      return true;
+    }
+
+    inline size_t encode_32(const uint8_t *data, char *output) {
+      return encode_fixed<32>(data, output);
+    }
+
+    inline size_t encode_64(const uint8_t *data, char *output) {
+      return encode_fixed<64>(data, output);
+    }
+
+    inline bool decode_32(const char *b58, size_t size, uint8_t *output) {
+      return decode_fixed<32>(b58, size, output);
+    }
+
+    inline bool decode_64(const char *b58, size_t size, uint8_t *output) {
+      return decode_fixed<64>(b58, size, output);
+    }
+
+    /**
+     * Encodes count packed N-byte values, such as the signature section of a
+     * transaction, into output[0..count).
+     */
+    template <size_t N>
+    void encode_batch(const uint8_t *data, size_t count, std::string *output) {
+      char buffer[FixedWidth<N>::MAX_ENCODED_SIZE + 1];
+      for (size_t i = 0; i < count; i++) {
+        size_t size = encode_fixed<N>(data + i * N, buffer);
+        output[i].assign(buffer, size);
+      }
+    }
+
+    /**
+     * Decodes count strings into packed N-byte values.
+     *
+     * @return The number of leading strings decoded; decoding stops at the first invalid one
+     */
+    template <size_t N>
+    size_t decode_batch(const std::string *b58, size_t count, uint8_t *output) {
+      for (size_t i = 0; i < count; i++) {
+        if (!decode_fixed<N>(b58[i].data(), b58[i].size(), output + i * N)) {
+          return i;
+        }
+      }
+      return count;
+    }
+
   } // namespace base58
 
   namespace base64 {
 
     const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
+    /**
+     * The codec kernels. The fastest one the CPU supports is picked at startup; see kernel().
+     */
+    enum class Kernel {
+      Scalar,
+      SSE41,
+      AVX2,
+    };
+
+    bool kernel_supported(Kernel kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+      switch (kernel) {
+        case Kernel::AVX2: return __builtin_cpu_supports("avx2");
+        case Kernel::SSE41: return __builtin_cpu_supports("sse4.1");
+        default: return true;
+      }
+#else
+      return kernel == Kernel::Scalar;
+#endif
+    }
+
+    /**
+     * The kernel used by encode() and decode(). Assign a supported kernel to override it.
+     */
+    Kernel& kernel() {
+      static Kernel kernel = kernel_supported(Kernel::AVX2) ? Kernel::AVX2 : kernel_supported(Kernel::SSE41) ? Kernel::SSE41 : Kernel::Scalar;
+      return kernel;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    // The vector kernels follow Wojciech Muła and Daniel Lemire, "Faster Base64 Encoding
+    // and Decoding Using AVX2 Instructions", and Alfred Klomp's base64 library. Each one
+    // handles whole blocks and returns where it stopped; the scalar loops do the rest.
+
+    /** Splits each 3 bytes of a 12-byte group into four 6-bit indices, one per byte */
+    __attribute__((target("sse4.1")))
+    inline __m128i encode_reshuffle(__m128i in) {
+      in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+      const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+      const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+      const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+      const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+      return _mm_or_si128(t1, t3);
+    }
+
+    /** Maps 6-bit indices to base64 characters */
+    __attribute__((target("sse4.1")))
+    inline __m128i encode_translate(__m128i indices) {
+      __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+      const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+      result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+      const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+      return _mm_add_epi8(_mm_shuffle_epi8(shift, result), indices);
+    }
+
+    __attribute__((target("sse4.1")))
+    size_t encode_sse41(const unsigned char *data, size_t input_length, char *output, size_t output_size, size_t& j) {
+      size_t i = 0;
+      // Each load reads 16 bytes and consumes 12
+      while (i + 16 <= input_length && j + 16 <= output_size) {
+        __m128i in = _mm_loadu_si128((const __m128i*)(data + i));
+        _mm_storeu_si128((__m128i*)(output + j), encode_translate(encode_reshuffle(in)));
+        i += 12;
+        j += 16;
+      }
+      return i;
+    }
+
+    __attribute__((target("avx2")))
+    size_t encode_avx2(const unsigned char *data, size_t input_length, char *output, size_t output_size, size_t& j) {
+      const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+      const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+      size_t i = 0;
+      // Each lane takes 12 bytes; the high lane's load ends 4 bytes past the 24 consumed
+      while (i + 28 <= input_length && j + 32 <= output_size) {
+        __m256i in = _mm256_inserti128_si256(
+          _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(data + i))),
+          _mm_loadu_si128((const __m128i*)(data + i + 12)), 1);
+        in = _mm256_shuffle_epi8(in, shuffle);
+        const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        const __m256i indices = _mm256_or_si256(t1, t3);
+        __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        result = _mm256_add_epi8(_mm256_shuffle_epi8(shift, result), indices);
+        _mm256_storeu_si256((__m256i*)(output + j), result);
+        i += 24;
+        j += 32;
+      }
+      return i;
+    }
+
+    /**
+     * Translates 16 base64 characters to 6-bit values and packs them into 12 bytes at
+     * the start of the register. Returns false if any character is not in the alphabet,
+     * including padding.
+     */
+    __attribute__((target("sse4.1")))
+    inline bool decode_block(__m128i& str) {
+      const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+      const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+      const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+      const __m128i mask_2f = _mm_set1_epi8(0x2f);
+
+      const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+      const __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+      const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+      const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+      if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0) {
+        return false;
+      }
+      const __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+      str = _mm_add_epi8(str, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles)));
+
+      const __m128i merged = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+      const __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+      str = _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+      return true;
+    }
+
+    __attribute__((target("sse4.1")))
+    size_t decode_sse41(const char *data, size_t input_length, char *output, size_t output_length, size_t& j) {
+      size_t i = 0;
+      // Each store writes 16 bytes, of which 12 are output
+      while (i + 16 <= input_length && j + 16 <= output_length) {
+        __m128i str = _mm_loadu_si128((const __m128i*)(data + i));
+        if (!decode_block(str)) {
+          break;
+        }
+        _mm_storeu_si128((__m128i*)(output + j), str);
+        i += 16;
+        j += 12;
+      }
+      return i;
+    }
+
+    __attribute__((target("avx2")))
+    size_t decode_avx2(const char *data, size_t input_length, char *output, size_t output_length, size_t& j) {
+      const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+      const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+      const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+      const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+      const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+      size_t i = 0;
+      // Each store writes 32 bytes, of which 24 are output
+      while (i + 32 <= input_length && j + 32 <= output_length) {
+        __m256i str = _mm256_loadu_si256((const __m256i*)(data + i));
+        const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+        const __m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+        const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        if (!_mm256_testz_si256(lo, hi)) {
+          break;
+        }
+        const __m256i eq_2f = _mm256_cmpeq_epi8(str, mask_2f);
+        str = _mm256_add_epi8(str, _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles)));
+
+        const __m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+        const __m256i packed = _mm256_shuffle_epi8(_mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000)), pack);
+        _mm256_storeu_si256((__m256i*)(output + j), _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7)));
+        i += 32;
+        j += 24;
+      }
+      return i;
+    }
+#endif
+
     size_t encode(const unsigned char *data, size_t input_length, char *output, size_t output_size) {
       if (output_size < 4 * ((input_length + 2) / 3)) {
         throw std::runtime_error("Output buffer too small");
       }
 
-      for (size_t i = 0, j = 0; i < input_length;) {
+      size_t i = 0, j = 0;
+#if defined(__x86_64__) || defined(__i386__)
+      switch (kernel()) {
+        case Kernel::AVX2: i = encode_avx2(data, input_length, output, output_size, j);
+          // The 16-byte kernel takes the groups too short for a 32-byte store
+          // fall through
+        case Kernel::SSE41: i += encode_sse41(data + i, input_length - i, output, output_size, j); break;
+        default: break;
+      }
+#endif
+
+      while (i < input_length) {
         uint32_t octet_a = i < input_length ? (unsigned char)data[i++] : 0;
         uint32_t octet_b = i < input_length ? (unsigned char)data[i++] : 0;
         uint32_t octet_c = i < input_length ? (unsigned char)data[i++] : 0;
@@ -350,27 +840,17 @@ namespace many {
     }
 
     std::string encode(const unsigned char *data, size_t input_length) {
-      int output_length = 4 * ((input_length + 2) / 3);
-      char output[output_length + 1];
-      output[output_length] = '\0';
-      encode((unsigned char *)data, input_length, output, output_length);
+      std::string output(4 * ((input_length + 2) / 3), '\0');
+      encode(data, input_length, output.data(), output.size());
       return output;
     }
 
     std::string encode(const std::string& input) {
-      int output_length = 4 * ((input.size() + 2) / 3);
-      char output[output_length + 1];
-      output[output_length] = '\0';
-      encode((unsigned char *)input.data(), input.size(), output, output_length);
-      return output;
+      return encode((const unsigned char *)input.data(), input.size());
     }
 
     std::string encode(const std::vector<uint8_t>& input) {
-      int output_length = 4 * ((input.size() + 2) / 3);
-      char output[output_length + 1];
-      output[output_length] = '\0';
-      encode((unsigned char *)input.data(), input.size(), output, output_length);
-      return output;
+      return encode(input.data(), input.size());
     }
 
     const int base64_decode_chars[] = {
@@ -388,11 +868,16 @@ namespace many {
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
     };
 
     size_t decode(const char *data, size_t input_length, char *output, size_t output_size) {
-      size_t i, j;
+      if (input_length < 2) {
+        return 0;
+      }
+
+      size_t i = 0, j = 0;
       size_t output_length = input_length / 4 * 3;
 
       if (data[input_length - 1] == '=') output_length--;
@@ -402,11 +887,20 @@ namespace many {
         throw std::runtime_error("Output buffer too small");
       }
 
-      for (i = 0, j = 0; i < input_length; ) {
-        unsigned int a = data[i] == '=' ? 0 & i++ : base64_decode_chars[(int)data[i++]];
-        unsigned int b = data[i] == '=' ? 0 & i++ : base64_decode_chars[(int)data[i++]];
-        unsigned int c = data[i] == '=' ? 0 & i++ : base64_decode_chars[(int)data[i++]];
-        unsigned int d = data[i] == '=' ? 0 & i++ : base64_decode_chars[(int)data[i++]];
+#if defined(__x86_64__) || defined(__i386__)
+      switch (kernel()) {
+        case Kernel::AVX2: i = decode_avx2(data, input_length, output, output_length, j);
+          // fall through
+        case Kernel::SSE41: i += decode_sse41(data + i, input_length - i, output, output_length, j); break;
+        default: break;
+      }
+#endif
+
+      while (i < input_length) {
+        unsigned int a = data[i] == '=' ? 0 & i++ : base64_decode_chars[(uint8_t)data[i++]];
+        unsigned int b = data[i] == '=' ? 0 & i++ : base64_decode_chars[(uint8_t)data[i++]];
+        unsigned int c = data[i] == '=' ? 0 & i++ : base64_decode_chars[(uint8_t)data[i++]];
+        unsigned int d = data[i] == '=' ? 0 & i++ : base64_decode_chars[(uint8_t)data[i++]];
 
         unsigned int triple = (a << 3 * 6) + (b << 2 * 6) + (c << 1 * 6) + (d << 0 * 6);
 
@@ -426,92 +920,1183 @@ namespace many {
       buffer.resize(output_length);
       return buffer;
     }
-  } // namespace base64
-
-  struct Context {
-    uint64_t slot;
-  };
 
-  void from_json(const json& j, Context& context) {
-    context.slot = j["slot"].get<uint64_t>();
-  }
+    /**
+     * Returns the number of bytes that the base64 text decodes to.
+     */
+    size_t decoded_length(const char *data, size_t input_length) {
+      if (input_length < 4) {
+        return 0;
+      }
+      size_t output_length = input_length / 4 * 3;
+      if (data[input_length - 1] == '=') output_length--;
+      if (data[input_length - 2] == '=') output_length--;
+      return output_length;
+    }
 
-  namespace endian {
+    /**
+     * Returns true if the text is whole quads of base64 characters, with '=' only as
+     * padding in the last one or two places.
+     */
+    bool is_valid(const char *data, size_t input_length) {
+      if (input_length % 4 != 0) {
+        return false;
+      }
+      size_t padding = 0;
+      if (input_length > 0 && data[input_length - 1] == '=') {
+        padding = data[input_length - 2] == '=' ? 2 : 1;
+      }
+      for (size_t i = 0; i < input_length - padding; i++) {
+        if (base64_decode_chars[(uint8_t)data[i]] < 0) {
+          return false;
+        }
+      }
+      return true;
+    }
 
     /**
-     * Convert a 16-bit integer from host byte order to big-endian byte order
+     * Decodes length bytes starting at byte offset of the base64 text, touching only
+     * the quads that hold them.
      *
-     * @param x 16-bit integer in host byte order
+     * @return The number of bytes decoded, which is less than length past the end of the data
      */
-    inline uint64_t be64toh(uint64_t x) {
-      #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-        return __builtin_bswap64(x);
-      #else
-        return x;
-      #endif
+    size_t decode_range(const char *data, size_t input_length, size_t offset, uint8_t *output, size_t length) {
+      size_t output_length = decoded_length(data, input_length);
+      if (offset >= output_length) {
+        return 0;
+      }
+      length = std::min(length, output_length - offset);
+
+      size_t written = 0;
+      for (size_t quad = offset / 3; written < length; quad++) {
+        char bytes[3];
+        decode(data + quad * 4, 4, bytes, 3);
+        for (size_t k = quad == offset / 3 ? offset % 3 : 0; k < 3 && written < length; k++) {
+          output[written++] = bytes[k];
+        }
+      }
+      return written;
     }
 
-  } // namespace endian
-
-  namespace http {
+    /**
+     * Encodes input that arrives in chunks, carrying the bytes that do not fill a
+     * whole 3-byte group over to the next chunk.
+     */
+    class StreamEncoder {
+    public:
+      /** Appends the text for every whole group of data seen so far */
+      void update(const uint8_t *data, size_t length, std::string& output) {
+        while (_pending_size > 0 && _pending_size < 3 && length > 0) {
+          _pending[_pending_size++] = *data++;
+          length--;
+        }
+        if (_pending_size == 3) {
+          append(_pending, 3, output);
+          _pending_size = 0;
+        }
+        size_t whole = length / 3 * 3;
+        append(data, whole, output);
+        for (size_t i = whole; i < length; i++) {
+          _pending[_pending_size++] = data[i];
+        }
+      }
 
-    class HttpClient {
-      const std::string _interface;
-      const std::string _url;
-      std::string _host;
-      std::string _resource; //TODO this is a bit of a hack.
+      /** Appends the padded text for the last partial group */
+      void finish(std::string& output) {
+        append(_pending, _pending_size, output);
+        _pending_size = 0;
+      }
 
-      int _socket;
-      bool _use_ssl = false;
-      SSL_CTX *_ssl_ctx;
-      SSL *_ssl;
+    private:
+      uint8_t _pending[3];
+      size_t _pending_size = 0;
 
-      char* _send_buffer = nullptr;
-      char* _recv_buffer = nullptr;
+      static void append(const uint8_t *data, size_t length, std::string& output) {
+        if (length == 0) {
+          return;
+        }
+        size_t offset = output.size();
+        output.resize(offset + 4 * ((length + 2) / 3));
+        encode(data, length, output.data() + offset, output.size() - offset);
+      }
+    };
 
-      bool write(const char *data, size_t length) {
-        if (_use_ssl) {
-          int ret = SSL_write(_ssl, data, (int)length);
-          if (ret <= 0) {
-            std::cerr << "Error: SSL_write() failed" << std::endl;
-            disconnect();
-            return false;
-          }
-        } else {
-          int ret = ::write(_socket, data, (int)length);
-          if (ret <= 0) {
-            std::cerr << "Error: write() failed" << std::endl;
-            disconnect();
-            return false;
-          }
+    /**
+     * Decodes base64 text that arrives in chunks, such as a large account data field
+     * read off the socket, carrying the characters that do not fill a whole quad over
+     * to the next chunk.
+     */
+    class StreamDecoder {
+    public:
+      /** Appends the bytes for every whole quad of text seen so far */
+      void update(const char *data, size_t length, std::vector<uint8_t>& output) {
+        while (_pending_size > 0 && _pending_size < 4 && length > 0) {
+          _pending[_pending_size++] = *data++;
+          length--;
+        }
+        if (_pending_size == 4) {
+          append(_pending, 4, output);
+          _pending_size = 0;
+        }
+        size_t whole = length / 4 * 4;
+        append(data, whole, output);
+        for (size_t i = whole; i < length; i++) {
+          _pending[_pending_size++] = data[i];
         }
-        return true;
       }
 
-      bool can_read() {
-        fd_set readfds;
-        FD_ZERO(&readfds);
-        FD_SET(_socket, &readfds);
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 0;
-        int ret = select(_socket + 1, &readfds, NULL, NULL, &timeout);
-        if (ret == -1) {
-          std::cerr << "Error: select() failed" << std::endl;
-          disconnect();
-          return false;
+      /** Returns false if the text ended inside a quad */
+      bool finish() {
+        bool complete = _pending_size == 0;
+        _pending_size = 0;
+        return complete;
+      }
+
+    private:
+      char _pending[4];
+      size_t _pending_size = 0;
+
+      static void append(const char *data, size_t length, std::vector<uint8_t>& output) {
+        if (length == 0) {
+          return;
         }
-        return ret > 0;
+        size_t offset = output.size();
+        output.resize(offset + length / 4 * 3);
+        size_t decoded = decode(data, length, (char *)output.data() + offset, output.size() - offset);
+        output.resize(offset + decoded);
       }
+    };
+  } // namespace base64
 
-      int read(char *data, int length) {
-        if (_use_ssl) {
-          int ret = SSL_read(_ssl, data, length);
-          if (ret <= 0) {
-            std::cerr << "Error: SSL_read() failed" << std::endl;
-            disconnect();
-            return 0;
-          }
+  namespace sha256 {
+
+    constexpr size_t BLOCK_SIZE = 64;
+    constexpr size_t DIGEST_SIZE = 32;
+
+    static const uint32_t K[64] = {
+      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+      0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+      0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+      0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+      0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+      0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+    /**
+     * The compression kernels. The fastest one the CPU supports is picked at startup; see kernel().
+     */
+    enum class Kernel {
+      Scalar,
+      SHANI,
+    };
+
+    bool kernel_supported(Kernel kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+      switch (kernel) {
+        case Kernel::SHANI: return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+        default: return true;
+      }
+#else
+      return kernel == Kernel::Scalar;
+#endif
+    }
+
+    /**
+     * The kernel used by the hash functions. Assign a supported kernel to override it.
+     */
+    Kernel& kernel() {
+      static Kernel kernel = kernel_supported(Kernel::SHANI) ? Kernel::SHANI : Kernel::Scalar;
+      return kernel;
+    }
+
+    inline uint32_t rotr(uint32_t x, int n) {
+      return (x >> n) | (x << (32 - n));
+    }
+
+    void compress_scalar(uint32_t state[8], const uint8_t *data, size_t blocks) {
+      uint32_t w[64];
+      for (; blocks > 0; blocks--, data += BLOCK_SIZE) {
+        for (int i = 0; i < 16; i++) {
+          w[i] = (uint32_t)data[4 * i] << 24 | (uint32_t)data[4 * i + 1] << 16 | (uint32_t)data[4 * i + 2] << 8 | data[4 * i + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+          uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+          uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+          w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+          uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+          uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+          h = g;
+          g = f;
+          f = e;
+          e = d + t1;
+          d = c;
+          c = b;
+          b = a;
+          a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+      }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    // Follows Intel's "SHA extensions" reference flow as in Jeffrey Walton's public domain
+    // SHA-Intrinsics: the state is kept as ABEF/CDGH, each sha256rnds2 does two rounds, and
+    // sha256msg1/msg2 extend the message schedule four words at a time.
+    __attribute__((target("sha,sse4.1")))
+    void compress_shani(uint32_t state[8], const uint8_t *data, size_t blocks) {
+      const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+      __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+      __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+      __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+      state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+      for (; blocks > 0; blocks--, data += BLOCK_SIZE) {
+        const __m128i abef = state0;
+        const __m128i cdgh = state1;
+        __m128i w[4];
+
+        for (int g = 0; g < 16; g++) {
+          if (g < 4) {
+            w[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * g)), mask);
+          }
+          __m128i msg = _mm_add_epi32(w[g % 4], _mm_loadu_si128((const __m128i*)&K[4 * g]));
+          state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+          if (g >= 3 && g <= 14) {
+            tmp = _mm_alignr_epi8(w[g % 4], w[(g + 3) % 4], 4);
+            w[(g + 1) % 4] = _mm_sha256msg2_epu32(_mm_add_epi32(w[(g + 1) % 4], tmp), w[g % 4]);
+          }
+          msg = _mm_shuffle_epi32(msg, 0x0E);
+          state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+          if (g >= 1 && g <= 12) {
+            w[(g + 3) % 4] = _mm_sha256msg1_epu32(w[(g + 3) % 4], w[g % 4]);
+          }
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+      }
+
+      tmp = _mm_shuffle_epi32(state0, 0x1B);
+      state1 = _mm_shuffle_epi32(state1, 0xB1);
+      state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+      state1 = _mm_alignr_epi8(state1, tmp, 8);
+      _mm_storeu_si128((__m128i*)&state[0], state0);
+      _mm_storeu_si128((__m128i*)&state[4], state1);
+    }
+#endif
+
+    void compress(uint32_t state[8], const uint8_t *data, size_t blocks) {
+#if defined(__x86_64__) || defined(__i386__)
+      if (kernel() == Kernel::SHANI) {
+        compress_shani(state, data, blocks);
+        return;
+      }
+#endif
+      compress_scalar(state, data, blocks);
+    }
+
+    /**
+     * An incremental SHA-256. The state is a plain value: copy it after hashing a common
+     * prefix to hash several messages that share it without hashing the prefix again.
+     */
+    struct State {
+      uint32_t h[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+      uint64_t length = 0;
+      uint8_t buffer[BLOCK_SIZE];
+
+      void update(const void *data, size_t size) {
+        const uint8_t *input = (const uint8_t *)data;
+        size_t buffered = length % BLOCK_SIZE;
+        length += size;
+        if (buffered > 0) {
+          size_t take = std::min(size, BLOCK_SIZE - buffered);
+          memcpy(buffer + buffered, input, take);
+          input += take;
+          size -= take;
+          if (buffered + take < BLOCK_SIZE) {
+            return;
+          }
+          compress(h, buffer, 1);
+        }
+        if (size >= BLOCK_SIZE) {
+          compress(h, input, size / BLOCK_SIZE);
+          input += size / BLOCK_SIZE * BLOCK_SIZE;
+          size %= BLOCK_SIZE;
+        }
+        memcpy(buffer, input, size);
+      }
+
+      /**
+       * Writes the 32-byte digest. The state is spent afterwards.
+       */
+      void finish(uint8_t *digest) {
+        size_t buffered = length % BLOCK_SIZE;
+        uint64_t bits = length * 8;
+        buffer[buffered++] = 0x80;
+        if (buffered > BLOCK_SIZE - 8) {
+          memset(buffer + buffered, 0, BLOCK_SIZE - buffered);
+          compress(h, buffer, 1);
+          buffered = 0;
+        }
+        memset(buffer + buffered, 0, BLOCK_SIZE - 8 - buffered);
+        for (int i = 0; i < 8; i++) {
+          buffer[BLOCK_SIZE - 1 - i] = (uint8_t)(bits >> (8 * i));
+        }
+        compress(h, buffer, 1);
+        for (int i = 0; i < 8; i++) {
+          digest[4 * i] = (uint8_t)(h[i] >> 24);
+          digest[4 * i + 1] = (uint8_t)(h[i] >> 16);
+          digest[4 * i + 2] = (uint8_t)(h[i] >> 8);
+          digest[4 * i + 3] = (uint8_t)h[i];
+        }
+      }
+    };
+
+    inline void hash(const void *data, size_t size, uint8_t *digest) {
+      State state;
+      state.update(data, size);
+      state.finish(digest);
+    }
+  } // namespace sha256
+
+  /**
+   * A monotonic arena for the short-lived allocations of parsing one message.
+   *
+   * Allocation bumps a pointer through a list of chunks and deallocation is a no-op;
+   * reset() rewinds to the first chunk, keeping every chunk for the next cycle, so a
+   * steady stream of messages stops touching the global heap once the chunks have grown
+   * to fit the largest message.
+   *
+   * Only allocations made through ArenaAllocator come from the arena, which covers the
+   * strings of the sax lexer and arena_json values. A value decoded by sax::DomDecoder,
+   * and the params given to a websocket callback, are still heap json DOMs because
+   * from_json and those callbacks take nlohmann::json. Only types with a streaming
+   * decoder parse without the heap.
+   */
+  class Arena {
+    struct Chunk {
+      char* data;
+      size_t size;
+    };
+
+    std::vector<Chunk> _chunks;
+    size_t _chunk_size;
+    /** The chunk being allocated from */
+    size_t _current = 0;
+    size_t _offset = 0;
+    size_t _served = 0;
+
+  public:
+
+    struct Stats {
+      /** The number of reset cycles */
+      uint64_t cycles = 0;
+      /** The bytes served in the last completed cycle */
+      size_t last_cycle_bytes = 0;
+      /** The most bytes served in one cycle */
+      size_t peak_cycle_bytes = 0;
+      /** The bytes held in chunks */
+      size_t reserved_bytes = 0;
+    };
+
+  private:
+    Stats _stats;
+
+  public:
+    explicit Arena(size_t chunk_size = 65536) : _chunk_size(chunk_size) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+      for (auto& chunk : _chunks) {
+        free(chunk.data);
+      }
+    }
+
+    void* allocate(size_t size, size_t alignment) {
+      while (_current < _chunks.size()) {
+        Chunk& chunk = _chunks[_current];
+        size_t offset = (_offset + alignment - 1) & ~(alignment - 1);
+        if (offset + size <= chunk.size) {
+          _offset = offset + size;
+          _served += size;
+          return chunk.data + offset;
+        }
+        _current++;
+        _offset = 0;
+      }
+      size_t chunk_size = std::max(_chunk_size, size + alignment);
+      _chunks.push_back({ (char*)malloc(chunk_size), chunk_size });
+      _stats.reserved_bytes += chunk_size;
+      _current = _chunks.size() - 1;
+      _offset = 0;
+      return allocate(size, alignment);
+    }
+
+    /** Whether p points into one of the arena's chunks */
+    bool owns(const void* p) const {
+      for (auto& chunk : _chunks) {
+        if (p >= chunk.data && p < chunk.data + chunk.size) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * Releases everything allocated since the last reset, and ends the cycle.
+     */
+    void reset() {
+      _stats.cycles++;
+      _stats.last_cycle_bytes = _served;
+      _stats.peak_cycle_bytes = std::max(_stats.peak_cycle_bytes, _served);
+      _served = 0;
+      _current = 0;
+      _offset = 0;
+    }
+
+    /** The bytes served since the last reset */
+    size_t bytes_served() const {
+      return _served;
+    }
+
+    const Stats& stats() const {
+      return _stats;
+    }
+
+    /** The arena ArenaAllocator serves from on this thread, or nullptr for the heap */
+    static Arena*& current() {
+      static thread_local Arena* arena = nullptr;
+      return arena;
+    }
+
+    /**
+     * Makes an arena current on this thread for the lifetime of the scope, then
+     * resets it. Every value allocated from the arena must be destroyed inside the scope.
+     */
+    class Scope {
+      Arena& _arena;
+      Arena* _previous;
+
+    public:
+      Scope(Arena& arena) : _arena(arena), _previous(current()) {
+        current() = &arena;
+      }
+
+      ~Scope() {
+        current() = _previous;
+        _arena.reset();
+      }
+    };
+  };
+
+  /**
+   * A stateless allocator that serves from the current arena (see Arena::Scope), or
+   * from the heap when no arena is current.
+   */
+  template <typename T>
+  struct ArenaAllocator {
+    using value_type = T;
+
+    ArenaAllocator() = default;
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+      Arena* arena = Arena::current();
+      if (arena) {
+        return (T*)arena->allocate(n * sizeof(T), alignof(T));
+      }
+      return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) {
+      Arena* arena = Arena::current();
+      if (arena && arena->owns(p)) {
+        return;
+      }
+      std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>&) const {
+      return true;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>&) const {
+      return false;
+    }
+  };
+
+  /**
+   * On-demand typed decoding.
+   *
+   * Decodes a JSON document straight into typed structs with the nlohmann SAX
+   * interface, without materializing a DOM. A type gets a streaming decoder by
+   * declaring a `sax_decoder(T*)` overload, found by argument-dependent lookup,
+   * whose return type is the decoder class. The declaration is only used for its
+   * type and needs no definition. Types without one fall back to DomDecoder, which
+   * builds a DOM of just that value and calls its from_json.
+   *
+   * The lexer's strings are allocated from the current arena, if any (see Arena::Scope),
+   * and string values reach decoders as views of them.
+   */
+  namespace sax {
+
+    using arena_string = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+    /** The json type the lexer runs with; only its arena-backed string type is used */
+    using arena_json = nlohmann::basic_json<std::map, std::vector, arena_string, bool, std::int64_t, std::uint64_t, double, ArenaAllocator>;
+
+    /**
+     * The kind of value a decoder is about to receive.
+     */
+    enum class Kind {
+      Null,
+      Scalar,
+      Object,
+      Array,
+    };
+
+    /**
+     * Receives the SAX events of one JSON value.
+     *
+     * Scalar events are delivered to the decoder of the value itself. Inside an
+     * object, key() returns the decoder of the member that follows, and inside an
+     * array element() returns the decoder of the next element; nullptr skips the
+     * value. Returning false from an event aborts the parse.
+     */
+    class Decoder {
+    public:
+      virtual ~Decoder() = default;
+
+      /**
+       * Returns the decoder that receives a value of the given kind, or nullptr to skip it.
+       */
+      virtual Decoder* resolve(Kind) {
+        return this;
+      }
+
+      virtual bool null() { return false; }
+      virtual bool boolean(bool) { return false; }
+      virtual bool number_integer(int64_t) { return false; }
+      virtual bool number_unsigned(uint64_t) { return false; }
+      virtual bool number_float(double) { return false; }
+      virtual bool string(std::string_view) { return false; }
+      virtual bool start_object() { return false; }
+      virtual Decoder* key(std::string_view) { return nullptr; }
+      virtual bool end_object() { return true; }
+      virtual bool start_array() { return false; }
+      virtual Decoder* element() { return nullptr; }
+      virtual bool end_array() { return true; }
+    };
+
+    /**
+     * Base class for decoders of JSON objects into a struct. Subclasses map each key to
+     * the decoder of the field it fills.
+     */
+    template <typename T>
+    class ObjectDecoder : public Decoder {
+    protected:
+      T* _target = nullptr;
+
+    public:
+      Decoder* bind(T& target) {
+        _target = &target;
+        return this;
+      }
+
+      bool start_object() override {
+        return true;
+      }
+    };
+
+    /**
+     * Decodes a JSON boolean, number or string into a bool, arithmetic type or std::string.
+     */
+    template <typename T>
+    class ValueDecoder : public Decoder {
+      T* _target = nullptr;
+
+      template <typename V>
+      bool assign(V&& value) {
+        using U = std::decay_t<V>;
+        if constexpr (std::is_same_v<T, std::string>) {
+          if constexpr (std::is_same_v<U, std::string_view>) {
+            _target->assign(value);
+            return true;
+          }
+        } else if constexpr (std::is_same_v<T, bool>) {
+          if constexpr (std::is_same_v<U, bool>) {
+            *_target = value;
+            return true;
+          }
+        } else if constexpr (std::is_arithmetic_v<T> && std::is_arithmetic_v<U>) {
+          *_target = static_cast<T>(value);
+          return true;
+        }
+        return false;
+      }
+
+    public:
+      Decoder* bind(T& target) {
+        _target = &target;
+        return this;
+      }
+
+      bool boolean(bool value) override { return assign(value); }
+      bool number_integer(int64_t value) override { return assign(value); }
+      bool number_unsigned(uint64_t value) override { return assign(value); }
+      bool number_float(double value) override { return assign(value); }
+      bool string(std::string_view value) override { return assign(value); }
+    };
+
+    /**
+     * Fallback decoder: builds a DOM of just this value and converts it with from_json.
+     */
+    template <typename T>
+    class DomDecoder : public Decoder {
+      T* _target = nullptr;
+      json _value;
+      std::vector<json*> _stack;
+      std::string _key;
+
+      json* add(json value) {
+        if (_stack.empty()) {
+          _value = std::move(value);
+          return &_value;
+        }
+        json* parent = _stack.back();
+        if (parent->is_object()) {
+          return &((*parent)[_key] = std::move(value));
+        }
+        parent->push_back(std::move(value));
+        return &parent->back();
+      }
+
+      void finish() {
+        if constexpr (std::is_same_v<T, json>) {
+          *_target = std::move(_value);
+        } else {
+          _value.get_to(*_target);
+        }
+      }
+
+      bool scalar(json value) {
+        add(std::move(value));
+        if (_stack.empty()) {
+          finish();
+        }
+        return true;
+      }
+
+      bool end() {
+        _stack.pop_back();
+        if (_stack.empty()) {
+          finish();
+        }
+        return true;
+      }
+
+    public:
+      Decoder* bind(T& target) {
+        _target = &target;
+        _stack.clear();
+        return this;
+      }
+
+      bool null() override { return scalar(nullptr); }
+      bool boolean(bool value) override { return scalar(value); }
+      bool number_integer(int64_t value) override { return scalar(value); }
+      bool number_unsigned(uint64_t value) override { return scalar(value); }
+      bool number_float(double value) override { return scalar(value); }
+      bool string(std::string_view value) override { return scalar(std::string(value)); }
+
+      bool start_object() override {
+        _stack.push_back(add(json::object()));
+        return true;
+      }
+
+      Decoder* key(std::string_view key) override {
+        _key = key;
+        return this;
+      }
+
+      bool end_object() override {
+        return end();
+      }
+
+      bool start_array() override {
+        _stack.push_back(add(json::array()));
+        return true;
+      }
+
+      Decoder* element() override {
+        return this;
+      }
+
+      bool end_array() override {
+        return end();
+      }
+    };
+
+    template <typename T> class OptionalDecoder;
+    template <typename T> class VectorDecoder;
+
+    ValueDecoder<bool> sax_decoder(bool*);
+    ValueDecoder<uint8_t> sax_decoder(uint8_t*);
+    ValueDecoder<uint16_t> sax_decoder(uint16_t*);
+    ValueDecoder<uint32_t> sax_decoder(uint32_t*);
+    ValueDecoder<uint64_t> sax_decoder(uint64_t*);
+    ValueDecoder<int64_t> sax_decoder(int64_t*);
+    ValueDecoder<double> sax_decoder(double*);
+    ValueDecoder<std::string> sax_decoder(std::string*);
+    template <typename T> OptionalDecoder<T> sax_decoder(std::optional<T>*);
+    template <typename T> VectorDecoder<T> sax_decoder(std::vector<T>*);
+
+    template <typename T, typename = void>
+    struct DecoderOf {
+      using type = DomDecoder<T>;
+    };
+
+    template <typename T>
+    struct DecoderOf<T, std::void_t<decltype(sax_decoder(std::declval<T*>()))>> {
+      using type = decltype(sax_decoder(std::declval<T*>()));
+    };
+
+    /** The streaming decoder of T, or DomDecoder<T> if T has none */
+    template <typename T>
+    using TypedDecoder = typename DecoderOf<T>::type;
+
+    /**
+     * Decodes null as std::nullopt, and anything else as T.
+     */
+    template <typename T>
+    class OptionalDecoder : public Decoder {
+      std::optional<T>* _target = nullptr;
+      TypedDecoder<T> _value;
+
+    public:
+      Decoder* bind(std::optional<T>& target) {
+        _target = &target;
+        return this;
+      }
+
+      Decoder* resolve(Kind kind) override {
+        if (kind == Kind::Null) {
+          _target->reset();
+          return nullptr;
+        }
+        return _value.bind(_target->emplace())->resolve(kind);
+      }
+    };
+
+    /**
+     * Decodes a JSON array into a std::vector, one element at a time.
+     */
+    template <typename T>
+    class VectorDecoder : public Decoder {
+      std::vector<T>* _target = nullptr;
+      TypedDecoder<T> _element;
+
+    public:
+      Decoder* bind(std::vector<T>& target) {
+        _target = &target;
+        return this;
+      }
+
+      bool start_array() override {
+        _target->clear();
+        return true;
+      }
+
+      Decoder* element() override {
+        return _element.bind(_target->emplace_back());
+      }
+
+      bool end_array() override {
+        return true;
+      }
+    };
+
+    /**
+     * Drives the decoders from nlohmann's SAX events, and skips the values no decoder asked for.
+     */
+    class Parser : public nlohmann::json_sax<arena_json> {
+      struct Frame {
+        Decoder* decoder;
+        bool array;
+      };
+
+      std::vector<Frame> _frames;
+      /** The decoder of the next value, or nullptr to skip it */
+      Decoder* _next;
+      /** The depth inside a skipped object or array */
+      size_t _skip = 0;
+      std::string _error;
+
+      /** Returns the decoder of a value that starts, asking the array for it inside one */
+      Decoder* begin(Kind kind) {
+        Decoder* decoder = _next;
+        _next = nullptr;
+        if (!_frames.empty() && _frames.back().array) {
+          decoder = _frames.back().decoder->element();
+        }
+        return decoder ? decoder->resolve(kind) : nullptr;
+      }
+
+      template <typename Event>
+      bool scalar(Kind kind, Event event) {
+        if (_skip) {
+          return true;
+        }
+        Decoder* decoder = begin(kind);
+        bool ok = decoder ? event(decoder) : true;
+        return ok || fail("unexpected json value");
+      }
+
+      bool start(Kind kind) {
+        if (_skip) {
+          _skip++;
+          return true;
+        }
+        Decoder* decoder = begin(kind);
+        if (!decoder) {
+          _skip = 1;
+          return true;
+        }
+        _frames.push_back({ decoder, kind == Kind::Array });
+        if (kind == Kind::Array) {
+          return decoder->start_array() || fail("unexpected json array");
+        }
+        return decoder->start_object() || fail("unexpected json object");
+      }
+
+      bool end(Kind kind) {
+        if (_skip) {
+          _skip--;
+          return true;
+        }
+        Decoder* decoder = _frames.back().decoder;
+        _frames.pop_back();
+        bool ok = kind == Kind::Array ? decoder->end_array() : decoder->end_object();
+        return ok || fail("invalid json value");
+      }
+
+      bool fail(const std::string& error) {
+        _error = error;
+        return false;
+      }
+
+    public:
+      Parser(Decoder* root) : _next(root) {}
+
+      const std::string& error() const {
+        return _error;
+      }
+
+      bool null() override {
+        return scalar(Kind::Null, [](Decoder* d) { return d->null(); });
+      }
+
+      bool boolean(bool value) override {
+        return scalar(Kind::Scalar, [&](Decoder* d) { return d->boolean(value); });
+      }
+
+      bool number_integer(number_integer_t value) override {
+        return scalar(Kind::Scalar, [&](Decoder* d) { return d->number_integer(value); });
+      }
+
+      bool number_unsigned(number_unsigned_t value) override {
+        return scalar(Kind::Scalar, [&](Decoder* d) { return d->number_unsigned(value); });
+      }
+
+      bool number_float(number_float_t value, const string_t&) override {
+        return scalar(Kind::Scalar, [&](Decoder* d) { return d->number_float(value); });
+      }
+
+      bool string(string_t& value) override {
+        return scalar(Kind::Scalar, [&](Decoder* d) { return d->string(std::string_view(value.data(), value.size())); });
+      }
+
+      bool binary(binary_t&) override {
+        return fail("unexpected binary value");
+      }
+
+      bool start_object(std::size_t) override {
+        return start(Kind::Object);
+      }
+
+      bool key(string_t& key) override {
+        if (!_skip) {
+          _next = _frames.back().decoder->key(std::string_view(key.data(), key.size()));
+        }
+        return true;
+      }
+
+      bool end_object() override {
+        return end(Kind::Object);
+      }
+
+      bool start_array(std::size_t) override {
+        return start(Kind::Array);
+      }
+
+      bool end_array() override {
+        return end(Kind::Array);
+      }
+
+      bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override {
+        return fail(ex.what());
+      }
+    };
+
+    /**
+     * Decodes a JSON document into target without building a DOM.
+     *
+     * @param data The JSON text
+     * @param length The length of the JSON text
+     * @param target The value to decode into
+     */
+    template <typename T, typename D = TypedDecoder<T>>
+    void decode(const char* data, size_t length, T& target) {
+      D decoder;
+      Parser parser(decoder.bind(target));
+      // The text parser alone; arena_json::sax_parse would also instantiate the binary
+      // readers, which need std::string
+      auto input = nlohmann::detail::input_adapter(data, data + length);
+      nlohmann::detail::parser<arena_json, decltype(input)> text_parser(std::move(input), nullptr, false);
+      if (!text_parser.sax_parse(&parser, true)) {
+        throw std::runtime_error("Unable to decode json: " + parser.error());
+      }
+    }
+
+  } // namespace sax
+
+  struct Context {
+    uint64_t slot;
+  };
+
+  void from_json(const json& j, Context& context) {
+    context.slot = j["slot"].get<uint64_t>();
+  }
+
+  class ContextDecoder : public sax::ObjectDecoder<Context> {
+    sax::ValueDecoder<uint64_t> _slot;
+
+  public:
+    Decoder* key(std::string_view key) override {
+      return key == "slot" ? _slot.bind(_target->slot) : nullptr;
+    }
+  };
+
+  ContextDecoder sax_decoder(Context*);
+
+  namespace endian {
+
+    /**
+     * Convert a 16-bit integer from host byte order to big-endian byte order
+     *
+     * @param x 16-bit integer in host byte order
+     */
+    inline uint64_t be64toh(uint64_t x) {
+      #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return __builtin_bswap64(x);
+      #else
+        return x;
+      #endif
+    }
+
+  } // namespace endian
+
+  /**
+   * Returns the CLOCK_REALTIME time in nanoseconds, the clock used by kernel receive timestamps.
+   */
+  uint64_t realtime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+  }
+
+  /**
+   * Asks the kernel to timestamp received data on a socket. NIC hardware timestamps
+   * (SO_TIMESTAMPING) are used where the driver provides them, which needs hardware
+   * timestamping enabled on the interface and the NIC clock synced to CLOCK_REALTIME.
+   * Otherwise the kernel software timestamp (SO_TIMESTAMPNS) is used.
+   *
+   * @param socket The socket to enable receive timestamps on
+   *
+   * @return false if the socket does not support receive timestamps
+   */
+  bool enable_receive_timestamps(int socket) {
+  #ifdef __linux__
+    int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (setsockopt(socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0) {
+      return true;
+    }
+    int enable = 1;
+    return setsockopt(socket, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) == 0;
+  #else
+    return false;
+  #endif
+  }
+
+  /**
+   * Returns the kernel receive timestamp of the data waiting on a socket, or 0 if
+   * there is none. The data is only peeked, so this also works before SSL_read.
+   *
+   * @param socket A socket with receive timestamps enabled
+   * @param empty Set to true if no data is waiting, so a non-blocking read would block
+   */
+  uint64_t peek_receive_timestamp(int socket, bool* empty = nullptr) {
+    if (empty) {
+      *empty = false;
+    }
+  #ifdef __linux__
+    char byte;
+    char control[256];
+    struct iovec iov = { &byte, 1 };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t peeked = recvmsg(socket, &msg, MSG_PEEK | MSG_DONTWAIT);
+    if (peeked <= 0) {
+      if (empty) {
+        *empty = peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+      }
+      return 0;
+    }
+
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level != SOL_SOCKET) {
+        continue;
+      }
+      if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+        // [0] is the software timestamp, [2] the raw hardware timestamp
+        struct timespec ts[3];
+        memcpy(ts, CMSG_DATA(cmsg), sizeof(ts));
+        const struct timespec& best = (ts[2].tv_sec != 0) ? ts[2] : ts[0];
+        return (uint64_t)best.tv_sec * 1000000000ULL + (uint64_t)best.tv_nsec;
+      }
+      if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+        struct timespec ts;
+        memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+        return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+      }
+    }
+  #endif
+    return 0;
+  }
+
+  namespace http {
+
+    class HttpClient {
+      const std::string _interface;
+      const std::string _url;
+      std::string _host;
+      std::string _resource; //TODO this is a bit of a hack.
+
+      int _socket;
+      bool _use_ssl = false;
+      SSL_CTX *_ssl_ctx;
+      SSL *_ssl;
+
+      char* _send_buffer = nullptr;
+      char* _recv_buffer = nullptr;
+
+      bool _receive_timestamps = false;
+      uint64_t _last_receive_ns = 0;
+
+      bool write(const char *data, size_t length) {
+        if (_use_ssl) {
+          int ret = SSL_write(_ssl, data, (int)length);
+          if (ret <= 0) {
+            std::cerr << "Error: SSL_write() failed" << std::endl;
+            disconnect();
+            return false;
+          }
+        } else {
+          int ret = ::write(_socket, data, (int)length);
+          if (ret <= 0) {
+            std::cerr << "Error: write() failed" << std::endl;
+            disconnect();
+            return false;
+          }
+        }
+        return true;
+      }
+
+      bool can_read() {
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(_socket, &readfds);
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 0;
+        int ret = select(_socket + 1, &readfds, NULL, NULL, &timeout);
+        if (ret == -1) {
+          std::cerr << "Error: select() failed" << std::endl;
+          disconnect();
+          return false;
+        }
+        return ret > 0;
+      }
+
+      /**
+       * Blocks until the socket has data to read.
+       */
+      bool wait_readable() {
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(_socket, &readfds);
+        return select(_socket + 1, &readfds, NULL, NULL, NULL) > 0;
+      }
+
+      /**
+       * Reads part of a response. The first read of each response records when its
+       * first byte arrived.
+       */
+      int read(char *data, int length) {
+        if (_last_receive_ns == 0 && _receive_timestamps && wait_readable()) {
+          _last_receive_ns = peek_receive_timestamp(_socket);
+        }
+        int ret = read_some(data, length);
+        if (_last_receive_ns == 0) {
+          _last_receive_ns = realtime_ns();
+        }
+        return ret;
+      }
+
+      int read_some(char *data, int length) {
+        if (_use_ssl) {
+          int ret = SSL_read(_ssl, data, length);
+          if (ret <= 0) {
+            std::cerr << "Error: SSL_read() failed" << std::endl;
+            disconnect();
+            return 0;
+          }
           return ret;
         } else {
           int ret = ::read(_socket, data, length);
@@ -601,6 +2186,10 @@ namespace many {
           return false;
         }
 
+        if (_receive_timestamps && !enable_receive_timestamps(_socket)) {
+          std::cerr << "Error: receive timestamps not supported" << std::endl;
+        }
+
         struct sockaddr_in localaddr;
         memset(&localaddr, 0, sizeof(localaddr));
         localaddr.sin_family = AF_INET;
@@ -705,6 +2294,22 @@ namespace many {
         return true;
       }
 
+      /**
+       * Enables kernel receive timestamps. Takes effect on the next connect().
+       */
+      void set_receive_timestamps(bool enabled) {
+        _receive_timestamps = enabled;
+      }
+
+      /**
+       * Returns the receive time of the first byte of the last response, in
+       * CLOCK_REALTIME nanoseconds. This is the kernel timestamp when receive
+       * timestamps are enabled, otherwise the time it was read.
+       */
+      uint64_t last_receive_ns() const {
+        return _last_receive_ns;
+      }
+
       char* post(json& request, int* recv_length) {
         std::string json_string = request.dump();
 
@@ -717,6 +2322,7 @@ namespace many {
         memcpy(&_send_buffer[send_length], json_string.c_str(), json_string.size());
         send_length += json_string.size();
 
+        _last_receive_ns = 0;
         write(_send_buffer, send_length);
 
         *recv_length = read(&_recv_buffer[*recv_length], 8192);
@@ -780,32 +2386,65 @@ namespace many {
       return json::parse(std::string(response, response_length));
     }
 
-  } // namespace http
+    /**
+     * The arena that decoding a response allocates from on this thread. It is reset
+     * after every response, so its stats() count the bytes each response used.
+     */
+    Arena& response_arena() {
+      static thread_local Arena arena;
+      return arena;
+    }
 
-  namespace libsodium {
+    /**
+     * Called by post() with the receive time of the response's first byte and the
+     * time it finished decoding. Overload it for response types that carry latency
+     * stamps; it is found by argument-dependent lookup.
+     */
+    template <typename T>
+    void stamp_response(T&, uint64_t, uint64_t) {
+    }
 
     /**
-     * The following is based on https://github.com/jedisct1/libsodium
+     * Takes a url and a json request object and decodes the response into T, without
+     * building a json DOM of the response (see sax::decode)
+     *
+     * @param url The url endpoint for the POST request
+     * @param request The json request object
+     * @param receive_timestamps Whether to stamp the response with the kernel receive time
      */
+    template <typename T>
+    T post(const std::string url, json request, bool receive_timestamps = false) {
+      HttpClient client(url);
+      client.set_receive_timestamps(receive_timestamps);
+      client.connect();
+      if (!client.is_connected()) {
+        throw std::runtime_error("Unable to connect to HttpClient.");
+      }
 
-    typedef int32_t fe25519[10];
+      int response_length = 0;
+      char* response = client.post(request, &response_length);
 
-    typedef struct {
-      fe25519 X;
-      fe25519 Y;
-      fe25519 Z;
-      fe25519 T;
-    } ge25519_p3;
+      T result;
+      {
+        Arena::Scope scope(response_arena());
+        sax::decode(response, response_length, result);
+      }
+      stamp_response(result, client.last_receive_ns(), realtime_ns());
+      client.disconnect();
+      return result;
+    }
 
-    /* sqrt(-1) */
-    static const fe25519 fe25519_sqrtm1 = {
-      -32595792, -7943725,  9377950,  3500415, 12389472, -272473, -25146209, -2005654, 326686, 11406482
-    };
+  } // namespace http
 
-    /* 37095705934669439343138083508754565189542113879843219016388785533085940283555 */
-    static const fe25519 ed25519_d = {
-      -10913610, 13857413, -15372611, 6949391,   114729, -8787816, -6275908, -3247719, -18696448, -12055116
-    };
+  namespace libsodium {
+
+    /**
+     * The following is based on https://github.com/jedisct1/libsodium
+     */
+
+#if !defined(MANY_FE25519_REF10) && defined(__SIZEOF_INT128__) && (defined(__x86_64__) || defined(__aarch64__))
+  #define MANY_FE25519_51
+#endif
 
     static inline uint64_t load_3(const unsigned char *in) {
       uint64_t result;
@@ -838,12 +2477,385 @@ namespace many {
       return 1 & ((d - 1) >> 8);
     }
 
+#ifdef MANY_FE25519_51
+
+    /**
+     * Field elements as five 51-bit limbs, multiplied through unsigned __int128. This is
+     * libsodium's fe_51 representation and needs about a quarter of the multiplications of
+     * the ten 25.5-bit limbs below. Define MANY_FE25519_REF10 to use those instead.
+     */
+
+    typedef uint64_t fe25519[5];
+
+    typedef unsigned __int128 uint128_t;
+
+    /* sqrt(-1) */
+    static const fe25519 fe25519_sqrtm1 = {
+      1718705420411056ULL, 234908883556509ULL, 2233514472574048ULL, 2117202627021982ULL, 765476049583133ULL
+    };
+
+    /* 37095705934669439343138083508754565189542113879843219016388785533085940283555 */
+    static const fe25519 ed25519_d = {
+      929955233495203ULL, 466365720129213ULL, 1662059464998953ULL, 2033849074728123ULL, 1442794654840575ULL
+    };
+
+    /* 2 * d = 16295367250680780974490674513165176452449235426866156013048779062215315747161 */
+    static const fe25519 ed25519_d2 = {
+      1859910466990425ULL, 932731440258426ULL, 1072319116312658ULL, 1815898335770999ULL, 633789495995903ULL
+    };
+
+    static inline uint64_t load_8(const unsigned char *in) {
+      uint64_t result;
+
+      memcpy(&result, in, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      result = __builtin_bswap64(result);
+#endif
+      return result;
+    }
+
+    static inline void store_8(unsigned char *out, uint64_t in) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      in = __builtin_bswap64(in);
+#endif
+      memcpy(out, &in, 8);
+    }
+
+    static inline void fe25519_0(fe25519 h) {
+      memset(&h[0], 0, 5 * sizeof h[0]);
+    }
+
+    static inline void fe25519_copy(fe25519 h, const fe25519 f) {
+      memcpy(h, f, 5 * sizeof h[0]);
+    }
+
+    static inline void fe25519_1(fe25519 h) {
+      h[0] = 1;
+      memset(&h[1], 0, 4 * sizeof h[0]);
+    }
+
+    static inline void fe25519_add(fe25519 h, const fe25519 f, const fe25519 g) {
+      h[0] = f[0] + g[0];
+      h[1] = f[1] + g[1];
+      h[2] = f[2] + g[2];
+      h[3] = f[3] + g[3];
+      h[4] = f[4] + g[4];
+    }
+
+    static inline void fe25519_sub(fe25519 h, const fe25519 f, const fe25519 g) {
+      const uint64_t mask = 0x7ffffffffffffULL;
+      uint64_t       h0, h1, h2, h3, h4;
+
+      h0 = g[0];
+      h1 = g[1];
+      h2 = g[2];
+      h3 = g[3];
+      h4 = g[4];
+
+      h1 += h0 >> 51;
+      h0 &= mask;
+      h2 += h1 >> 51;
+      h1 &= mask;
+      h3 += h2 >> 51;
+      h2 &= mask;
+      h4 += h3 >> 51;
+      h3 &= mask;
+      h0 += 19ULL * (h4 >> 51);
+      h4 &= mask;
+
+      /* f + 2p - g */
+      h[0] = (f[0] + 0xfffffffffffdaULL) - h0;
+      h[1] = (f[1] + 0xffffffffffffeULL) - h1;
+      h[2] = (f[2] + 0xffffffffffffeULL) - h2;
+      h[3] = (f[3] + 0xffffffffffffeULL) - h3;
+      h[4] = (f[4] + 0xffffffffffffeULL) - h4;
+    }
+
+    static inline void fe25519_neg(fe25519 h, const fe25519 f) {
+      fe25519 zero;
+
+      fe25519_0(zero);
+      fe25519_sub(h, zero, f);
+    }
+
+    static void fe25519_cmov(fe25519 f, const fe25519 g, unsigned int b) {
+      const uint64_t mask = (uint64_t) (-(int64_t) b);
+
+      f[0] ^= (f[0] ^ g[0]) & mask;
+      f[1] ^= (f[1] ^ g[1]) & mask;
+      f[2] ^= (f[2] ^ g[2]) & mask;
+      f[3] ^= (f[3] ^ g[3]) & mask;
+      f[4] ^= (f[4] ^ g[4]) & mask;
+    }
+
+    void fe25519_frombytes(fe25519 h, const unsigned char *s) {
+      const uint64_t mask = 0x7ffffffffffffULL;
+
+      h[0] = (load_8(s)) & mask;
+      h[1] = (load_8(s + 6) >> 3) & mask;
+      h[2] = (load_8(s + 12) >> 6) & mask;
+      h[3] = (load_8(s + 19) >> 1) & mask;
+      h[4] = (load_8(s + 24) >> 12) & mask;
+    }
+
+    static void fe25519_reduce(fe25519 h, const fe25519 f) {
+      const uint64_t mask = 0x7ffffffffffffULL;
+      uint64_t       t[5];
+
+      memcpy(t, f, sizeof t);
+
+      for (int i = 0; i < 2; i++) {
+        t[1] += t[0] >> 51;
+        t[0] &= mask;
+        t[2] += t[1] >> 51;
+        t[1] &= mask;
+        t[3] += t[2] >> 51;
+        t[2] &= mask;
+        t[4] += t[3] >> 51;
+        t[3] &= mask;
+        t[0] += 19ULL * (t[4] >> 51);
+        t[4] &= mask;
+      }
+
+      /* t < 2^255: add 19 so that t >= p wraps past 2^255 */
+      t[0] += 19ULL;
+
+      t[1] += t[0] >> 51;
+      t[0] &= mask;
+      t[2] += t[1] >> 51;
+      t[1] &= mask;
+      t[3] += t[2] >> 51;
+      t[2] &= mask;
+      t[4] += t[3] >> 51;
+      t[3] &= mask;
+      t[0] += 19ULL * (t[4] >> 51);
+      t[4] &= mask;
+
+      /* add 2^255 - 19 and drop 2^255, which leaves t mod p */
+      t[0] += 0x8000000000000ULL - 19ULL;
+      t[1] += 0x8000000000000ULL - 1ULL;
+      t[2] += 0x8000000000000ULL - 1ULL;
+      t[3] += 0x8000000000000ULL - 1ULL;
+      t[4] += 0x8000000000000ULL - 1ULL;
+
+      t[1] += t[0] >> 51;
+      t[0] &= mask;
+      t[2] += t[1] >> 51;
+      t[1] &= mask;
+      t[3] += t[2] >> 51;
+      t[2] &= mask;
+      t[4] += t[3] >> 51;
+      t[3] &= mask;
+      t[4] &= mask;
+
+      memcpy(h, t, sizeof t);
+    }
+
+    void fe25519_tobytes(unsigned char *s, const fe25519 h) {
+      fe25519 t;
+
+      fe25519_reduce(t, h);
+      store_8(s, t[0] | (t[1] << 51));
+      store_8(s + 8, (t[1] >> 13) | (t[2] << 38));
+      store_8(s + 16, (t[2] >> 26) | (t[3] << 25));
+      store_8(s + 24, (t[3] >> 39) | (t[4] << 12));
+    }
+
+    static void fe25519_mul(fe25519 h, const fe25519 f, const fe25519 g) {
+      const uint64_t mask = 0x7ffffffffffffULL;
+      uint128_t      r0, r1, r2, r3, r4, carry;
+      uint64_t       f0, f1, f2, f3, f4;
+      uint64_t       f1_19, f2_19, f3_19, f4_19;
+      uint64_t       g0, g1, g2, g3, g4;
+      uint64_t       r00, r01, r02, r03, r04;
+
+      f0 = f[0];
+      f1 = f[1];
+      f2 = f[2];
+      f3 = f[3];
+      f4 = f[4];
+
+      g0 = g[0];
+      g1 = g[1];
+      g2 = g[2];
+      g3 = g[3];
+      g4 = g[4];
+
+      f1_19 = 19ULL * f1;
+      f2_19 = 19ULL * f2;
+      f3_19 = 19ULL * f3;
+      f4_19 = 19ULL * f4;
+
+      r0  = ((uint128_t) f0) * ((uint128_t) g0);
+      r0 += ((uint128_t) f1_19) * ((uint128_t) g4);
+      r0 += ((uint128_t) f2_19) * ((uint128_t) g3);
+      r0 += ((uint128_t) f3_19) * ((uint128_t) g2);
+      r0 += ((uint128_t) f4_19) * ((uint128_t) g1);
+
+      r1  = ((uint128_t) f0) * ((uint128_t) g1);
+      r1 += ((uint128_t) f1) * ((uint128_t) g0);
+      r1 += ((uint128_t) f2_19) * ((uint128_t) g4);
+      r1 += ((uint128_t) f3_19) * ((uint128_t) g3);
+      r1 += ((uint128_t) f4_19) * ((uint128_t) g2);
+
+      r2  = ((uint128_t) f0) * ((uint128_t) g2);
+      r2 += ((uint128_t) f1) * ((uint128_t) g1);
+      r2 += ((uint128_t) f2) * ((uint128_t) g0);
+      r2 += ((uint128_t) f3_19) * ((uint128_t) g4);
+      r2 += ((uint128_t) f4_19) * ((uint128_t) g3);
+
+      r3  = ((uint128_t) f0) * ((uint128_t) g3);
+      r3 += ((uint128_t) f1) * ((uint128_t) g2);
+      r3 += ((uint128_t) f2) * ((uint128_t) g1);
+      r3 += ((uint128_t) f3) * ((uint128_t) g0);
+      r3 += ((uint128_t) f4_19) * ((uint128_t) g4);
+
+      r4  = ((uint128_t) f0) * ((uint128_t) g4);
+      r4 += ((uint128_t) f1) * ((uint128_t) g3);
+      r4 += ((uint128_t) f2) * ((uint128_t) g2);
+      r4 += ((uint128_t) f3) * ((uint128_t) g1);
+      r4 += ((uint128_t) f4) * ((uint128_t) g0);
+
+      r00   = ((uint64_t) r0) & mask;
+      carry = r0 >> 51;
+      r1   += carry;
+      r01   = ((uint64_t) r1) & mask;
+      carry = r1 >> 51;
+      r2   += carry;
+      r02   = ((uint64_t) r2) & mask;
+      carry = r2 >> 51;
+      r3   += carry;
+      r03   = ((uint64_t) r3) & mask;
+      carry = r3 >> 51;
+      r4   += carry;
+      r04   = ((uint64_t) r4) & mask;
+      carry = r4 >> 51;
+      r00  += 19ULL * (uint64_t) carry;
+      carry = r00 >> 51;
+      r00  &= mask;
+      r01  += (uint64_t) carry;
+      carry = r01 >> 51;
+      r01  &= mask;
+      r02  += (uint64_t) carry;
+
+      h[0] = r00;
+      h[1] = r01;
+      h[2] = r02;
+      h[3] = r03;
+      h[4] = r04;
+    }
+
+    static void fe25519_sq(fe25519 h, const fe25519 f) {
+      const uint64_t mask = 0x7ffffffffffffULL;
+      uint128_t      r0, r1, r2, r3, r4, carry;
+      uint64_t       f0, f1, f2, f3, f4;
+      uint64_t       f0_2, f1_2, f1_38, f2_38, f3_38, f3_19, f4_19;
+      uint64_t       r00, r01, r02, r03, r04;
+
+      f0 = f[0];
+      f1 = f[1];
+      f2 = f[2];
+      f3 = f[3];
+      f4 = f[4];
+
+      f0_2 = f0 << 1;
+      f1_2 = f1 << 1;
+
+      f1_38 = 38ULL * f1;
+      f2_38 = 38ULL * f2;
+      f3_38 = 38ULL * f3;
+
+      f3_19 = 19ULL * f3;
+      f4_19 = 19ULL * f4;
+
+      r0  = ((uint128_t) f0) * ((uint128_t) f0);
+      r0 += ((uint128_t) f1_38) * ((uint128_t) f4);
+      r0 += ((uint128_t) f2_38) * ((uint128_t) f3);
+
+      r1  = ((uint128_t) f0_2) * ((uint128_t) f1);
+      r1 += ((uint128_t) f2_38) * ((uint128_t) f4);
+      r1 += ((uint128_t) f3_19) * ((uint128_t) f3);
+
+      r2  = ((uint128_t) f0_2) * ((uint128_t) f2);
+      r2 += ((uint128_t) f1) * ((uint128_t) f1);
+      r2 += ((uint128_t) f3_38) * ((uint128_t) f4);
+
+      r3  = ((uint128_t) f0_2) * ((uint128_t) f3);
+      r3 += ((uint128_t) f1_2) * ((uint128_t) f2);
+      r3 += ((uint128_t) f4_19) * ((uint128_t) f4);
+
+      r4  = ((uint128_t) f0_2) * ((uint128_t) f4);
+      r4 += ((uint128_t) f1_2) * ((uint128_t) f3);
+      r4 += ((uint128_t) f2) * ((uint128_t) f2);
+
+      r00   = ((uint64_t) r0) & mask;
+      carry = r0 >> 51;
+      r1   += carry;
+      r01   = ((uint64_t) r1) & mask;
+      carry = r1 >> 51;
+      r2   += carry;
+      r02   = ((uint64_t) r2) & mask;
+      carry = r2 >> 51;
+      r3   += carry;
+      r03   = ((uint64_t) r3) & mask;
+      carry = r3 >> 51;
+      r4   += carry;
+      r04   = ((uint64_t) r4) & mask;
+      carry = r4 >> 51;
+      r00  += 19ULL * (uint64_t) carry;
+      carry = r00 >> 51;
+      r00  &= mask;
+      r01  += (uint64_t) carry;
+      carry = r01 >> 51;
+      r01  &= mask;
+      r02  += (uint64_t) carry;
+
+      h[0] = r00;
+      h[1] = r01;
+      h[2] = r02;
+      h[3] = r03;
+      h[4] = r04;
+    }
+
+    /* h = 2 * f^2 */
+    static inline void fe25519_sq2(fe25519 h, const fe25519 f) {
+      fe25519_sq(h, f);
+      fe25519_add(h, h, h);
+    }
+
+#else
+
+    typedef int32_t fe25519[10];
+
+    /* sqrt(-1) */
+    static const fe25519 fe25519_sqrtm1 = {
+      -32595792, -7943725,  9377950,  3500415, 12389472, -272473, -25146209, -2005654, 326686, 11406482
+    };
+
+    /* 37095705934669439343138083508754565189542113879843219016388785533085940283555 */
+    static const fe25519 ed25519_d = {
+      -10913610, 13857413, -15372611, 6949391,   114729, -8787816, -6275908, -3247719, -18696448, -12055116
+    };
+
+    /* 2 * d = 16295367250680780974490674513165176452449235426866156013048779062215315747161 */
+    static const fe25519 ed25519_d2 = {
+      -21827239, -5839606,  -30745221, 13898782, 229458, 15978800, -12551817, -6495438, 29715968, 9444199
+    };
+
     static inline void fe25519_1(fe25519 h) {
       h[0] = 1;
       h[1] = 0;
       memset(&h[2], 0, 8 * sizeof h[0]);
     }
 
+    static inline void fe25519_0(fe25519 h) {
+      memset(&h[0], 0, 10 * sizeof h[0]);
+    }
+
+    static inline void fe25519_copy(fe25519 h, const fe25519 f) {
+      memcpy(h, f, 10 * sizeof h[0]);
+    }
+
     static inline void fe25519_add(fe25519 h, const fe25519 f, const fe25519 g) {
       int32_t h0 = f[0] + g[0];
       int32_t h1 = f[1] + g[1];
@@ -1099,22 +3111,6 @@ namespace many {
       s[31] = t[9] >> 18;
     }
 
-    static inline int fe25519_isnegative(const fe25519 f) {
-      unsigned char s[32];
-
-      fe25519_tobytes(s, f);
-
-      return s[0] & 1;
-    }
-
-    static inline int fe25519_iszero(const fe25519 f) {
-      unsigned char s[32];
-
-      fe25519_tobytes(s, f);
-
-      return sodium_is_zero(s, 32);
-    }
-
     static void fe25519_mul(fe25519 h, const fe25519 f, const fe25519 g) {
       int32_t f0 = f[0];
       int32_t f1 = f[1];
@@ -1539,44 +3535,186 @@ namespace many {
       h0 += carry9 * 19;
       h9 -= carry9 * ((uint64_t) 1L << 25);
 
-      carry0 = (h0 + (int64_t)(1L << 25)) >> 26;
-      h1 += carry0;
-      h0 -= carry0 * ((uint64_t) 1L << 26);
+      carry0 = (h0 + (int64_t)(1L << 25)) >> 26;
+      h1 += carry0;
+      h0 -= carry0 * ((uint64_t) 1L << 26);
+
+      h[0] = (int32_t) h0;
+      h[1] = (int32_t) h1;
+      h[2] = (int32_t) h2;
+      h[3] = (int32_t) h3;
+      h[4] = (int32_t) h4;
+      h[5] = (int32_t) h5;
+      h[6] = (int32_t) h6;
+      h[7] = (int32_t) h7;
+      h[8] = (int32_t) h8;
+      h[9] = (int32_t) h9;
+    }
+
+    static void fe25519_sub(fe25519 h, const fe25519 f, const fe25519 g) {
+      int32_t h0 = f[0] - g[0];
+      int32_t h1 = f[1] - g[1];
+      int32_t h2 = f[2] - g[2];
+      int32_t h3 = f[3] - g[3];
+      int32_t h4 = f[4] - g[4];
+      int32_t h5 = f[5] - g[5];
+      int32_t h6 = f[6] - g[6];
+      int32_t h7 = f[7] - g[7];
+      int32_t h8 = f[8] - g[8];
+      int32_t h9 = f[9] - g[9];
+
+      h[0] = h0;
+      h[1] = h1;
+      h[2] = h2;
+      h[3] = h3;
+      h[4] = h4;
+      h[5] = h5;
+      h[6] = h6;
+      h[7] = h7;
+      h[8] = h8;
+      h[9] = h9;
+    }
+
+    /* h = 2 * f^2 */
+    static inline void fe25519_sq2(fe25519 h, const fe25519 f) {
+      fe25519 f2;
+
+      fe25519_add(f2, f, f);
+      fe25519_mul(h, f2, f);
+    }
+
+#endif
+
+    typedef struct {
+      fe25519 X;
+      fe25519 Y;
+      fe25519 Z;
+      fe25519 T;
+    } ge25519_p3;
+
+    typedef struct {
+      fe25519 X;
+      fe25519 Y;
+      fe25519 Z;
+    } ge25519_p2;
+
+    typedef struct {
+      fe25519 X;
+      fe25519 Y;
+      fe25519 Z;
+      fe25519 T;
+    } ge25519_p1p1;
+
+    typedef struct {
+      fe25519 YplusX;
+      fe25519 YminusX;
+      fe25519 Z;
+      fe25519 T2d;
+    } ge25519_cached;
+
+    static inline int fe25519_isnegative(const fe25519 f) {
+      unsigned char s[32];
+
+      fe25519_tobytes(s, f);
+
+      return s[0] & 1;
+    }
+
+    static inline int fe25519_iszero(const fe25519 f) {
+      unsigned char s[32];
+
+      fe25519_tobytes(s, f);
+
+      return sodium_is_zero(s, 32);
+    }
+
+    /**
+     * Jacobi symbol (a/n) for odd n, with both operands LEN limbs long, times (-1)^sign.
+     * Binary algorithm: strip factors of two, swap by quadratic reciprocity, subtract. The
+     * limb count drops as the operands shrink.
+     */
+    template <size_t LEN>
+    static int jacobi_vartime(uint64_t *a, uint64_t *n, int sign) {
+      if constexpr (LEN == 1) {
+        uint64_t x = a[0];
+        uint64_t y = n[0];
+
+        while (x != 0) {
+          int z = __builtin_ctzll(x);
+          x >>= z;
+          sign ^= (z & 1) & (int) ((y >> 1) ^ (y >> 2));
+          if (x < y) {
+            std::swap(x, y);
+            sign ^= (int) ((x & y) >> 1) & 1;
+          }
+          x -= y;
+        }
+        return y != 1 ? 0 : sign ? -1 : 1;
+      } else {
+        for (;;) {
+          if (a[LEN - 1] == 0 && n[LEN - 1] == 0) {
+            return jacobi_vartime<LEN - 1>(a, n, sign);
+          }
+
+          if (a[0] == 0) {
+            /* whole zero limbs are an even power of two, which does not change the symbol */
+            size_t zero = 1;
+            while (zero < LEN && a[zero] == 0) {
+              zero++;
+            }
+            if (zero == LEN) {
+              return 0;
+            }
+            for (size_t i = 0; i < LEN; i++) {
+              a[i] = i + zero < LEN ? a[i + zero] : 0;
+            }
+          }
+
+          int z = __builtin_ctzll(a[0]);
+          if (z > 0) {
+            for (size_t i = 0; i + 1 < LEN; i++) {
+              a[i] = (a[i] >> z) | (a[i + 1] << (64 - z));
+            }
+            a[LEN - 1] >>= z;
+            /* (2/n) = -1 when n = 3 or 5 mod 8 */
+            sign ^= (z & 1) & (int) ((n[0] >> 1) ^ (n[0] >> 2));
+          }
 
-      h[0] = (int32_t) h0;
-      h[1] = (int32_t) h1;
-      h[2] = (int32_t) h2;
-      h[3] = (int32_t) h3;
-      h[4] = (int32_t) h4;
-      h[5] = (int32_t) h5;
-      h[6] = (int32_t) h6;
-      h[7] = (int32_t) h7;
-      h[8] = (int32_t) h8;
-      h[9] = (int32_t) h9;
+          size_t top = LEN - 1;
+          while (top > 0 && a[top] == n[top]) {
+            top--;
+          }
+          if (a[top] < n[top]) {
+            std::swap(a, n);
+            /* (a/n)(n/a) = -1 when both are 3 mod 4 */
+            sign ^= (int) ((a[0] & n[0]) >> 1) & 1;
+          }
+
+          unsigned char borrow = 0;
+          for (size_t i = 0; i < LEN; i++) {
+            uint64_t d = a[i] - n[i];
+            unsigned char next = (a[i] < n[i]) | (d < borrow);
+            a[i] = d - borrow;
+            borrow = next;
+          }
+        }
+      }
     }
 
-    static void fe25519_sub(fe25519 h, const fe25519 f, const fe25519 g) {
-      int32_t h0 = f[0] - g[0];
-      int32_t h1 = f[1] - g[1];
-      int32_t h2 = f[2] - g[2];
-      int32_t h3 = f[3] - g[3];
-      int32_t h4 = f[4] - g[4];
-      int32_t h5 = f[5] - g[5];
-      int32_t h6 = f[6] - g[6];
-      int32_t h7 = f[7] - g[7];
-      int32_t h8 = f[8] - g[8];
-      int32_t h9 = f[9] - g[9];
+    /**
+     * Legendre symbol of f: 1 if f is a non-zero square, -1 if it is not a square and 0 if f = 0.
+     * Runs in variable time, so it is only for public values such as candidate addresses.
+     */
+    int fe25519_legendre_vartime(const fe25519 f) {
+      unsigned char s[32];
+      uint64_t      a[4];
+      uint64_t      n[4] = { 0xffffffffffffffedULL, 0xffffffffffffffffULL, 0xffffffffffffffffULL, 0x7fffffffffffffffULL };
 
-      h[0] = h0;
-      h[1] = h1;
-      h[2] = h2;
-      h[3] = h3;
-      h[4] = h4;
-      h[5] = h5;
-      h[6] = h6;
-      h[7] = h7;
-      h[8] = h8;
-      h[9] = h9;
+      fe25519_tobytes(s, f);
+      for (int i = 0; i < 4; i++) {
+        a[i] = load_4(s + 8 * i) | (load_4(s + 8 * i + 4) << 32);
+      }
+      return jacobi_vartime<4>(a, n, 0);
     }
 
     static void fe25519_pow22523(fe25519 out, const fe25519 z) {
@@ -1643,45 +3781,697 @@ namespace many {
       return 1 - (c & d & 1);
     }
 
-    int ge25519_frombytes(ge25519_p3 *h, const unsigned char *s) {
-      fe25519 u;
-      fe25519 v;
-      fe25519 vxx;
-      fe25519 m_root_check, p_root_check;
-      fe25519 negx;
-      fe25519 x_sqrtm1;
-      int     has_m_root, has_p_root;
+    int ge25519_frombytes(ge25519_p3 *h, const unsigned char *s) {
+      fe25519 u;
+      fe25519 v;
+      fe25519 vxx;
+      fe25519 m_root_check, p_root_check;
+      fe25519 negx;
+      fe25519 x_sqrtm1;
+      int     has_m_root, has_p_root;
+
+      fe25519_frombytes(h->Y, s);
+      fe25519_1(h->Z);
+      fe25519_sq(u, h->Y);
+      fe25519_mul(v, u, ed25519_d);
+      fe25519_sub(u, u, h->Z); /* u = y^2-1 */
+      fe25519_add(v, v, h->Z); /* v = dy^2+1 */
+
+      fe25519_mul(h->X, u, v);
+      fe25519_pow22523(h->X, h->X);
+      fe25519_mul(h->X, u, h->X); /* u((uv)^((q-5)/8)) */
+
+      fe25519_sq(vxx, h->X);
+      fe25519_mul(vxx, vxx, v);
+      fe25519_sub(m_root_check, vxx, u); /* vx^2-u */
+      fe25519_add(p_root_check, vxx, u); /* vx^2+u */
+      has_m_root = fe25519_iszero(m_root_check);
+      has_p_root = fe25519_iszero(p_root_check);
+      fe25519_mul(x_sqrtm1, h->X, fe25519_sqrtm1); /* x*sqrt(-1) */
+      fe25519_cmov(h->X, x_sqrtm1, 1 - has_m_root);
+
+      fe25519_neg(negx, h->X);
+      fe25519_cmov(h->X, negx, fe25519_isnegative(h->X) ^ (s[31] >> 7));
+      fe25519_mul(h->T, h->X, h->Y);
+
+      return (has_m_root | has_p_root) - 1;
+    }
+
+    /**
+     * Returns 1 if s is the y coordinate of a curve point, as ge25519_frombytes would accept it,
+     * without recovering x: (y^2 - 1) / (d y^2 + 1) must be a square, and so must the product of
+     * numerator and denominator. Variable time.
+     */
+    int ge25519_is_on_curve(const unsigned char *s) {
+      fe25519 y;
+      fe25519 u;
+      fe25519 v;
+      fe25519 w;
+      fe25519 one;
+
+      fe25519_frombytes(y, s);
+      fe25519_1(one);
+      fe25519_sq(u, y);
+      fe25519_mul(v, u, ed25519_d);
+      fe25519_sub(u, u, one); /* u = y^2-1 */
+      fe25519_add(v, v, one); /* v = dy^2+1 */
+      fe25519_mul(w, u, v);
+
+      return fe25519_legendre_vartime(w) >= 0;
+    }
+
+    void ge25519_p2_0(ge25519_p2 *h) {
+      fe25519_0(h->X);
+      fe25519_1(h->Y);
+      fe25519_1(h->Z);
+    }
+
+    int ge25519_p2_is_identity(const ge25519_p2 *p) {
+      fe25519 d;
+
+      fe25519_sub(d, p->Y, p->Z);
+      return fe25519_iszero(p->X) & fe25519_iszero(d);
+    }
+
+    void ge25519_p3_to_p2(ge25519_p2 *r, const ge25519_p3 *p) {
+      fe25519_copy(r->X, p->X);
+      fe25519_copy(r->Y, p->Y);
+      fe25519_copy(r->Z, p->Z);
+    }
+
+    void ge25519_p3_to_cached(ge25519_cached *r, const ge25519_p3 *p) {
+      fe25519_add(r->YplusX, p->Y, p->X);
+      fe25519_sub(r->YminusX, p->Y, p->X);
+      fe25519_copy(r->Z, p->Z);
+      fe25519_mul(r->T2d, p->T, ed25519_d2);
+    }
+
+    void ge25519_p1p1_to_p2(ge25519_p2 *r, const ge25519_p1p1 *p) {
+      fe25519_mul(r->X, p->X, p->T);
+      fe25519_mul(r->Y, p->Y, p->Z);
+      fe25519_mul(r->Z, p->Z, p->T);
+    }
+
+    void ge25519_p1p1_to_p3(ge25519_p3 *r, const ge25519_p1p1 *p) {
+      fe25519_mul(r->X, p->X, p->T);
+      fe25519_mul(r->Y, p->Y, p->Z);
+      fe25519_mul(r->Z, p->Z, p->T);
+      fe25519_mul(r->T, p->X, p->Y);
+    }
+
+    /* r = 2 * p */
+    void ge25519_p2_dbl(ge25519_p1p1 *r, const ge25519_p2 *p) {
+      fe25519 t0;
+
+      fe25519_sq(r->X, p->X);
+      fe25519_sq(r->Z, p->Y);
+      fe25519_sq2(r->T, p->Z);
+      fe25519_add(r->Y, p->X, p->Y);
+      fe25519_sq(t0, r->Y);
+      fe25519_add(r->Y, r->Z, r->X);
+      fe25519_sub(r->Z, r->Z, r->X);
+      fe25519_sub(r->X, t0, r->Y);
+      fe25519_sub(r->T, r->T, r->Z);
+    }
+
+    /* r = 2 * p */
+    void ge25519_p3_dbl(ge25519_p1p1 *r, const ge25519_p3 *p) {
+      ge25519_p2 q;
+
+      ge25519_p3_to_p2(&q, p);
+      ge25519_p2_dbl(r, &q);
+    }
+
+    /* r = p + q */
+    void ge25519_add(ge25519_p1p1 *r, const ge25519_p3 *p, const ge25519_cached *q) {
+      fe25519 t0;
+
+      fe25519_add(r->X, p->Y, p->X);
+      fe25519_sub(r->Y, p->Y, p->X);
+      fe25519_mul(r->Z, r->X, q->YplusX);
+      fe25519_mul(r->Y, r->Y, q->YminusX);
+      fe25519_mul(r->T, q->T2d, p->T);
+      fe25519_mul(r->X, p->Z, q->Z);
+      fe25519_add(t0, r->X, r->X);
+      fe25519_sub(r->X, r->Z, r->Y);
+      fe25519_add(r->Y, r->Z, r->Y);
+      fe25519_add(r->Z, t0, r->T);
+      fe25519_sub(r->T, t0, r->T);
+    }
+
+    /* r = p - q */
+    void ge25519_sub(ge25519_p1p1 *r, const ge25519_p3 *p, const ge25519_cached *q) {
+      fe25519 t0;
+
+      fe25519_add(r->X, p->Y, p->X);
+      fe25519_sub(r->Y, p->Y, p->X);
+      fe25519_mul(r->Z, r->X, q->YminusX);
+      fe25519_mul(r->Y, r->Y, q->YplusX);
+      fe25519_mul(r->T, q->T2d, p->T);
+      fe25519_mul(r->X, p->Z, q->Z);
+      fe25519_add(t0, r->X, r->X);
+      fe25519_sub(r->X, r->Z, r->Y);
+      fe25519_add(r->Y, r->Z, r->Y);
+      fe25519_sub(r->Z, t0, r->T);
+      fe25519_add(r->T, t0, r->T);
+    }
+
+    /* Returns 1 if 8 * p is the identity */
+    int ge25519_has_small_order(const ge25519_p3 *p) {
+      ge25519_p1p1 t;
+      ge25519_p2   r;
+
+      ge25519_p3_to_p2(&r, p);
+      for (int i = 0; i < 3; i++) {
+        ge25519_p2_dbl(&t, &r);
+        ge25519_p1p1_to_p2(&r, &t);
+      }
+      return ge25519_p2_is_identity(&r);
+    }
+
+    /* Returns 1 if s < L */
+    int sc25519_is_canonical(const unsigned char s[32]) {
+      static const unsigned char L[32] = {
+        0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7,
+        0xa2, 0xde, 0xf9, 0xde, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+      };
+      unsigned char c = 0;
+      unsigned char n = 1;
+      unsigned int  i = 32;
+
+      do {
+        i--;
+        c |= ((s[i] - L[i]) >> 8) & n;
+        n &= ((s[i] ^ L[i]) - 1) >> 8;
+      } while (i != 0);
+
+      return (c != 0);
+    }
+
+    static void slide_vartime(signed char *r, const unsigned char *a) {
+      int i;
+      int b;
+      int k;
+      int ribs;
+      int cmp;
+
+      for (i = 0; i < 256; ++i) {
+        r[i] = 1 & (a[i >> 3] >> (i & 7));
+      }
+      for (i = 0; i < 256; ++i) {
+        if (! r[i]) {
+          continue;
+        }
+        for (b = 1; b <= 6 && i + b < 256; ++b) {
+          if (! r[i + b]) {
+            continue;
+          }
+          ribs = r[i + b] << b;
+          cmp = r[i] + ribs;
+          if (cmp <= 15) {
+            r[i] = cmp;
+            r[i + b] = 0;
+          } else {
+            cmp = r[i] - ribs;
+            if (cmp < -15) {
+              break;
+            }
+            r[i] = cmp;
+            for (k = i + b; k < 256; ++k) {
+              if (! r[k]) {
+                r[k] = 1;
+                break;
+              }
+              r[k] = 0;
+            }
+          }
+        }
+      }
+    }
+
+    /**
+     * r = scalars[0] * points[0] + ... + scalars[count - 1] * points[count - 1], in variable time.
+     *
+     * Straus' method: every scalar is recoded into signed sliding windows with odd digits in
+     * [-15, 15], the odd multiples P, 3P, ..., 15P of each point are cached, and all points share
+     * a single chain of 256 doublings. Scalars are 32 little-endian bytes below 2^255.
+     */
+    void ge25519_multi_scalarmult_vartime(ge25519_p2 *r, const unsigned char *scalars, const ge25519_p3 *points, size_t count) {
+      std::vector<signed char>    digits(256 * count);
+      std::vector<ge25519_cached> multiples(8 * count);
+      signed char                 slide[256];
+      ge25519_p1p1                t;
+      ge25519_p3                  u;
+      ge25519_p3                  p2;
+      int                         top = -1;
+
+      for (size_t k = 0; k < count; k++) {
+        slide_vartime(slide, scalars + 32 * k);
+        for (int i = 0; i < 256; i++) {
+          digits[count * i + k] = slide[i];
+          if (slide[i] && i > top) {
+            top = i;
+          }
+        }
+
+        ge25519_cached *m = &multiples[8 * k];
+        ge25519_p3_to_cached(&m[0], &points[k]);
+        ge25519_p3_dbl(&t, &points[k]);
+        ge25519_p1p1_to_p3(&p2, &t);
+        for (int i = 0; i < 7; i++) {
+          ge25519_add(&t, &p2, &m[i]);
+          ge25519_p1p1_to_p3(&u, &t);
+          ge25519_p3_to_cached(&m[i + 1], &u);
+        }
+      }
+
+      ge25519_p2_0(r);
+      for (int i = top; i >= 0; --i) {
+        const signed char *row = &digits[count * i];
+
+        ge25519_p2_dbl(&t, r);
+        for (size_t k = 0; k < count; k++) {
+          if (row[k] > 0) {
+            ge25519_p1p1_to_p3(&u, &t);
+            ge25519_add(&t, &u, &multiples[8 * k + row[k] / 2]);
+          } else if (row[k] < 0) {
+            ge25519_p1p1_to_p3(&u, &t);
+            ge25519_sub(&t, &u, &multiples[8 * k + (-row[k]) / 2]);
+          }
+        }
+        ge25519_p1p1_to_p2(r, &t);
+      }
+    }
+
+  } // namespace libsodium
+
+  /**
+   * A bounded lock-free ring for handing items from one producer thread to one
+   * consumer thread. Each cell carries a sequence number (Vyukov's bounded queue),
+   * which also lets the producer safely discard the oldest item when it is full.
+   */
+  template <typename T>
+  class SpscRing {
+    struct alignas(64) Cell {
+      std::atomic<size_t> sequence;
+      T value;
+    };
+
+    std::unique_ptr<Cell[]> _cells;
+    size_t _mask;
+    alignas(64) std::atomic<size_t> _enqueue_pos{0};
+    alignas(64) std::atomic<size_t> _dequeue_pos{0};
+
+  public:
+
+    /**
+     * @param capacity The number of items the ring can hold, rounded up to a power of two
+     */
+    SpscRing(size_t capacity) {
+      size_t size = 2;
+      while (size < capacity) {
+        size <<= 1;
+      }
+      _cells.reset(new Cell[size]);
+      _mask = size - 1;
+      for (size_t i = 0; i < size; i++) {
+        _cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    SpscRing() = delete;
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    /**
+     * Pushes an item, or returns false (leaving value untouched) if the ring is full.
+     * Must only be called from the producer thread.
+     */
+    bool try_push(T&& value) {
+      size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+      Cell& cell = _cells[pos & _mask];
+      if (cell.sequence.load(std::memory_order_acquire) != pos) {
+        return false;
+      }
+      cell.value = std::move(value);
+      cell.sequence.store(pos + 1, std::memory_order_release);
+      _enqueue_pos.store(pos + 1, std::memory_order_relaxed);
+      return true;
+    }
+
+    /**
+     * Pops the oldest item, or returns false if the ring is empty. Called from the
+     * consumer thread, or from the producer to discard the oldest item.
+     */
+    bool try_pop(T& value) {
+      size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+      Cell* cell;
+      while (true) {
+        cell = &_cells[pos & _mask];
+        intptr_t diff = (intptr_t)cell->sequence.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+        if (diff == 0) {
+          if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            break;
+          }
+        } else if (diff < 0) {
+          return false;
+        } else {
+          pos = _dequeue_pos.load(std::memory_order_relaxed);
+        }
+      }
+      value = std::move(cell->value);
+      cell->value = T();
+      cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * Returns the number of items in the ring
+     */
+    size_t size() const {
+      size_t enqueue_pos = _enqueue_pos.load(std::memory_order_relaxed);
+      size_t dequeue_pos = _dequeue_pos.load(std::memory_order_relaxed);
+      return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+    }
+
+    size_t capacity() const {
+      return _mask + 1;
+    }
+  };
+
+  /**
+   * Pins the calling thread to a cpu core. Returns false if pinning is not supported.
+   *
+   * @param cpu The core to pin to
+   */
+  bool pin_thread(int cpu) {
+  #ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) == 0;
+  #else
+    return false;
+  #endif
+  }
+
+  /**
+   * Worker threads for fork-join work such as parallel_for. The threads are created
+   * on first use and kept, growing to the largest number any call has asked for,
+   * so repeated calls do not pay for thread start-up. One job runs at a time; a
+   * job started from inside a worker runs on the calling thread instead. Work that
+   * runs for an unbounded time should start its own threads, since every other
+   * caller waits for the pool.
+   */
+  class ThreadPool {
+    std::vector<std::thread> _workers;
+    std::mutex _run_mutex;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    const std::function<void()>* _job = nullptr;
+    uint64_t _generation = 0;
+    size_t _participants = 0;
+    size_t _running = 0;
+    bool _stopping = false;
+
+    static bool& inside_job() {
+      static thread_local bool inside = false;
+      return inside;
+    }
+
+    void worker_main(size_t index) {
+      inside_job() = true;
+      uint64_t generation = 0;
+      std::unique_lock<std::mutex> lock(_mutex);
+      while (true) {
+        _wake.wait(lock, [&]() { return _stopping || _generation != generation; });
+        if (_stopping) {
+          return;
+        }
+        generation = _generation;
+        if (index >= _participants) {
+          continue;
+        }
+        const std::function<void()>* job = _job;
+        lock.unlock();
+        (*job)();
+        lock.lock();
+        if (--_running == 0) {
+          _done.notify_one();
+        }
+      }
+    }
+
+  public:
+    ThreadPool() = default;
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+      }
+      _wake.notify_all();
+      for (auto& worker : _workers) {
+        worker.join();
+      }
+    }
+
+    /**
+     * The pool parallel_for uses.
+     */
+    static ThreadPool& global() {
+      static ThreadPool pool;
+      return pool;
+    }
+
+    /**
+     * Runs job on the calling thread and on helpers pool threads at once, and
+     * returns when every copy has returned. job must not throw.
+     */
+    void run(size_t helpers, const std::function<void()>& job) {
+      if (helpers == 0 || inside_job()) {
+        job();
+        return;
+      }
+      std::lock_guard<std::mutex> serial(_run_mutex);
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        while (_workers.size() < helpers) {
+          size_t index = _workers.size();
+          _workers.emplace_back([this, index]() { worker_main(index); });
+        }
+        _job = &job;
+        _participants = helpers;
+        _running = helpers;
+        _generation++;
+      }
+      _wake.notify_all();
+
+      inside_job() = true;
+      job();
+      inside_job() = false;
+
+      std::unique_lock<std::mutex> lock(_mutex);
+      _done.wait(lock, [&]() { return _running == 0; });
+      _job = nullptr;
+    }
+  };
+
+  /**
+   * Runs f(i) for every i in [0, count) across threads workers from
+   * ThreadPool::global(), the calling thread being one of them. Workers claim
+   * blocks of grain indices from a shared counter, so uneven work balances itself.
+   * The first exception thrown by f stops the remaining blocks and is rethrown
+   * once every worker has finished.
+   *
+   * @param count The number of indices
+   * @param f Called with each index
+   * @param threads The number of workers, 0 for one per core
+   * @param grain The number of indices a worker claims at a time
+   */
+  template <typename F>
+  void parallel_for(size_t count, F f, size_t threads = 0, size_t grain = 64) {
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    grain = std::max<size_t>(1, grain);
+    threads = std::min(threads, (count + grain - 1) / grain);
+    if (threads <= 1) {
+      for (size_t i = 0; i < count; i++) {
+        f(i);
+      }
+      return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    std::exception_ptr error;
+    std::function<void()> work = [&]() {
+      try {
+        size_t begin;
+        while ((begin = next.fetch_add(grain, std::memory_order_relaxed)) < count) {
+          size_t end = std::min(count, begin + grain);
+          for (size_t i = begin; i < end; i++) {
+            f(i);
+          }
+        }
+      } catch (...) {
+        next.store(count, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    };
+
+    ThreadPool::global().run(threads - 1, work);
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  namespace websockets {
+
+    struct SubscribeReport {
+      /** Subscriptions the server confirmed */
+      std::vector<int> confirmed;
+      /** Subscriptions the server rejected */
+      std::vector<int> failed;
+      /** Subscriptions that were not confirmed before the timeout */
+      std::vector<int> timed_out;
+      /** Time from the first write to the last confirmation, in microseconds */
+      uint64_t elapsed_us = 0;
+
+      /**
+       * Returns true if every subscription is live
+       */
+      bool live() const {
+        return failed.empty() && timed_out.empty();
+      }
+    };
+
+#ifdef MANY_PERMESSAGE_DEFLATE
+    /**
+     * Inflates permessage-deflate messages (RFC 7692). Messages share one raw deflate
+     * stream, so a message can refer back to earlier ones unless the context is reset.
+     */
+    class Inflater {
+      z_stream _stream;
+      bool _initialized = false;
+      std::string _buffer;
+      size_t _length = 0;
+      size_t _max_size;
+
+    public:
+
+      static constexpr size_t DEFAULT_MAX_SIZE = 1048576; // 1024 * 1024
+
+      /**
+       * @param max_size The largest inflated message accepted, so a small payload
+       * cannot expand without bound
+       */
+      explicit Inflater(size_t max_size = DEFAULT_MAX_SIZE) : _max_size(max_size) {
+        ASSERT(max_size > 0 && max_size < UINT32_MAX);
+      }
+
+      Inflater(const Inflater&) = delete;
+      Inflater& operator=(const Inflater&) = delete;
+
+      ~Inflater() {
+        end();
+      }
+
+      /**
+       * Inflates one message payload, sent without its 00 00 ff ff tail. Resets the
+       * stream first when reset_context is set. Returns false if the payload is corrupt
+       * or inflates past the maximum size, after which the stream starts over.
+       */
+      bool inflate(const char* payload, size_t payload_size, bool reset_context) {
+        if (!_initialized) {
+          memset(&_stream, 0, sizeof(_stream));
+          if (inflateInit2(&_stream, -15) != Z_OK) {
+            return false;
+          }
+          _initialized = true;
+        } else if (reset_context) {
+          inflateReset(&_stream);
+        }
 
-      fe25519_frombytes(h->Y, s);
-      fe25519_1(h->Z);
-      fe25519_sq(u, h->Y);
-      fe25519_mul(v, u, ed25519_d);
-      fe25519_sub(u, u, h->Z); /* u = y^2-1 */
-      fe25519_add(v, v, h->Z); /* v = dy^2+1 */
+        static const unsigned char trailer[4] = { 0x00, 0x00, 0xff, 0xff };
 
-      fe25519_mul(h->X, u, v);
-      fe25519_pow22523(h->X, h->X);
-      fe25519_mul(h->X, u, h->X); /* u((uv)^((q-5)/8)) */
+        // One byte past the maximum tells a message of exactly the maximum from a larger one
+        size_t limit = _max_size + 1;
+        size_t inflated = 0;
+        if (_buffer.size() < std::min(payload_size * 4 + 1024, limit)) {
+          _buffer.resize(std::min(payload_size * 4 + 1024, limit));
+        }
 
-      fe25519_sq(vxx, h->X);
-      fe25519_mul(vxx, vxx, v);
-      fe25519_sub(m_root_check, vxx, u); /* vx^2-u */
-      fe25519_add(p_root_check, vxx, u); /* vx^2+u */
-      has_m_root = fe25519_iszero(m_root_check);
-      has_p_root = fe25519_iszero(p_root_check);
-      fe25519_mul(x_sqrtm1, h->X, fe25519_sqrtm1); /* x*sqrt(-1) */
-      fe25519_cmov(h->X, x_sqrtm1, 1 - has_m_root);
+        for (int pass = 0; pass < 2; pass++) {
+          _stream.next_in = (Bytef*)(pass == 0 ? (const unsigned char*)payload : trailer);
+          _stream.avail_in = (uInt)(pass == 0 ? payload_size : sizeof(trailer));
+          do {
+            if (inflated == _buffer.size()) {
+              if (_buffer.size() >= limit) {
+                std::cerr << "Error: inflated message too large" << std::endl;
+                end();
+                return false;
+              }
+              _buffer.resize(std::min(_buffer.size() * 2, limit));
+            }
+            _stream.next_out = (Bytef*)&_buffer[inflated];
+            _stream.avail_out = (uInt)(_buffer.size() - inflated);
+            int ret = ::inflate(&_stream, Z_SYNC_FLUSH);
+            inflated = _buffer.size() - _stream.avail_out;
+            if (ret == Z_STREAM_END) {
+              // A block with BFINAL set ends the stream; the rest of the input is padding.
+              // With context takeover the next message can still refer back to this one.
+              unsigned char window[32768];
+              uInt window_size = 0;
+              if (!reset_context) {
+                inflateGetDictionary(&_stream, window, &window_size);
+              }
+              inflateReset(&_stream);
+              if (window_size > 0) {
+                inflateSetDictionary(&_stream, window, window_size);
+              }
+              _length = inflated;
+              return true;
+            }
+            if (ret != Z_OK && ret != Z_BUF_ERROR) {
+              std::cerr << "Error: inflate() failed" << std::endl;
+              end();
+              return false;
+            }
+          } while (_stream.avail_in > 0 || _stream.avail_out == 0);
+        }
 
-      fe25519_neg(negx, h->X);
-      fe25519_cmov(h->X, negx, fe25519_isnegative(h->X) ^ (s[31] >> 7));
-      fe25519_mul(h->T, h->X, h->Y);
+        _length = inflated;
+        return true;
+      }
 
-      return (has_m_root | has_p_root) - 1;
-    }
+      /**
+       * Returns the last inflated message
+       */
+      const char* data() const {
+        return _buffer.data();
+      }
 
-  } // namespace libsodium
+      size_t size() const {
+        return _length;
+      }
 
-  namespace websockets {
+      void end() {
+        if (_initialized) {
+          inflateEnd(&_stream);
+          _initialized = false;
+        }
+      }
+    };
+#endif
 
     class WebSocketClient {
       const std::string _interface;
@@ -1716,11 +4506,345 @@ namespace many {
       static const uint8_t OPCODE_PING   = 0x09;
       static const uint8_t OPCODE_PONG   = 0x0A;
       static const uint8_t FIN_FLAG      = 0x80;
+      static const uint8_t RSV1_FLAG     = 0x40;
       static const uint8_t MASK_FLAG     = 0x80;
 
-      int _nextSubscriptionId = 0;
-      std::map<int, std::function<void(json)>> _subscriptions;
+    public:
+
+      struct Subscription {
+        /** The subscribe method, e.g. "accountSubscribe" */
+        std::string method;
+        /** The subscribe params, kept so the subscription can be replayed after a reconnect */
+        json params;
+        /** The callback for notifications on this subscription, given the params */
+        std::function<void(json)> callback;
+        /**
+         * Set instead of callback to decode notifications without a json DOM. It gets the
+         * whole message while the client's parse arena is current (see sax::decode).
+         */
+        std::function<void(const char* message, size_t message_size)> on_message;
+      };
+
+    private:
+
+      std::atomic<int> _nextSubscriptionId{0};
+      std::map<int, Subscription> _subscriptions;
       std::map<int, int> _subscription_map;
+      /** Unsubscribe methods of subscriptions cancelled before the server confirmed them */
+      std::map<int, std::string> _pending_unsubscribes;
+      /**
+       * Methods of unsubscribes awaiting a response, by request id. The ids count down
+       * from -1 so a response can never be taken for a subscribe confirmation.
+       */
+      std::map<int, std::string> _unsubscribes;
+      int _nextUnsubscribeId = 0;
+
+      bool _reconnect = true;
+      bool _supervised = false;
+      int _reconnect_attempts = 0;
+      std::chrono::milliseconds _reconnect_min_backoff{100};
+      std::chrono::milliseconds _reconnect_max_backoff{5000};
+      std::chrono::steady_clock::time_point _disconnected_at;
+      std::chrono::steady_clock::time_point _next_reconnect_at;
+      std::function<void(uint64_t)> _on_reconnect;
+      std::thread _connect_thread;
+      std::atomic<bool> _connecting{false};
+      std::atomic<bool> _connect_done{false};
+      /** Set by disconnect() to give up on a handshake the reconnect thread is waiting for */
+      std::atomic<bool> _cancel_connect{false};
+      bool _connect_result = false;
+
+      std::chrono::milliseconds _ping_interval{10000};
+      std::chrono::milliseconds _pong_timeout{5000};
+      std::chrono::steady_clock::time_point _ping_sent_at;
+      bool _ping_outstanding = false;
+      uint64_t _rtt_us = 0;
+      uint64_t _last_rtt_us = 0;
+
+      static const size_t BATCH_WRITE_SIZE = 262144;
+      /** Limit on the TCP connect, TLS and upgrade handshakes of one open() together */
+      static constexpr int HANDSHAKE_TIMEOUT_MS = 10000;
+
+      struct ConfirmationBatch {
+        std::set<int> pending;
+        SubscribeReport report;
+        std::chrono::steady_clock::time_point started_at;
+        std::chrono::steady_clock::time_point deadline;
+        std::function<void(const SubscribeReport&)> callback;
+      };
+
+      // Options read by the background reconnect are atomic so they can be set meanwhile
+      std::atomic<bool> _receive_timestamps{false};
+      uint64_t _last_receive_ns = 0;
+
+      std::atomic<bool> _spin{false};
+      std::atomic<int> _busy_poll_us{0};
+
+      bool _batch_writes = false;
+      std::string _write_batch;
+      std::vector<ConfirmationBatch> _confirmation_batches;
+
+    public:
+
+      struct DeflateStats {
+        /** Number of compressed messages received */
+        uint64_t messages = 0;
+        /** Bytes received on the wire for compressed messages */
+        uint64_t compressed_bytes = 0;
+        /** Bytes after inflating compressed messages */
+        uint64_t inflated_bytes = 0;
+        /** Thread CPU time spent inflating, in nanoseconds */
+        uint64_t inflate_cpu_ns = 0;
+
+        /**
+         * Returns the compression ratio (inflated / compressed bytes)
+         */
+        double ratio() const {
+          return compressed_bytes == 0 ? 0.0 : (double)inflated_bytes / (double)compressed_bytes;
+        }
+      };
+
+    private:
+
+      std::atomic<bool> _deflate_requested{false};
+      std::atomic<bool> _deflate_context_takeover{true};
+      bool _deflate_active = false;
+      bool _deflate_server_no_context_takeover = false;
+      DeflateStats _deflate_stats;
+#ifdef MANY_PERMESSAGE_DEFLATE
+      Inflater _inflater{MESSAGE_BUFFER_SIZE};
+
+      /**
+       * Inflates a permessage-deflate payload into _inflater. The context is kept
+       * across messages, and is only reset when the server does not use context takeover.
+       */
+      bool inflate_message(const char* payload, size_t payload_size) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+
+        if (!_inflater.inflate(payload, payload_size, _deflate_server_no_context_takeover)) {
+          return false;
+        }
+
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+
+        _deflate_stats.messages++;
+        _deflate_stats.compressed_bytes += payload_size;
+        _deflate_stats.inflated_bytes += _inflater.size();
+        _deflate_stats.inflate_cpu_ns += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+        _inflated = _inflater.data();
+        _inflate_length = _inflater.size();
+        return true;
+      }
+
+      void inflate_end() {
+        _inflater.end();
+      }
+#else
+      bool inflate_message(const char*, size_t) {
+        return false;
+      }
+
+      void inflate_end() {
+      }
+#endif
+      const char* _inflated = nullptr;
+      size_t _inflate_length = 0;
+
+      /** Allocations made while parsing a message, reset after it is dispatched */
+      Arena _arena;
+
+      /** The fields of a message that dispatch() routes on */
+      struct Envelope {
+        bool notification = false;
+        int64_t subscription = 0;
+        std::optional<int64_t> id;
+        /** The result, if it is an integer: the server id of a new subscription */
+        std::optional<int64_t> result;
+        bool error = false;
+        int64_t error_code = 0;
+        std::string error_message;
+      };
+
+      class EnvelopeDecoder : public sax::ObjectDecoder<Envelope> {
+        /** Keeps integer values and ignores any other scalar */
+        class Integer : public sax::Decoder {
+        public:
+          std::optional<int64_t>* target = nullptr;
+
+          Decoder* resolve(sax::Kind kind) override {
+            return kind == sax::Kind::Scalar ? this : nullptr;
+          }
+
+          bool boolean(bool) override { return true; }
+          bool number_integer(int64_t value) override { *target = value; return true; }
+          bool number_unsigned(uint64_t value) override { *target = (int64_t)value; return true; }
+          bool number_float(double) override { return true; }
+          bool string(std::string_view) override { return true; }
+        };
+
+        class Params : public sax::ObjectDecoder<Envelope> {
+          sax::ValueDecoder<int64_t> _subscription;
+
+        public:
+          Decoder* key(std::string_view key) override {
+            return key == "subscription" ? _subscription.bind(_target->subscription) : nullptr;
+          }
+        };
+
+        class Error : public sax::ObjectDecoder<Envelope> {
+          sax::ValueDecoder<int64_t> _code;
+          sax::ValueDecoder<std::string> _message;
+
+        public:
+          Decoder* resolve(sax::Kind kind) override {
+            return kind == sax::Kind::Object ? this : nullptr;
+          }
+
+          Decoder* key(std::string_view key) override {
+            if (key == "code") {
+              return _code.bind(_target->error_code);
+            }
+            if (key == "message") {
+              return _message.bind(_target->error_message);
+            }
+            return nullptr;
+          }
+        };
+
+        Params _params;
+        Integer _id;
+        Integer _result;
+        Error _error;
+
+      public:
+        Decoder* key(std::string_view key) override {
+          if (key == "params") {
+            _target->notification = true;
+            return _params.bind(*_target);
+          }
+          if (key == "id") {
+            _id.target = &_target->id;
+            return &_id;
+          }
+          if (key == "result") {
+            _result.target = &_target->result;
+            return &_result;
+          }
+          if (key == "error") {
+            _target->error = true;
+            return _error.bind(*_target);
+          }
+          return nullptr;
+        }
+      };
+
+      /**
+       * Decodes just the params of a notification, for a subscription without on_message.
+       */
+      class ParamsDecoder : public sax::ObjectDecoder<json> {
+        sax::DomDecoder<json> _params;
+
+      public:
+        Decoder* key(std::string_view key) override {
+          return key == "params" ? _params.bind(*_target) : nullptr;
+        }
+      };
+
+      /**
+       * Dispatches a text message to its subscription, or records the server
+       * subscription id for a subscribe confirmation. Only the routing fields are
+       * decoded here; subscriptions with on_message decode the rest themselves.
+       */
+      void dispatch(const char* message, size_t message_size) {
+        Arena::Scope scope(_arena);
+        Envelope envelope;
+        sax::decode<Envelope, EnvelopeDecoder>(message, message_size, envelope);
+
+        if (envelope.notification) {
+          auto mapped = _subscription_map.find(envelope.subscription);
+          if (mapped != _subscription_map.end()) {
+            auto it = _subscriptions.find(mapped->second);
+            if (it != _subscriptions.end()) {
+              if (it->second.on_message) {
+                it->second.on_message(message, message_size);
+              } else {
+                json params;
+                sax::decode<json, ParamsDecoder>(message, message_size, params);
+                it->second.callback(std::move(params));
+              }
+            }
+          }
+        } else if (envelope.id && *envelope.id < 0) {
+          auto unsubscribe = _unsubscribes.find(*envelope.id);
+          if (unsubscribe != _unsubscribes.end()) {
+            if (envelope.error) {
+              std::cerr << "UNSUBSCRIBE FAILED " << unsubscribe->second << " " << envelope.error_code << " " << envelope.error_message << std::endl;
+            }
+            _unsubscribes.erase(unsubscribe);
+          }
+        } else if (envelope.id && envelope.result) {
+          auto pending = _pending_unsubscribes.find(*envelope.id);
+          if (pending != _pending_unsubscribes.end()) {
+            // Cancelled while the subscribe was in flight, so cancel it on the server now
+            send_unsubscribe(pending->second, *envelope.result);
+            _pending_unsubscribes.erase(pending);
+            return;
+          }
+          _subscription_map[*envelope.result] = *envelope.id;
+          settle_confirmation(*envelope.id, true);
+        } else if (envelope.id && envelope.error) {
+          _pending_unsubscribes.erase(*envelope.id);
+          std::cerr << "SUBSCRIBE FAILED " << envelope.error_code << " " << envelope.error_message << std::endl;
+          settle_confirmation(*envelope.id, false);
+        }
+      }
+
+      /**
+       * Records the outcome of a tracked subscribe, and reports every batch that has
+       * no confirmations left.
+       *
+       * @param subscriptionId The subscription that was confirmed or rejected
+       * @param confirmed Whether the server confirmed the subscription
+       */
+      void settle_confirmation(int subscriptionId, bool confirmed) {
+        if (_confirmation_batches.empty()) {
+          return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        for (auto& batch : _confirmation_batches) {
+          if (batch.pending.erase(subscriptionId)) {
+            (confirmed ? batch.report.confirmed : batch.report.failed).push_back(subscriptionId);
+            batch.report.elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(now - batch.started_at).count();
+          }
+        }
+        complete_confirmations(now);
+      }
+
+      void complete_confirmations(std::chrono::steady_clock::time_point now) {
+        std::vector<ConfirmationBatch> completed;
+        for (auto it = _confirmation_batches.begin(); it != _confirmation_batches.end();) {
+          if (it->pending.empty() || now >= it->deadline) {
+            for (int subscriptionId : it->pending) {
+              it->report.timed_out.push_back(subscriptionId);
+            }
+            completed.push_back(std::move(*it));
+            it = _confirmation_batches.erase(it);
+          } else {
+            ++it;
+          }
+        }
+        for (auto& batch : completed) {
+          batch.callback(batch.report);
+        }
+      }
+
+      void flush_writes() {
+        if (!_write_batch.empty()) {
+          write(_write_batch.data(), _write_batch.size());
+          _write_batch.clear();
+        }
+      }
 
       void send_message(uint8_t opcode, const char* message, size_t message_size) {
         int send_length = 0;
@@ -1742,7 +4866,7 @@ namespace many {
         }
         else {
           std::cerr << "Message too big." << std::endl;
-          disconnect();
+          drop();
           return;
         }
 
@@ -1759,6 +4883,14 @@ namespace many {
 
         send_length += message_size;
 
+        if (_batch_writes) {
+          _write_batch.append(_send_buffer, send_length);
+          if (_write_batch.size() >= BATCH_WRITE_SIZE) {
+            flush_writes();
+          }
+          return;
+        }
+
         write(_send_buffer, send_length);
       }
 
@@ -1781,6 +4913,16 @@ namespace many {
                 return false;
               }
             }
+            else if (strncasecmp(&buffer[start], "Sec-WebSocket-Extensions: ", 26) == 0) {
+              std::string extensions(&buffer[start + 26], end - start - 26);
+              if (extensions.find("permessage-deflate") != std::string::npos) {
+                if (!_deflate_requested) {
+                  return false;
+                }
+                _deflate_active = true;
+                _deflate_server_no_context_takeover = extensions.find("server_no_context_takeover") != std::string::npos;
+              }
+            }
             else if (strncasecmp(&buffer[start], "Sec-WebSocket-Accept: ", 22) == 0) {
               std::string key = base64::encode(_nonce.begin(), 16) + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 
@@ -1801,25 +4943,55 @@ namespace many {
       char* read(int& length) {
         length = 0;
 
-        if (!is_connected()) {
+        if (_socket == -1) {
           return nullptr;
         }
 
-        struct timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = 0;
+        // In spin mode the socket is non-blocking once the handshake is done, so read
+        // directly without select(). Until then the handshake deadline needs select().
+        bool spinning = _spin && _handshake_complete;
+        int rv = 1;
         fd_set readfds;
-        FD_ZERO(&readfds);
-        FD_SET(_socket, &readfds);
-        int rv = select(_socket + 1, &readfds, NULL, NULL, &tv);
+        if (!spinning) {
+          struct timeval tv;
+          tv.tv_sec = 0;
+          tv.tv_usec = 0;
+          FD_ZERO(&readfds);
+          FD_SET(_socket, &readfds);
+          rv = select(_socket + 1, &readfds, NULL, NULL, &tv);
+        }
 
-        if(rv > 0 && FD_ISSET(_socket, &readfds)) {
+        if(rv > 0 && (spinning || FD_ISSET(_socket, &readfds))) {
+          uint64_t receive_ns = 0;
+          if (_receive_timestamps) {
+            bool empty = false;
+            receive_ns = peek_receive_timestamp(_socket, &empty);
+            // When spinning the peek doubles as the readiness check, so an idle spin
+            // costs one syscall. SSL may still hold the rest of a record it has read.
+            if (spinning && empty && (!_use_ssl || SSL_pending(_ssl) == 0)) {
+              return nullptr;
+            }
+          }
+          _last_receive_ns = receive_ns;
           length = (_use_ssl) ? SSL_read(_ssl, _recv_buffer, 8192) : ::read(_socket, _recv_buffer, 8192);
+          if (_last_receive_ns == 0) {
+            _last_receive_ns = realtime_ns();
+          }
 
           if (length > 0) {
             return _recv_buffer;
           }
+          else if (length == 0) {
+            std::cerr << "CONNECTION CLOSED" << std::endl;
+            drop();
+            return nullptr;
+          }
           else if (length < 0) {
+            if (spinning && would_block(length)) {
+              length = 0;
+              return nullptr;
+            }
+
             std::cerr << "READ FAILED" << std::endl;
 
             if (_use_ssl) {
@@ -1832,85 +5004,295 @@ namespace many {
               }
             }
 
-            disconnect();
+            drop();
+            length = 0;
+
+            return nullptr;
+          }
+
+          return nullptr;
+        }
+        else {
+          return nullptr;
+        }
+      }
+
+      bool write(const void* buffer, const int length) {
+        if (_socket == -1) {
+          return false;
+        }
+
+        ASSERT(length > 0);
+        const char* data = (const char*)buffer;
+        int remaining = length;
+        int return_code;
+        while (true) {
+          return_code = (_use_ssl) ? SSL_write(_ssl, data, remaining) : ::write(_socket, data, remaining);
+          if (return_code > 0 && return_code < remaining) {
+            data += return_code;
+            remaining -= return_code;
+          } else if (return_code <= 0 && _spin && would_block(return_code)) {
+            // The socket is non-blocking in spin mode, so wait for room in the send buffer
+          } else {
+            break;
+          }
+        }
+
+        if (_handshake_complete) {
+          //TODO: log
+        }
+
+        if (return_code <= 0) {
+          if (_use_ssl) {
+            int err = SSL_get_error(_ssl, return_code);
+            switch (err) {
+              case SSL_ERROR_WANT_WRITE:
+              {
+                std::cerr << "SSL_ERROR_WANT_WRITE" << std::endl;
+                break;
+              }
+              case SSL_ERROR_WANT_READ:
+              {
+                std::cerr << "SSL_ERROR_WANT_READ" << std::endl;
+                break;
+              }
+              case SSL_ERROR_ZERO_RETURN:
+              {
+                std::cerr << "SSL_ERROR_ZERO_RETURN" << std::endl;
+                break;
+              }
+              case SSL_ERROR_SYSCALL:
+              {
+                std::cerr << "SSL_ERROR_SYSCALL" << std::endl;
+                break;
+              }
+              case SSL_ERROR_SSL:
+              {
+                std::cerr << "SSL_ERROR_SSL" << std::endl;
+                break;
+              }
+            }
+          }
+
+          std::cerr << "SEND FAILED" << std::endl;
+          drop();
+          return false;
+        }
+
+        return true;
+      }
+
+      /**
+       * Returns true if a failed read or write only means the non-blocking socket was not ready.
+       */
+      bool would_block(int return_code) {
+        if (_use_ssl) {
+          int err = SSL_get_error(_ssl, return_code);
+          return err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+
+      /**
+       * Switches the connected socket between blocking reads behind select() and
+       * non-blocking busy polling.
+       */
+      void apply_spin() {
+        int flags = fcntl(_socket, F_GETFL, 0);
+        fcntl(_socket, F_SETFL, _spin ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+      #ifdef SO_BUSY_POLL
+        int busy_poll_us = _spin ? _busy_poll_us.load() : 0;
+        if (setsockopt(_socket, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us, sizeof(busy_poll_us)) != 0 && _spin) {
+          std::cerr << "SO_BUSY_POLL FAILED (needs CAP_NET_ADMIN above net.core.busy_read)" << std::endl;
+        }
+      #endif
+      }
+
+      // void send_close(std::string message) {
+      //   send_message(OPCODE_CLOSE, message.c_str(), message.size());
+      // }
+
+      /**
+       * Sends a ping carrying the send time, so the pong echo gives an RTT sample.
+       */
+      void send_ping(std::chrono::steady_clock::time_point now) {
+        int64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+        send_message(OPCODE_PING, (const char*)&timestamp, sizeof(timestamp));
+        _ping_sent_at = now;
+        _ping_outstanding = true;
+      }
+
+      void send_pong(const char* message, size_t message_size) {
+        send_message(OPCODE_PONG, message, message_size);
+      }
+
+      void on_pong(const char* message, size_t message_size) {
+        if (message_size != sizeof(int64_t)) {
+          return;
+        }
+        int64_t timestamp;
+        memcpy(&timestamp, message, sizeof(timestamp));
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (timestamp > now) {
+          return;
+        }
+        _last_rtt_us = (uint64_t)(now - timestamp) / 1000;
+        // Smoothed like TCP's SRTT, srtt = 7/8 srtt + 1/8 sample
+        _rtt_us = (_rtt_us == 0) ? _last_rtt_us : (7 * _rtt_us + _last_rtt_us) / 8;
+        _ping_outstanding = false;
+      }
+
+      /**
+       * Sends periodic pings and drops the connection when a pong is overdue.
+       */
+      void heartbeat() {
+        if (_ping_interval.count() == 0) {
+          return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (_ping_outstanding) {
+          if (now - _ping_sent_at > _pong_timeout) {
+            std::cerr << "PONG TIMEOUT" << std::endl;
+            drop();
+          }
+        } else if (now - _ping_sent_at > _ping_interval) {
+          send_ping(now);
+        }
+      }
+
+      void send_message(json j) {
+        std::string message = j.dump();
+        send_message(OPCODE_TEXT, message.c_str(), message.size());
+      }
+
+      void send_subscribe(int subscriptionId, const Subscription& subscription) {
+        if (subscription.params.is_null()) {
+          send_message({
+            {"jsonrpc", "2.0"},
+            {"id", subscriptionId},
+            {"method", subscription.method},
+          });
+        } else {
+          send_message({
+            {"jsonrpc", "2.0"},
+            {"id", subscriptionId},
+            {"method", subscription.method},
+            {"params", subscription.params},
+          });
+        }
+      }
+
+      void send_unsubscribe(const std::string& method, int64_t serverId) {
+        int requestId = --_nextUnsubscribeId;
+        _unsubscribes[requestId] = method;
+        send_message({
+          {"jsonrpc", "2.0"},
+          {"id", requestId},
+          {"method", method},
+          {"params", {
+            serverId,
+          }},
+        });
+      }
+
+      /**
+       * Closes the socket after a read or write error. Unlike disconnect(), the
+       * connection stays supervised and poll() will try to reconnect.
+       */
+      void drop() {
+        if (_handshake_complete) {
+          _disconnected_at = std::chrono::steady_clock::now();
+          _next_reconnect_at = _disconnected_at;
+          _reconnect_attempts = 0;
+        }
+        close_socket();
+        _handshake_complete = false;
+        _message_start = 0;
+        _message_end = 0;
+      }
 
-            return nullptr;
+      void close_socket() {
+        if (_use_ssl) {
+          if (_ssl != nullptr) {
+            SSL_shutdown(_ssl);
+            SSL_free(_ssl);
+            _ssl = nullptr;
+          }
+          if (_ssl_ctx != nullptr) {
+            SSL_CTX_free(_ssl_ctx);
+            _ssl_ctx = nullptr;
           }
-
-          return nullptr;
         }
-        else {
-          return nullptr;
+        if (_socket != -1) {
+          close(_socket);
+          _socket = -1;
         }
       }
 
-      bool write(const void* buffer, const int length) {
-        if (!is_connected()) {
-          return false;
+      /**
+       * Reconnects with exponential backoff and replays every active subscription.
+       * The DNS lookup, TCP connect, TLS and upgrade handshakes run on a background
+       * thread so an unreachable server does not stall poll(), which picks up the
+       * result on a later call. The server assigns new subscription ids, which are
+       * remapped as the confirmations arrive in poll().
+       */
+      void reconnect() {
+        if (_connecting) {
+          if (!_connect_done) {
+            return;
+          }
+          _connect_thread.join();
+          _connecting = false;
+          finish_reconnect();
+          return;
         }
 
-        ASSERT(length > 0);
-        int return_code = (_use_ssl) ? SSL_write(_ssl, buffer, length) : ::write(_socket, buffer, length);
-
-        if (_handshake_complete) {
-          //TODO: log
+        auto now = std::chrono::steady_clock::now();
+        if (now < _next_reconnect_at) {
+          return;
         }
 
-        if (return_code <= 0) {
-          if (_use_ssl) {
-            int err = SSL_get_error(_ssl, length);
-            switch (err) {
-              case SSL_ERROR_WANT_WRITE:
-              {
-                std::cerr << "SSL_ERROR_WANT_WRITE" << std::endl;
-                break;
-              }
-              case SSL_ERROR_WANT_READ:
-              {
-                std::cerr << "SSL_ERROR_WANT_READ" << std::endl;
-                break;
-              }
-              case SSL_ERROR_ZERO_RETURN:
-              {
-                std::cerr << "SSL_ERROR_ZERO_RETURN" << std::endl;
-                break;
-              }
-              case SSL_ERROR_SYSCALL:
-              {
-                std::cerr << "SSL_ERROR_SYSCALL" << std::endl;
-                break;
-              }
-              case SSL_ERROR_SSL:
-              {
-                std::cerr << "SSL_ERROR_SSL" << std::endl;
-                break;
-              }
-            }
-          }
+        _connect_done = false;
+        _cancel_connect = false;
+        _connecting = true;
+        _connect_thread = std::thread([this]() {
+          _connect_result = open();
+          _connect_done = true;
+        });
+      }
 
-          std::cerr << "SEND FAILED" << std::endl;
-          disconnect();
-          return false;
+      void finish_reconnect() {
+        auto now = std::chrono::steady_clock::now();
+        if (!_connect_result) {
+          drop_attempt(now);
+          return;
         }
 
-        return true;
-      }
-
-      // void send_close(std::string message) {
-      //   send_message(OPCODE_CLOSE, message.c_str(), message.size());
-      // }
+        _subscription_map.clear();
+        _pending_unsubscribes.clear();
+        _unsubscribes.clear();
+        for (auto& [subscriptionId, subscription] : _subscriptions) {
+          send_subscribe(subscriptionId, subscription);
+        }
 
-      // void send_ping(std::string message) {
-      //   send_message(OPCODE_PING, message.c_str(), message.size());
-      // }
+        if (!is_connected()) {
+          drop_attempt(now);
+          return;
+        }
 
-      // void send_pong(std::string message) {
-      //   send_message(OPCODE_PONG, message.c_str(), message.size());
-      // }
+        uint64_t downtime_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _disconnected_at).count();
+        _reconnect_attempts = 0;
+        if (_on_reconnect) {
+          _on_reconnect(downtime_ms);
+        }
+      }
 
-      void send_message(json j) {
-        std::string message = j.dump();
-        send_message(OPCODE_TEXT, message.c_str(), message.size());
+      void drop_attempt(std::chrono::steady_clock::time_point now) {
+        close_socket();
+        _handshake_complete = false;
+        auto backoff = _reconnect_min_backoff * (1 << std::min(_reconnect_attempts, 16));
+        _next_reconnect_at = now + std::min(backoff, _reconnect_max_backoff);
+        _reconnect_attempts++;
       }
 
     public:
@@ -1931,6 +5313,8 @@ namespace many {
       ~WebSocketClient() {
         disconnect();
 
+        inflate_end();
+
         free(_send_buffer);
         free(_recv_buffer);
         free(_message_buffer);
@@ -1942,11 +5326,30 @@ namespace many {
       WebSocketClient& operator=(const WebSocketClient&) = delete;
       WebSocketClient& operator=(WebSocketClient&&) = delete;
 
-      bool is_connected() {
-        return _socket != -1;
+      /**
+       * Returns true once the handshake has completed, and false while a
+       * reconnect is in flight.
+       */
+      bool is_connected() const {
+        return !_connecting && _socket != -1;
       }
 
+      /**
+       * Connects and completes the websocket handshake, blocking until it is done.
+       * After the connection drops, poll() reconnects without blocking.
+       */
       bool connect() {
+        _cancel_connect = false;
+        if (!open()) {
+          return false;
+        }
+        _supervised = true;
+        return true;
+      }
+
+    private:
+
+      bool open() {
         std::size_t index = _url.find("://");
         ASSERT(index != std::string::npos);
         std::string protocol = _url.substr(0, index);
@@ -1961,40 +5364,43 @@ namespace many {
           hostname = hostname.substr(0, index);
         }
 
-        struct hostent *server;
-        server = gethostbyname(hostname.c_str());
-        if (server == NULL) {
-          std::cerr << "Error: gethostbyname() failed" << std::endl;
+        // getaddrinfo rather than gethostbyname, which is not safe on the reconnect thread
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo *addresses = nullptr;
+        if (getaddrinfo(hostname.c_str(), nullptr, &hints, &addresses) != 0) {
+          std::cerr << "Error: getaddrinfo() failed" << std::endl;
           return false;
         }
 
-        ASSERT(server->h_addrtype == AF_INET);
-
-        int i = 0;
-        while (server->h_addr_list[i] != NULL) {
-          if (connect(hostname, (struct in_addr*)server->h_addr_list[i], port)) {
-            return true;
-          }
-          i++;
+        bool connected = false;
+        for (struct addrinfo *address = addresses; address != nullptr && !connected; address = address->ai_next) {
+          connected = connect(hostname, &((struct sockaddr_in*)address->ai_addr)->sin_addr, port);
         }
+        freeaddrinfo(addresses);
 
-        return false;
+        return connected;
       }
 
-    private:
-
       bool connect(const std::string& hostname, struct in_addr *addr, uint16_t port) {
         ASSERT(_socket == -1);
 
         _handshake_complete = false;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(HANDSHAKE_TIMEOUT_MS);
 
         _socket = socket(AF_INET, SOCK_STREAM, 0);
         if (_socket < 0) {
           std::cerr << "Error: socket() failed" << std::endl;
-          disconnect();
+          drop();
           return false;
         }
 
+        if (_receive_timestamps && !enable_receive_timestamps(_socket)) {
+          std::cerr << "Error: receive timestamps not supported" << std::endl;
+        }
+
         struct sockaddr_in localaddr;
         memset(&localaddr, 0, sizeof(localaddr));
         localaddr.sin_family = AF_INET;
@@ -2008,16 +5414,33 @@ namespace many {
         bzero(&remoteaddr, sizeof(remoteaddr));
         remoteaddr.sin_family = AF_INET;
         remoteaddr.sin_port = htons(port);
-        remoteaddr.sin_addr.s_addr = *(long *)addr;
-
-        std::string address = inet_ntoa(*addr);
-
-        if (::connect(_socket, (sockaddr *)&remoteaddr, (int)sizeof(remoteaddr)) == -1) {
+        remoteaddr.sin_addr = *addr;
+
+        char address[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, addr, address, sizeof(address));
+
+        // Connect and run the TLS handshake without blocking, so neither outlasts the
+        // deadline or keeps disconnect() waiting on the reconnect thread
+        int flags = fcntl(_socket, F_GETFL, 0);
+        fcntl(_socket, F_SETFL, flags | O_NONBLOCK);
+        int result = ::connect(_socket, (sockaddr *)&remoteaddr, (int)sizeof(remoteaddr));
+        if (result == -1 && errno == EINPROGRESS && wait_for_socket(POLLOUT, deadline)) {
+          int error = 0;
+          socklen_t length = sizeof(error);
+          if (getsockopt(_socket, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0) {
+            result = 0;
+          }
+        }
+        if (result == -1) {
+          if (_cancel_connect) {
+            drop();
+            return false;
+          }
           std::cerr << "CONNECT FAILED" << std::endl;
           std::cerr << "  socket = " << std::to_string(_socket) << std::endl;
           std::cerr << "  address = " << address << std::endl;
           std::cerr << "  port = " << std::to_string(port) << std::endl;
-          disconnect();
+          drop();
           return false;
         }
 
@@ -2027,7 +5450,7 @@ namespace many {
           _ssl_ctx = SSL_CTX_new(method);
           if (_ssl_ctx == NULL) {
             std::cerr << "Error: SSL_CTX_new() failed" << std::endl;
-            disconnect();
+            drop();
             return false;
           }
 
@@ -2041,13 +5464,13 @@ namespace many {
                 std::cerr << str << std::endl;
               }
             }
-            disconnect();
+            drop();
             return false;
           }
 
           if (SSL_set_fd(_ssl, _socket) == 0) {
             std::cerr << "Error: SSL_set_fd() failed" << std::endl;
-            disconnect();
+            drop();
             return false;
           }
 
@@ -2059,17 +5482,21 @@ namespace many {
             if (ret == 1) {
               break;
             }
-            else if (SSL_get_error(_ssl, ret) == SSL_ERROR_WANT_READ) {
-              // Not enough data because we are using non-blocking IO.
+
+            int err = SSL_get_error(_ssl, ret);
+            if ((err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) && wait_for_socket(err == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT, deadline)) {
+              continue;
             }
-            else {
+            if (!_cancel_connect) {
               std::cerr << "Error: SSL_connect() failed" << std::endl;
-              disconnect();
-              return false;
             }
+            drop();
+            return false;
           }
         }
 
+        fcntl(_socket, F_SETFL, flags);
+
         // std::cout << "CONNECT" << std::endl;
         // std::cout << "  socket = " << std::to_string(_socket) << std::endl;
         // std::cout << "  address = " << address << std::endl;
@@ -2085,11 +5512,30 @@ namespace many {
         send_length += sprintf(&_send_buffer[send_length], "Connection: Upgrade\r\n");
         send_length += sprintf(&_send_buffer[send_length], "Sec-WebSocket-Key: %s\r\n", websocket_key.c_str());
         send_length += sprintf(&_send_buffer[send_length], "Sec-WebSocket-Version: 13\r\n");
+#ifdef MANY_PERMESSAGE_DEFLATE
+        if (_deflate_requested) {
+          send_length += sprintf(&_send_buffer[send_length], "Sec-WebSocket-Extensions: permessage-deflate; client_no_context_takeover%s\r\n", _deflate_context_takeover ? "" : "; server_no_context_takeover");
+        }
+#endif
         send_length += sprintf(&_send_buffer[send_length], "\r\n");
 
+        _deflate_active = false;
+        _deflate_server_no_context_takeover = false;
+        inflate_end();
+
         write(_send_buffer, send_length);
 
-        while (is_connected()) {
+        while (_socket != -1) {
+          if (std::chrono::steady_clock::now() > deadline) {
+            std::cerr << "HANDSHAKE TIMEOUT" << std::endl;
+            drop();
+            return false;
+          }
+          if (_cancel_connect) {
+            drop();
+            return false;
+          }
+
           int length;
           char *buffer = read(length);
 
@@ -2097,13 +5543,18 @@ namespace many {
             if (validate_handshake(buffer, length)) {
               //end_read(0);
               _handshake_complete = true;
+              _ping_outstanding = false;
+              _ping_sent_at = std::chrono::steady_clock::now();
               *((uint32_t *)_send_mask) = rand();
+              if (_spin) {
+                apply_spin();
+              }
               return true;
             }
             else {
               //end_read(0);
               std::cerr << "HANDSHAKE FAILED" << std::endl;
-              disconnect();
+              drop();
               return false;
             }
 
@@ -2114,28 +5565,145 @@ namespace many {
         return false;
       }
 
-    public:
-
-      bool disconnect() {
-        if (_use_ssl) {
-          if (_ssl != nullptr) {
-            SSL_shutdown(_ssl);
-            SSL_free(_ssl);
-            _ssl = nullptr;
+      /**
+       * Waits for the connecting socket to be ready for events. Returns false at the
+       * deadline, or as soon as disconnect() cancels the connect.
+       */
+      bool wait_for_socket(short events, std::chrono::steady_clock::time_point deadline) {
+        while (!_cancel_connect) {
+          auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+          if (remaining <= 0) {
+            std::cerr << "HANDSHAKE TIMEOUT" << std::endl;
+            return false;
           }
-          if (_ssl_ctx != nullptr) {
-            SSL_CTX_free(_ssl_ctx);
-            _ssl_ctx = nullptr;
+          struct pollfd fd = { _socket, events, 0 };
+          int rv = ::poll(&fd, 1, (int)std::min<int64_t>(remaining, 10));
+          if (rv > 0) {
+            return true;
+          }
+          if (rv < 0 && errno != EINTR) {
+            return false;
           }
         }
-        if (_socket != -1) {
-          close(_socket);
-          _socket = -1;
+        return false;
+      }
+
+    public:
+
+      bool disconnect() {
+        _cancel_connect = true;
+        if (_connect_thread.joinable()) {
+          _connect_thread.join();
         }
+        _connecting = false;
+        _supervised = false;
+        close_socket();
+        _handshake_complete = false;
+        _message_start = 0;
+        _message_end = 0;
         return true;
       }
 
+      /**
+       * Enables or disables automatic reconnects after a read or write error.
+       *
+       * @param enabled Whether poll() should reconnect and replay subscriptions
+       * @param min_backoff_ms Delay before the first reconnect attempt
+       * @param max_backoff_ms Upper bound for the exponential backoff between attempts
+       */
+      void set_reconnect(bool enabled, uint64_t min_backoff_ms = 100, uint64_t max_backoff_ms = 5000) {
+        _reconnect = enabled;
+        _reconnect_min_backoff = std::chrono::milliseconds(min_backoff_ms);
+        _reconnect_max_backoff = std::chrono::milliseconds(max_backoff_ms);
+      }
+
+      /**
+       * Configures the client heartbeat. Pings are sent from poll() every interval,
+       * and the connection is dropped (and reconnected) if a pong is overdue.
+       *
+       * @param interval_ms Time between pings, or 0 to disable pings
+       * @param timeout_ms Time to wait for a pong before dropping the connection
+       */
+      void set_heartbeat(uint64_t interval_ms, uint64_t timeout_ms = 5000) {
+        _ping_interval = std::chrono::milliseconds(interval_ms);
+        _pong_timeout = std::chrono::milliseconds(timeout_ms);
+      }
+
+      /**
+       * Requests the permessage-deflate extension (RFC 7692) on the next connect.
+       * Only available when compiled with MANY_PERMESSAGE_DEFLATE (link with -lz).
+       *
+       * @param enabled Whether to offer permessage-deflate in the handshake
+       * @param context_takeover Whether the server may keep its compression context between messages
+       */
+      void set_permessage_deflate(bool enabled, bool context_takeover = true) {
+        _deflate_requested = enabled;
+        _deflate_context_takeover = context_takeover;
+      }
+
+      /**
+       * Returns true if permessage-deflate was negotiated on the current connection,
+       * and false while there is none, such as while a reconnect is in flight.
+       */
+      bool is_deflate_active() const {
+        return is_connected() && _deflate_active;
+      }
+
+      /**
+       * Returns compression ratio and inflate time metrics for received messages.
+       * Only poll() updates them, so a reconnect in flight leaves them as they were.
+       */
+      const DeflateStats& deflate_stats() const {
+        return _deflate_stats;
+      }
+
+      /**
+       * Returns the parse arena's stats; it is reset after every dispatched message.
+       */
+      const Arena::Stats& arena_stats() const {
+        return _arena.stats();
+      }
+
+      /**
+       * Returns the smoothed ping round-trip time in microseconds, or 0 before the first pong.
+       */
+      uint64_t rtt_us() const {
+        return _rtt_us;
+      }
+
+      /**
+       * Returns the most recent ping round-trip time in microseconds.
+       */
+      uint64_t last_rtt_us() const {
+        return _last_rtt_us;
+      }
+
+      /**
+       * Drops the connection so the next poll() reconnects and replays every
+       * subscription. Does nothing while a reconnect is already in flight.
+       */
+      void restart() {
+        if (!_connecting) {
+          drop();
+        }
+      }
+
+      /**
+       * Sets a callback that is called after a successful reconnect, with the downtime in milliseconds.
+       */
+      void on_reconnect(std::function<void(uint64_t)> callback) {
+        _on_reconnect = callback;
+      }
+
       void poll() {
+        if (is_reconnecting()) {
+          reconnect();
+        }
+
+        if (!_confirmation_batches.empty()) {
+          complete_confirmations(std::chrono::steady_clock::now());
+        }
+
         if (!is_connected() || !_handshake_complete) {
           return;
         }
@@ -2145,7 +5713,7 @@ namespace many {
 
         if ((_message_end + length) >= MESSAGE_BUFFER_SIZE) {
           std::cerr << "Message buffer out of space." << std::endl;
-          disconnect();
+          drop();
           _message_start = 0;
           _message_end = 0;
           return;
@@ -2157,12 +5725,13 @@ namespace many {
         while ((_message_start + 1) < _message_end) {
           uint8_t opcode = _message_buffer[_message_start] & 0x0F;
           bool fin = ((_message_buffer[_message_start] >> 7) & 0x01) != 0;
+          bool compressed = (_message_buffer[_message_start] & RSV1_FLAG) != 0;
 
           bool mask = ((_message_buffer[_message_start + 1] >> 7) & 0x01) != 0;
 
           if (mask) {
             std::cerr << "Mask not expected." << std::endl;
-            disconnect();
+            drop();
             _message_start = 0;
             _message_end = 0;
             return;
@@ -2197,59 +5766,54 @@ namespace many {
 
           ASSERT((_message_start + payload_size) <= _message_end);
 
+          // Step past the frame first, so a callback that throws does not see it again
+          const char* payload = &_message_buffer[_message_start];
+          _message_start += payload_size;
+
           switch (opcode) {
             case OPCODE_TEXT:
             {
-              if (_message_buffer[_message_start] != '{') {
+              if (compressed && _deflate_active) {
+                if (!inflate_message(payload, payload_size)) {
+                  std::cerr << "Inflate failed." << std::endl;
+                  drop();
+                  return;
+                }
+                if (_inflate_length > 0) {
+                  dispatch(_inflated, _inflate_length);
+                }
+                break;
+              }
+
+              if (payload[0] != '{') {
                 std::cerr << "Expected '{'." << std::endl;
-                disconnect();
+                drop();
                 _message_start = 0;
                 _message_end = 0;
                 return;
               }
 
               if (payload_size > 0) {
-                std::string message = std::string(&_message_buffer[_message_start], payload_size);
-                json j = json::parse(message);
-
-                if (j.contains("params")) {
-                  std::string method = j["method"];
-                  int subscription = j["params"]["subscription"];
-                  if (_subscription_map.find(subscription) != _subscription_map.end()) {
-                    int subscription_id = _subscription_map[subscription];
-                    if (_subscriptions.find(subscription_id) != _subscriptions.end()) {
-                      _subscriptions[subscription_id](j["params"]);
-                    }
-                  }
-                } else if (j.contains("id") && j.contains("result")) {
-                  int id = j["id"];
-                  int result = j["result"];
-                  _subscription_map[result] = id;
-                }
+                dispatch(payload, payload_size);
               }
               break;
             }
             case OPCODE_CLOSE:
             {
-              disconnect();
+              drop();
               return;
             }
             case OPCODE_PING:
             {
-              //if (_pong_message.size() > 0)
-              //{
-                //send_pong(_pong_message);
-              //}
+              send_pong(payload, payload_size);
               break;
             }
             case OPCODE_PONG:
             {
-              //LastPongTimestamp = timestamp;
+              on_pong(payload, payload_size);
               break;
             }
           }
-
-          _message_start += payload_size;
         }
 
         if (_message_start == _message_end) {
@@ -2262,47 +5826,213 @@ namespace many {
           _message_end -= _message_start;
           _message_start = 0;
         }
+
+        // After draining the socket, so a pong that has already arrived is counted
+        if (is_connected()) {
+          heartbeat();
+        }
       }
 
       int subscribe(std::string method, json params, std::function<void(json)> callback) {
+        return subscribe(reserve_subscription_id(), method, params, callback);
+      }
+
+      /**
+       * Subscribe with an id from reserve_subscription_id(). This lets another
+       * thread hand out the id before the subscription is sent.
+       */
+      int subscribe(int subscriptionId, std::string method, json params, std::function<void(json)> callback) {
+        return subscribe(subscriptionId, { method, params, callback, nullptr });
+      }
+
+      int subscribe(int subscriptionId, Subscription subscription) {
+        if (is_reconnecting()) {
+          // Sent when the reconnect replays every subscription
+          _subscriptions[subscriptionId] = std::move(subscription);
+          return subscriptionId;
+        }
+
         if (!is_connected()) {
           connect();
         }
         ASSERT(is_connected());
 
-        int subscriptionId = ++_nextSubscriptionId;
-        if (params.is_null()) {
-          send_message({
-            {"jsonrpc", "2.0"},
-            {"id", subscriptionId},
-            {"method", method},
-          });
-        } else {
-          send_message({
-            {"jsonrpc", "2.0"},
-            {"id", subscriptionId},
-            {"method", method},
-            {"params", params},
-          });
+        _subscriptions[subscriptionId] = std::move(subscription);
+        send_subscribe(subscriptionId, _subscriptions[subscriptionId]);
+        return subscriptionId;
+      }
+
+      /**
+       * Moves a subscription to another client, keeping its id and callback.
+       *
+       * @param subscriptionId The subscription to move
+       * @param method The unsubscribe method, e.g. "accountUnsubscribe"
+       * @param to The client to subscribe on
+       *
+       * @return false if the subscription was not found
+       */
+      bool move_subscription(int subscriptionId, std::string method, WebSocketClient& to) {
+        auto it = _subscriptions.find(subscriptionId);
+        if (it == _subscriptions.end()) {
+          return false;
         }
+        Subscription subscription = it->second;
+        unsubscribe(subscriptionId, method);
+        to.subscribe(subscriptionId, std::move(subscription));
+        return true;
+      }
 
-        _subscriptions[subscriptionId] = callback;
-        return subscriptionId;
+      /**
+       * Enables kernel receive timestamps (see enable_receive_timestamps).
+       */
+      void set_receive_timestamps(bool enabled) {
+        _receive_timestamps = enabled;
+        if (enabled && is_connected() && !enable_receive_timestamps(_socket)) {
+          std::cerr << "Error: receive timestamps not supported" << std::endl;
+        }
+      }
+
+      /**
+       * Enables spin mode: after the handshake the socket is non-blocking with
+       * SO_BUSY_POLL, and poll() reads directly instead of calling select() first.
+       * Meant for a thread that does nothing but poll, pinned to its own core.
+       *
+       * @param enabled Whether to spin
+       * @param busy_poll_us How long the kernel busy-polls the NIC queue on each read
+       */
+      void set_spin(bool enabled, int busy_poll_us = 50) {
+        _spin = enabled;
+        _busy_poll_us = busy_poll_us;
+        if (is_connected() && _handshake_complete) {
+          apply_spin();
+        }
+      }
+
+      /**
+       * Returns the receive time of the data that completed the frame being
+       * dispatched, in CLOCK_REALTIME nanoseconds. This is the kernel timestamp
+       * when receive timestamps are enabled, otherwise the time it was read.
+       */
+      uint64_t last_receive_ns() const {
+        return _last_receive_ns;
+      }
+
+      /**
+       * Returns true if the server has confirmed the subscription on the current connection
+       */
+      bool is_confirmed(int subscriptionId) const {
+        for (auto& mapping : _subscription_map) {
+          if (mapping.second == subscriptionId) {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      /**
+       * Returns the number of active subscriptions on this client
+       */
+      size_t subscription_count() const {
+        return _subscriptions.size();
+      }
+
+      /**
+       * Returns true while the connection is down and poll() is trying to reconnect
+       */
+      bool is_reconnecting() const {
+        return _connecting || (!is_connected() && _supervised && _reconnect);
       }
 
+      /**
+       * Subscribes to many streams at once. The subscribe frames are packed into a
+       * few large writes instead of one write per subscription, and the report is
+       * delivered from poll() once every subscription is confirmed, rejected, or
+       * has timed out.
+       *
+       * @param subscriptions The subscriptions to add
+       * @param timeout_ms How long to wait for the confirmations
+       * @param callback Called with the report
+       *
+       * @return The subscription ids, in the same order as subscriptions
+       */
+      std::vector<int> subscribe_many(const std::vector<Subscription>& subscriptions, uint64_t timeout_ms, std::function<void(const SubscribeReport&)> callback) {
+        std::vector<int> subscriptionIds;
+        begin_batch();
+        for (auto& subscription : subscriptions) {
+          subscriptionIds.push_back(subscribe(reserve_subscription_id(), subscription));
+        }
+        end_batch();
+        track_confirmations(subscriptionIds, timeout_ms, callback);
+        return subscriptionIds;
+      }
+
+      /**
+       * Holds back subscribe and unsubscribe frames until end_batch(), so they go
+       * out in a few large writes.
+       */
+      void begin_batch() {
+        _batch_writes = true;
+      }
+
+      /**
+       * Writes the frames held back since begin_batch().
+       */
+      void end_batch() {
+        _batch_writes = false;
+        flush_writes();
+      }
+
+      /**
+       * Reports when every subscription in subscriptionIds is confirmed, rejected,
+       * or has gone timeout_ms without a confirmation. The callback runs from poll().
+       *
+       * @param subscriptionIds The subscriptions to wait for
+       * @param timeout_ms How long to wait for the confirmations
+       * @param callback Called with the report
+       */
+      void track_confirmations(const std::vector<int>& subscriptionIds, uint64_t timeout_ms, std::function<void(const SubscribeReport&)> callback) {
+        ConfirmationBatch batch;
+        batch.pending.insert(subscriptionIds.begin(), subscriptionIds.end());
+        batch.started_at = std::chrono::steady_clock::now();
+        batch.deadline = batch.started_at + std::chrono::milliseconds(timeout_ms);
+        batch.callback = callback;
+        _confirmation_batches.push_back(std::move(batch));
+      }
+
+      /**
+       * Returns a new subscription id. This is safe to call from any thread.
+       */
+      int reserve_subscription_id() {
+        return ++_nextSubscriptionId;
+      }
+
+      /**
+       * Removes a subscription. If the server has not confirmed it yet, the
+       * unsubscribe is sent when the confirmation arrives.
+       *
+       * @param subscriptionId The subscription to remove
+       * @param method The unsubscribe method, e.g. "accountUnsubscribe"
+       */
       void unsubscribe(int subscriptionId, std::string method) {
         if (_subscriptions.find(subscriptionId) != _subscriptions.end()) {
-          if (is_connected()) {
-            send_message({
-              {"jsonrpc", "2.0"},
-              {"id", subscriptionId},
-              {"method", method},
-              {"params", {
-                subscriptionId,
-              }},
-            });
+          bool mapped = false;
+          for (auto it = _subscription_map.begin(); it != _subscription_map.end(); ++it) {
+            if (it->second == subscriptionId) {
+              if (is_connected()) {
+                send_unsubscribe(method, it->first);
+              }
+              _subscription_map.erase(it);
+              mapped = true;
+              break;
+            }
+          }
+          if (!mapped && is_connected()) {
+            _pending_unsubscribes[subscriptionId] = method;
           }
           _subscriptions.erase(subscriptionId);
+          for (auto& batch : _confirmation_batches) {
+            batch.pending.erase(subscriptionId);
+          }
         }
       }
 
@@ -22,19 +22,8 @@ using namespace many;
 
 #define LAMPORTS_PER_SOL 1000000000
 
-#define NATIVE_MINT PublicKey("So11111111111111111111111111111111111111112")
-
-#define SYSTEM_PROGRAM PublicKey("11111111111111111111111111111111")
-#define SYSVAR_RENT_PUBKEY PublicKey("SysvarRent111111111111111111111111111111111")
-#define SYSVAR_CLOCK_PUBKEY PublicKey("SysvarC1ock11111111111111111111111111111111")
-#define SYSVAR_REWARDS_PUBKEY PublicKey("SysvarRewards1111111111111111111111111111111")
-#define SYSVAR_STAKE_HISTORY_PUBKEY PublicKey("SysvarStakeHistory1111111111111111111111111")
-#define SYSVAR_INSTRUCTIONS_PUBKEY PublicKey("Sysvar1nstructions1111111111111111111111111")
-
-#define TOKEN_PROGRAM_ID PublicKey("TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA")
-#define ASSOCIATED_TOKEN_PROGRAM_ID PublicKey("ATokenGPvbdGVxr1b2hvZbsiqW5xWH25efTNsLJA8knL")
-
 #define MAX_SEED_LENGTH 32
+#define MAX_SEEDS 16
 #define PACKET_DATA_SIZE 1232
 #define PRIVATE_KEY_LENGTH 64
 #define PUBLIC_KEY_LENGTH 32
@@ -105,49 +94,66 @@ namespace solana {
     }
   }
 
-  struct PublicKey {
+  /**
+   * A 32-byte public key. It is trivially copyable and 32-byte aligned so that
+   * comparisons and hashing work on whole 64-bit or 256-bit words.
+   */
+  struct alignas(32) PublicKey {
     /** An array of bytes representing the Pubkey */
     std::array<uint8_t, PUBLIC_KEY_LENGTH> bytes;
 
-    PublicKey() {
-      for (int i = 0; i < PUBLIC_KEY_LENGTH; i++) {
-        bytes[i] = 0;
-      }
-    }
+    constexpr PublicKey() : bytes{} {}
+
+    constexpr PublicKey(const std::array<uint8_t, PUBLIC_KEY_LENGTH>& value) : bytes(value) {}
 
     PublicKey(const std::string& value) {
-      size_t size = PUBLIC_KEY_LENGTH;
-      base58::b58tobin(bytes.data(), &size, value.c_str(), 0);
+      if (!base58::decode_32(value.data(), value.size(), bytes.data())) {
+        bytes.fill(0);
+      }
     }
 
     PublicKey(const uint8_t* value) {
-      for (int i = 0; i < PUBLIC_KEY_LENGTH; i++) {
-        bytes[i] = value[i];
-      }
+      memcpy(bytes.data(), value, PUBLIC_KEY_LENGTH);
     }
 
-    PublicKey(const PublicKey& other) {
-      for (int i = 0; i < PUBLIC_KEY_LENGTH; i++) {
-        bytes[i] = other.bytes[i];
-      }
+    /**
+     * Returns the i-th 64-bit word of the key in memory order
+     */
+    uint64_t word(size_t i) const {
+      uint64_t value;
+      memcpy(&value, bytes.data() + 8 * i, sizeof(value));
+      return value;
     }
 
-    bool operator==(const PublicKey& other) const {
-      for (int i = 0; i < PUBLIC_KEY_LENGTH; i++) {
-        if (bytes[i] != other.bytes[i]) {
-          return false;
+    constexpr bool operator==(const PublicKey& other) const {
+      if (__builtin_is_constant_evaluated()) {
+        for (int i = 0; i < PUBLIC_KEY_LENGTH; i++) {
+          if (bytes[i] != other.bytes[i]) {
+            return false;
+          }
         }
+        return true;
       }
-      return true;
+#ifdef __AVX2__
+      __m256i a = _mm256_load_si256((const __m256i*)bytes.data());
+      __m256i b = _mm256_load_si256((const __m256i*)other.bytes.data());
+      return _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)) == -1;
+#else
+      return ((word(0) ^ other.word(0)) | (word(1) ^ other.word(1)) | (word(2) ^ other.word(2)) | (word(3) ^ other.word(3))) == 0;
+#endif
     }
 
+    constexpr bool operator!=(const PublicKey& other) const {
+      return !(*this == other);
+    }
+
+    /** Orders keys by their bytes, most significant first */
     bool operator<(const PublicKey& other) const {
-      for (int i = 0; i < PUBLIC_KEY_LENGTH; i++) {
-        if (bytes[i] < other.bytes[i]) {
-          return true;
-        }
-        else if (bytes[i] > other.bytes[i]) {
-          return false;
+      for (size_t i = 0; i < PUBLIC_KEY_LENGTH / 8; i++) {
+        uint64_t a = __builtin_bswap64(word(i));
+        uint64_t b = __builtin_bswap64(other.word(i));
+        if (a != b) {
+          return a < b;
         }
       }
       return false;
@@ -156,13 +162,7 @@ namespace solana {
     /**
      * Returns the base-58 representation of the public key
      */
-    std::string to_base58() const {
-      char temp[45];
-      memset(temp, 0, 45);
-      size_t size = 45;
-      base58::b58enc(temp, &size, bytes.data(), bytes.size());
-      return std::string(temp, size - 1);
-    }
+    std::string to_base58() const;
 
     /**
      * Returns a buffer representation of the public key
@@ -175,13 +175,65 @@ namespace solana {
      * Check if this publickey is on the ed25519 curve
      */
     bool is_on_curve() const {
-      libsodium::ge25519_p3 point;
-      if (libsodium::ge25519_is_canonical(bytes.data()) == 0 || libsodium::ge25519_frombytes(&point, bytes.data()) != 0) {
-        return false;
+      return libsodium::ge25519_is_canonical(bytes.data()) != 0 && libsodium::ge25519_is_on_curve(bytes.data()) != 0;
+    }
+
+    /**
+     * A program address seed. It views bytes owned by the caller, which must stay alive
+     * for the call.
+     */
+    struct Seed {
+      const uint8_t* data;
+      size_t size;
+
+      Seed(const uint8_t* data, size_t size) : data(data), size(size) {}
+      Seed(const std::vector<uint8_t>& seed) : data(seed.data()), size(seed.size()) {}
+      Seed(const std::string& seed) : data((const uint8_t*)seed.data()), size(seed.size()) {}
+      template <size_t N>
+      Seed(const char (&seed)[N]) : data((const uint8_t*)seed), size(N - 1) {}
+      Seed(const PublicKey& key) : data(key.bytes.data()), size(PUBLIC_KEY_LENGTH) {}
+    };
+
+  private:
+    template <typename Seeds>
+    static void hash_seeds(sha256::State& state, const Seeds& seeds) {
+      for (Seed seed : seeds) {
+        if (seed.size > MAX_SEED_LENGTH) {
+          throw std::runtime_error("Max seed length exceeded");
+        }
+        state.update(seed.data, seed.size);
       }
-      return true;
     }
 
+    /**
+     * Finishes SHA-256(seeds || program_id || "ProgramDerivedAddress") from a copy of the seeds' state.
+     */
+    static void hash_program_address(sha256::State state, const PublicKey& program_id, PublicKey& address) {
+      static const char marker[] = "ProgramDerivedAddress";
+      state.update(program_id.bytes.data(), PUBLIC_KEY_LENGTH);
+      state.update(marker, sizeof(marker) - 1);
+      state.finish(address.bytes.data());
+    }
+
+    template <typename Seeds>
+    static std::optional<PublicKey> create_program_address_from(const Seeds& seeds, size_t count, const PublicKey& program_id) {
+      if (count > MAX_SEEDS) {
+        throw std::runtime_error("Max seeds exceeded");
+      }
+      sha256::State state;
+      hash_seeds(state, seeds);
+      PublicKey address;
+      hash_program_address(state, program_id, address);
+      if (address.is_on_curve()) {
+        return std::nullopt;
+      }
+      return address;
+    }
+
+    template <typename Seeds>
+    static std::tuple<PublicKey, uint8_t> find_program_address_from(const Seeds& seeds, size_t count, const PublicKey& program_id);
+
+  public:
     /**
      * Derive a program address from seeds and a program ID.
      *
@@ -192,28 +244,11 @@ namespace solana {
       const std::vector<std::vector<uint8_t>>& seeds,
       const PublicKey& program_id
     ) {
-      std::vector<uint8_t> buffer;
-      for (auto seed : seeds) {
-        if (seed.size() > MAX_SEED_LENGTH) {
-          throw std::runtime_error("Max seed length exceeded");
-        }
-        buffer.insert(buffer.end(), seed.begin(), seed.end());
-      }
-      buffer.insert(buffer.end(), program_id.bytes.begin(), program_id.bytes.end());
-      std::string ProgramDerivedAddress = "ProgramDerivedAddress";
-      buffer.insert(buffer.end(), ProgramDerivedAddress.begin(), ProgramDerivedAddress.end());
-
-      // Create a sha256 hash
-      unsigned char hash[crypto_hash_sha256_BYTES];
-      memset(hash, 0, crypto_hash_sha256_BYTES);
-      static_assert(crypto_hash_sha256_BYTES == PUBLIC_KEY_LENGTH);
-      crypto_hash_sha256(hash, buffer.data(), buffer.size());
+      return create_program_address_from(seeds, seeds.size(), program_id);
+    }
 
-      PublicKey pubkey = PublicKey((uint8_t*)hash);
-      if (pubkey.is_on_curve()) {
-        return std::nullopt;
-      }
-      return pubkey;
+    static std::optional<PublicKey> create_program_address(std::initializer_list<Seed> seeds, const PublicKey& program_id) {
+      return create_program_address_from(seeds, seeds.size(), program_id);
     }
 
     /**
@@ -221,31 +256,69 @@ namespace solana {
      *
      * Valid program addresses must fall off the ed25519 curve.  This function
      * iterates a nonce until it finds one that when combined with the seeds
-     * results in a valid program address.
+     * results in a valid program address. The seeds are hashed once and the
+     * SHA-256 state is copied for every nonce, without allocating. Results come
+     * from ProgramAddressCache::global() once it is enabled.
      *
      * @param seeds Seed values used to generate the program address
-     * @param programId Program ID to generate the address for
+     * @param program_id Program ID to generate the address for
      */
     static std::tuple<PublicKey, uint8_t> find_program_address(
       const std::vector<std::vector<uint8_t>>& seeds,
-      const PublicKey& programId
+      const PublicKey& program_id
+    );
+
+    static std::tuple<PublicKey, uint8_t> find_program_address(std::initializer_list<Seed> seeds, const PublicKey& program_id);
+
+    /**
+     * Finds the program address for each list of seeds, spread over a pool of threads.
+     *
+     * @param seeds One list of seeds per address
+     * @param program_id Program ID to generate the addresses for
+     * @param addresses Receives seeds.size() addresses and bumps, in order
+     * @param threads The number of threads, 0 for one per core
+     */
+    static void find_program_addresses(
+      const std::vector<std::vector<Seed>>& seeds,
+      const PublicKey& program_id,
+      std::tuple<PublicKey, uint8_t>* addresses,
+      size_t threads = 0
     ) {
-      uint8_t nonce = 255;
-      while (nonce != 0) {
-        std::vector<std::vector<uint8_t>> seedsWithNonce(seeds.begin(), seeds.end());
-        seedsWithNonce.push_back({nonce});
-
-        std::optional<PublicKey> address = create_program_address(seedsWithNonce, programId);
-        if (address.has_value()) {
-          return std::make_tuple(address.value(), nonce);
-        } else {
-          nonce -= 1;
-        }
-      }
-      throw std::runtime_error("Unable to find a viable program address nonce");
+      many::parallel_for(seeds.size(), [&](size_t i) {
+        addresses[i] = find_program_address_from(seeds[i], seeds[i].size(), program_id);
+      }, threads);
+    }
+
+    static std::vector<std::tuple<PublicKey, uint8_t>> find_program_addresses(
+      const std::vector<std::vector<Seed>>& seeds,
+      const PublicKey& program_id
+    ) {
+      std::vector<std::tuple<PublicKey, uint8_t>> addresses(seeds.size());
+      find_program_addresses(seeds, program_id, addresses.data());
+      return addresses;
     }
   };
 
+  /**
+   * A public key decoded at compile time, e.g. "TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA"_pk.
+   * An invalid literal fails to compile wherever a constant is required.
+   */
+  constexpr PublicKey operator""_pk(const char* value, size_t size) {
+    return PublicKey(base58::decode_constexpr<PUBLIC_KEY_LENGTH>(value, size));
+  }
+
+  inline constexpr PublicKey NATIVE_MINT = "So11111111111111111111111111111111111111112"_pk;
+
+  inline constexpr PublicKey SYSTEM_PROGRAM = "11111111111111111111111111111111"_pk;
+  inline constexpr PublicKey SYSVAR_RENT_PUBKEY = "SysvarRent111111111111111111111111111111111"_pk;
+  inline constexpr PublicKey SYSVAR_CLOCK_PUBKEY = "SysvarC1ock11111111111111111111111111111111"_pk;
+  inline constexpr PublicKey SYSVAR_REWARDS_PUBKEY = "SysvarRewards111111111111111111111111111111"_pk;
+  inline constexpr PublicKey SYSVAR_STAKE_HISTORY_PUBKEY = "SysvarStakeHistory1111111111111111111111111"_pk;
+  inline constexpr PublicKey SYSVAR_INSTRUCTIONS_PUBKEY = "Sysvar1nstructions1111111111111111111111111"_pk;
+
+  inline constexpr PublicKey TOKEN_PROGRAM_ID = "TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA"_pk;
+  inline constexpr PublicKey ASSOCIATED_TOKEN_PROGRAM_ID = "ATokenGPvbdGVxr1b2hvZbsiqW5xWH25efTNsLJA8knL"_pk;
+
   void from_json(const nlohmann::json& j, PublicKey& pubkey) {
     pubkey = PublicKey(j.get<std::string>());
   }
@@ -254,887 +327,3705 @@ namespace solana {
     j = pubkey.to_base58();
   }
 
+  class PublicKeyDecoder : public sax::Decoder {
+    PublicKey* _target = nullptr;
+
+  public:
+    Decoder* bind(PublicKey& target) {
+      _target = &target;
+      return this;
+    }
+
+    bool string(std::string_view value) override {
+      if (!base58::decode_32(value.data(), value.size(), _target->bytes.data())) {
+        _target->bytes.fill(0);
+      }
+      return true;
+    }
+  };
+
+  PublicKeyDecoder sax_decoder(PublicKey*);
+
   std::ostream& operator<<(std::ostream& os, const PublicKey& pubkey) {
     os << pubkey.to_base58();
     return os;
   }
 
-  struct Keypair {
-    std::array<uint8_t, crypto_sign_SECRETKEYBYTES> secret_key;
-    PublicKey public_key;
+}
 
-    Keypair() {
-      auto sodium_result = sodium_init();
-      if (sodium_result == -1) {
-        throw std::runtime_error("Failed to initialize libsodium");
+namespace std {
+  /**
+   * Public keys are hashes or curve points, so their bytes are already uniformly
+   * distributed. Folding the first and last words keeps vanity keys, whose leading
+   * bytes are chosen, just as well spread.
+   */
+  template <>
+  struct hash<solana::PublicKey> {
+    size_t operator()(const solana::PublicKey& key) const noexcept {
+      return (size_t)(key.word(0) ^ key.word(3));
+    }
+  };
+}
+
+namespace solana {
+
+  /**
+   * An open-addressing hash map keyed by PublicKey, for account caches and indexes.
+   *
+   * Slots are probed linearly in one flat array and erase shifts the following
+   * entries back, so no tombstones build up. Inserting may rehash, which invalidates
+   * iterators, pointers and references into the map.
+   */
+  template <typename V>
+  class PubkeyMap {
+  public:
+    using value_type = std::pair<PublicKey, V>;
+
+    template <typename Slot>
+    class Iterator {
+      friend class PubkeyMap;
+      Slot* _slots;
+      const uint8_t* _used;
+      size_t _index;
+      size_t _capacity;
+
+      Iterator(Slot* slots, const uint8_t* used, size_t index, size_t capacity) : _slots(slots), _used(used), _index(index), _capacity(capacity) {
+        skip();
       }
-      for (int i = 0; i < crypto_sign_SECRETKEYBYTES; i++) {
-        secret_key[i] = 0;
+
+      void skip() {
+        while (_index < _capacity && !_used[_index]) {
+          _index++;
+        }
       }
-      public_key = PublicKey();
+
+    public:
+      Slot& operator*() const { return _slots[_index]; }
+      Slot* operator->() const { return &_slots[_index]; }
+      Iterator& operator++() { _index++; skip(); return *this; }
+      bool operator==(const Iterator& other) const { return _index == other._index; }
+      bool operator!=(const Iterator& other) const { return _index != other._index; }
+    };
+
+    using iterator = Iterator<value_type>;
+    using const_iterator = Iterator<const value_type>;
+
+    PubkeyMap() = default;
+
+    explicit PubkeyMap(size_t capacity) {
+      reserve(capacity);
+    }
+
+    size_t size() const {
+      return _size;
+    }
+
+    bool empty() const {
+      return _size == 0;
     }
 
     /**
-     * Create a keypair from a raw secret key byte array.
-     *
-     * This method should only be used to recreate a keypair from a previously
-     * generated secret key. Generating keypairs from a random seed should be done
-     * with the {@link Keypair.from_seed} method.
-     *
-     * @throws error if the provided secret key is invalid and validation is not skipped.
-     *
-     * @param secret_key secret key byte array
-     * @param options: skip secret key validation
+     * Makes room for count keys without rehashing.
      */
-    Keypair(std::array<char, PUBLIC_KEY_LENGTH> secret_key, bool skipValidation = false) {
-      auto sodium_result = sodium_init();
-      if (sodium_result == -1) {
-        throw std::runtime_error("Failed to initialize libsodium");
+    void reserve(size_t count) {
+      size_t capacity = 16;
+      while (capacity * 7 / 8 < count) {
+        capacity *= 2;
       }
-      if (!skipValidation && crypto_sign_ed25519_sk_to_pk((unsigned char *)public_key.bytes.data(), (unsigned char *)secret_key.data()) != 0) {
-        throw std::runtime_error("invalid secret key");
+      if (capacity > _slots.size()) {
+        rehash(capacity);
       }
     }
 
-    ~Keypair() {
+    void clear() {
+      for (size_t i = 0; i < _slots.size(); i++) {
+        if (_used[i]) {
+          _slots[i] = value_type();
+          _used[i] = false;
+        }
+      }
+      _size = 0;
     }
 
     /**
-     * Read a keypair from a file.
-     *
-     * @throws error if the keypair file cannot be read.
-     *
-     * @param path path to keypair file
+     * Returns the value for key, or nullptr if it is not in the map.
      */
-    static Keypair from_file(const std::string &path) {
-      Keypair result = Keypair();
-      std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
-      if (file.is_open()) {
-        std::streamsize size = file.tellg();
-        file.seekg(0, std::ios::beg);
-        if (size == crypto_sign_SECRETKEYBYTES) {
-          file.read((char *)result.secret_key.data(), size);
-          crypto_sign_ed25519_sk_to_pk((unsigned char *)result.public_key.bytes.data(), (unsigned char *)result.secret_key.data());
-        } else {
-          throw std::runtime_error("invalid secret key file");
-        }
-      } else {
-        throw std::runtime_error("could not open secret key file");
-      }
-      return result;
+    V* find(const PublicKey& key) {
+      size_t index = locate(key);
+      return index == NOT_FOUND ? nullptr : &_slots[index].second;
+    }
+
+    const V* find(const PublicKey& key) const {
+      size_t index = locate(key);
+      return index == NOT_FOUND ? nullptr : &_slots[index].second;
+    }
+
+    bool contains(const PublicKey& key) const {
+      return locate(key) != NOT_FOUND;
     }
 
     /**
-     * Create a keypair from a secret key seed.
-     *
-     * @throws error if the provided seed is invalid.
+     * Inserts key with value unless it is already present.
      *
-     * @param seed secret key seed
+     * @return The stored value and whether it was inserted
      */
-    static Keypair from_seed(const uint8_t *seed) {
-      Keypair result = Keypair();
-      crypto_sign_seed_keypair((unsigned char *)result.public_key.bytes.data(), (unsigned char *)result.secret_key.data(), seed);
-      return result;
+    std::pair<V*, bool> insert(const PublicKey& key, V value) {
+      if ((_size + 1) * 8 > _slots.size() * 7) {
+        rehash(_slots.empty() ? 16 : _slots.size() * 2);
+      }
+      size_t mask = _slots.size() - 1;
+      for (size_t index = std::hash<PublicKey>()(key) & mask; ; index = (index + 1) & mask) {
+        if (!_used[index]) {
+          _slots[index] = value_type(key, std::move(value));
+          _used[index] = true;
+          _size++;
+          return { &_slots[index].second, true };
+        }
+        if (_slots[index].first == key) {
+          return { &_slots[index].second, false };
+        }
+      }
     }
 
     /**
-     * Create a new random keypair.
+     * Returns the value for key, inserting a default one if it is not present.
      */
-    static Keypair generate() {
-      Keypair result = Keypair();
-      crypto_sign_keypair((unsigned char *)result.public_key.bytes.data(), (unsigned char *)result.secret_key.data());
-      return result;
+    V& operator[](const PublicKey& key) {
+      V* value = find(key);
+      return value ? *value : *insert(key, V()).first;
     }
 
     /**
-     * Sign a message with the keypair's secret key.
+     * Removes key from the map.
      *
-     * @param message message to sign
+     * @return false if the key was not present
      */
-    std::string sign(const std::vector<uint8_t> message) const {
-      uint8_t sig[crypto_sign_BYTES];
-      unsigned long long sigSize;
-      if (0 != crypto_sign_detached(sig, &sigSize, message.data(), message.size(), secret_key.data())) {
-        throw std::runtime_error("could not sign tx with private key");
+    bool erase(const PublicKey& key) {
+      size_t hole = locate(key);
+      if (hole == NOT_FOUND) {
+        return false;
       }
-      return std::string((char*)sig, sigSize);
+      // Shift back every following entry of the run that may no longer be reachable
+      size_t mask = _slots.size() - 1;
+      for (size_t index = (hole + 1) & mask; _used[index]; index = (index + 1) & mask) {
+        size_t home = std::hash<PublicKey>()(_slots[index].first) & mask;
+        if (((index - home) & mask) >= ((index - hole) & mask)) {
+          _slots[hole] = std::move(_slots[index]);
+          hole = index;
+        }
+      }
+      _slots[hole] = value_type();
+      _used[hole] = false;
+      _size--;
+      return true;
     }
-  };
 
-  struct Account {
-    /** Number of lamports assigned to this account */
-    uint64_t lamports;
-    /** Identifier of the program that owns the account */
-    PublicKey owner;
-    /** Data associated with the account */
-    std::string data;
-    /** Boolean indicating if the account contains a program (and is strictly read-only) */
-    bool executable;
-    /** The epoch at which this account will next owe rent */
-    uint64_t rent_epoch;
-  };
+    iterator begin() { return iterator(_slots.data(), _used.data(), 0, _slots.size()); }
+    iterator end() { return iterator(_slots.data(), _used.data(), _slots.size(), _slots.size()); }
+    const_iterator begin() const { return const_iterator(_slots.data(), _used.data(), 0, _slots.size()); }
+    const_iterator end() const { return const_iterator(_slots.data(), _used.data(), _slots.size(), _slots.size()); }
 
-  void from_json(const json& j, Account& account) {
-    account.lamports = j["lamports"].get<uint64_t>();
-    account.owner = j["owner"].get<PublicKey>();
+  private:
+    static constexpr size_t NOT_FOUND = SIZE_MAX;
 
-    if (j["data"].is_string()) {
-      account.data = j["data"].get<std::string>();
-    } else {
-      auto encoding = j["data"][1].get<std::string>();
-      ASSERT(encoding == "base64");
-      account.data = j["data"][0].get<std::string>();
-    }
+    std::vector<value_type> _slots;
+    std::vector<uint8_t> _used;
+    size_t _size = 0;
 
-    account.executable = j["executable"].get<bool>();
-    account.rent_epoch = j["rentEpoch"].get<uint64_t>();
-  }
+    size_t locate(const PublicKey& key) const {
+      if (_size == 0) {
+        return NOT_FOUND;
+      }
+      size_t mask = _slots.size() - 1;
+      for (size_t index = std::hash<PublicKey>()(key) & mask; _used[index]; index = (index + 1) & mask) {
+        if (_slots[index].first == key) {
+          return index;
+        }
+      }
+      return NOT_FOUND;
+    }
 
-  struct AccountInfo {
-    PublicKey pubkey;
-    Account account;
+    void rehash(size_t capacity) {
+      std::vector<value_type> slots(capacity);
+      std::vector<uint8_t> used(capacity, false);
+      std::swap(slots, _slots);
+      std::swap(used, _used);
+      _size = 0;
+      for (size_t i = 0; i < slots.size(); i++) {
+        if (used[i]) {
+          insert(slots[i].first, std::move(slots[i].second));
+        }
+      }
+    }
   };
 
-  void from_json(const json& j, AccountInfo& accountInfo) {
-    accountInfo.pubkey = j["pubkey"].get<PublicKey>();
-    accountInfo.account = j["account"].get<Account>();
-  }
+  /**
+   * An open-addressing hash set of public keys; see PubkeyMap.
+   */
+  class PubkeySet {
+    struct Empty {};
+    PubkeyMap<Empty> _map;
 
-  struct TokenBalance {
-    /** The raw balance without decimals, as a string representation */
-    uint64_t amount;
-    /** The number of base 10 digits to the right of the decimal place */
-    uint64_t decimals;
+  public:
+    class iterator {
+      friend class PubkeySet;
+      PubkeyMap<Empty>::const_iterator _it;
+      iterator(PubkeyMap<Empty>::const_iterator it) : _it(it) {}
+
+    public:
+      const PublicKey& operator*() const { return _it->first; }
+      const PublicKey* operator->() const { return &_it->first; }
+      iterator& operator++() { ++_it; return *this; }
+      bool operator==(const iterator& other) const { return _it == other._it; }
+      bool operator!=(const iterator& other) const { return _it != other._it; }
+    };
+
+    PubkeySet() = default;
+
+    explicit PubkeySet(size_t capacity) : _map(capacity) {}
+
+    size_t size() const { return _map.size(); }
+    bool empty() const { return _map.empty(); }
+    void reserve(size_t count) { _map.reserve(count); }
+    void clear() { _map.clear(); }
+
+    bool contains(const PublicKey& key) const {
+      return _map.contains(key);
+    }
 
     /**
-     * Returns the balance as a number of tokens, with decimals applied.
+     * @return false if the key was already present
      */
-    double tokens() {
-      return (double) amount / (double) pow(10, decimals);
+    bool insert(const PublicKey& key) {
+      return _map.insert(key, Empty()).second;
     }
+
+    bool erase(const PublicKey& key) {
+      return _map.erase(key);
+    }
+
+    iterator begin() const { return iterator(_map.begin()); }
+    iterator end() const { return iterator(_map.end()); }
   };
 
-  void from_json(const json& j, TokenBalance& tokenAmount) {
-    tokenAmount.amount = stol(j["amount"].get<std::string>());
-    tokenAmount.decimals = j["decimals"].get<uint64_t>();
-  }
+  /**
+   * A bounded, thread-safe cache from public keys to values that are costly to compute
+   * and asked for over and over.
+   *
+   * Keys are spread over independently locked shards. Each shard holds up to its
+   * share of the capacity and evicts with the clock algorithm: a hit marks the entry
+   * referenced, and the hand clears marks until it finds an unreferenced entry.
+   */
+  template <typename V>
+  class PubkeyCache {
+    static constexpr size_t SHARDS = 16;
+
+    struct Entry {
+      PublicKey key;
+      V value;
+      bool referenced = false;
+    };
 
-  struct ClusterNode {
-    /** Node public key */
-    PublicKey pubkey;
-    /** Gossip network address for the node */
-    std::string gossip;
-    /** TPU network address for the node */
-    std::string tpu;
-    /** JSON RPC network address for the node, if the JSON RPC service is enabled */
-    std::string rpc;
-    /** The software version of the node, if the version information is available */
-    std::string version;
-    /** The unique identifier of the node's feature set */
-    uint64_t feature_set;
-    /** The shred version the node has been configured to use */
-    uint64_t shred_version;
-  };
+    struct alignas(64) Shard {
+      std::mutex mutex;
+      PubkeyMap<uint32_t> index;
+      std::vector<Entry> entries;
+      size_t hand = 0;
+    };
 
-  void from_json(const json& j, ClusterNode& cluster_node) {
-    if (!j["featureSet"].is_null()) {
-      cluster_node.feature_set = j["featureSet"].get<uint64_t>();
-    }
-    cluster_node.gossip = j["gossip"].get<std::string>();
-    cluster_node.pubkey = j["pubkey"].get<PublicKey>();
-    if (!j["rpc"].is_null()) {
-      cluster_node.rpc = j["rpc"].get<std::string>();
-    }
-    cluster_node.shred_version = j["shredVersion"].get<uint64_t>();
-    if (!j["tpu"].is_null()) {
-      cluster_node.tpu = j["tpu"].get<std::string>();
-    }
-    if (!j["version"].is_null()) {
-      cluster_node.version = j["version"].get<std::string>();
+    std::array<Shard, SHARDS> _shards;
+    size_t _shard_capacity = 1;
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+
+    Shard& shard(const PublicKey& key) {
+      // The maps index by the low bits of the hash, so pick the shard from the high ones
+      return _shards[(std::hash<PublicKey>()(key) >> 56) % SHARDS];
     }
-  }
 
-  struct Identity {
-    PublicKey identity;
-  };
+  public:
+    explicit PubkeyCache(size_t capacity = 4096) {
+      resize(capacity);
+    }
 
-  void from_json(const json& j, Identity& identity) {
-    identity.identity = PublicKey(j["identity"].get<std::string>());
-  }
+    /**
+     * Drops every entry and sets the number of keys the cache holds.
+     */
+    void resize(size_t capacity) {
+      _shard_capacity = std::max<size_t>(1, (capacity + SHARDS - 1) / SHARDS);
+      for (auto& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.index = PubkeyMap<uint32_t>(_shard_capacity);
+        shard.entries.clear();
+        shard.entries.reserve(_shard_capacity);
+        shard.hand = 0;
+      }
+    }
 
-  struct LeaderSchedule {
-    PublicKey leader;
-    std::vector<int> schedule;
-  };
+    /**
+     * Returns the value for key, calling make(key) outside the lock and caching the
+     * result on a miss.
+     */
+    template <typename F>
+    V get(const PublicKey& key, F make) {
+      Shard& shard = this->shard(key);
+      {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (uint32_t* index = shard.index.find(key)) {
+          Entry& entry = shard.entries[*index];
+          entry.referenced = true;
+          _hits.fetch_add(1, std::memory_order_relaxed);
+          return entry.value;
+        }
+      }
 
-  void from_json(const json& j, LeaderSchedule& leader_schedule) {
-    auto it = j.begin();
-    leader_schedule.leader = PublicKey(it.key());
-    leader_schedule.schedule = it.value().get<std::vector<int>>();
-  }
+      _misses.fetch_add(1, std::memory_order_relaxed);
+      V value = make(key);
 
-  struct Logs {
-    std::vector<std::string> logs;
-    std::string signature;
-  };
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      if (shard.index.contains(key)) {
+        return value;
+      }
+      if (shard.entries.size() < _shard_capacity) {
+        shard.index.insert(key, (uint32_t)shard.entries.size());
+        shard.entries.push_back({ key, value, false });
+        return value;
+      }
+      while (shard.entries[shard.hand].referenced) {
+        shard.entries[shard.hand].referenced = false;
+        shard.hand = (shard.hand + 1) % shard.entries.size();
+      }
+      Entry& victim = shard.entries[shard.hand];
+      shard.index.erase(victim.key);
+      shard.index.insert(key, (uint32_t)shard.hand);
+      victim = { key, value, false };
+      shard.hand = (shard.hand + 1) % shard.entries.size();
+      return value;
+    }
 
-  void from_json(const json& j, Logs& logs) {
-    logs.logs = j["logs"].get<std::vector<std::string>>();
-    logs.signature = j["signature"].get<std::string>();
-  }
+    /** The number of lookups answered from the cache */
+    uint64_t hits() const {
+      return _hits.load(std::memory_order_relaxed);
+    }
 
-  struct ResultError {
-    int64_t code;
-    std::string message;
+    /** The number of lookups that had to compute the value */
+    uint64_t misses() const {
+      return _misses.load(std::memory_order_relaxed);
+    }
   };
 
-  void from_json(const json& j, ResultError& t) {
-    t.code = j["code"].get<int64_t>();
-    t.message = j["message"].get<std::string>();
-  }
+  /**
+   * A cache from public keys to their base-58 text, so that requests which name the
+   * same accounts over and over look the text up instead of encoding it again.
+   */
+  class Base58Cache : public PubkeyCache<std::string> {
+    static std::atomic<bool>& enabled() {
+      static std::atomic<bool> enabled{false};
+      return enabled;
+    }
 
-  template <typename T>
-  class Result {
   public:
+    using PubkeyCache::PubkeyCache;
 
-    std::optional<Context> _context;
-    std::optional<T> _result;
-    std::optional<ResultError> _error;
-
-    Result() = default;
+    /**
+     * Returns the base-58 text of key, encoding and caching it on a miss.
+     */
+    std::string get(const PublicKey& key) {
+      return PubkeyCache::get(key, [](const PublicKey& key) {
+        char temp[base58::FixedWidth<PUBLIC_KEY_LENGTH>::MAX_ENCODED_SIZE];
+        return std::string(temp, base58::encode_32(key.bytes.data(), temp));
+      });
+    }
 
-    Result(T result) : _result(result) {}
+    /**
+     * The cache PublicKey::to_base58() uses once enable() is called.
+     */
+    static Base58Cache& global() {
+      static Base58Cache cache;
+      return cache;
+    }
 
-    Result(ResultError error) : _error(error) {}
+    /**
+     * Serves PublicKey::to_base58() from global(), sized to hold capacity keys.
+     * Call it before starting threads that encode keys.
+     */
+    static void enable(size_t capacity = 4096) {
+      global().resize(capacity);
+      enabled().store(true, std::memory_order_release);
+    }
 
-    bool ok() const {
-      return _result != std::nullopt;
+    /**
+     * Goes back to encoding on every PublicKey::to_base58() call.
+     */
+    static void disable() {
+      enabled().store(false, std::memory_order_release);
     }
 
-    T unwrap() {
-      if (_error) {
-        std::cerr << _error->message << std::endl;
-        throw std::runtime_error(_error->message);
-      }
-      return _result.value();
+    static bool is_enabled() {
+      return enabled().load(std::memory_order_acquire);
     }
   };
 
-  template <typename T>
-  void from_json(const json& j, Result<T>& r) {
-    if (j.contains("result")) {
-      if (j["result"].contains("context")) {
-        r._context = j["result"]["context"].get<Context>();
-      }
+  /**
+   * A cache of program address searches, keyed by SHA-256(seeds || program id), which
+   * fixes the result. Associated token accounts and other PDAs that are looked up over
+   * and over skip the bump search and its curve checks.
+   */
+  class ProgramAddressCache : public PubkeyCache<std::pair<PublicKey, uint8_t>> {
+    static std::atomic<bool>& enabled() {
+      static std::atomic<bool> enabled{false};
+      return enabled;
+    }
 
-      if (j["result"].contains("value")) {
-        if (!j["result"]["value"].is_null()) {
-          r._result = j["result"]["value"];
-        }
-      } else {
-        if (!j["result"].is_null()) {
-          r._result = j["result"].get<T>();
-        }
-      }
-    } else if (j.contains("error")) {
-      r._error = j["error"].get<ResultError>();
+  public:
+    using PubkeyCache::PubkeyCache;
+
+    /**
+     * The cache PublicKey::find_program_address() uses once enable() is called.
+     */
+    static ProgramAddressCache& global() {
+      static ProgramAddressCache cache;
+      return cache;
     }
-  }
 
-  struct SlotInfo {
-    /** Currently processing slot */
-    uint64_t slot;
-    /** Parent of the current slot */
-    uint64_t parent;
-    /** The root block of the current slot's fork */
-    uint64_t root;
-  };
+    /**
+     * Serves PublicKey::find_program_address() from global(), sized to hold capacity
+     * addresses. Call it before starting threads that derive addresses.
+     */
+    static void enable(size_t capacity = 4096) {
+      global().resize(capacity);
+      enabled().store(true, std::memory_order_release);
+    }
 
-  void from_json(const json& j, SlotInfo& slot_info) {
-    slot_info.slot = j["slot"].get<uint64_t>();
-    slot_info.parent = j["parent"].get<uint64_t>();
-    slot_info.root = j["root"].get<uint64_t>();
-  }
+    /**
+     * Goes back to searching on every PublicKey::find_program_address() call.
+     */
+    static void disable() {
+      enabled().store(false, std::memory_order_release);
+    }
 
-  struct TokenAccount {
-    /** The account's Pubkey */
-    PublicKey pubkey;
-    /** The account data */
-    struct Account {
-      /** Number of lamports assigned to the account */
-      uint64_t lamports;
-      /** The Pubkey of the program that owns the account */
-      PublicKey owner;
-      struct Data {
-        struct Parsed {
-          struct Info {
-            /** Boolean indicating if the account is native */
-            bool is_native;
-            /** The mint of the token */
-            PublicKey mint;
-            /** The Pubkey of the token account owner */
-            PublicKey owner;
-            /** The amount of tokens */
-            TokenBalance token_amount;
-            /** The account this token account is delegated to */
-            PublicKey delegate;
-            /** Amount delegated */
-            TokenBalance delegated_amount;
-            /** State of the token account (ex: "initialized") */
-            std::string state;
-          } info;
-          /** The account type (ex: "account") */
-          std::string type;
-        } parsed;
-        /* Name of token program (ex: "spl-token") */
-        std::string program;
-        /** The length of the account data */
-        uint64_t space;
-      } data;
-      /** Boolean indicating if the account contains a program (and is strictly read-only) */
-      bool executable;
-      /** The epoch at which this account will next owe rent */
-      uint64_t rent_epoch;
-    } account;
+    static bool is_enabled() {
+      return enabled().load(std::memory_order_acquire);
+    }
   };
 
-  void from_json(const json& j, TokenAccount::Account::Data::Parsed::Info& parsedAccountInfo) {
-    parsedAccountInfo.is_native = j["isNative"].get<bool>();
-    parsedAccountInfo.mint = j["mint"].get<PublicKey>();
-    parsedAccountInfo.owner = j["owner"].get<PublicKey>();
-    parsedAccountInfo.token_amount = j["tokenAmount"].get<TokenBalance>();
-    if (j.contains("delegate")) {
-      parsedAccountInfo.delegate = j["account"]["data"]["parsed"]["info"]["delegate"].get<PublicKey>();
-      parsedAccountInfo.delegated_amount = j["account"]["data"]["parsed"]["info"]["delegatedAmount"].get<TokenBalance>();
+  template <typename Seeds>
+  std::tuple<PublicKey, uint8_t> PublicKey::find_program_address_from(const Seeds& seeds, size_t count, const PublicKey& program_id) {
+    if (count + 1 > MAX_SEEDS) {
+      throw std::runtime_error("Max seeds exceeded");
     }
-    parsedAccountInfo.state = j["state"].get<std::string>();
+    sha256::State prefix;
+    hash_seeds(prefix, seeds);
+
+    auto search = [&](const PublicKey&) {
+      for (int nonce = 255; nonce > 0; nonce--) {
+        uint8_t bump = (uint8_t)nonce;
+        sha256::State state = prefix;
+        state.update(&bump, 1);
+        PublicKey address;
+        hash_program_address(state, program_id, address);
+        if (!address.is_on_curve()) {
+          return std::make_pair(address, bump);
+        }
+      }
+      throw std::runtime_error("Unable to find a viable program address nonce");
+    };
+
+    std::pair<PublicKey, uint8_t> result;
+    if (ProgramAddressCache::is_enabled()) {
+      PublicKey key;
+      hash_program_address(prefix, program_id, key);
+      result = ProgramAddressCache::global().get(key, search);
+    } else {
+      result = search(program_id);
+    }
+    return std::make_tuple(result.first, result.second);
   }
 
-  void from_json(const json& j, TokenAccount::Account::Data::Parsed& parsedAccountData) {
-    parsedAccountData.info = j["info"].get<TokenAccount::Account::Data::Parsed::Info>();
-    parsedAccountData.type = j["type"].get<std::string>();
+  std::tuple<PublicKey, uint8_t> PublicKey::find_program_address(const std::vector<std::vector<uint8_t>>& seeds, const PublicKey& program_id) {
+    return find_program_address_from(seeds, seeds.size(), program_id);
   }
 
-  void from_json(const json& j, TokenAccount::Account::Data& accountData) {
-    accountData.program = j["program"].get<std::string>();
-    accountData.parsed = j["parsed"].get<TokenAccount::Account::Data::Parsed>();
-    accountData.space = j["space"].get<uint64_t>();
+  std::tuple<PublicKey, uint8_t> PublicKey::find_program_address(std::initializer_list<Seed> seeds, const PublicKey& program_id) {
+    return find_program_address_from(seeds, seeds.size(), program_id);
   }
 
-  void from_json(const json& j, TokenAccount::Account& account) {
-    account.lamports = j["lamports"].get<uint64_t>();
-    account.owner = j["owner"].get<PublicKey>();
-    account.data.program = j["data"]["program"].get<std::string>();
-    account.data.parsed = j["data"]["parsed"].get<TokenAccount::Account::Data::Parsed>();
-    account.data.space = j["data"]["space"].get<uint64_t>();
-    account.executable = j["executable"].get<bool>();
-    account.rent_epoch = j["rentEpoch"].get<uint64_t>();
+  std::string PublicKey::to_base58() const {
+    if (Base58Cache::is_enabled()) {
+      return Base58Cache::global().get(*this);
+    }
+    char temp[base58::FixedWidth<PUBLIC_KEY_LENGTH>::MAX_ENCODED_SIZE];
+    size_t size = base58::encode_32(bytes.data(), temp);
+    return std::string(temp, size);
   }
 
-  void from_json(const json& j, TokenAccount& tokenAccount) {
-    tokenAccount.pubkey = j["pubkey"].get<PublicKey>();
-    tokenAccount.account = j["account"].get<TokenAccount::Account>();
+  /**
+   * Returns the base-58 representation of each public key
+   */
+  std::vector<std::string> to_base58(const std::vector<PublicKey>& public_keys) {
+    std::vector<std::string> result(public_keys.size());
+    for (size_t i = 0; i < public_keys.size(); i++) {
+      result[i] = public_keys[i].to_base58();
+    }
+    return result;
   }
 
-  struct TransactionMessageHeader {
-    /** The number of signatures required to validate this transaction */
-    uint8_t num_required_signatures;
-    /** The number of read-only signed accounts */
-    uint8_t num_readonly_signed_accounts;
-    /** The number of read-only unsigned accounts */
-    uint8_t num_readonly_unsigned_accounts;
-  };
+  struct Keypair {
+    std::array<uint8_t, crypto_sign_SECRETKEYBYTES> secret_key;
+    PublicKey public_key;
 
-  void from_json(const json& j, TransactionMessageHeader& header) {
-    header.num_required_signatures = j["numRequiredSignatures"].get<uint8_t>();
-    header.num_readonly_signed_accounts = j["numReadonlySignedAccounts"].get<uint8_t>();
-    header.num_readonly_unsigned_accounts = j["numReadonlyUnsignedAccounts"].get<uint8_t>();
-  }
+    Keypair() {
+      auto sodium_result = sodium_init();
+      if (sodium_result == -1) {
+        throw std::runtime_error("Failed to initialize libsodium");
+      }
+      for (int i = 0; i < crypto_sign_SECRETKEYBYTES; i++) {
+        secret_key[i] = 0;
+      }
+      public_key = PublicKey();
+    }
 
-  struct CompiledTransaction {
-    /** Defines the content of the transaction */
-    struct Message {
-      /** The message header */
-      TransactionMessageHeader header;
-      /** List of base-58 encoded Pubkeys used by the transaction, including by the instructions and for signatures.
-      The first message.header.numRequiredSignatures Pubkeys must sign the transaction. */
-      std::vector<PublicKey> account_keys;
-      /** A base-58 encoded hash of a recent block in the ledger used to prevent transaction duplication and to give transactions lifetimes. */
-      PublicKey recent_blockhash;
-      struct Instruction {
-        /** Ordered indices into the `message.accountKeys` array indicating which accounts to pass to the program */
-        std::vector<uint8_t> accounts;
-        /** The program input data */
-        std::vector<uint8_t> data;
-        /** Index into the `message.accountKeys` array indicating the program account that executes this instruction */
-        uint8_t program_id_index;
-      };
-      /** List of program instructions that will be executed in sequence and committed in one atomic transaction if all succeed. */
-      std::vector<Instruction> instructions;
+    /**
+     * Create a keypair from a raw secret key byte array.
+     *
+     * This method should only be used to recreate a keypair from a previously
+     * generated secret key. Generating keypairs from a random seed should be done
+     * with the {@link Keypair.from_seed} method.
+     *
+     * @throws error if the provided secret key is invalid and validation is not skipped.
+     *
+     * @param secret_key secret key byte array
+     * @param options: skip secret key validation
+     */
+    Keypair(std::array<char, PUBLIC_KEY_LENGTH> secret_key, bool skipValidation = false) {
+      auto sodium_result = sodium_init();
+      if (sodium_result == -1) {
+        throw std::runtime_error("Failed to initialize libsodium");
+      }
+      if (!skipValidation && crypto_sign_ed25519_sk_to_pk((unsigned char *)public_key.bytes.data(), (unsigned char *)secret_key.data()) != 0) {
+        throw std::runtime_error("invalid secret key");
+      }
+    }
 
-      void serialize(std::vector<uint8_t>& serialized_message) {
-        if (serialized_message.size() > 0) {
-          throw new std::runtime_error("Message is already serialized");
-        }
-        if (header.num_required_signatures == 0) {
-          throw new std::runtime_error("Message must have at least one signature");
+    ~Keypair() {
+    }
+
+    /**
+     * Read a keypair from a file.
+     *
+     * @throws error if the keypair file cannot be read.
+     *
+     * @param path path to keypair file
+     */
+    static Keypair from_file(const std::string &path) {
+      Keypair result = Keypair();
+      std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+      if (file.is_open()) {
+        std::streamsize size = file.tellg();
+        file.seekg(0, std::ios::beg);
+        if (size == crypto_sign_SECRETKEYBYTES) {
+          file.read((char *)result.secret_key.data(), size);
+          crypto_sign_ed25519_sk_to_pk((unsigned char *)result.public_key.bytes.data(), (unsigned char *)result.secret_key.data());
+        } else {
+          throw std::runtime_error("invalid secret key file");
         }
-        serialized_message.push_back(header.num_required_signatures);
-        serialized_message.push_back(header.num_readonly_signed_accounts);
-        serialized_message.push_back(header.num_readonly_unsigned_accounts);
+      } else {
+        throw std::runtime_error("could not open secret key file");
+      }
+      return result;
+    }
 
-        auto keyCount = encode_length(account_keys.size());
-        serialized_message.insert(serialized_message.end(), keyCount.begin(), keyCount.end());
+    /**
+     * Create a keypair from a secret key seed.
+     *
+     * @throws error if the provided seed is invalid.
+     *
+     * @param seed secret key seed
+     */
+    static Keypair from_seed(const uint8_t *seed) {
+      Keypair result = Keypair();
+      crypto_sign_seed_keypair((unsigned char *)result.public_key.bytes.data(), (unsigned char *)result.secret_key.data(), seed);
+      return result;
+    }
 
-        for (auto& key : account_keys) {
-          serialized_message.insert(serialized_message.end(), key.bytes.begin(), key.bytes.end());
-        }
+    /**
+     * Create a new random keypair.
+     */
+    static Keypair generate() {
+      Keypair result = Keypair();
+      crypto_sign_keypair((unsigned char *)result.public_key.bytes.data(), (unsigned char *)result.secret_key.data());
+      return result;
+    }
 
-        serialized_message.insert(serialized_message.end(), recent_blockhash.bytes.begin(), recent_blockhash.bytes.end());
+    /**
+     * Sign a message with the keypair's secret key.
+     *
+     * @param message message to sign
+     */
+    std::string sign(const std::vector<uint8_t>& message) const {
+      uint8_t sig[crypto_sign_BYTES];
+      unsigned long long sigSize;
+      if (0 != crypto_sign_detached(sig, &sigSize, message.data(), message.size(), secret_key.data())) {
+        throw std::runtime_error("could not sign tx with private key");
+      }
+      return std::string((char*)sig, sigSize);
+    }
+  };
 
-        auto instructionCount = encode_length(instructions.size());
-        serialized_message.insert(serialized_message.end(), instructionCount.begin(), instructionCount.end());
+  /**
+   * Signs with a keypair whose secret is expanded once up front.
+   *
+   * crypto_sign_detached hashes the seed with SHA-512 and derives the signing scalar
+   * and nonce prefix again for every signature. HotSigner keeps the reduced scalar,
+   * the prefix and the public key, and signs straight into a caller-provided buffer.
+   * The fixed-base multiplication uses libsodium's precomputed base point tables.
+   * Signatures are identical to Keypair::sign.
+   */
+  class HotSigner {
+    std::array<uint8_t, crypto_core_ed25519_SCALARBYTES> _scalar;
+    std::array<uint8_t, 32> _prefix;
+    PublicKey _public_key;
 
-        for (auto& instruction : instructions) {
-          serialized_message.push_back(instruction.program_id_index);
+  public:
+    explicit HotSigner(const Keypair& keypair) : _public_key(keypair.public_key) {
+      uint8_t expanded[crypto_hash_sha512_BYTES];
+      crypto_hash_sha512(expanded, keypair.secret_key.data(), crypto_sign_SEEDBYTES);
+      expanded[0] &= 248;
+      expanded[31] &= 127;
+      expanded[31] |= 64;
+
+      uint8_t wide[crypto_core_ed25519_NONREDUCEDSCALARBYTES] = {};
+      memcpy(wide, expanded, 32);
+      crypto_core_ed25519_scalar_reduce(_scalar.data(), wide);
+      memcpy(_prefix.data(), expanded + 32, 32);
+
+      sodium_memzero(expanded, sizeof(expanded));
+      sodium_memzero(wide, sizeof(wide));
+    }
 
-          auto keyIndicesCount = encode_length(instruction.accounts.size());
-          serialized_message.insert(serialized_message.end(), keyIndicesCount.begin(), keyIndicesCount.end());
+    HotSigner(const HotSigner&) = default;
+    HotSigner& operator=(const HotSigner&) = default;
 
-          for (auto& accountIndex : instruction.accounts) {
-            serialized_message.push_back(accountIndex);
-          }
+    ~HotSigner() {
+      sodium_memzero(_scalar.data(), _scalar.size());
+      sodium_memzero(_prefix.data(), _prefix.size());
+    }
 
-          auto dataLength = encode_length(instruction.data.size());
-          serialized_message.insert(serialized_message.end(), dataLength.begin(), dataLength.end());
+    const PublicKey& public_key() const {
+      return _public_key;
+    }
 
-          serialized_message.insert(serialized_message.end(), instruction.data.begin(), instruction.data.end());
-        }
+    /**
+     * Writes the 64-byte signature of message to signature.
+     */
+    void sign(const uint8_t* message, size_t size, uint8_t* signature) const {
+      crypto_hash_sha512_state state;
+      uint8_t nonce[crypto_hash_sha512_BYTES];
+      uint8_t challenge[crypto_hash_sha512_BYTES];
+      uint8_t r[crypto_core_ed25519_SCALARBYTES];
+      uint8_t k[crypto_core_ed25519_SCALARBYTES];
+
+      crypto_hash_sha512_init(&state);
+      crypto_hash_sha512_update(&state, _prefix.data(), _prefix.size());
+      crypto_hash_sha512_update(&state, message, size);
+      crypto_hash_sha512_final(&state, nonce);
+      crypto_core_ed25519_scalar_reduce(r, nonce);
+
+      if (crypto_scalarmult_ed25519_base_noclamp(signature, r) != 0) {
+        throw std::runtime_error("could not sign tx with private key");
       }
-    } message;
-    /** The transaction signatures */
-    std::vector<std::string> signatures;
+
+      crypto_hash_sha512_init(&state);
+      crypto_hash_sha512_update(&state, signature, 32);
+      crypto_hash_sha512_update(&state, _public_key.bytes.data(), PUBLIC_KEY_LENGTH);
+      crypto_hash_sha512_update(&state, message, size);
+      crypto_hash_sha512_final(&state, challenge);
+      crypto_core_ed25519_scalar_reduce(k, challenge);
+
+      crypto_core_ed25519_scalar_mul(k, k, _scalar.data());
+      crypto_core_ed25519_scalar_add(signature + 32, k, r);
+
+      sodium_memzero(nonce, sizeof(nonce));
+      sodium_memzero(r, sizeof(r));
+    }
+
+    void sign(const std::vector<uint8_t>& message, uint8_t* signature) const {
+      sign(message.data(), message.size(), signature);
+    }
+  };
+
+  /**
+   * Verifies many ed25519 signatures together.
+   *
+   * Signatures are checked in chunks: each chunk is folded into one equation
+   * sum(z_i * (R_i + k_i * A_i - s_i * B)) = 0 with random 128-bit z_i and evaluated
+   * with a single multi-scalar multiplication. When a chunk fails, its signatures
+   * are verified one by one with libsodium to find the bad ones.
+   *
+   * Signatures that libsodium rejects up front (non-canonical s, R or A, or small
+   * order R or A) are rejected here the same way. The combined equation is checked
+   * up to the cofactor: the sum is multiplied by 8 before the identity test, so a
+   * torsion component in R or A cannot make a valid chunk fail. This makes a passing
+   * chunk a cofactored verification, which accepts every signature libsodium accepts
+   * and may also accept one whose R or A carries a torsion component that libsodium
+   * rejects. Standard signers never produce such signatures. Chunks that fail, and
+   * chunks smaller than MIN_COMBINED, are verified with libsodium as usual.
+   */
+  class SignatureBatch {
+    struct Entry {
+      uint8_t signature[crypto_sign_BYTES];
+      PublicKey public_key;
+      size_t offset;
+      size_t size;
+    };
+
+    struct Key {
+      libsodium::ge25519_p3 point;
+      bool valid;
+    };
+
+    std::vector<Entry> _entries;
+    std::vector<uint8_t> _messages;
+
+    static const libsodium::ge25519_p3& base_point() {
+      static const libsodium::ge25519_p3 point = []() {
+        uint8_t bytes[32];
+        memset(bytes, 0x66, sizeof(bytes));
+        bytes[0] = 0x58;
+        libsodium::ge25519_p3 p;
+        libsodium::ge25519_frombytes(&p, bytes);
+        return p;
+      }();
+      return point;
+    }
+
+    static bool decode_point(libsodium::ge25519_p3* point, const uint8_t* bytes) {
+      return libsodium::ge25519_is_canonical(bytes) != 0
+        && libsodium::ge25519_frombytes(point, bytes) == 0
+        && libsodium::ge25519_has_small_order(point) == 0;
+    }
+
+    static Key decode_key(PubkeyMap<Key>& keys, const PublicKey& public_key) {
+      const Key* key = keys.find(public_key);
+      if (key != nullptr) {
+        return *key;
+      }
+      Key decoded;
+      decoded.valid = decode_point(&decoded.point, public_key.bytes.data());
+      keys.insert(public_key, decoded);
+      return decoded;
+    }
+
+    bool verify_one(const Entry& entry) const {
+      return crypto_sign_verify_detached(entry.signature, _messages.data() + entry.offset, entry.size, entry.public_key.bytes.data()) == 0;
+    }
 
     /**
-     * Serialize the transaction
+     * Checks entries [begin, end) as one combination. Entries that fail the up-front
+     * checks are marked invalid and left out.
      */
-    std::vector<uint8_t> serialize(std::vector<uint8_t>& serialized_message) {
-      std::vector<uint8_t> buffer;
-      std::vector<uint8_t> signatures_length = encode_length(signatures.size());
-      buffer.insert(buffer.end(), signatures_length.begin(), signatures_length.end());
-      for (auto& signature : signatures) {
-        ASSERT(signature.size() == 64);
-        buffer.insert(buffer.end(), signature.begin(), signature.end());
+    bool verify_combined(size_t begin, size_t end, std::vector<bool>& valid, PubkeyMap<Key>& keys) const {
+      size_t count = end - begin;
+      std::vector<libsodium::ge25519_p3> points(2 * count + 1);
+      std::vector<uint8_t> scalars;
+      scalars.reserve(32 * (2 * count + 1));
+
+      size_t used = 0;
+      uint8_t sum[crypto_core_ed25519_SCALARBYTES] = {};
+      for (size_t i = begin; i < end; i++) {
+        const Entry& entry = _entries[i];
+        Key key = decode_key(keys, entry.public_key);
+        valid[i] = key.valid
+          && libsodium::sc25519_is_canonical(entry.signature + 32)
+          && decode_point(&points[used], entry.signature);
+        if (!valid[i]) {
+          continue;
+        }
+        points[used + 1] = key.point;
+        used += 2;
+
+        uint8_t hash[crypto_hash_sha512_BYTES];
+        uint8_t k[crypto_core_ed25519_SCALARBYTES];
+        uint8_t z[crypto_core_ed25519_SCALARBYTES] = {};
+        uint8_t zk[crypto_core_ed25519_SCALARBYTES];
+        uint8_t zs[crypto_core_ed25519_SCALARBYTES];
+
+        crypto_hash_sha512_state state;
+        crypto_hash_sha512_init(&state);
+        crypto_hash_sha512_update(&state, entry.signature, 32);
+        crypto_hash_sha512_update(&state, entry.public_key.bytes.data(), PUBLIC_KEY_LENGTH);
+        crypto_hash_sha512_update(&state, _messages.data() + entry.offset, entry.size);
+        crypto_hash_sha512_final(&state, hash);
+        crypto_core_ed25519_scalar_reduce(k, hash);
+
+        randombytes_buf(z, 16);
+        crypto_core_ed25519_scalar_mul(zk, z, k);
+        crypto_core_ed25519_scalar_mul(zs, z, entry.signature + 32);
+        crypto_core_ed25519_scalar_add(sum, sum, zs);
+
+        scalars.insert(scalars.end(), z, z + sizeof(z));
+        scalars.insert(scalars.end(), zk, zk + sizeof(zk));
       }
-      if (serialized_message.size() == 0) {
-        throw new std::runtime_error("Message is not serialized");
+      if (used == 0) {
+        return true;
       }
-      buffer.insert(buffer.end(), serialized_message.begin(), serialized_message.end());
-      return buffer;
+
+      uint8_t negated[crypto_core_ed25519_SCALARBYTES];
+      crypto_core_ed25519_scalar_negate(negated, sum);
+      points[used++] = base_point();
+      scalars.insert(scalars.end(), negated, negated + sizeof(negated));
+
+      // Multiplying by the cofactor clears any torsion left in the sum, which is then
+      // zero when each equation holds up to the cofactor, barring a 2^-128 chance in z
+      libsodium::ge25519_p2 r;
+      libsodium::ge25519_p1p1 t;
+      libsodium::ge25519_multi_scalarmult_vartime(&r, scalars.data(), points.data(), used);
+      for (int i = 0; i < 3; i++) {
+        libsodium::ge25519_p2_dbl(&t, &r);
+        libsodium::ge25519_p1p1_to_p2(&r, &t);
+      }
+      return libsodium::ge25519_p2_is_identity(&r) != 0;
     }
 
+  public:
+    /** Signatures combined into one multi-scalar multiplication */
+    static constexpr size_t CHUNK_SIZE = 64;
+    /** Smaller chunks are verified one by one, which is cheaper */
+    static constexpr size_t MIN_COMBINED = 4;
+
     /**
-     * Sign the transaction with the provided signers
+     * Queues a 64-byte signature of message by public_key. The message is copied.
      */
-    void sign(const std::vector<uint8_t>& serialized_message, const std::vector<Keypair>& signers) {
-      ASSERT(signatures.size() == 0);
-      for (auto& signer : signers) {
-        //signatures.insert(signer.public_key, signer.sign(serialized_message));
-        signatures.push_back(signer.sign(serialized_message));
+    void add(const uint8_t* signature, const PublicKey& public_key, const uint8_t* message, size_t size) {
+      Entry entry;
+      memcpy(entry.signature, signature, crypto_sign_BYTES);
+      entry.public_key = public_key;
+      entry.offset = _messages.size();
+      entry.size = size;
+      _entries.push_back(entry);
+      _messages.insert(_messages.end(), message, message + size);
+    }
+
+    void add(const uint8_t* signature, const PublicKey& public_key, const std::vector<uint8_t>& message) {
+      add(signature, public_key, message.data(), message.size());
+    }
+
+    size_t size() const {
+      return _entries.size();
+    }
+
+    void clear() {
+      _entries.clear();
+      _messages.clear();
+    }
+
+    /**
+     * Verifies every queued signature and sets valid[i] for the i-th one.
+     *
+     * @return true if all signatures are valid
+     */
+    bool verify(std::vector<bool>& valid) const {
+      valid.assign(_entries.size(), true);
+      PubkeyMap<Key> keys;
+      for (size_t begin = 0; begin < _entries.size(); begin += CHUNK_SIZE) {
+        size_t end = std::min(begin + CHUNK_SIZE, _entries.size());
+        if (end - begin < MIN_COMBINED || !verify_combined(begin, end, valid, keys)) {
+          for (size_t i = begin; i < end; i++) {
+            valid[i] = valid[i] && verify_one(_entries[i]);
+          }
+        }
       }
+      return std::find(valid.begin(), valid.end(), false) == valid.end();
+    }
+
+    /**
+     * @return true if all queued signatures are valid
+     */
+    bool verify() const {
+      std::vector<bool> valid;
+      return verify(valid);
     }
   };
 
-  void from_json(const json& j, CompiledTransaction::Message::Instruction& instruction) {
-    instruction.accounts = j["accounts"].get<std::vector<uint8_t>>();
-    instruction.data = base64::decode(j["data"].get<std::string>());
-    instruction.program_id_index = j["programIdIndex"].get<uint8_t>();
-  }
+  namespace vanity {
 
-  void from_json(const json& j, CompiledTransaction::Message& message) {
-    message.account_keys = j["accountKeys"].get<std::vector<PublicKey>>();
-    message.header.num_readonly_signed_accounts = j["header"]["numReadonlySignedAccounts"].get<uint8_t>();
-    message.header.num_readonly_unsigned_accounts = j["header"]["numReadonlyUnsignedAccounts"].get<uint8_t>();
-    message.header.num_required_signatures = j["header"]["numRequiredSignatures"].get<uint8_t>();
-    message.instructions = j["instructions"].get<std::vector<CompiledTransaction::Message::Instruction>>();
-    message.recent_blockhash = PublicKey(j["recentBlockhash"].get<std::string>());
-  }
+    /**
+     * A snapshot of a running search.
+     */
+    struct Progress {
+      uint64_t attempts;
+      double seconds;
+      /** Keypairs tried per second */
+      double rate;
+    };
 
-  void from_json(const json& j, CompiledTransaction& transaction) {
-    transaction.message = j["message"].get<CompiledTransaction::Message>();
-    transaction.signatures = j["signatures"].get<std::vector<std::string>>();
-  }
+    /**
+     * A compiled vanity pattern.
+     *
+     * The base-58 text of a key without leading zero bytes starts with a given prefix
+     * exactly when the key, read as a big-endian number, lies in one of a few ranges,
+     * and ends with a given suffix exactly when its remainder modulo 58^length matches.
+     * candidate() checks both on the raw bytes, so only likely matches are encoded.
+     */
+    class Pattern {
+      typedef std::array<uint8_t, PUBLIC_KEY_LENGTH> Bytes;
+      // Little-endian 32-bit limbs, wide enough for 58^44 > 2^256
+      typedef std::array<uint32_t, 9> Number;
+
+      static constexpr size_t MAX_VARIANTS = 4096;
+      // 58^9 < 2^56, so a remainder can be shifted by a byte without overflowing
+      static constexpr size_t MAX_SUFFIX_DIGITS = 9;
+
+      std::string _prefix;
+      std::string _suffix;
+      bool _case_insensitive;
+      // Disjoint, sorted by lower bound, both bounds inclusive
+      std::vector<std::pair<Bytes, Bytes>> _ranges;
+      bool _check_prefix = false;
+      uint64_t _modulus = 1;
+      std::vector<uint64_t> _residues;
+
+      static int digit(char c) {
+        return c & 0x80 ? -1 : many::base58::b58digits_map[(uint8_t)c];
+      }
 
-  struct Transaction {
-    /** The transaction signatures */
-    std::vector<std::string> signatures;
-    /** The transaction message */
-    struct Message {
-      /** The message header */
-      TransactionMessageHeader header;
-      /** The account keys used by this transaction */
-      std::vector<PublicKey> account_keys;
-      /** Recent blockhash */
-      PublicKey recent_blockhash;
-      struct Instruction {
-        /** The program id that executes this instruction */
-        PublicKey program_id;
-        /** Account metadata used to define instructions */
-        struct AccountMeta {
-          /** An account's Pubkey */
-          PublicKey pubkey;
-          /** True if an instruction requires a transaction signature matching `pubkey` */
-          bool is_signer;
-          /** True if the Pubkey can be loaded as a read-write account. */
-          bool is_writable;
+      static char fold(char c) {
+        return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+      }
 
-          bool operator==(const AccountMeta& other) const {
-            return pubkey == other.pubkey;
-          }
+      static void multiply_add(Number& n, uint32_t m, uint32_t add) {
+        uint64_t carry = add;
+        for (auto& limb : n) {
+          carry += (uint64_t)limb * m;
+          limb = (uint32_t)carry;
+          carry >>= 32;
+        }
+      }
 
-          bool operator==(const PublicKey& other) const {
-            return pubkey == other;
+      static int compare(const Number& a, const Number& b) {
+        for (size_t i = a.size(); i-- > 0;) {
+          if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
           }
-        };
-        /** Ordered indices into the transaction keys array indicating which accounts to pass to the program */
-        std::vector<AccountMeta> accounts;
-        /** Program input data */
-        std::vector<uint8_t> data;
-      };
-      /** The program instructions */
-      std::vector<Instruction> instructions;
+        }
+        return 0;
+      }
 
-      CompiledTransaction::Message compile(const std::vector<Keypair>& signers) {
+      static Number power_of_two(size_t bits) {
+        Number n{};
+        n[bits / 32] = 1u << (bits % 32);
+        return n;
+      }
 
-        //TODO check if recentBlockhash is the default pubkey
-        // if (recentBlockhash.empty()) {
-        //   throw std::runtime_error("recentBlockhash required");
-        // }
-        if (instructions.empty()) {
-          throw std::runtime_error("No instructions provided");
+      static Number power_of_58(size_t exponent) {
+        Number n{};
+        n[0] = 1;
+        for (size_t i = 0; i < exponent; i++) {
+          multiply_add(n, 58, 0);
         }
-        if (signers.size() == 0) {
-          throw std::runtime_error("No signers provided");
+        return n;
+      }
+
+      static Bytes to_bytes(const Number& n) {
+        Bytes bytes;
+        for (size_t i = 0; i < bytes.size(); i++) {
+          bytes[bytes.size() - 1 - i] = (uint8_t)(n[i / 4] >> (8 * (i % 4)));
         }
+        return bytes;
+      }
 
-        std::vector<Transaction::Message::Instruction::AccountMeta> account_metas;
-        for (auto& instruction : instructions) {
-          for (auto& account : instruction.accounts) {
-            //TODO there is a bug here, if the same account is used twice with different signer or writable flags.
-            if (std::find(account_metas.begin(), account_metas.end(), account) == account_metas.end()) {
-              account_metas.push_back(account);
+      /**
+       * Every spelling of text that differs only in case, or just text when matching
+       * case. Throws if a character has no base-58 spelling.
+       */
+      static std::vector<std::string> variants(const std::string& text, bool case_insensitive) {
+        std::vector<std::string> result = { "" };
+        for (char c : text) {
+          std::string options;
+          for (char option : { c, fold(c), (char)(c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c) }) {
+            if (digit(option) >= 0 && options.find(option) == std::string::npos && (case_insensitive || option == c)) {
+              options += option;
+            }
+          }
+          if (options.empty()) {
+            throw std::runtime_error("Vanity pattern is not base58: " + text);
+          }
+          std::vector<std::string> next;
+          for (const auto& variant : result) {
+            for (char option : options) {
+              next.push_back(variant + option);
             }
           }
+          if (next.size() > MAX_VARIANTS) {
+            throw std::runtime_error("Vanity pattern has too many case variants: " + text);
+          }
+          result = std::move(next);
         }
+        return result;
+      }
 
-        std::vector<PublicKey> programIds;
-        for (auto& instruction : instructions) {
-          auto programId = instruction.program_id;
-          if (std::find(programIds.begin(), programIds.end(), programId) == programIds.end()) {
-            programIds.push_back(programId);
-            account_metas.push_back({programId, false, false});
+    public:
+      Pattern(const std::string& prefix, const std::string& suffix = "", bool case_insensitive = false)
+        : _prefix(prefix), _suffix(suffix), _case_insensitive(case_insensitive) {
+        if (prefix.size() + suffix.size() > base58::FixedWidth<PUBLIC_KEY_LENGTH>::MAX_ENCODED_SIZE) {
+          throw std::runtime_error("Vanity pattern is longer than a public key");
+        }
+
+        // Keys with leading zero bytes encode with leading '1's, and are left to matches()
+        _check_prefix = !prefix.empty() && prefix[0] != '1';
+        if (_check_prefix) {
+          const Number lowest = power_of_two(248);
+          const Number limit = power_of_two(256);
+          for (const auto& variant : variants(prefix, case_insensitive)) {
+            // Without leading zero bytes a key has 43 or 44 digits
+            for (size_t digits = 43; digits <= 44; digits++) {
+              if (variant.size() > digits) {
+                continue;
+              }
+              Number lo{}, hi{};
+              for (char c : variant) {
+                multiply_add(lo, 58, digit(c));
+              }
+              hi = lo;
+              multiply_add(hi, 1, 1);
+              for (size_t i = variant.size(); i < digits; i++) {
+                multiply_add(lo, 58, 0);
+                multiply_add(hi, 58, 0);
+              }
+              Number min = power_of_58(digits - 1);
+              Number max = power_of_58(digits);
+              if (compare(lo, min) < 0) lo = min;
+              if (compare(lo, lowest) < 0) lo = lowest;
+              if (compare(hi, max) > 0) hi = max;
+              if (compare(hi, limit) > 0) hi = limit;
+              if (compare(lo, hi) >= 0) {
+                continue;
+              }
+              // hi is exclusive and at least 1
+              for (auto& limb : hi) {
+                if (limb-- != 0) {
+                  break;
+                }
+              }
+              _ranges.push_back({ to_bytes(lo), to_bytes(hi) });
+            }
+          }
+          std::sort(_ranges.begin(), _ranges.end());
+          if (_ranges.empty()) {
+            throw std::runtime_error("No public key starts with vanity prefix: " + prefix);
           }
         }
 
-        // Sort. Prioritizing first by signer, then by writable
-        std::sort(account_metas.begin(), account_metas.end(), [](const auto& a, const auto& b) {
-          if (a.is_signer != b.is_signer) {
-            return a.is_signer;
+        size_t suffix_digits = std::min(suffix.size(), MAX_SUFFIX_DIGITS);
+        for (char c : suffix.substr(0, suffix.size() - suffix_digits)) {
+          // Throws if the character has no base-58 spelling
+          variants(std::string(1, c), case_insensitive);
+        }
+        if (suffix_digits > 0) {
+          _modulus = power_of_58(suffix_digits)[0] | (uint64_t)power_of_58(suffix_digits)[1] << 32;
+          // Only the last digits set the remainder; matches() checks the rest of the suffix
+          for (const auto& variant : variants(suffix.substr(suffix.size() - suffix_digits), case_insensitive)) {
+            uint64_t residue = 0;
+            for (char c : variant) {
+              residue = residue * 58 + digit(c);
+            }
+            _residues.push_back(residue);
           }
-          if (a.is_writable != b.is_writable) {
-            return a.is_writable;
+          std::sort(_residues.begin(), _residues.end());
+          _residues.erase(std::unique(_residues.begin(), _residues.end()), _residues.end());
+        }
+      }
+
+      /**
+       * Returns false if key cannot match, without encoding it.
+       */
+      bool candidate(const uint8_t* key) const {
+        if (_check_prefix) {
+          auto range = std::upper_bound(_ranges.begin(), _ranges.end(), key, [](const uint8_t* key, const std::pair<Bytes, Bytes>& range) {
+            return memcmp(key, range.first.data(), PUBLIC_KEY_LENGTH) < 0;
+          });
+          if (range == _ranges.begin() || memcmp(key, (--range)->second.data(), PUBLIC_KEY_LENGTH) > 0) {
+            return false;
           }
-          return a.pubkey < b.pubkey;
-        });
+        }
+        if (_modulus > 1) {
+          uint64_t residue = 0;
+          for (size_t i = 0; i < PUBLIC_KEY_LENGTH; i++) {
+            residue = ((residue << 8) | key[i]) % _modulus;
+          }
+          if (!std::binary_search(_residues.begin(), _residues.end(), residue)) {
+            return false;
+          }
+        }
+        return true;
+      }
 
-        // Use implicit fee payer
-        auto fee_payer = signers[0].public_key;
-
-        // Move fee payer to the front
-        auto fee_payer_index = std::find(account_metas.begin(), account_metas.end(), fee_payer);
-        if (fee_payer_index != account_metas.end()) {
-          auto payerMeta = *fee_payer_index;
-          account_metas.erase(fee_payer_index);
-          payerMeta.is_signer = true;
-          payerMeta.is_writable = true;
-          account_metas.insert(account_metas.begin(), payerMeta);
-        } else {
-          account_metas.insert(account_metas.begin(), {fee_payer, true, true});
+      /**
+       * Returns true if the base-58 text of key has the prefix and suffix.
+       */
+      bool matches(const PublicKey& key) const {
+        char text[base58::FixedWidth<PUBLIC_KEY_LENGTH>::MAX_ENCODED_SIZE];
+        size_t size = base58::encode_32(key.bytes.data(), text);
+        if (size < _prefix.size() + _suffix.size()) {
+          return false;
         }
+        auto equal = [this](const char* a, const std::string& b) {
+          for (size_t i = 0; i < b.size(); i++) {
+            if (_case_insensitive ? fold(a[i]) != fold(b[i]) : a[i] != b[i]) {
+              return false;
+            }
+          }
+          return true;
+        };
+        return equal(text, _prefix) && equal(text + size - _suffix.size(), _suffix);
+      }
+    };
 
-        uint8_t num_required_signatures = 0;
-        uint8_t num_readonly_signed_accounts = 0;
-        uint8_t num_readonly_unsigned_accounts = 0;
+    /**
+     * Generates keypairs until one's public key has the prefix and suffix.
+     *
+     * Every thread walks its own run of seeds from a random start, so the keypair found
+     * is an ordinary seed keypair that wallets can load. Candidates are screened with
+     * Pattern::candidate() before being encoded.
+     *
+     * @param prefix The base-58 text the public key starts with
+     * @param suffix The base-58 text the public key ends with
+     * @param case_insensitive Match letters in either case
+     * @param threads The number of threads, 0 for one per core
+     * @param progress Called about every progress_seconds from one of the search threads
+     * @param progress_seconds The time between progress calls
+     */
+    Keypair search(
+      const std::string& prefix,
+      const std::string& suffix = "",
+      bool case_insensitive = false,
+      size_t threads = 0,
+      const std::function<void(const Progress&)>& progress = nullptr,
+      double progress_seconds = 1.0
+    ) {
+      static constexpr uint64_t STRIDE = 256;
 
-        // Split out signing from non-signing keys and count header values
-        std::vector<PublicKey> signed_keys;
-        std::vector<PublicKey> unsigned_keys;
-        for (auto& account_meta : account_metas) {
-          if (account_meta.is_signer) {
-            signed_keys.push_back(account_meta.pubkey);
-            num_required_signatures += 1;
-            if (!account_meta.is_writable) {
-              num_readonly_signed_accounts += 1;
+      Pattern pattern(prefix, suffix, case_insensitive);
+      if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+      }
+
+      std::atomic<bool> done{false};
+      std::atomic<uint64_t> attempts{0};
+      std::mutex mutex;
+      Keypair result;
+      auto start = std::chrono::steady_clock::now();
+      auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(progress_seconds));
+
+      auto work = [&](size_t worker) {
+        uint8_t seed[crypto_sign_SEEDBYTES];
+        randombytes_buf(seed, sizeof(seed));
+        Keypair candidate;
+        auto report = start + interval;
+        try {
+          while (!done.load(std::memory_order_relaxed)) {
+            for (uint64_t i = 0; i < STRIDE; i++) {
+              // SHA-512 of the seed gives the secret scalar, so consecutive seeds give unrelated keys
+              for (size_t j = 0; j < sizeof(seed) && ++seed[j] == 0; j++) {}
+              crypto_sign_seed_keypair(candidate.public_key.bytes.data(), candidate.secret_key.data(), seed);
+              if (pattern.candidate(candidate.public_key.bytes.data()) && pattern.matches(candidate.public_key)) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!done.exchange(true)) {
+                  result = candidate;
+                }
+                break;
+              }
             }
-          } else {
-            unsigned_keys.push_back(account_meta.pubkey);
-            if (!account_meta.is_writable) {
-              num_readonly_unsigned_accounts += 1;
+            uint64_t total = attempts.fetch_add(STRIDE, std::memory_order_relaxed) + STRIDE;
+            if (worker == 0 && progress) {
+              auto now = std::chrono::steady_clock::now();
+              if (now >= report) {
+                double seconds = std::chrono::duration<double>(now - start).count();
+                progress({ total, seconds, total / seconds });
+                report = now + interval;
+              }
             }
           }
+        } catch (...) {
+          done.store(true);
+          sodium_memzero(seed, sizeof(seed));
+          sodium_memzero(candidate.secret_key.data(), candidate.secret_key.size());
+          throw;
         }
+        sodium_memzero(seed, sizeof(seed));
+        sodium_memzero(candidate.secret_key.data(), candidate.secret_key.size());
+      };
 
-        auto account_keys = signed_keys;
-        account_keys.insert(account_keys.end(), unsigned_keys.begin(), unsigned_keys.end());
-
-        std::vector<CompiledTransaction::Message::Instruction> compiled_instructions;
-        for (auto& instruction : instructions) {
-          std::vector<uint8_t> accounts_indexes;
-          for (auto& account : instruction.accounts) {
-            auto index = std::find(account_keys.begin(), account_keys.end(), account.pubkey);
-            if (index == account_keys.end()) {
-              throw std::runtime_error("Unknown account");
-            }
-            accounts_indexes.push_back(index - account_keys.begin());
+      // The search runs until a key is found, so it starts threads of its own rather
+      // than hold the shared pool that parallel_for callers wait on
+      std::exception_ptr error;
+      auto run = [&](size_t worker) {
+        try {
+          work(worker);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (!error) {
+            error = std::current_exception();
           }
-          compiled_instructions.push_back(CompiledTransaction::Message::Instruction {
-            .accounts = accounts_indexes,
-            .data = instruction.data,
-            .program_id_index = (uint8_t)(std::find(account_keys.begin(), account_keys.end(), instruction.program_id) - account_keys.begin()),
-          });
         }
+      };
+      std::vector<std::thread> helpers;
+      for (size_t worker = 1; worker < threads; worker++) {
+        helpers.emplace_back(run, worker);
+      }
+      run(0);
+      for (auto& helper : helpers) {
+        helper.join();
+      }
+      if (error) {
+        std::rethrow_exception(error);
+      }
 
-        return {
-          {
-            num_required_signatures,
-            num_readonly_signed_accounts,
-            num_readonly_unsigned_accounts,
-          },
-          account_keys,
-          recent_blockhash,
-          compiled_instructions
-        };
+      return result;
+    }
+
+  } // namespace vanity
+
+  /**
+   * The data of an account as bytes.
+   *
+   * RPC responses carry the data base64 encoded. The text is kept until the bytes are
+   * first needed, then decoded once and released, so cached accounts hold no base64
+   * overhead once read. read() decodes a few bytes without decoding the rest. The first
+   * decode takes a lock, so a const AccountData can be read from several threads.
+   */
+  class AccountData {
+    mutable std::string _base64;
+    mutable std::vector<uint8_t> _bytes;
+    size_t _size = 0;
+    /** Set while _base64 holds the data, and cleared with release once _bytes does */
+    mutable std::atomic<bool> _pending{false};
+
+    /**
+     * Returns the lock for the first decode of the data at address. Accounts share a
+     * few striped locks, which keeps AccountData small and copyable.
+     */
+    static std::mutex& decode_mutex(const void* address) {
+      struct alignas(64) Stripe {
+        std::mutex mutex;
+      };
+      static std::array<Stripe, 16> stripes;
+      return stripes[((uintptr_t)address / sizeof(AccountData)) % stripes.size()].mutex;
+    }
+
+    void decode() const {
+      if (!_pending.load(std::memory_order_acquire)) {
+        return;
       }
-    } message;
+      std::lock_guard<std::mutex> lock(decode_mutex(this));
+      if (_pending.load(std::memory_order_relaxed)) {
+        _bytes.resize(_size);
+        if (!_bytes.empty()) {
+          size_t decoded = base64::decode(_base64.data(), _base64.size(), (char*)_bytes.data(), _bytes.size());
+          ASSERT(decoded == _size);
+        }
+        _base64.clear();
+        _base64.shrink_to_fit();
+        _pending.store(false, std::memory_order_release);
+      }
+    }
+
+  public:
+    AccountData() = default;
+
+    AccountData(std::vector<uint8_t> bytes) : _bytes(std::move(bytes)), _size(_bytes.size()) {}
+
+    AccountData(const AccountData& other) {
+      *this = other;
+    }
+
+    AccountData(AccountData&& other) noexcept {
+      *this = std::move(other);
+    }
+
+    AccountData& operator=(const AccountData& other) {
+      if (this == &other) {
+        return *this;
+      }
+      if (other._pending.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(decode_mutex(&other));
+        if (other._pending.load(std::memory_order_relaxed)) {
+          _base64 = other._base64;
+          _size = other._size;
+          _pending.store(true, std::memory_order_relaxed);
+          return *this;
+        }
+      }
+      _base64.clear();
+      _bytes = other._bytes;
+      _size = other._size;
+      _pending.store(false, std::memory_order_relaxed);
+      return *this;
+    }
+
+    /** Leaves other empty, so it can still be read or assigned */
+    AccountData& operator=(AccountData&& other) noexcept {
+      if (this == &other) {
+        return *this;
+      }
+      _base64 = std::move(other._base64);
+      _bytes = std::move(other._bytes);
+      _size = other._size;
+      _pending.store(other._pending.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      other._base64.clear();
+      other._bytes.clear();
+      other._size = 0;
+      other._pending.store(false, std::memory_order_relaxed);
+      return *this;
+    }
+
+    static AccountData from_base64(std::string_view text) {
+      AccountData data;
+      data.assign_base64(text);
+      return data;
+    }
 
     /**
-     * Add an instruction to the transaction message
+     * Replaces the data with base64 text, decoded on first access into this object's
+     * byte buffer, which keeps its capacity across assignments.
      *
-     * @param instruction The instruction to add
+     * @throws error if the text is not padded base64, leaving the data unchanged
      */
-    void add(Transaction::Message::Instruction instruction) {
-      message.instructions.push_back(instruction);
+    void assign_base64(std::string_view text) {
+      if (!base64::is_valid(text.data(), text.size())) {
+        throw std::runtime_error("invalid base64 account data");
+      }
+      _base64.assign(text);
+      _size = base64::decoded_length(_base64.data(), _base64.size());
+      _pending.store(true, std::memory_order_release);
     }
-  };
 
-  void from_json(const json& j, Transaction::Message::Instruction::AccountMeta& accountMeta) {
-    accountMeta.pubkey = j["pubkey"].get<PublicKey>();
-    accountMeta.is_signer = j["isSigner"].get<bool>();
-    accountMeta.is_writable = j["isWritable"].get<bool>();
-  }
+    const uint8_t* data() const {
+      decode();
+      return _bytes.data();
+    }
 
-  std::ostream& operator<<(std::ostream& os, const TransactionMessageHeader& header) {
-    //os << "num_required_signatures: " << (int)header.num_required_signatures << ", num_readonly_signed_accounts: " << (int)header.num_readonly_signed_accounts << ", num_readonly_unsigned_accounts: " << (int)header.num_readonly_unsigned_accounts;
-    return os;
-  }
+    size_t size() const {
+      return _size;
+    }
 
-  std::ostream& operator<<(std::ostream& os, const Transaction::Message::Instruction::AccountMeta& accountMeta) {
-    os << "pubkey: " << accountMeta.pubkey << ", is_signer: " << accountMeta.is_signer << ", is_writable: " << accountMeta.is_writable;
-    return os;
-  }
+    bool empty() const {
+      return size() == 0;
+    }
 
-  std::ostream& operator<<(std::ostream& os, const Transaction::Message::Instruction& instruction) {
-    os << "accounts: [";
-    for (auto& account : instruction.accounts) {
-      os << account << ", ";
+    const std::vector<uint8_t>& bytes() const {
+      decode();
+      return _bytes;
     }
-    os << "], data: " << instruction.data.data() << ", program_id: " << instruction.program_id;
-    return os;
-  }
 
-  std::ostream& operator<<(std::ostream& os, const Transaction::Message& message) {
-    os << "header: " << message.header << ", account_keys: [";
-    for (auto& account_key : message.account_keys) {
-      os << account_key << ", ";
+    std::vector<uint8_t>::const_iterator begin() const {
+      return bytes().begin();
     }
-    os << "], recent_blockhash: " << message.recent_blockhash << ", instructions: [";
-    for (auto& instruction : message.instructions) {
-      os << instruction << ", ";
+
+    std::vector<uint8_t>::const_iterator end() const {
+      return bytes().end();
     }
-    os << "]";
-    return os;
-  }
 
-  std::ostream& operator<<(std::ostream& os, const Transaction& transaction) {
-    os << "signatures: [";
-    for (auto& signature : transaction.signatures) {
-      os << signature << ", ";
+    uint8_t operator[](size_t index) const {
+      ASSERT(index < _size);
+      decode();
+      return _bytes[index];
     }
-    os << "], message: " << transaction.message;
+
+    /**
+     * Copies length bytes starting at offset into output. Data that has not been
+     * decoded yet is decoded only around the requested range.
+     *
+     * @return The number of bytes copied, which is less than length past the end of the data
+     */
+    size_t read(size_t offset, void* output, size_t length) const {
+      if (_pending.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(decode_mutex(this));
+        if (_pending.load(std::memory_order_relaxed)) {
+          return base64::decode_range(_base64.data(), _base64.size(), offset, (uint8_t*)output, length);
+        }
+      }
+      if (offset >= _bytes.size()) {
+        return 0;
+      }
+      length = std::min(length, _bytes.size() - offset);
+      memcpy(output, _bytes.data() + offset, length);
+      return length;
+    }
+
+    std::string to_base64() const {
+      if (_pending.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(decode_mutex(this));
+        if (_pending.load(std::memory_order_relaxed)) {
+          return _base64;
+        }
+      }
+      return base64::encode(_bytes);
+    }
+
+    bool operator==(const AccountData& other) const {
+      return bytes() == other.bytes();
+    }
+
+    bool operator!=(const AccountData& other) const {
+      return !(*this == other);
+    }
+  };
+
+  std::ostream& operator<<(std::ostream& os, const AccountData& data) {
+    os << data.to_base64();
     return os;
   }
 
-  struct TransactionResponseReturnData {
-    /** The program that generated the return data */
-    PublicKey program_d;
-    /** The return data itself */
-    std::string data;
+  struct Account {
+    /** Number of lamports assigned to this account */
+    uint64_t lamports;
+    /** Identifier of the program that owns the account */
+    PublicKey owner;
+    /** Data associated with the account */
+    AccountData data;
+    /** Boolean indicating if the account contains a program (and is strictly read-only) */
+    bool executable;
+    /** The epoch at which this account will next owe rent */
+    uint64_t rent_epoch;
   };
 
-  void from_json(const json& j, TransactionResponseReturnData& transactionReturnData) {
-    transactionReturnData.program_d = j["programId"].get<PublicKey>();
-    transactionReturnData.data = j["data"].get<std::string>();
+  void from_json(const json& j, Account& account) {
+    account.lamports = j["lamports"].get<uint64_t>();
+    account.owner = j["owner"].get<PublicKey>();
+
+    if (j["data"].is_string()) {
+      // The legacy binary encoding is base58
+      std::string bytes = base58::decode(j["data"].get<std::string>());
+      account.data = AccountData(std::vector<uint8_t>(bytes.begin(), bytes.end()));
+    } else {
+      auto encoding = j["data"][1].get<std::string>();
+      ASSERT(encoding == "base64");
+      account.data.assign_base64(j["data"][0].get<std::string>());
+    }
+
+    account.executable = j["executable"].get<bool>();
+    account.rent_epoch = j["rentEpoch"].get<uint64_t>();
   }
 
-  struct TransactionResponse {
-    /** The slot this transaction was processed in */
-    uint64_t slot;
-    /** The estimated production time of when the transaction was processed. */
-    uint64_t block_time;
-    /** The transaction */
-    CompiledTransaction transaction;
-    /** Transaction status metadata object */
-    struct Meta {
-      /** Error if the transaction failed */
-      std::string err;
-      /** Fee this transaction was charged, as u64 integer */
-      uint64_t fee;
-      /** List of inner instructions if inner instruction recording was enabled during this transaction */
-      struct InnerInstruction {
-        /** Index of the transaction instruction from which the inner instruction(s) originated */
-        uint64_t index;
-        /** Ordered list of inner program instructions that were invoked during a single transaction instruction. */
-        struct Instruction {
-          /** Index into the message.accountKeys array indicating the program account that executes this instruction */
-          uint64_t program_id_index;
-          /** List of ordered indices into the message.accountKeys array indicating which accounts to pass to the program. */
-          std::vector<uint64_t> accounts;
-          /** The program input data encoded in a base-58 string. */
-          std::string data;
-        };
-        std::vector<Instruction> instructions;
-      };
-      std::vector<InnerInstruction> inner_instructions;
-      /** Pubkeys for loaded accounts */
-      struct LoadedAddresses {
-        /** Ordered list of Pubkeys for writable loaded accounts */
-        std::vector<PublicKey> writable;
-        /** Ordered list of Pubkeys for read-only loaded accounts */
-        std::vector<PublicKey> readonly;
-      } loaded_addresses;
-      /** Array of log messages if log message recording was enabled during this transaction */
-      std::vector<std::string> log_messages;
-      /** Array of u64 account balances from before the transaction was processed */
-      std::vector<uint64_t> pre_balances;
-      /** List of token balances from before the transaction was processed */
-      std::vector<TokenBalance> pre_token_balances;
-      /** Array of u64 account balances from after the transaction was processed */
-      std::vector<uint64_t> post_balances;
-      /** List of token balances from after the transaction was processed */
-      std::vector<TokenBalance> post_token_balances;
-      /** Transaction-level rewards, populated if rewards are requested */
-      struct TransactionReward {
-        /** The Pubkey of the account that received the reward */
-        PublicKey pubkey;
-        /** The number of reward lamports credited or debited by the account */
-        uint64_t lamports;
-        /** The account balance in lamports after the reward was applied */
-        uint64_t post_balance;
-        /** The type of reward */
-        std::string reward_type;
-        /** Vote account commission when the reward was credited, only present for voting and staking rewards */
-        uint8_t commission;
-      };
-      std::vector<TransactionReward> rewards;
-    } meta;
-    /** The return data for the transaction */
-    TransactionResponseReturnData return_data;
+  /**
+   * Decodes account data given either as a base58 string or as [data, encoding].
+   */
+  class AccountDataDecoder : public sax::Decoder {
+    /** The base64 text, kept as is for AccountData to decode on first access */
+    class Text : public sax::Decoder {
+    public:
+      AccountData* target = nullptr;
+
+      bool string(std::string_view value) override {
+        target->assign_base64(value);
+        return true;
+      }
+    };
+
+    AccountData* _target = nullptr;
+    Text _text;
+    std::string _encoding;
+    sax::ValueDecoder<std::string> _string;
+    size_t _index = 0;
+
+  public:
+    Decoder* bind(AccountData& target) {
+      _target = &target;
+      return this;
+    }
+
+    bool string(std::string_view value) override {
+      std::string bytes = base58::decode(std::string(value));
+      *_target = AccountData(std::vector<uint8_t>(bytes.begin(), bytes.end()));
+      return true;
+    }
+
+    bool start_array() override {
+      _index = 0;
+      _encoding.clear();
+      return true;
+    }
+
+    Decoder* element() override {
+      switch (_index++) {
+        case 0:
+          _text.target = _target;
+          return &_text;
+        case 1: return _string.bind(_encoding);
+        default: return nullptr;
+      }
+    }
+
+    bool end_array() override {
+      ASSERT(_encoding == "base64");
+      return true;
+    }
   };
 
-  void from_json(const json& j, TransactionResponse::Meta::InnerInstruction::Instruction& metaInstruction) {
-    metaInstruction.program_id_index = j["programIdIndex"].get<uint64_t>();
-    metaInstruction.accounts = j["accounts"].get<std::vector<uint64_t>>();
-    metaInstruction.data = j["data"].get<std::string>();
+  class AccountDecoder : public sax::ObjectDecoder<Account> {
+    sax::ValueDecoder<uint64_t> _uint64;
+    sax::ValueDecoder<bool> _bool;
+    PublicKeyDecoder _owner;
+    AccountDataDecoder _data;
+
+  public:
+    Decoder* key(std::string_view key) override {
+      if (key == "lamports") return _uint64.bind(_target->lamports);
+      if (key == "owner") return _owner.bind(_target->owner);
+      if (key == "data") return _data.bind(_target->data);
+      if (key == "executable") return _bool.bind(_target->executable);
+      if (key == "rentEpoch") return _uint64.bind(_target->rent_epoch);
+      return nullptr;
+    }
+  };
+
+  AccountDecoder sax_decoder(Account*);
+
+  struct AccountInfo {
+    PublicKey pubkey;
+    Account account;
+  };
+
+  void from_json(const json& j, AccountInfo& accountInfo) {
+    accountInfo.pubkey = j["pubkey"].get<PublicKey>();
+    accountInfo.account = j["account"].get<Account>();
   }
 
-  void from_json(const json& j, TransactionResponse::Meta::InnerInstruction& metaInnerInstruction) {
-    metaInnerInstruction.index = j["index"].get<uint64_t>();
-    metaInnerInstruction.instructions = j["instructions"].get<std::vector<TransactionResponse::Meta::InnerInstruction::Instruction>>();
+  class AccountInfoDecoder : public sax::ObjectDecoder<AccountInfo> {
+    PublicKeyDecoder _pubkey;
+    AccountDecoder _account;
+
+  public:
+    Decoder* key(std::string_view key) override {
+      if (key == "pubkey") return _pubkey.bind(_target->pubkey);
+      if (key == "account") return _account.bind(_target->account);
+      return nullptr;
+    }
+  };
+
+  AccountInfoDecoder sax_decoder(AccountInfo*);
+
+  struct TokenBalance {
+    /** The raw balance without decimals, as a string representation */
+    uint64_t amount;
+    /** The number of base 10 digits to the right of the decimal place */
+    uint64_t decimals;
+
+    /**
+     * Returns the balance as a number of tokens, with decimals applied.
+     */
+    double tokens() {
+      return (double) amount / (double) pow(10, decimals);
+    }
+  };
+
+  void from_json(const json& j, TokenBalance& tokenAmount) {
+    tokenAmount.amount = stol(j["amount"].get<std::string>());
+    tokenAmount.decimals = j["decimals"].get<uint64_t>();
   }
 
-  void from_json(const json& j, TransactionResponse::Meta::TransactionReward& reward) {
-    reward.pubkey = j["pubkey"].get<PublicKey>();
-    reward.lamports = j["lamports"].get<uint64_t>();
-    reward.post_balance = j["postBalance"].get<uint64_t>();
-    reward.reward_type = j["rewardType"].get<std::string>();
-    if (j.contains("commission")) {
-      reward.commission = j["commission"].get<uint8_t>();
+  class TokenBalanceDecoder : public sax::ObjectDecoder<TokenBalance> {
+    /** The amount is a decimal string */
+    class Amount : public sax::Decoder {
+    public:
+      uint64_t* target = nullptr;
+
+      bool string(std::string_view value) override {
+        return std::from_chars(value.data(), value.data() + value.size(), *target).ec == std::errc();
+      }
+    };
+
+    Amount _amount;
+    sax::ValueDecoder<uint64_t> _decimals;
+
+  public:
+    Decoder* key(std::string_view key) override {
+      if (key == "amount") {
+        _amount.target = &_target->amount;
+        return &_amount;
+      }
+      if (key == "decimals") return _decimals.bind(_target->decimals);
+      return nullptr;
+    }
+  };
+
+  TokenBalanceDecoder sax_decoder(TokenBalance*);
+
+  struct ClusterNode {
+    /** Node public key */
+    PublicKey pubkey;
+    /** Gossip network address for the node */
+    std::string gossip;
+    /** TPU network address for the node */
+    std::string tpu;
+    /** JSON RPC network address for the node, if the JSON RPC service is enabled */
+    std::string rpc;
+    /** The software version of the node, if the version information is available */
+    std::string version;
+    /** The unique identifier of the node's feature set */
+    uint64_t feature_set;
+    /** The shred version the node has been configured to use */
+    uint64_t shred_version;
+  };
+
+  void from_json(const json& j, ClusterNode& cluster_node) {
+    if (!j["featureSet"].is_null()) {
+      cluster_node.feature_set = j["featureSet"].get<uint64_t>();
+    }
+    cluster_node.gossip = j["gossip"].get<std::string>();
+    cluster_node.pubkey = j["pubkey"].get<PublicKey>();
+    if (!j["rpc"].is_null()) {
+      cluster_node.rpc = j["rpc"].get<std::string>();
+    }
+    cluster_node.shred_version = j["shredVersion"].get<uint64_t>();
+    if (!j["tpu"].is_null()) {
+      cluster_node.tpu = j["tpu"].get<std::string>();
+    }
+    if (!j["version"].is_null()) {
+      cluster_node.version = j["version"].get<std::string>();
     }
   }
 
-  void from_json(const json& j, TransactionResponse::Meta::LoadedAddresses& loadedAddresses) {
-    loadedAddresses.readonly = j["readonly"].get<std::vector<PublicKey>>();
-    loadedAddresses.writable = j["writable"].get<std::vector<PublicKey>>();
+  struct Identity {
+    PublicKey identity;
+  };
+
+  void from_json(const json& j, Identity& identity) {
+    identity.identity = PublicKey(j["identity"].get<std::string>());
   }
 
-  void from_json(const json& j, TransactionResponse::Meta& meta) {
-    if (!j.at("err").is_null()) {
-      meta.err = j["err"].get<std::string>();
-    } else {
-      meta.err = "";
+  struct LeaderSchedule {
+    PublicKey leader;
+    std::vector<int> schedule;
+  };
+
+  void from_json(const json& j, LeaderSchedule& leader_schedule) {
+    auto it = j.begin();
+    leader_schedule.leader = PublicKey(it.key());
+    leader_schedule.schedule = it.value().get<std::vector<int>>();
+  }
+
+  struct Logs {
+    std::vector<std::string> logs;
+    std::string signature;
+  };
+
+  void from_json(const json& j, Logs& logs) {
+    logs.logs = j["logs"].get<std::vector<std::string>>();
+    logs.signature = j["signature"].get<std::string>();
+  }
+
+  class LogsDecoder : public sax::ObjectDecoder<Logs> {
+    sax::VectorDecoder<std::string> _logs;
+    sax::ValueDecoder<std::string> _signature;
+
+  public:
+    Decoder* key(std::string_view key) override {
+      if (key == "logs") return _logs.bind(_target->logs);
+      if (key == "signature") return _signature.bind(_target->signature);
+      return nullptr;
     }
-    meta.fee = j["fee"].get<uint64_t>();
-    meta.inner_instructions = j["innerInstructions"].get<std::vector<TransactionResponse::Meta::InnerInstruction>>();
-    meta.log_messages = j["logMessages"].get<std::vector<std::string>>();
-    meta.loaded_addresses = j["loadedAddresses"].get<TransactionResponse::Meta::LoadedAddresses>();
-    meta.post_balances = j["postBalances"].get<std::vector<uint64_t>>();
-    meta.post_token_balances = j["postTokenBalances"].get<std::vector<TokenBalance>>();
-    meta.pre_balances = j["preBalances"].get<std::vector<uint64_t>>();
-    meta.pre_token_balances = j["preTokenBalances"].get<std::vector<TokenBalance>>();
-    meta.rewards = j["rewards"].get<std::vector<TransactionResponse::Meta::TransactionReward>>();
+  };
+
+  LogsDecoder sax_decoder(Logs*);
+
+  struct ResultError {
+    int64_t code;
+    std::string message;
+  };
+
+  void from_json(const json& j, ResultError& t) {
+    t.code = j["code"].get<int64_t>();
+    t.message = j["message"].get<std::string>();
   }
 
-  void from_json(const json& j, TransactionResponse& transactionResponse) {
-    transactionResponse.slot = j["slot"].get<uint64_t>();
-    transactionResponse.block_time = j["blockTime"].get<uint64_t>();
-    transactionResponse.transaction = j["transaction"].get<CompiledTransaction>();
-    transactionResponse.meta = j["meta"].get<TransactionResponse::Meta>();
-    if (j.contains("returnData")) {
-      transactionResponse.return_data = j["returnData"].get<TransactionResponseReturnData>();
+  class ResultErrorDecoder : public sax::ObjectDecoder<ResultError> {
+    sax::ValueDecoder<int64_t> _code;
+    sax::ValueDecoder<std::string> _message;
+
+  public:
+    Decoder* key(std::string_view key) override {
+      if (key == "code") return _code.bind(_target->code);
+      if (key == "message") return _message.bind(_target->message);
+      return nullptr;
+    }
+  };
+
+  ResultErrorDecoder sax_decoder(ResultError*);
+
+  struct LatencyStamps {
+    /** Receive time of the frame, or of the first byte of an RPC response: the kernel timestamp when enabled, otherwise the time it was read */
+    uint64_t recv_ns = 0;
+    /** Time the notification finished parsing */
+    uint64_t parse_done_ns = 0;
+    /** Time the callback was called */
+    uint64_t callback_start_ns = 0;
+  };
+
+  template <typename T>
+  class Result {
+  public:
+
+    std::optional<Context> _context;
+    std::optional<T> _result;
+    std::optional<ResultError> _error;
+    /** Latency stamps for websocket notifications and RPC responses, in CLOCK_REALTIME nanoseconds */
+    LatencyStamps _stamps;
+
+    Result() = default;
+
+    Result(T result) : _result(result) {}
+
+    Result(ResultError error) : _error(error) {}
+
+    bool ok() const {
+      return _result != std::nullopt;
+    }
+
+    T unwrap() {
+      if (_error) {
+        std::cerr << _error->message << std::endl;
+        throw std::runtime_error(_error->message);
+      }
+      return _result.value();
+    }
+  };
+
+  /**
+   * Stamps an RPC response with the receive time of its first byte and the time
+   * it finished decoding (see http::post).
+   */
+  template <typename T>
+  void stamp_response(Result<T>& result, uint64_t recv_ns, uint64_t parse_done_ns) {
+    result._stamps.recv_ns = recv_ns;
+    result._stamps.parse_done_ns = parse_done_ns;
+  }
+
+  template <typename T>
+  void from_json(const json& j, Result<T>& r) {
+    if (j.contains("result")) {
+      if (j["result"].contains("context")) {
+        r._context = j["result"]["context"].get<Context>();
+      }
+
+      if (j["result"].contains("value")) {
+        if (!j["result"]["value"].is_null()) {
+          r._result = j["result"]["value"];
+        }
+      } else {
+        if (!j["result"].is_null()) {
+          r._result = j["result"].get<T>();
+        }
+      }
+    } else if (j.contains("error")) {
+      r._error = j["error"].get<ResultError>();
+    }
+  }
+
+  /**
+   * Decodes a JSON-RPC response into a Result without building a DOM. The result is
+   * either {"context": ..., "value": ...} or the value itself, told apart by its first key.
+   */
+  template <typename T>
+  class ResultDecoder : public sax::ObjectDecoder<Result<T>> {
+    using sax::ObjectDecoder<Result<T>>::_target;
+
+    class Body : public sax::Decoder {
+    public:
+      ResultDecoder* parent = nullptr;
+      /** Receives the events of a result that is the value itself */
+      Decoder* forward = nullptr;
+      bool wrapped = false;
+      bool failed = false;
+
+      Decoder* resolve(sax::Kind kind) override {
+        if (kind == sax::Kind::Object) {
+          forward = nullptr;
+          wrapped = false;
+          failed = false;
+          return this;
+        }
+        return parent->_value.bind(parent->_target->_result)->resolve(kind);
+      }
+
+      bool start_object() override {
+        return true;
+      }
+
+      Decoder* key(std::string_view key) override {
+        if (forward) {
+          return forward->key(key);
+        }
+        if (key == "context") {
+          wrapped = true;
+          return parent->_context.bind(parent->_target->_context.emplace());
+        }
+        if (key == "value") {
+          wrapped = true;
+          return parent->_value.bind(parent->_target->_result);
+        }
+        if (wrapped) {
+          return nullptr;
+        }
+        forward = parent->_value.bind(parent->_target->_result)->resolve(sax::Kind::Object);
+        failed = !forward->start_object();
+        return forward->key(key);
+      }
+
+      bool end_object() override {
+        return !failed && (!forward || forward->end_object());
+      }
+    };
+
+    Body _body;
+    ContextDecoder _context;
+    sax::OptionalDecoder<T> _value;
+    sax::OptionalDecoder<ResultError> _error;
+
+  public:
+    ResultDecoder() {
+      _body.parent = this;
+    }
+
+    sax::Decoder* key(std::string_view key) override {
+      if (key == "result") return &_body;
+      if (key == "error") return _error.bind(_target->_error);
+      return nullptr;
+    }
+  };
+
+  template <typename T>
+  ResultDecoder<T> sax_decoder(Result<T>*);
+
+  /**
+   * Decodes a websocket notification, whose params hold the Result.
+   */
+  template <typename T>
+  class NotificationDecoder : public sax::ObjectDecoder<Result<T>> {
+    ResultDecoder<T> _params;
+
+  public:
+    sax::Decoder* key(std::string_view key) override {
+      return key == "params" ? _params.bind(*this->_target) : nullptr;
+    }
+  };
+
+  struct SlotInfo {
+    /** Currently processing slot */
+    uint64_t slot;
+    /** Parent of the current slot */
+    uint64_t parent;
+    /** The root block of the current slot's fork */
+    uint64_t root;
+  };
+
+  void from_json(const json& j, SlotInfo& slot_info) {
+    slot_info.slot = j["slot"].get<uint64_t>();
+    slot_info.parent = j["parent"].get<uint64_t>();
+    slot_info.root = j["root"].get<uint64_t>();
+  }
+
+  class SlotInfoDecoder : public sax::ObjectDecoder<SlotInfo> {
+    sax::ValueDecoder<uint64_t> _slot;
+
+  public:
+    Decoder* key(std::string_view key) override {
+      if (key == "slot") return _slot.bind(_target->slot);
+      if (key == "parent") return _slot.bind(_target->parent);
+      if (key == "root") return _slot.bind(_target->root);
+      return nullptr;
+    }
+  };
+
+  SlotInfoDecoder sax_decoder(SlotInfo*);
+
+  struct TokenAccount {
+    /** The account's Pubkey */
+    PublicKey pubkey;
+    /** The account data */
+    struct Account {
+      /** Number of lamports assigned to the account */
+      uint64_t lamports;
+      /** The Pubkey of the program that owns the account */
+      PublicKey owner;
+      struct Data {
+        struct Parsed {
+          struct Info {
+            /** Boolean indicating if the account is native */
+            bool is_native;
+            /** The mint of the token */
+            PublicKey mint;
+            /** The Pubkey of the token account owner */
+            PublicKey owner;
+            /** The amount of tokens */
+            TokenBalance token_amount;
+            /** The account this token account is delegated to */
+            PublicKey delegate;
+            /** Amount delegated */
+            TokenBalance delegated_amount;
+            /** State of the token account (ex: "initialized") */
+            std::string state;
+          } info;
+          /** The account type (ex: "account") */
+          std::string type;
+        } parsed;
+        /* Name of token program (ex: "spl-token") */
+        std::string program;
+        /** The length of the account data */
+        uint64_t space;
+      } data;
+      /** Boolean indicating if the account contains a program (and is strictly read-only) */
+      bool executable;
+      /** The epoch at which this account will next owe rent */
+      uint64_t rent_epoch;
+    } account;
+  };
+
+  void from_json(const json& j, TokenAccount::Account::Data::Parsed::Info& parsedAccountInfo) {
+    parsedAccountInfo.is_native = j["isNative"].get<bool>();
+    parsedAccountInfo.mint = j["mint"].get<PublicKey>();
+    parsedAccountInfo.owner = j["owner"].get<PublicKey>();
+    parsedAccountInfo.token_amount = j["tokenAmount"].get<TokenBalance>();
+    if (j.contains("delegate")) {
+      parsedAccountInfo.delegate = j["account"]["data"]["parsed"]["info"]["delegate"].get<PublicKey>();
+      parsedAccountInfo.delegated_amount = j["account"]["data"]["parsed"]["info"]["delegatedAmount"].get<TokenBalance>();
+    }
+    parsedAccountInfo.state = j["state"].get<std::string>();
+  }
+
+  void from_json(const json& j, TokenAccount::Account::Data::Parsed& parsedAccountData) {
+    parsedAccountData.info = j["info"].get<TokenAccount::Account::Data::Parsed::Info>();
+    parsedAccountData.type = j["type"].get<std::string>();
+  }
+
+  void from_json(const json& j, TokenAccount::Account::Data& accountData) {
+    accountData.program = j["program"].get<std::string>();
+    accountData.parsed = j["parsed"].get<TokenAccount::Account::Data::Parsed>();
+    accountData.space = j["space"].get<uint64_t>();
+  }
+
+  void from_json(const json& j, TokenAccount::Account& account) {
+    account.lamports = j["lamports"].get<uint64_t>();
+    account.owner = j["owner"].get<PublicKey>();
+    account.data.program = j["data"]["program"].get<std::string>();
+    account.data.parsed = j["data"]["parsed"].get<TokenAccount::Account::Data::Parsed>();
+    account.data.space = j["data"]["space"].get<uint64_t>();
+    account.executable = j["executable"].get<bool>();
+    account.rent_epoch = j["rentEpoch"].get<uint64_t>();
+  }
+
+  void from_json(const json& j, TokenAccount& tokenAccount) {
+    tokenAccount.pubkey = j["pubkey"].get<PublicKey>();
+    tokenAccount.account = j["account"].get<TokenAccount::Account>();
+  }
+
+  class TokenAccountDecoder : public sax::ObjectDecoder<TokenAccount> {
+    class Info : public sax::ObjectDecoder<TokenAccount::Account::Data::Parsed::Info> {
+      sax::ValueDecoder<bool> _bool;
+      sax::ValueDecoder<std::string> _string;
+      PublicKeyDecoder _pubkey;
+      TokenBalanceDecoder _balance;
+
+    public:
+      Decoder* key(std::string_view key) override {
+        if (key == "isNative") return _bool.bind(_target->is_native);
+        if (key == "mint") return _pubkey.bind(_target->mint);
+        if (key == "owner") return _pubkey.bind(_target->owner);
+        if (key == "tokenAmount") return _balance.bind(_target->token_amount);
+        if (key == "delegate") return _pubkey.bind(_target->delegate);
+        if (key == "delegatedAmount") return _balance.bind(_target->delegated_amount);
+        if (key == "state") return _string.bind(_target->state);
+        return nullptr;
+      }
+    };
+
+    class Parsed : public sax::ObjectDecoder<TokenAccount::Account::Data::Parsed> {
+      Info _info;
+      sax::ValueDecoder<std::string> _type;
+
+    public:
+      Decoder* key(std::string_view key) override {
+        if (key == "info") return _info.bind(_target->info);
+        if (key == "type") return _type.bind(_target->type);
+        return nullptr;
+      }
+    };
+
+    class Data : public sax::ObjectDecoder<TokenAccount::Account::Data> {
+      Parsed _parsed;
+      sax::ValueDecoder<std::string> _program;
+      sax::ValueDecoder<uint64_t> _space;
+
+    public:
+      Decoder* key(std::string_view key) override {
+        if (key == "program") return _program.bind(_target->program);
+        if (key == "parsed") return _parsed.bind(_target->parsed);
+        if (key == "space") return _space.bind(_target->space);
+        return nullptr;
+      }
+    };
+
+    class Account : public sax::ObjectDecoder<TokenAccount::Account> {
+      sax::ValueDecoder<uint64_t> _uint64;
+      sax::ValueDecoder<bool> _bool;
+      PublicKeyDecoder _owner;
+      Data _data;
+
+    public:
+      Decoder* key(std::string_view key) override {
+        if (key == "lamports") return _uint64.bind(_target->lamports);
+        if (key == "owner") return _owner.bind(_target->owner);
+        if (key == "data") return _data.bind(_target->data);
+        if (key == "executable") return _bool.bind(_target->executable);
+        if (key == "rentEpoch") return _uint64.bind(_target->rent_epoch);
+        return nullptr;
+      }
+    };
+
+    PublicKeyDecoder _pubkey;
+    Account _account;
+
+  public:
+    Decoder* key(std::string_view key) override {
+      if (key == "pubkey") return _pubkey.bind(_target->pubkey);
+      if (key == "account") return _account.bind(_target->account);
+      return nullptr;
+    }
+  };
+
+  TokenAccountDecoder sax_decoder(TokenAccount*);
+
+  struct TransactionMessageHeader {
+    /** The number of signatures required to validate this transaction */
+    uint8_t num_required_signatures;
+    /** The number of read-only signed accounts */
+    uint8_t num_readonly_signed_accounts;
+    /** The number of read-only unsigned accounts */
+    uint8_t num_readonly_unsigned_accounts;
+  };
+
+  void from_json(const json& j, TransactionMessageHeader& header) {
+    header.num_required_signatures = j["numRequiredSignatures"].get<uint8_t>();
+    header.num_readonly_signed_accounts = j["numReadonlySignedAccounts"].get<uint8_t>();
+    header.num_readonly_unsigned_accounts = j["numReadonlyUnsignedAccounts"].get<uint8_t>();
+  }
+
+  struct CompiledTransaction {
+    /** Defines the content of the transaction */
+    struct Message {
+      /** The message header */
+      TransactionMessageHeader header;
+      /** List of base-58 encoded Pubkeys used by the transaction, including by the instructions and for signatures.
+      The first message.header.numRequiredSignatures Pubkeys must sign the transaction. */
+      std::vector<PublicKey> account_keys;
+      /** A base-58 encoded hash of a recent block in the ledger used to prevent transaction duplication and to give transactions lifetimes. */
+      PublicKey recent_blockhash;
+      struct Instruction {
+        /** Ordered indices into the `message.accountKeys` array indicating which accounts to pass to the program */
+        std::vector<uint8_t> accounts;
+        /** The program input data */
+        std::vector<uint8_t> data;
+        /** Index into the `message.accountKeys` array indicating the program account that executes this instruction */
+        uint8_t program_id_index;
+      };
+      /** List of program instructions that will be executed in sequence and committed in one atomic transaction if all succeed. */
+      std::vector<Instruction> instructions;
+
+      void serialize(std::vector<uint8_t>& serialized_message) {
+        if (serialized_message.size() > 0) {
+          throw new std::runtime_error("Message is already serialized");
+        }
+        if (header.num_required_signatures == 0) {
+          throw new std::runtime_error("Message must have at least one signature");
+        }
+        serialized_message.push_back(header.num_required_signatures);
+        serialized_message.push_back(header.num_readonly_signed_accounts);
+        serialized_message.push_back(header.num_readonly_unsigned_accounts);
+
+        auto keyCount = encode_length(account_keys.size());
+        serialized_message.insert(serialized_message.end(), keyCount.begin(), keyCount.end());
+
+        for (auto& key : account_keys) {
+          serialized_message.insert(serialized_message.end(), key.bytes.begin(), key.bytes.end());
+        }
+
+        serialized_message.insert(serialized_message.end(), recent_blockhash.bytes.begin(), recent_blockhash.bytes.end());
+
+        auto instructionCount = encode_length(instructions.size());
+        serialized_message.insert(serialized_message.end(), instructionCount.begin(), instructionCount.end());
+
+        for (auto& instruction : instructions) {
+          serialized_message.push_back(instruction.program_id_index);
+
+          auto keyIndicesCount = encode_length(instruction.accounts.size());
+          serialized_message.insert(serialized_message.end(), keyIndicesCount.begin(), keyIndicesCount.end());
+
+          for (auto& accountIndex : instruction.accounts) {
+            serialized_message.push_back(accountIndex);
+          }
+
+          auto dataLength = encode_length(instruction.data.size());
+          serialized_message.insert(serialized_message.end(), dataLength.begin(), dataLength.end());
+
+          serialized_message.insert(serialized_message.end(), instruction.data.begin(), instruction.data.end());
+        }
+      }
+    } message;
+    /** The transaction signatures */
+    std::vector<std::string> signatures;
+
+    /**
+     * Serialize the transaction
+     */
+    std::vector<uint8_t> serialize(std::vector<uint8_t>& serialized_message) {
+      std::vector<uint8_t> buffer;
+      std::vector<uint8_t> signatures_length = encode_length(signatures.size());
+      buffer.insert(buffer.end(), signatures_length.begin(), signatures_length.end());
+      for (auto& signature : signatures) {
+        ASSERT(signature.size() == 64);
+        buffer.insert(buffer.end(), signature.begin(), signature.end());
+      }
+      if (serialized_message.size() == 0) {
+        throw new std::runtime_error("Message is not serialized");
+      }
+      buffer.insert(buffer.end(), serialized_message.begin(), serialized_message.end());
+      return buffer;
+    }
+
+    /**
+     * Sign the transaction with the provided signers
+     */
+    void sign(const std::vector<uint8_t>& serialized_message, const std::vector<Keypair>& signers) {
+      ASSERT(signatures.size() == 0);
+      for (auto& signer : signers) {
+        //signatures.insert(signer.public_key, signer.sign(serialized_message));
+        signatures.push_back(signer.sign(serialized_message));
+      }
+    }
+
+    /**
+     * Sign the transaction with the provided hot signers
+     */
+    void sign(const std::vector<uint8_t>& serialized_message, const std::vector<HotSigner>& signers) {
+      ASSERT(signatures.size() == 0);
+      for (auto& signer : signers) {
+        std::string signature(crypto_sign_BYTES, '\0');
+        signer.sign(serialized_message, (uint8_t*)signature.data());
+        signatures.push_back(std::move(signature));
+      }
+    }
+
+    /**
+     * Queue the transaction's signatures into batch, e.g. to verify a whole block at once.
+     *
+     * Signatures may be raw 64-byte strings or base58 as returned by the RPC. Only legacy
+     * messages serialize back to the signed bytes. A signature that does not decode is
+     * queued as zeros, which never verifies.
+     */
+    void add_signatures(SignatureBatch& batch) {
+      ASSERT(signatures.size() <= message.account_keys.size());
+      std::vector<uint8_t> serialized_message;
+      message.serialize(serialized_message);
+      for (size_t i = 0; i < signatures.size(); i++) {
+        uint8_t signature[crypto_sign_BYTES] = {};
+        if (signatures[i].size() == crypto_sign_BYTES) {
+          memcpy(signature, signatures[i].data(), crypto_sign_BYTES);
+        } else if (!base58::decode_64(signatures[i].data(), signatures[i].size(), signature)) {
+          memset(signature, 0, sizeof(signature));
+        }
+        batch.add(signature, message.account_keys[i], serialized_message);
+      }
+    }
+
+    /**
+     * Verify all of the transaction's signatures in one batch, up to the cofactor when
+     * there are enough of them to combine (see SignatureBatch)
+     */
+    bool verify_signatures() {
+      SignatureBatch batch;
+      add_signatures(batch);
+      return batch.verify();
+    }
+  };
+
+  void from_json(const json& j, CompiledTransaction::Message::Instruction& instruction) {
+    instruction.accounts = j["accounts"].get<std::vector<uint8_t>>();
+    instruction.data = base64::decode(j["data"].get<std::string>());
+    instruction.program_id_index = j["programIdIndex"].get<uint8_t>();
+  }
+
+  void from_json(const json& j, CompiledTransaction::Message& message) {
+    message.account_keys = j["accountKeys"].get<std::vector<PublicKey>>();
+    message.header.num_readonly_signed_accounts = j["header"]["numReadonlySignedAccounts"].get<uint8_t>();
+    message.header.num_readonly_unsigned_accounts = j["header"]["numReadonlyUnsignedAccounts"].get<uint8_t>();
+    message.header.num_required_signatures = j["header"]["numRequiredSignatures"].get<uint8_t>();
+    message.instructions = j["instructions"].get<std::vector<CompiledTransaction::Message::Instruction>>();
+    message.recent_blockhash = PublicKey(j["recentBlockhash"].get<std::string>());
+  }
+
+  void from_json(const json& j, CompiledTransaction& transaction) {
+    transaction.message = j["message"].get<CompiledTransaction::Message>();
+    transaction.signatures = j["signatures"].get<std::vector<std::string>>();
+  }
+
+  struct Transaction {
+    /** The transaction signatures */
+    std::vector<std::string> signatures;
+    /** The transaction message */
+    struct Message {
+      /** The message header */
+      TransactionMessageHeader header;
+      /** The account keys used by this transaction */
+      std::vector<PublicKey> account_keys;
+      /** Recent blockhash */
+      PublicKey recent_blockhash;
+      struct Instruction {
+        /** The program id that executes this instruction */
+        PublicKey program_id;
+        /** Account metadata used to define instructions */
+        struct AccountMeta {
+          /** An account's Pubkey */
+          PublicKey pubkey;
+          /** True if an instruction requires a transaction signature matching `pubkey` */
+          bool is_signer;
+          /** True if the Pubkey can be loaded as a read-write account. */
+          bool is_writable;
+
+          bool operator==(const AccountMeta& other) const {
+            return pubkey == other.pubkey;
+          }
+
+          bool operator==(const PublicKey& other) const {
+            return pubkey == other;
+          }
+        };
+        /** Ordered indices into the transaction keys array indicating which accounts to pass to the program */
+        std::vector<AccountMeta> accounts;
+        /** Program input data */
+        std::vector<uint8_t> data;
+      };
+      /** The program instructions */
+      std::vector<Instruction> instructions;
+
+      CompiledTransaction::Message compile(const std::vector<Keypair>& signers) {
+
+        //TODO check if recentBlockhash is the default pubkey
+        // if (recentBlockhash.empty()) {
+        //   throw std::runtime_error("recentBlockhash required");
+        // }
+        if (instructions.empty()) {
+          throw std::runtime_error("No instructions provided");
+        }
+        if (signers.size() == 0) {
+          throw std::runtime_error("No signers provided");
+        }
+
+        // Use implicit fee payer
+        const PublicKey& fee_payer = signers[0].public_key;
+
+        size_t reference_count = 1;
+        for (auto& instruction : instructions) {
+          reference_count += instruction.accounts.size() + 1;
+        }
+
+        // One meta per key, with the signer and writable flags of every use merged
+        std::vector<Transaction::Message::Instruction::AccountMeta> account_metas;
+        account_metas.reserve(reference_count);
+        PubkeyMap<uint32_t> account_indexes(reference_count);
+        auto add_account = [&](const PublicKey& pubkey, bool is_signer, bool is_writable) {
+          auto inserted = account_indexes.insert(pubkey, (uint32_t)account_metas.size());
+          if (inserted.second) {
+            account_metas.push_back({ pubkey, is_signer, is_writable });
+          } else {
+            auto& account_meta = account_metas[*inserted.first];
+            account_meta.is_signer = account_meta.is_signer || is_signer;
+            account_meta.is_writable = account_meta.is_writable || is_writable;
+          }
+        };
+        add_account(fee_payer, true, true);
+        for (auto& instruction : instructions) {
+          for (auto& account : instruction.accounts) {
+            add_account(account.pubkey, account.is_signer, account.is_writable);
+          }
+          add_account(instruction.program_id, false, false);
+        }
+        if (account_metas.size() > 256) {
+          throw std::runtime_error("Too many accounts");
+        }
+
+        // The fee payer stays first. Sort the rest, prioritizing first by signer, then by writable
+        std::sort(account_metas.begin() + 1, account_metas.end(), [](const auto& a, const auto& b) {
+          if (a.is_signer != b.is_signer) {
+            return a.is_signer;
+          }
+          if (a.is_writable != b.is_writable) {
+            return a.is_writable;
+          }
+          return a.pubkey < b.pubkey;
+        });
+
+        uint8_t num_required_signatures = 0;
+        uint8_t num_readonly_signed_accounts = 0;
+        uint8_t num_readonly_unsigned_accounts = 0;
+
+        // Signing keys sort first. Count header values and point the index at the sorted positions
+        std::vector<PublicKey> account_keys;
+        account_keys.reserve(account_metas.size());
+        for (auto& account_meta : account_metas) {
+          *account_indexes.find(account_meta.pubkey) = (uint32_t)account_keys.size();
+          account_keys.push_back(account_meta.pubkey);
+          if (account_meta.is_signer) {
+            num_required_signatures += 1;
+            if (!account_meta.is_writable) {
+              num_readonly_signed_accounts += 1;
+            }
+          } else if (!account_meta.is_writable) {
+            num_readonly_unsigned_accounts += 1;
+          }
+        }
+
+        std::vector<CompiledTransaction::Message::Instruction> compiled_instructions;
+        compiled_instructions.reserve(instructions.size());
+        for (auto& instruction : instructions) {
+          CompiledTransaction::Message::Instruction compiled_instruction;
+          compiled_instruction.accounts.reserve(instruction.accounts.size());
+          for (auto& account : instruction.accounts) {
+            compiled_instruction.accounts.push_back((uint8_t)*account_indexes.find(account.pubkey));
+          }
+          compiled_instruction.data = instruction.data;
+          compiled_instruction.program_id_index = (uint8_t)*account_indexes.find(instruction.program_id);
+          compiled_instructions.push_back(std::move(compiled_instruction));
+        }
+
+        return {
+          {
+            num_required_signatures,
+            num_readonly_signed_accounts,
+            num_readonly_unsigned_accounts,
+          },
+          std::move(account_keys),
+          recent_blockhash,
+          std::move(compiled_instructions)
+        };
+      }
+    } message;
+
+    /**
+     * Add an instruction to the transaction message
+     *
+     * @param instruction The instruction to add
+     */
+    void add(Transaction::Message::Instruction instruction) {
+      message.instructions.push_back(instruction);
+    }
+  };
+
+  void from_json(const json& j, Transaction::Message::Instruction::AccountMeta& accountMeta) {
+    accountMeta.pubkey = j["pubkey"].get<PublicKey>();
+    accountMeta.is_signer = j["isSigner"].get<bool>();
+    accountMeta.is_writable = j["isWritable"].get<bool>();
+  }
+
+  std::ostream& operator<<(std::ostream& os, const TransactionMessageHeader& header) {
+    //os << "num_required_signatures: " << (int)header.num_required_signatures << ", num_readonly_signed_accounts: " << (int)header.num_readonly_signed_accounts << ", num_readonly_unsigned_accounts: " << (int)header.num_readonly_unsigned_accounts;
+    return os;
+  }
+
+  std::ostream& operator<<(std::ostream& os, const Transaction::Message::Instruction::AccountMeta& accountMeta) {
+    os << "pubkey: " << accountMeta.pubkey << ", is_signer: " << accountMeta.is_signer << ", is_writable: " << accountMeta.is_writable;
+    return os;
+  }
+
+  std::ostream& operator<<(std::ostream& os, const Transaction::Message::Instruction& instruction) {
+    os << "accounts: [";
+    for (auto& account : instruction.accounts) {
+      os << account << ", ";
+    }
+    os << "], data: " << instruction.data.data() << ", program_id: " << instruction.program_id;
+    return os;
+  }
+
+  std::ostream& operator<<(std::ostream& os, const Transaction::Message& message) {
+    os << "header: " << message.header << ", account_keys: [";
+    for (auto& account_key : message.account_keys) {
+      os << account_key << ", ";
+    }
+    os << "], recent_blockhash: " << message.recent_blockhash << ", instructions: [";
+    for (auto& instruction : message.instructions) {
+      os << instruction << ", ";
+    }
+    os << "]";
+    return os;
+  }
+
+  std::ostream& operator<<(std::ostream& os, const Transaction& transaction) {
+    os << "signatures: [";
+    for (auto& signature : transaction.signatures) {
+      os << signature << ", ";
+    }
+    os << "], message: " << transaction.message;
+    return os;
+  }
+
+  struct TransactionResponseReturnData {
+    /** The program that generated the return data */
+    PublicKey program_d;
+    /** The return data itself */
+    std::string data;
+  };
+
+  void from_json(const json& j, TransactionResponseReturnData& transactionReturnData) {
+    transactionReturnData.program_d = j["programId"].get<PublicKey>();
+    transactionReturnData.data = j["data"].get<std::string>();
+  }
+
+  struct TransactionResponse {
+    /** The slot this transaction was processed in */
+    uint64_t slot;
+    /** The estimated production time of when the transaction was processed. */
+    uint64_t block_time;
+    /** The transaction */
+    CompiledTransaction transaction;
+    /** Transaction status metadata object */
+    struct Meta {
+      /** Error if the transaction failed */
+      std::string err;
+      /** Fee this transaction was charged, as u64 integer */
+      uint64_t fee;
+      /** List of inner instructions if inner instruction recording was enabled during this transaction */
+      struct InnerInstruction {
+        /** Index of the transaction instruction from which the inner instruction(s) originated */
+        uint64_t index;
+        /** Ordered list of inner program instructions that were invoked during a single transaction instruction. */
+        struct Instruction {
+          /** Index into the message.accountKeys array indicating the program account that executes this instruction */
+          uint64_t program_id_index;
+          /** List of ordered indices into the message.accountKeys array indicating which accounts to pass to the program. */
+          std::vector<uint64_t> accounts;
+          /** The program input data encoded in a base-58 string. */
+          std::string data;
+        };
+        std::vector<Instruction> instructions;
+      };
+      std::vector<InnerInstruction> inner_instructions;
+      /** Pubkeys for loaded accounts */
+      struct LoadedAddresses {
+        /** Ordered list of Pubkeys for writable loaded accounts */
+        std::vector<PublicKey> writable;
+        /** Ordered list of Pubkeys for read-only loaded accounts */
+        std::vector<PublicKey> readonly;
+      } loaded_addresses;
+      /** Array of log messages if log message recording was enabled during this transaction */
+      std::vector<std::string> log_messages;
+      /** Array of u64 account balances from before the transaction was processed */
+      std::vector<uint64_t> pre_balances;
+      /** List of token balances from before the transaction was processed */
+      std::vector<TokenBalance> pre_token_balances;
+      /** Array of u64 account balances from after the transaction was processed */
+      std::vector<uint64_t> post_balances;
+      /** List of token balances from after the transaction was processed */
+      std::vector<TokenBalance> post_token_balances;
+      /** Transaction-level rewards, populated if rewards are requested */
+      struct TransactionReward {
+        /** The Pubkey of the account that received the reward */
+        PublicKey pubkey;
+        /** The number of reward lamports credited or debited by the account */
+        uint64_t lamports;
+        /** The account balance in lamports after the reward was applied */
+        uint64_t post_balance;
+        /** The type of reward */
+        std::string reward_type;
+        /** Vote account commission when the reward was credited, only present for voting and staking rewards */
+        uint8_t commission;
+      };
+      std::vector<TransactionReward> rewards;
+    } meta;
+    /** The return data for the transaction */
+    TransactionResponseReturnData return_data;
+  };
+
+  void from_json(const json& j, TransactionResponse::Meta::InnerInstruction::Instruction& metaInstruction) {
+    metaInstruction.program_id_index = j["programIdIndex"].get<uint64_t>();
+    metaInstruction.accounts = j["accounts"].get<std::vector<uint64_t>>();
+    metaInstruction.data = j["data"].get<std::string>();
+  }
+
+  void from_json(const json& j, TransactionResponse::Meta::InnerInstruction& metaInnerInstruction) {
+    metaInnerInstruction.index = j["index"].get<uint64_t>();
+    metaInnerInstruction.instructions = j["instructions"].get<std::vector<TransactionResponse::Meta::InnerInstruction::Instruction>>();
+  }
+
+  void from_json(const json& j, TransactionResponse::Meta::TransactionReward& reward) {
+    reward.pubkey = j["pubkey"].get<PublicKey>();
+    reward.lamports = j["lamports"].get<uint64_t>();
+    reward.post_balance = j["postBalance"].get<uint64_t>();
+    reward.reward_type = j["rewardType"].get<std::string>();
+    if (j.contains("commission")) {
+      reward.commission = j["commission"].get<uint8_t>();
+    }
+  }
+
+  void from_json(const json& j, TransactionResponse::Meta::LoadedAddresses& loadedAddresses) {
+    loadedAddresses.readonly = j["readonly"].get<std::vector<PublicKey>>();
+    loadedAddresses.writable = j["writable"].get<std::vector<PublicKey>>();
+  }
+
+  void from_json(const json& j, TransactionResponse::Meta& meta) {
+    if (!j.at("err").is_null()) {
+      meta.err = j["err"].get<std::string>();
+    } else {
+      meta.err = "";
+    }
+    meta.fee = j["fee"].get<uint64_t>();
+    meta.inner_instructions = j["innerInstructions"].get<std::vector<TransactionResponse::Meta::InnerInstruction>>();
+    meta.log_messages = j["logMessages"].get<std::vector<std::string>>();
+    meta.loaded_addresses = j["loadedAddresses"].get<TransactionResponse::Meta::LoadedAddresses>();
+    meta.post_balances = j["postBalances"].get<std::vector<uint64_t>>();
+    meta.post_token_balances = j["postTokenBalances"].get<std::vector<TokenBalance>>();
+    meta.pre_balances = j["preBalances"].get<std::vector<uint64_t>>();
+    meta.pre_token_balances = j["preTokenBalances"].get<std::vector<TokenBalance>>();
+    meta.rewards = j["rewards"].get<std::vector<TransactionResponse::Meta::TransactionReward>>();
+  }
+
+  void from_json(const json& j, TransactionResponse& transactionResponse) {
+    transactionResponse.slot = j["slot"].get<uint64_t>();
+    transactionResponse.block_time = j["blockTime"].get<uint64_t>();
+    transactionResponse.transaction = j["transaction"].get<CompiledTransaction>();
+    transactionResponse.meta = j["meta"].get<TransactionResponse::Meta>();
+    if (j.contains("returnData")) {
+      transactionResponse.return_data = j["returnData"].get<TransactionResponseReturnData>();
+    }
+  }
+
+  struct SimulatedTransactionResponse {
+    /** Error if the transaction failed */
+    std::string err;
+    /** Array of log messages the transaction instructions output during execution */
+    std::vector<std::string> logs;
+    /** Array of accounts with the same length as the accounts.addresses array in the request */
+    std::vector<AccountInfo> accounts;
+    /** The number of compute budget units consumed during the processing of this transaction */
+    uint64_t units_consumed;
+    /** The return data for the simulated transaction */
+    TransactionResponseReturnData return_data;
+  };
+
+  void from_json(const json& j, SimulatedTransactionResponse& simulatedTransactoinResponse) {
+    simulatedTransactoinResponse.err = j["value"]["err"].get<std::string>();
+    simulatedTransactoinResponse.logs = j["value"]["logs"].get<std::vector<std::string>>();
+    simulatedTransactoinResponse.accounts = j["value"]["accounts"].get<std::vector<AccountInfo>>();
+    simulatedTransactoinResponse.units_consumed = j["value"]["unitsConsumed"].get<uint64_t>();
+    simulatedTransactoinResponse.return_data = j["value"]["returnData"].get<TransactionResponseReturnData>();
+  }
+
+  /**
+   * Keeps only the newest state of each account, ordered by Context.slot, plus a
+   * dirty set of the accounts that changed since they were last drained. Feed it
+   * from a subscription and drain() it at the consumer's own pace: states that were
+   * replaced before drain() are never handed to the consumer.
+   */
+  class LatestAccountStore {
+    struct Entry {
+      uint64_t slot = 0;
+      Result<Account> account;
+      bool dirty = false;
+    };
+
+    PubkeyMap<Entry> _entries;
+    std::deque<PublicKey> _dirty;
+    uint64_t _updates = 0;
+    uint64_t _conflated = 0;
+    uint64_t _stale = 0;
+
+  public:
+
+    /**
+     * Stores the state of an account, unless a newer slot is already stored.
+     *
+     * @param account_id The account
+     * @param account The new state
+     *
+     * @return false if the update was older than the stored state
+     */
+    bool update(const PublicKey& account_id, Result<Account> account) {
+      uint64_t slot = account._context ? account._context->slot : 0;
+      _updates++;
+      Entry& entry = _entries[account_id];
+      if (slot < entry.slot) {
+        _stale++;
+        return false;
+      }
+      entry.slot = slot;
+      entry.account = std::move(account);
+      if (entry.dirty) {
+        _conflated++;
+      } else {
+        entry.dirty = true;
+        _dirty.push_back(account_id);
+      }
+      return true;
+    }
+
+    /**
+     * Calls callback with the latest state of each dirty account, in the order
+     * they first changed, and marks them clean.
+     * The callback must not update() the store.
+     *
+     * @param callback The callback function to call for each dirty account
+     * @param max The most accounts to deliver
+     *
+     * @return The number of accounts delivered
+     */
+    size_t drain(const std::function<void(const PublicKey&, const Result<Account>&)>& callback, size_t max = SIZE_MAX) {
+      size_t count = 0;
+      while (count < max && !_dirty.empty()) {
+        PublicKey account_id = _dirty.front();
+        _dirty.pop_front();
+        Entry& entry = *_entries.find(account_id);
+        entry.dirty = false;
+        callback(account_id, entry.account);
+        count++;
+      }
+      return count;
+    }
+
+    /**
+     * Returns the latest state of an account, or nullptr if none was stored.
+     */
+    const Result<Account>* latest(const PublicKey& account_id) const {
+      const Entry* entry = _entries.find(account_id);
+      return entry ? &entry->account : nullptr;
+    }
+
+    /** The number of accounts waiting to be drained */
+    size_t dirty_count() const {
+      return _dirty.size();
+    }
+
+    /** The number of updates stored */
+    uint64_t updates() const {
+      return _updates;
+    }
+
+    /** The number of updates that replaced a state that was never drained */
+    uint64_t conflated() const {
+      return _conflated;
+    }
+
+    /** The number of updates dropped because a newer slot was already stored */
+    uint64_t stale() const {
+      return _stale;
+    }
+  };
+
+  struct SubscriptionGap {
+    /** The last slot seen before the websocket dropped */
+    uint64_t last_slot;
+    /** The first slot seen after the subscriptions were replayed */
+    uint64_t resume_slot;
+    /** How long the websocket was down, in milliseconds */
+    uint64_t downtime_ms;
+    /** Accounts with an account listener, which may have missed updates (see get_multiple_accounts) */
+    std::vector<PublicKey> accounts;
+    /** Programs with a program account listener, which may have missed updates (see get_program_accounts) */
+    std::vector<PublicKey> programs;
+  };
+
+  enum class OverflowPolicy {
+    /** The network thread waits for the strategy thread to make room */
+    Block,
+    /** The oldest queued update is discarded */
+    DropOldest,
+    /** Only the latest update per account is kept; older queued updates are replaced */
+    ConflateByKey,
+  };
+
+  struct NetworkThreadOptions {
+    /** The cpu core to pin the network thread to, or -1 to leave it unpinned */
+    int cpu = -1;
+    /** The number of updates the ring can hold */
+    size_t capacity = 65536;
+    /** What to do when the ring is full */
+    OverflowPolicy overflow = OverflowPolicy::Block;
+  };
+
+  struct NetworkThreadStats {
+    /** The number of updates waiting in the ring */
+    size_t depth;
+    /** The deepest the ring has been */
+    size_t high_water;
+    /** The number of updates pushed into the ring */
+    uint64_t pushed;
+    /** The number of updates discarded by OverflowPolicy::DropOldest */
+    uint64_t dropped;
+    /** The number of updates replaced by a newer one under OverflowPolicy::ConflateByKey */
+    uint64_t conflated;
+    /** The number of exceptions caught on the network thread, e.g. from a message that failed to decode */
+    uint64_t errors;
+    /** The number of per-key mailboxes held under OverflowPolicy::ConflateByKey */
+    size_t mailboxes;
+  };
+
+  struct SubscriptionUpdate {
+    /** A slot for the latest update of one key, used by OverflowPolicy::ConflateByKey */
+    struct Mailbox {
+      std::atomic<SubscriptionUpdate*> latest{nullptr};
+
+      ~Mailbox() {
+        delete latest.load();
+      }
+    };
+
+    /** The server subscription the update belongs to, or 0 for a subscription gap or task */
+    int subscription_id = 0;
+    /** The parsed notification, or a task to run on the strategy thread */
+    std::variant<std::monostate, Result<Account>, Result<AccountInfo>, Result<SlotInfo>, Result<Logs>, SubscriptionGap, std::function<void()>> value;
+    /** Set instead of value when the update was conflated */
+    std::shared_ptr<Mailbox> mailbox;
+  };
+
+  /**
+   * A consistent hash ring. Each node owns 64 points on the ring and a key belongs
+   * to the first node clockwise from its hash, so adding a node only moves the
+   * keys that land on the new node's points.
+   */
+  class HashRing {
+    std::vector<std::pair<uint64_t, size_t>> _points;
+
+  public:
+
+    static uint64_t hash(const std::string& key) {
+      uint64_t hash = 14695981039346656037ULL;
+      for (char c : key) {
+        hash ^= (uint8_t)c;
+        hash *= 1099511628211ULL;
+      }
+      return hash;
+    }
+
+    void add(size_t node) {
+      for (int vnode = 0; vnode < 64; vnode++) {
+        _points.push_back({ hash(std::to_string(node) + "#" + std::to_string(vnode)), node });
+      }
+      std::sort(_points.begin(), _points.end());
+    }
+
+    void clear() {
+      _points.clear();
+    }
+
+    /**
+     * Returns the first node clockwise from the key that accepts(node) allows, or
+     * nothing if no node does.
+     */
+    template <typename F>
+    std::optional<size_t> find(const std::string& key, F accepts) const {
+      auto it = std::lower_bound(_points.begin(), _points.end(), std::make_pair(hash(key), (size_t)0));
+      for (size_t i = 0; i < _points.size(); i++, it++) {
+        if (it == _points.end()) {
+          it = _points.begin();
+        }
+        if (accepts(it->second)) {
+          return it->second;
+        }
+      }
+      return std::nullopt;
+    }
+
+    /**
+     * Returns the node a key belongs to.
+     */
+    size_t find(const std::string& key) const {
+      return *find(key, [](size_t) { return true; });
+    }
+  };
+
+  enum class ShardPlacement {
+    /** Each key hashes to a fixed socket, so placement survives restarts */
+    ConsistentHash,
+    /** Each subscription goes to the socket with the fewest subscriptions */
+    LeastLoaded,
+  };
+
+  class Connection {
+    Commitment _commitment;
+    std::string _rpc_endpoint;
+    std::string _rpc_ws_endpoint;
+    std::atomic<bool> _receive_timestamps{false};
+
+    struct Shard {
+      std::unique_ptr<websockets::WebSocketClient> socket;
+      /** The number of account, program and logs subscriptions on this socket */
+      size_t feeds = 0;
+      /** The number of subscriptions on this socket with an activity timeout */
+      size_t timed = 0;
+      /** The slot subscription kept for stale detection, or 0 */
+      int slot_watch = 0;
+      /** The latest slot seen on this socket, and when it last advanced */
+      uint64_t last_slot = 0;
+      std::chrono::steady_clock::time_point slot_advanced_at;
+      /** The latest slot seen on any socket when this one dropped, while it is down */
+      std::optional<uint64_t> drop_slot;
+      /** The gap to report on the first notification on this socket after it resubscribes */
+      std::optional<SubscriptionGap> pending_gap;
+    };
+
+    /** When a subscription last delivered, for the activity timeout */
+    struct Activity {
+      std::chrono::milliseconds timeout{0};
+      std::chrono::steady_clock::time_point notified_at;
+      /** The slot of the socket at the last notification */
+      uint64_t notified_slot = 0;
+    };
+
+    struct Placement {
+      size_t shard;
+      std::string key;
+      std::string unsubscribe_method;
+      bool feed;
+      std::shared_ptr<Activity> activity;
+    };
+
+    std::vector<Shard> _shards;
+    ShardPlacement _shard_placement = ShardPlacement::ConsistentHash;
+    size_t _max_subscriptions_per_socket = 0;
+    HashRing _hash_ring;
+    std::map<int, Placement> _placements;
+    std::vector<std::function<void(websockets::WebSocketClient&)>> _socket_options;
+    bool _rebalance_pending = false;
+    std::atomic<int> _next_subscription_id{0};
+    websockets::WebSocketClient* _polling_socket = nullptr;
+    size_t _polling_shard = 0;
+
+    bool _threaded = false;
+    std::atomic<bool> _running{false};
+    std::thread _network_thread;
+    NetworkThreadOptions _network_thread_options;
+    std::unique_ptr<SpscRing<std::function<void()>>> _commands;
+    std::unique_ptr<SpscRing<SubscriptionUpdate>> _updates;
+    std::unique_ptr<SpscRing<SubscriptionUpdate>> _control;
+    /**
+     * The mailboxes of one subscription by account, or by the zero key for a
+     * subscription with a single key. A mailbox the strategy thread has emptied is
+     * only swept out once the map has grown past sweep_at, which bounds it by the
+     * keys still queued rather than every key ever seen.
+     */
+    struct Mailboxes {
+      PubkeyMap<std::shared_ptr<SubscriptionUpdate::Mailbox>> map;
+      size_t sweep_at = 64;
+    };
+    std::map<int, Mailboxes> _mailboxes;
+
+    /**
+     * Listeners with the same method and params (which include the commitment)
+     * share one server subscription. The channel id is the id of the listener that
+     * created it, and the last listener to leave sends the unsubscribe.
+     */
+    struct Channel {
+      std::string key;
+      std::map<int, std::function<void(SubscriptionUpdate&, bool)>> listeners;
+    };
+
+    std::map<int, Channel> _channels;
+    std::map<std::string, int> _channel_ids;
+    std::map<int, int> _listeners;
+    bool _dispatching = false;
+    std::vector<std::function<void()>> _deferred_unsubscribes;
+    std::set<int> _removed_listeners;
+    std::atomic<size_t> _high_water{0};
+    std::atomic<uint64_t> _pushed{0};
+    std::atomic<uint64_t> _dropped{0};
+    std::atomic<uint64_t> _conflated{0};
+    std::atomic<size_t> _mailbox_count{0};
+    std::atomic<uint64_t> _errors{0};
+
+    /** A copy of one socket's state, published by the network thread for the getters */
+    struct SocketSnapshot {
+      bool connected = false;
+      bool reconnecting = false;
+      size_t subscriptions = 0;
+      uint64_t rtt_us = 0;
+      websockets::WebSocketClient::DeflateStats deflate;
+      Arena::Stats arena;
+    };
+
+    mutable std::mutex _snapshot_mutex;
+    std::vector<SocketSnapshot> _snapshots;
+    std::chrono::steady_clock::time_point _snapshot_at;
+
+    std::map<int, PublicKey> _account_subscriptions;
+    std::map<int, PublicKey> _program_subscriptions;
+    uint64_t _last_slot = 0;
+    std::map<int, PublicKey> _logs_subscriptions;
+    std::function<void(const SubscriptionGap&)> _on_subscription_gap;
+
+    std::chrono::milliseconds _stale_timeout{0};
+    std::set<int> _timed_subscriptions;
+
+    static std::string make_websocket_url(std::string endpoint) {
+      auto url = endpoint;
+      url.replace(0, 4, "ws");
+      return url;
+    }
+
+    void add_shard() {
+      size_t index = _shards.size();
+      Shard shard;
+      shard.socket = std::make_unique<websockets::WebSocketClient>(_rpc_ws_endpoint);
+      shard.socket->on_reconnect([this, index](uint64_t downtime_ms) {
+        on_reconnect(index, downtime_ms);
+      });
+      for (auto& option : _socket_options) {
+        option(*shard.socket);
+      }
+      _shards.push_back(std::move(shard));
+      _hash_ring.add(index);
+    }
+
+    /**
+     * Applies a websocket option to every socket in the pool, including sockets added later.
+     */
+    void configure_sockets(std::function<void(websockets::WebSocketClient&)> option) {
+      for (auto& shard : _shards) {
+        option(*shard.socket);
+      }
+      _socket_options.push_back(option);
+    }
+
+    bool has_room(size_t shard) {
+      return _max_subscriptions_per_socket == 0 || _shards[shard].socket->subscription_count() < _max_subscriptions_per_socket;
+    }
+
+    /**
+     * Returns the socket a key belongs on when every socket is up: the first socket
+     * with room clockwise from the key on the hash ring.
+     */
+    size_t home_shard(const std::string& key) {
+      return _hash_ring.find(key, [this](size_t shard) { return has_room(shard); }).value_or(_hash_ring.find(key));
+    }
+
+    /**
+     * Picks the socket for a new subscription, avoiding sockets that are reconnecting.
+     */
+    size_t place(const std::string& key) {
+      size_t best = _shards.size();
+      if (_shard_placement == ShardPlacement::ConsistentHash) {
+        auto shard = _hash_ring.find(key, [this](size_t shard) {
+          return has_room(shard) && !_shards[shard].socket->is_reconnecting();
+        });
+        if (shard) {
+          return *shard;
+        }
+      } else {
+        for (size_t i = 0; i < _shards.size(); i++) {
+          if (!has_room(i) || _shards[i].socket->is_reconnecting()) {
+            continue;
+          }
+          if (best == _shards.size() || _shards[i].socket->subscription_count() < _shards[best].socket->subscription_count()) {
+            best = i;
+          }
+        }
+        if (best != _shards.size()) {
+          return best;
+        }
+      }
+
+      // Every socket is full or reconnecting
+      for (size_t i = 0; i < _shards.size(); i++) {
+        if (best == _shards.size() || _shards[i].socket->subscription_count() < _shards[best].socket->subscription_count()) {
+          best = i;
+        }
+      }
+      if (!has_room(best)) {
+        std::cerr << "WEBSOCKET SUBSCRIPTION LIMIT REACHED" << std::endl;
+      }
+      return best;
+    }
+
+    void move_placement(int subscription_id, Placement& placement, size_t to) {
+      if (!_shards[placement.shard].socket->move_subscription(subscription_id, placement.unsubscribe_method, *_shards[to].socket)) {
+        return;
+      }
+      if (placement.feed) {
+        remove_feed(placement.shard);
+        add_feed(to);
+      }
+      if (placement.activity->timeout.count() != 0) {
+        _shards[placement.shard].timed--;
+        _shards[to].timed++;
+        watch_slots(placement.shard);
+        watch_slots(to);
+      }
+      placement.shard = to;
+      reset_activity(placement);
+    }
+
+    /**
+     * Moves subscriptions that were placed elsewhere while a socket was down. With
+     * consistent hashing every subscription goes back to its home socket; with
+     * least-loaded placement, subscriptions move until the socket loads are within one.
+     */
+    void rebalance() {
+      _rebalance_pending = false;
+      if (_shards.size() < 2) {
+        return;
+      }
+
+      if (_shard_placement == ShardPlacement::ConsistentHash) {
+        for (auto& [subscription_id, placement] : _placements) {
+          size_t home = home_shard(placement.key);
+          if (home != placement.shard && !_shards[home].socket->is_reconnecting()) {
+            move_placement(subscription_id, placement, home);
+          }
+        }
+        return;
+      }
+
+      while (true) {
+        size_t lightest = _shards.size();
+        size_t heaviest = _shards.size();
+        for (size_t i = 0; i < _shards.size(); i++) {
+          if (_shards[i].socket->is_reconnecting()) {
+            continue;
+          }
+          size_t count = _shards[i].socket->subscription_count();
+          if (lightest == _shards.size() || count < _shards[lightest].socket->subscription_count()) {
+            lightest = i;
+          }
+          if (heaviest == _shards.size() || count > _shards[heaviest].socket->subscription_count()) {
+            heaviest = i;
+          }
+        }
+        if (lightest == _shards.size() || _shards[heaviest].socket->subscription_count() <= _shards[lightest].socket->subscription_count() + 1) {
+          return;
+        }
+        auto it = std::find_if(_placements.rbegin(), _placements.rend(), [&](auto& entry) {
+          return entry.second.shard == heaviest;
+        });
+        if (it == _placements.rend()) {
+          return;
+        }
+        move_placement(it->first, it->second, lightest);
+      }
+    }
+
+    void poll_shards() {
+      for (size_t i = 0; i < _shards.size(); i++) {
+        _polling_shard = i;
+        _polling_socket = _shards[i].socket.get();
+        _polling_socket->poll();
+        note_drop(i);
+      }
+      check_stale();
+      if (_rebalance_pending) {
+        rebalance();
+      }
+    }
+
+    /**
+     * Records the slot a socket dropped at, so its gap starts there rather than
+     * where the other sockets have got to by the time it is back.
+     */
+    void note_drop(size_t shard) {
+      if (!_shards[shard].drop_slot && _shards[shard].socket->is_reconnecting()) {
+        _shards[shard].drop_slot = _last_slot;
+      }
+    }
+
+    void on_reconnect(size_t shard, uint64_t downtime_ms) {
+      reset_stale_timer(shard);
+      for (int subscription_id : _timed_subscriptions) {
+        if (_placements[subscription_id].shard == shard) {
+          reset_activity(_placements[subscription_id]);
+        }
+      }
+      _rebalance_pending = true;
+
+      // A socket that drops again before its gap is reported keeps the earlier start
+      Shard& dropped = _shards[shard];
+      if (!dropped.pending_gap) {
+        dropped.pending_gap = SubscriptionGap{ dropped.drop_slot.value_or(_last_slot), 0, 0, {}, {} };
+      }
+      dropped.drop_slot.reset();
+      SubscriptionGap& gap = *dropped.pending_gap;
+      gap.downtime_ms = std::max(gap.downtime_ms, downtime_ms);
+      gap.accounts.clear();
+      gap.programs.clear();
+      for (auto& [subscription_id, account_id] : _account_subscriptions) {
+        if (_placements[subscription_id].shard == shard) {
+          gap.accounts.push_back(account_id);
+        }
+      }
+      for (auto& [subscription_id, program_id] : _program_subscriptions) {
+        if (_placements[subscription_id].shard == shard) {
+          gap.programs.push_back(program_id);
+        }
+      }
+    }
+
+    /**
+     * Decodes a notification message into a Result<T>, without a json DOM. Program
+     * notifications hold {pubkey, account} values; pass account_id for those, and
+     * the pubkey is returned in it.
+     */
+    template <typename T>
+    static Result<T> decode_notification(const char* message, size_t message_size, PublicKey* account_id) {
+      if constexpr (std::is_same_v<T, Account> || std::is_same_v<T, AccountInfo>) {
+        if (account_id) {
+          Result<AccountInfo> info;
+          sax::decode<Result<AccountInfo>, NotificationDecoder<AccountInfo>>(message, message_size, info);
+          if (info._result) {
+            *account_id = info._result->pubkey;
+          }
+          if constexpr (std::is_same_v<T, AccountInfo>) {
+            return info;
+          } else {
+            Result<Account> result;
+            result._context = info._context;
+            result._error = std::move(info._error);
+            if (info._result) {
+              result._result = std::move(info._result->account);
+            }
+            return result;
+          }
+        }
+      }
+      Result<T> result;
+      sax::decode<Result<T>, NotificationDecoder<T>>(message, message_size, result);
+      return result;
+    }
+
+    /** The slot of a notification, from its context or from a slot notification */
+    template <typename T>
+    static std::optional<uint64_t> notification_slot(const Result<T>& result) {
+      if (result._context) {
+        return result._context->slot;
+      }
+      if constexpr (std::is_same_v<T, SlotInfo>) {
+        if (result._result) {
+          return result._result->slot;
+        }
+      }
+      return std::nullopt;
+    }
+
+    /**
+     * Tracks the latest slot seen on any subscription and on the socket being
+     * polled, and reports that socket's slot gap on its first notification after
+     * a reconnect.
+     */
+    void observe_slot(std::optional<uint64_t> notification_slot) {
+      if (!notification_slot) {
+        return;
+      }
+      uint64_t slot = *notification_slot;
+
+      Shard& shard = _shards[_polling_shard];
+      if (slot > shard.last_slot) {
+        shard.last_slot = slot;
+        shard.slot_advanced_at = std::chrono::steady_clock::now();
+      }
+
+      if (shard.pending_gap) {
+        SubscriptionGap gap = std::move(*shard.pending_gap);
+        shard.pending_gap.reset();
+        gap.resume_slot = slot;
+        if (_threaded) {
+          SubscriptionUpdate update;
+          update.value = std::move(gap);
+          push_control(std::move(update));
+        } else if (_on_subscription_gap) {
+          _on_subscription_gap(gap);
+        }
+      }
+
+      _last_slot = std::max(_last_slot, slot);
+    }
+
+    void reset_stale_timer(size_t shard) {
+      _shards[shard].slot_advanced_at = std::chrono::steady_clock::now();
+    }
+
+    /** Starts the activity timeout of a subscription over from now */
+    void reset_activity(Placement& placement) {
+      placement.activity->notified_at = std::chrono::steady_clock::now();
+      placement.activity->notified_slot = _shards[placement.shard].last_slot;
+    }
+
+    void add_feed(size_t shard) {
+      _shards[shard].feeds++;
+      watch_slots(shard);
+    }
+
+    void remove_feed(size_t shard) {
+      _shards[shard].feeds--;
+      watch_slots(shard);
+    }
+
+    /**
+     * Keeps a slot subscription on a socket while stale detection is on and the
+     * socket carries feeds, or while it carries a subscription with an activity
+     * timeout, so its slot is seen to advance even when every account on it is quiet.
+     */
+    void watch_slots(size_t shard) {
+      Shard& watched = _shards[shard];
+      bool wanted = (_stale_timeout.count() != 0 && watched.feeds != 0) || watched.timed != 0;
+      if (!wanted && watched.slot_watch != 0) {
+        watched.socket->unsubscribe(watched.slot_watch, "slotUnsubscribe");
+        watched.slot_watch = 0;
+      }
+      if (!wanted || watched.slot_watch != 0) {
+        return;
+      }
+      websockets::WebSocketClient::Subscription subscription;
+      subscription.method = "slotSubscribe";
+      subscription.on_message = [this](const char* message, size_t message_size) {
+        observe_slot(notification_slot(decode_notification<SlotInfo>(message, message_size, nullptr)));
+      };
+      _shards[shard].slot_watch = _shards[shard].socket->subscribe(++_next_subscription_id, std::move(subscription));
+      reset_stale_timer(shard);
+    }
+
+    /**
+     * A socket is stale when the slot it reports has not advanced for the stale
+     * timeout. Sockets with account, program or logs subscriptions also subscribe
+     * to slots while stale detection is on, so quiet accounts do not count.
+     *
+     * A socket is also stale when a subscription with an activity timeout has not
+     * delivered for that long while the slot of its socket advanced, which catches
+     * a feed that died on a socket that is otherwise alive. A stale socket is
+     * restarted, which replays its subscriptions on the next poll.
+     */
+    void check_stale() {
+      if (_stale_timeout.count() == 0 && _timed_subscriptions.empty()) {
+        return;
+      }
+      auto now = std::chrono::steady_clock::now();
+      if (_stale_timeout.count() != 0) {
+        for (size_t i = 0; i < _shards.size(); i++) {
+          Shard& shard = _shards[i];
+          if (shard.feeds != 0 && !shard.socket->is_reconnecting() && now - shard.slot_advanced_at > _stale_timeout) {
+            std::cerr << "STALE FEED" << std::endl;
+            restart_stale(i);
+          }
+        }
+      }
+      for (int subscription_id : _timed_subscriptions) {
+        Placement& placement = _placements[subscription_id];
+        const Activity& activity = *placement.activity;
+        Shard& shard = _shards[placement.shard];
+        if (!shard.socket->is_reconnecting() && now - activity.notified_at > activity.timeout && shard.last_slot > activity.notified_slot) {
+          std::cerr << "SILENT FEED" << std::endl;
+          restart_stale(placement.shard);
+        }
+      }
+    }
+
+    void restart_stale(size_t shard) {
+      reset_stale_timer(shard);
+      _shards[shard].socket->restart();
+      note_drop(shard);
+    }
+
+    bool any_shard_connected() {
+      for (auto& shard : _shards) {
+        if (shard.socket->is_connected()) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void take_snapshot(const Shard& shard, SocketSnapshot& snapshot) const {
+      snapshot.connected = shard.socket->is_connected();
+      snapshot.reconnecting = shard.socket->is_reconnecting();
+      snapshot.subscriptions = shard.socket->subscription_count();
+      snapshot.rtt_us = shard.socket->rtt_us();
+      snapshot.deflate = shard.socket->deflate_stats();
+      snapshot.arena = shard.socket->arena_stats();
+    }
+
+    /**
+     * Copies the socket state for the getters, at most once a millisecond. The
+     * network thread skips a round rather than wait for a getter to finish.
+     */
+    void publish_snapshots() {
+      auto now = std::chrono::steady_clock::now();
+      if (now - _snapshot_at < std::chrono::milliseconds(1)) {
+        return;
+      }
+      std::unique_lock<std::mutex> lock(_snapshot_mutex, std::try_to_lock);
+      if (!lock.owns_lock()) {
+        return;
+      }
+      _snapshots.resize(_shards.size());
+      for (size_t i = 0; i < _shards.size(); i++) {
+        take_snapshot(_shards[i], _snapshots[i]);
+      }
+      _snapshot_at = now;
+    }
+
+    /**
+     * Returns the state of each socket: read directly when polling inline, or from
+     * the latest snapshot when the sockets belong to a network thread.
+     */
+    std::vector<SocketSnapshot> socket_snapshots() const {
+      if (_threaded) {
+        std::lock_guard<std::mutex> lock(_snapshot_mutex);
+        return _snapshots;
+      }
+      std::vector<SocketSnapshot> snapshots(_shards.size());
+      for (size_t i = 0; i < _shards.size(); i++) {
+        take_snapshot(_shards[i], snapshots[i]);
+      }
+      return snapshots;
+    }
+
+    /**
+     * Runs a command on the thread that owns the websocket.
+     */
+    void run_on_network_thread(std::function<void()> command) {
+      if (!_threaded) {
+        command();
+        return;
+      }
+      while (!_commands->try_push(std::move(command))) {
+        std::this_thread::yield();
+      }
+    }
+
+    void network_thread_main() {
+      if (_network_thread_options.cpu >= 0 && !pin_thread(_network_thread_options.cpu)) {
+        std::cerr << "FAILED TO PIN NETWORK THREAD" << std::endl;
+      }
+      std::function<void()> command;
+      while (true) {
+        // Commands queued before stop_network_thread() still run after the last poll
+        bool running = _running.load(std::memory_order_acquire);
+        // An exception escaping the thread would terminate the process, so count it and carry on
+        try {
+          while (_commands->try_pop(command)) {
+            command();
+          }
+          if (running) {
+            poll_shards();
+            publish_snapshots();
+          }
+        } catch (const std::exception& e) {
+          _errors.fetch_add(1, std::memory_order_relaxed);
+          std::cerr << "NETWORK THREAD ERROR " << e.what() << std::endl;
+        }
+        if (!running) {
+          break;
+        }
+        if (!any_shard_connected()) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      }
+    }
+
+    /**
+     * Pushes an update into the ring from the network thread.
+     */
+    void push_update(SubscriptionUpdate&& update, OverflowPolicy overflow) {
+      if (overflow == OverflowPolicy::DropOldest) {
+        SubscriptionUpdate oldest;
+        while (!_updates->try_push(std::move(update))) {
+          if (_updates->try_pop(oldest)) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+      } else {
+        while (!_updates->try_push(std::move(update))) {
+          if (!_running.load(std::memory_order_acquire)) {
+            return;
+          }
+          std::this_thread::yield();
+        }
+      }
+      _pushed.fetch_add(1, std::memory_order_relaxed);
+      size_t depth = _updates->size();
+      if (depth > _high_water.load(std::memory_order_relaxed)) {
+        _high_water.store(depth, std::memory_order_relaxed);
+      }
+    }
+
+    /**
+     * Pushes a subscription gap or a task from the network thread. These go on a
+     * ring of their own that nothing is ever discarded from, so DropOldest only
+     * drops notifications.
+     */
+    void push_control(SubscriptionUpdate&& update) {
+      while (!_control->try_push(std::move(update))) {
+        if (!_running.load(std::memory_order_acquire)) {
+          return;
+        }
+        std::this_thread::yield();
+      }
+    }
+
+    /**
+     * Delivers the updates queued in a ring now, so a busy feed cannot keep
+     * poll() from returning.
+     */
+    size_t deliver(SpscRing<SubscriptionUpdate>& ring) {
+      size_t count = 0;
+      size_t queued = ring.size();
+      SubscriptionUpdate update;
+      while (count < queued && ring.try_pop(update)) {
+        dispatch(update);
+        count++;
+      }
+      return count;
+    }
+
+    /**
+     * Publishes a notification from the network thread. Under ConflateByKey the
+     * update is parked in a mailbox per key, and the ring only carries the mailbox
+     * when it was empty, so the strategy thread always sees the latest value.
+     */
+    template <typename T>
+    void publish(int subscription_id, Result<T>&& result, const PublicKey& key) {
+      auto update = std::make_unique<SubscriptionUpdate>();
+      update->subscription_id = subscription_id;
+      update->value = std::move(result);
+
+      if (_network_thread_options.overflow != OverflowPolicy::ConflateByKey) {
+        push_update(std::move(*update), _network_thread_options.overflow);
+        return;
+      }
+
+      Mailboxes& mailboxes = _mailboxes[subscription_id];
+      auto [slot, inserted] = mailboxes.map.insert(key, nullptr);
+      if (inserted) {
+        *slot = std::make_shared<SubscriptionUpdate::Mailbox>();
+        _mailbox_count.fetch_add(1, std::memory_order_relaxed);
+        if (mailboxes.map.size() >= mailboxes.sweep_at) {
+          sweep_mailboxes(mailboxes, key);
+          slot = mailboxes.map.find(key);
+        }
+      }
+      std::shared_ptr<SubscriptionUpdate::Mailbox>& mailbox = *slot;
+      SubscriptionUpdate* previous = mailbox->latest.exchange(update.release(), std::memory_order_acq_rel);
+      if (previous) {
+        delete previous;
+        _conflated.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        SubscriptionUpdate carrier;
+        carrier.subscription_id = subscription_id;
+        carrier.mailbox = mailbox;
+        push_update(std::move(carrier), OverflowPolicy::Block);
+      }
+    }
+
+    /**
+     * Drops the mailboxes of a subscription that the strategy thread has emptied,
+     * except the one for keep. Only the network thread fills a mailbox, so one seen
+     * empty here stays empty, and a carrier still queued keeps its own reference.
+     */
+    void sweep_mailboxes(Mailboxes& mailboxes, const PublicKey& keep) {
+      std::vector<PublicKey> empty;
+      for (auto& [key, mailbox] : mailboxes.map) {
+        if (!(key == keep) && mailbox->latest.load(std::memory_order_acquire) == nullptr) {
+          empty.push_back(key);
+        }
+      }
+      for (const PublicKey& key : empty) {
+        mailboxes.map.erase(key);
+      }
+      _mailbox_count.fetch_sub(empty.size(), std::memory_order_relaxed);
+      mailboxes.sweep_at = std::max<size_t>(64, mailboxes.map.size() * 2);
+    }
+
+    void dispatch(SubscriptionUpdate& update) {
+      if (update.mailbox) {
+        std::unique_ptr<SubscriptionUpdate> latest(update.mailbox->latest.exchange(nullptr, std::memory_order_acq_rel));
+        if (latest) {
+          dispatch(*latest);
+        }
+        return;
+      }
+      if (auto* gap = std::get_if<SubscriptionGap>(&update.value)) {
+        if (_on_subscription_gap) {
+          _on_subscription_gap(*gap);
+        }
+        return;
+      }
+      if (auto* task = std::get_if<std::function<void()>>(&update.value)) {
+        (*task)();
+        return;
+      }
+      auto it = _channels.find(update.subscription_id);
+      if (it == _channels.end()) {
+        return;
+      }
+      // The update is decoded once; every listener but the last gets a copy
+      auto& listeners = it->second.listeners;
+      for (auto listener = listeners.begin(); listener != listeners.end(); ++listener) {
+        if (!_removed_listeners.empty() && _removed_listeners.count(listener->first)) {
+          continue;
+        }
+        listener->second(update, std::next(listener) == listeners.end());
+      }
+    }
+
+    /**
+     * Runs a task on the strategy thread: directly when polling inline, or through
+     * the update ring when a network thread is running.
+     */
+    void run_on_strategy_thread(std::function<void()> task) {
+      if (!_threaded) {
+        task();
+        return;
+      }
+      SubscriptionUpdate update;
+      update.value = std::move(task);
+      push_control(std::move(update));
+    }
+
+    /**
+     * Adds a listener, subscribing on the websocket thread if no other listener
+     * has the same method and params. Feed subscriptions (account, program and
+     * logs) are tracked for gap reports and stale detection.
+     *
+     * When batch is given, the websocket work is appended to it instead of run.
+     *
+     * @return The listener id
+     */
+    template <typename T>
+    int subscribe(std::string method, json params, std::function<void(Result<T>)> callback, std::map<int, PublicKey>* feed = nullptr, PublicKey key = PublicKey(), std::vector<std::function<void()>>* batch = nullptr) {
+      int listener_id = ++_next_subscription_id;
+      // Listeners share a channel only if they decode notifications the same way
+      std::string channel_key = std::string(typeid(T).name()) + method + params.dump();
+      auto channel = _channel_ids.find(channel_key);
+      int subscription_id = channel == _channel_ids.end() ? listener_id : channel->second;
+
+      _listeners[listener_id] = subscription_id;
+      _channels[subscription_id].listeners[listener_id] = [callback](SubscriptionUpdate& update, bool last) {
+        auto& result = std::get<Result<T>>(update.value);
+        result._stamps.callback_start_ns = realtime_ns();
+        if (last) {
+          callback(std::move(result));
+        } else {
+          callback(result);
+        }
+      };
+      if (channel != _channel_ids.end()) {
+        return listener_id;
+      }
+      _channels[subscription_id].key = channel_key;
+      _channel_ids[channel_key] = subscription_id;
+
+      bool keyed_by_account = method == "programSubscribe";
+      std::string unsubscribe_method = method.substr(0, method.size() - 9) + "Unsubscribe";
+      std::string placement_key = feed ? key.to_base58() : method;
+
+      auto subscribe_on_socket = [=]() {
+        size_t shard = place(placement_key);
+        auto activity = std::make_shared<Activity>();
+        _placements[subscription_id] = { shard, placement_key, unsubscribe_method, feed != nullptr, activity };
+        websockets::WebSocketClient::Subscription subscription;
+        subscription.method = method;
+        subscription.params = params;
+        subscription.on_message = [this, subscription_id, keyed_by_account, activity](const char* message, size_t message_size) {
+          PublicKey account_id;
+          Result<T> result = decode_notification<T>(message, message_size, keyed_by_account ? &account_id : nullptr);
+          observe_slot(notification_slot(result));
+          if (activity->timeout.count() != 0) {
+            activity->notified_at = std::chrono::steady_clock::now();
+            activity->notified_slot = _shards[_polling_shard].last_slot;
+          }
+          result._stamps.recv_ns = _polling_socket->last_receive_ns();
+          result._stamps.parse_done_ns = realtime_ns();
+          if (!_threaded) {
+            SubscriptionUpdate update;
+            update.subscription_id = subscription_id;
+            update.value = std::move(result);
+            dispatch(update);
+            return;
+          }
+          PublicKey mailbox_key;
+          if (keyed_by_account && result.ok()) {
+            mailbox_key = account_id;
+          }
+          publish(subscription_id, std::move(result), mailbox_key);
+        };
+        _shards[shard].socket->subscribe(subscription_id, std::move(subscription));
+        if (feed) {
+          (*feed)[subscription_id] = key;
+          add_feed(shard);
+        }
+      };
+      if (batch) {
+        batch->push_back(subscribe_on_socket);
+      } else {
+        run_on_network_thread(subscribe_on_socket);
+      }
+      return listener_id;
     }
-  }
 
-  struct SimulatedTransactionResponse {
-    /** Error if the transaction failed */
-    std::string err;
-    /** Array of log messages the transaction instructions output during execution */
-    std::vector<std::string> logs;
-    /** Array of accounts with the same length as the accounts.addresses array in the request */
-    std::vector<AccountInfo> accounts;
-    /** The number of compute budget units consumed during the processing of this transaction */
-    uint64_t units_consumed;
-    /** The return data for the simulated transaction */
-    TransactionResponseReturnData return_data;
-  };
+    /**
+     * Removes a listener, and unsubscribes on the websocket thread if it was the
+     * last listener on its server subscription. Removals from inside a callback
+     * take effect once poll() has finished delivering.
+     */
+    void unsubscribe(int listener_id, std::string method, std::map<int, PublicKey>* feed = nullptr) {
+      if (_dispatching) {
+        _removed_listeners.insert(listener_id);
+        _deferred_unsubscribes.push_back([=]() {
+          unsubscribe(listener_id, method, feed);
+        });
+        return;
+      }
 
-  void from_json(const json& j, SimulatedTransactionResponse& simulatedTransactoinResponse) {
-    simulatedTransactoinResponse.err = j["value"]["err"].get<std::string>();
-    simulatedTransactoinResponse.logs = j["value"]["logs"].get<std::vector<std::string>>();
-    simulatedTransactoinResponse.accounts = j["value"]["accounts"].get<std::vector<AccountInfo>>();
-    simulatedTransactoinResponse.units_consumed = j["value"]["unitsConsumed"].get<uint64_t>();
-    simulatedTransactoinResponse.return_data = j["value"]["returnData"].get<TransactionResponseReturnData>();
-  }
+      auto listener = _listeners.find(listener_id);
+      if (listener == _listeners.end()) {
+        return;
+      }
+      int subscription_id = listener->second;
+      _listeners.erase(listener);
 
-  class Connection {
-    Commitment _commitment;
-    std::string _rpc_endpoint;
-    std::string _rpc_ws_endpoint;
-    websockets::WebSocketClient _rpc_web_socket;
+      auto channel = _channels.find(subscription_id);
+      channel->second.listeners.erase(listener_id);
+      if (!channel->second.listeners.empty()) {
+        return;
+      }
+      _channel_ids.erase(channel->second.key);
+      _channels.erase(channel);
 
-    static std::string make_websocket_url(std::string endpoint) {
-      auto url = endpoint;
-      url.replace(0, 4, "ws");
-      return url;
+      run_on_network_thread([=]() {
+        auto placement = _placements.find(subscription_id);
+        if (placement == _placements.end()) {
+          return;
+        }
+        Shard& shard = _shards[placement->second.shard];
+        shard.socket->unsubscribe(subscription_id, method);
+        if (placement->second.activity->timeout.count() != 0) {
+          _timed_subscriptions.erase(subscription_id);
+          shard.timed--;
+        }
+        if (feed) {
+          feed->erase(subscription_id);
+          remove_feed(placement->second.shard);
+        } else {
+          watch_slots(placement->second.shard);
+        }
+        _placements.erase(placement);
+        auto mailboxes = _mailboxes.find(subscription_id);
+        if (mailboxes != _mailboxes.end()) {
+          _mailbox_count.fetch_sub(mailboxes->second.map.size(), std::memory_order_relaxed);
+          _mailboxes.erase(mailboxes);
+        }
+      });
+    }
+
+    /**
+     * Sends an RPC request and decodes the stamped response.
+     */
+    template <typename T>
+    T post(json request) const {
+      return http::post<T>(_rpc_endpoint, request, _receive_timestamps);
     }
 
   public:
@@ -1142,15 +4033,16 @@ namespace solana {
     Connection(std::string endpoint, Commitment commitment = Commitment::Processed)
       : _commitment(commitment),
       _rpc_endpoint(endpoint),
-      _rpc_ws_endpoint(make_websocket_url(endpoint)),
-      _rpc_web_socket(_rpc_ws_endpoint) {
+      _rpc_ws_endpoint(make_websocket_url(endpoint)) {
       auto sodium_result = sodium_init();
       if (sodium_result == -1) {
         throw std::runtime_error("Failed to initialize libsodium");
       }
+      add_shard();
     }
 
     ~Connection() {
+      stop_network_thread();
     }
 
     Connection() = delete;
@@ -1167,7 +4059,7 @@ namespace solana {
      * @param public_key The Pubkey of account to query
      */
     Result<Account> get_account_info(const PublicKey& public_key) {
-      return http::post(_rpc_endpoint, {
+      return post<Result<Account>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getAccountInfo"},
@@ -1186,7 +4078,7 @@ namespace solana {
      * @param public_key The Pubkey of the account to query
      */
     Result<uint64_t> get_balance(const PublicKey& public_key) {
-      return http::post(_rpc_endpoint, {
+      return post<Result<uint64_t>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getBalance"},
@@ -1403,7 +4295,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * Returns information about all the nodes participating in the cluster.
      */
     Result<std::vector<ClusterNode>> get_cluster_nodes() {
-      return http::post(_rpc_endpoint, {
+      return post<Result<std::vector<ClusterNode>>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getClusterNodes"},
@@ -1567,7 +4459,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * Returns the identity Pubkey of the current node.
      */
     Result<Identity> get_identity() {
-      return http::post(_rpc_endpoint, {
+      return post<Result<Identity>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getIdentity"},
@@ -1742,7 +4634,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * Returns the latest blockhash.
      */
     Result<Blockhash> get_latest_blockhash() const {
-      return http::post(_rpc_endpoint, {
+      return post<Result<Blockhash>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getLatestBlockhash"},
@@ -1772,7 +4664,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @param leader_address The Pubkey of the leader to query
      */
     Result<LeaderSchedule> get_leader_schedule(const PublicKey& leader_address) {
-      return http::post(_rpc_endpoint, {
+      return post<Result<LeaderSchedule>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getLeaderSchedule"},
@@ -1824,11 +4716,8 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @param public_keys The Pubkeys of the accounts to query
      */
     Result<std::vector<Account>> get_multiple_accounts(const std::vector<PublicKey>& public_keys) {
-      std::vector<std::string> base58Keys;
-      for (auto public_key : public_keys) {
-        base58Keys.push_back(public_key.to_base58());
-      }
-      return http::post(_rpc_endpoint, {
+      std::vector<std::string> base58Keys = to_base58(public_keys);
+      return post<Result<std::vector<Account>>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getMultipleAccounts"},
@@ -1847,7 +4736,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @param program_id The Pubkey of the program to query
      */
     Result<std::vector<AccountInfo>> get_program_accounts(const PublicKey& program_id) {
-      return http::post(_rpc_endpoint, {
+      return post<Result<std::vector<AccountInfo>>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getProgramAccounts"},
@@ -2025,7 +4914,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * Returns the slot that has reached the given or default commitment level.
      */
     Result<uint64_t> get_slot(const Commitment& commitment = Commitment::Finalized) {
-      return http::post(_rpc_endpoint, {
+      return post<Result<uint64_t>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getSlot"},
@@ -2036,7 +4925,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * Returns the current slot leader.
      */
     Result<PublicKey> get_slot_leader() {
-      return http::post(_rpc_endpoint, {
+      return post<Result<PublicKey>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getSlotLeader"},
@@ -2078,7 +4967,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @param token_address The Pubkey of the token account to query
      */
     Result<TokenBalance> get_token_account_balance(const PublicKey& token_address) {
-      return http::post(_rpc_endpoint, {
+      return post<Result<TokenBalance>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getTokenAccountBalance"},
@@ -2272,7 +5161,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @param owner_address The Pubkey of account owner to query
      */
     Result<std::vector<TokenAccount>> get_token_accounts_by_owner(const PublicKey& owner_address) {
-      return http::post(_rpc_endpoint, {
+      return post<Result<std::vector<TokenAccount>>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getTokenAccountsByOwner"},
@@ -2295,7 +5184,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @param token_mint The mint of the token to query
      */
     Result<std::vector<TokenAccount>> get_token_accounts_by_owner(const PublicKey& owner_address, const PublicKey& token_mint) {
-      return http::post(_rpc_endpoint, {
+      return post<Result<std::vector<TokenAccount>>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getTokenAccountsByOwner"},
@@ -2357,7 +5246,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @param token_mint The Pubkey of the token mint to query
      */
     Result<TokenBalance> get_token_supply(const PublicKey& token_mint) {
-      return http::post(_rpc_endpoint, {
+      return post<Result<TokenBalance>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getTokenSupply"},
@@ -2375,7 +5264,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
     Result<TransactionResponse> get_transaction(const std::string& transaction_signature) {
       //TODO commitment
 
-      return http::post(_rpc_endpoint, {
+      return post<Result<TransactionResponse>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getTransaction"},
@@ -2399,7 +5288,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * Returns the current solana versions running on the node.
      */
     Result<Version> get_version() {
-      return http::post(_rpc_endpoint, {
+      return post<Result<Version>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "getVersion"},
@@ -2489,7 +5378,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @param lamports The number of lamports to airdrop
      */
     Result<std::string> request_airdrop(const PublicKey& recipient_address, const uint64_t& lamports = LAMPORTS_PER_SOL) {
-      return http::post(_rpc_endpoint, {
+      return post<Result<std::string>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "requestAirdrop"},
@@ -2532,7 +5421,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
       std::vector<uint8_t> serialized_transaction = compiled_transaction.serialize(serialized_message);
       //std::cout << "Serialized transaction: " << base64::encode(serialized_transaction) << std::endl;
 
-      return http::post(_rpc_endpoint, {
+      return post<Result<std::string>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "sendTransaction"},
@@ -2551,7 +5440,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @param signed_transaction The signed transaction to simulate
      */
     Result<SimulatedTransactionResponse> simulate_transaction(const std::string& signed_transaction) {
-      return http::post(_rpc_endpoint, {
+      return post<Result<SimulatedTransactionResponse>>({
         {"jsonrpc", "2.0"},
         {"id", 1},
         {"method", "simulateTransaction"},
@@ -2566,21 +5455,350 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
 
     //-------- Websocket methods --------------------------------------------------------------------
 
-    bool is_connected() {
-      return _rpc_web_socket.is_connected();
+    /**
+     * Returns true if a websocket is connected and none is reconnecting. With a
+     * network thread running, this reflects the state up to a millisecond ago.
+     */
+    bool is_connected() const {
+      bool connected = false;
+      for (auto& snapshot : socket_snapshots()) {
+        if (snapshot.reconnecting) {
+          return false;
+        }
+        connected |= snapshot.connected;
+      }
+      return connected;
+    }
+
+    /**
+     * Poll the websocket for new messages. If the websocket has dropped, this
+     * reconnects (with backoff) and replays every active subscription.
+     *
+     * With a network thread running, this instead runs the callbacks for the
+     * updates waiting in the ring, on the calling thread. Subscription gaps and
+     * tasks are delivered ahead of queued notifications.
+     *
+     * @return The number of updates delivered from the ring
+     */
+    size_t poll() {
+      size_t count = 0;
+      _dispatching = true;
+      if (_updates) {
+        count += deliver(*_control);
+        count += deliver(*_updates);
+      }
+      if (!_threaded) {
+        poll_shards();
+      }
+      _dispatching = false;
+
+      auto deferred_unsubscribes = std::move(_deferred_unsubscribes);
+      _deferred_unsubscribes.clear();
+      _removed_listeners.clear();
+      for (auto& unsubscribe : deferred_unsubscribes) {
+        unsubscribe();
+      }
+      return count;
+    }
+
+    /**
+     * Enables spin mode on the websockets: non-blocking sockets with SO_BUSY_POLL,
+     * read without select(). Use it with spin(), or with a network thread pinned to
+     * its own core.
+     *
+     * @param enabled Whether to spin
+     * @param busy_poll_us How long the kernel busy-polls the NIC queue on each read
+     */
+    void set_spin(bool enabled, int busy_poll_us = 50) {
+      run_on_network_thread([=]() {
+        configure_sockets([=](websockets::WebSocketClient& socket) {
+          socket.set_spin(enabled, busy_poll_us);
+        });
+      });
+    }
+
+    /**
+     * Polls in a tight loop on the calling thread until running is cleared. The
+     * thread is pinned to cpu first. Nothing is logged on this path unless the
+     * connection fails.
+     *
+     * @param running Cleared (from any thread) to stop spinning
+     * @param cpu The core to pin to, or -1 to leave the thread unpinned
+     */
+    void spin(const std::atomic<bool>& running, int cpu = -1) {
+      if (cpu >= 0 && !pin_thread(cpu)) {
+        std::cerr << "FAILED TO PIN SPIN THREAD" << std::endl;
+      }
+      while (running.load(std::memory_order_relaxed)) {
+        poll();
+      }
+    }
+
+    /**
+     * Moves the websocket onto a dedicated network thread. The thread reads and
+     * parses notifications and pushes typed updates into a bounded lock-free ring,
+     * and poll() delivers them to the callbacks on the strategy thread, so a slow
+     * callback no longer stalls socket reads. Subscribing, unsubscribing and poll()
+     * must then all be called from the same strategy thread.
+     *
+     * This must be called before the websocket is connected.
+     *
+     * @param options The cpu to pin to, the ring capacity and the overflow policy
+     */
+    void start_network_thread(NetworkThreadOptions options = NetworkThreadOptions()) {
+      if (_threaded) {
+        throw std::runtime_error("Network thread already started");
+      }
+      if (any_shard_connected()) {
+        throw std::runtime_error("Network thread must be started before subscribing");
+      }
+      _network_thread_options = options;
+      _commands = std::make_unique<SpscRing<std::function<void()>>>(1024);
+      _updates = std::make_unique<SpscRing<SubscriptionUpdate>>(options.capacity);
+      _control = std::make_unique<SpscRing<SubscriptionUpdate>>(1024);
+      _snapshots = socket_snapshots();
+      _threaded = true;
+      _running.store(true, std::memory_order_release);
+      _network_thread = std::thread([this]() { network_thread_main(); });
+    }
+
+    /**
+     * Stops the network thread. The websocket stays connected and is polled
+     * inline again; updates still in the ring are delivered by the next poll().
+     */
+    void stop_network_thread() {
+      if (!_threaded) {
+        return;
+      }
+      _running.store(false, std::memory_order_release);
+      _network_thread.join();
+      _threaded = false;
+    }
+
+    /**
+     * Returns queue depth metrics for the network thread ring.
+     */
+    NetworkThreadStats network_thread_stats() const {
+      return {
+        _updates ? _updates->size() : 0,
+        _high_water.load(std::memory_order_relaxed),
+        _pushed.load(std::memory_order_relaxed),
+        _dropped.load(std::memory_order_relaxed),
+        _conflated.load(std::memory_order_relaxed),
+        _errors.load(std::memory_order_relaxed),
+        _mailbox_count.load(std::memory_order_relaxed),
+      };
+    }
+
+    /**
+     * Configures the websocket heartbeat.
+     *
+     * @param interval_ms Time between pings, or 0 to disable pings
+     * @param timeout_ms Time to wait for a pong before reconnecting
+     */
+    void set_heartbeat(uint64_t interval_ms, uint64_t timeout_ms = 5000) {
+      run_on_network_thread([=]() {
+        configure_sockets([=](websockets::WebSocketClient& socket) {
+          socket.set_heartbeat(interval_ms, timeout_ms);
+        });
+      });
+    }
+
+    /**
+     * Reconnect a socket with account, program or logs subscriptions when the
+     * slot it reports has not advanced for timeout_ms. Each such socket keeps a
+     * slot subscription while this is on.
+     *
+     * @param timeout_ms The stale timeout, or 0 to disable stale detection
+     */
+    void set_stale_timeout(uint64_t timeout_ms) {
+      run_on_network_thread([=]() {
+        _stale_timeout = std::chrono::milliseconds(timeout_ms);
+        for (size_t i = 0; i < _shards.size(); i++) {
+          reset_stale_timer(i);
+          watch_slots(i);
+        }
+      });
+    }
+
+    /**
+     * Reconnect the socket carrying a subscription when the subscription has not
+     * delivered for timeout_ms while the slot of that socket advanced. This is for
+     * feeds that are expected to be busy, such as programSubscribe on an active
+     * program, and catches a feed that dies on a socket that is otherwise alive.
+     * The socket keeps a slot subscription while it carries such a subscription.
+     *
+     * @param subscription_id The id returned when subscribing
+     * @param timeout_ms The activity timeout, or 0 to disable it
+     */
+    void set_activity_timeout(int subscription_id, uint64_t timeout_ms) {
+      auto listener = _listeners.find(subscription_id);
+      if (listener == _listeners.end()) {
+        return;
+      }
+      int channel_id = listener->second;
+      run_on_network_thread([=]() {
+        auto placement = _placements.find(channel_id);
+        if (placement == _placements.end()) {
+          return;
+        }
+        Activity& activity = *placement->second.activity;
+        Shard& shard = _shards[placement->second.shard];
+        if (timeout_ms != 0 && activity.timeout.count() == 0) {
+          _timed_subscriptions.insert(channel_id);
+          shard.timed++;
+        } else if (timeout_ms == 0 && activity.timeout.count() != 0) {
+          _timed_subscriptions.erase(channel_id);
+          shard.timed--;
+        }
+        activity.timeout = std::chrono::milliseconds(timeout_ms);
+        reset_activity(placement->second);
+        watch_slots(placement->second.shard);
+      });
+    }
+
+    /**
+     * Requests permessage-deflate compression for the websocket. This must be set
+     * before the first subscription, and requires MANY_PERMESSAGE_DEFLATE (link with -lz).
+     *
+     * @param enabled Whether to offer permessage-deflate in the handshake
+     * @param context_takeover Whether the server may keep its compression context between messages
+     */
+    void set_permessage_deflate(bool enabled, bool context_takeover = true) {
+      run_on_network_thread([=]() {
+        configure_sockets([=](websockets::WebSocketClient& socket) {
+          socket.set_permessage_deflate(enabled, context_takeover);
+        });
+      });
+    }
+
+    /**
+     * Returns compression ratio and inflate time metrics, summed over the websocket pool.
+     */
+    websockets::WebSocketClient::DeflateStats websocket_deflate_stats() const {
+      websockets::WebSocketClient::DeflateStats total;
+      for (auto& snapshot : socket_snapshots()) {
+        auto& stats = snapshot.deflate;
+        total.messages += stats.messages;
+        total.compressed_bytes += stats.compressed_bytes;
+        total.inflated_bytes += stats.inflated_bytes;
+        total.inflate_cpu_ns += stats.inflate_cpu_ns;
+      }
+      return total;
+    }
+
+    /**
+     * Returns the stats of the websocket parse arenas, combined over the websocket pool:
+     * cycles are summed, and the bytes per cycle are the largest of any socket.
+     */
+    Arena::Stats websocket_arena_stats() const {
+      Arena::Stats total;
+      for (auto& snapshot : socket_snapshots()) {
+        auto& stats = snapshot.arena;
+        total.cycles += stats.cycles;
+        total.last_cycle_bytes = std::max(total.last_cycle_bytes, stats.last_cycle_bytes);
+        total.peak_cycle_bytes = std::max(total.peak_cycle_bytes, stats.peak_cycle_bytes);
+        total.reserved_bytes += stats.reserved_bytes;
+      }
+      return total;
+    }
+
+    /**
+     * Enables kernel receive timestamps on the websockets and RPC requests, so
+     * LatencyStamps::recv_ns on each notification and response is the time the
+     * kernel (or NIC) received it rather than the time it was read.
+     *
+     * @param enabled Whether to request SO_TIMESTAMPING / SO_TIMESTAMPNS
+     */
+    void set_receive_timestamps(bool enabled) {
+      _receive_timestamps = enabled;
+      run_on_network_thread([=]() {
+        configure_sockets([=](websockets::WebSocketClient& socket) {
+          socket.set_receive_timestamps(enabled);
+        });
+      });
+    }
+
+    /**
+     * Returns the worst smoothed round-trip time across the websocket pool in
+     * microseconds, or 0 before the first pong.
+     */
+    uint64_t websocket_rtt_us() const {
+      uint64_t rtt_us = 0;
+      for (auto& snapshot : socket_snapshots()) {
+        rtt_us = std::max(rtt_us, snapshot.rtt_us);
+      }
+      return rtt_us;
+    }
+
+    /**
+     * Spreads subscriptions across a pool of websockets. Providers cap the number
+     * of subscriptions per socket, and a large notification on one socket no longer
+     * delays updates on the others. Subscription ids stay unique across the pool.
+     *
+     * When a socket reconnects, subscriptions that were placed elsewhere while it
+     * was down are moved back (ConsistentHash) or spread out evenly (LeastLoaded).
+     *
+     * This must be called before subscribing and before start_network_thread().
+     *
+     * @param count The number of websockets
+     * @param placement How subscriptions are assigned to websockets
+     * @param max_subscriptions_per_socket The provider's subscription cap, or 0 for no cap
+     */
+    void set_websocket_shards(size_t count, ShardPlacement placement = ShardPlacement::ConsistentHash, size_t max_subscriptions_per_socket = 0) {
+      if (_threaded || !_placements.empty()) {
+        throw std::runtime_error("Websocket shards must be set before subscribing");
+      }
+      ASSERT(count > 0);
+      _shard_placement = placement;
+      _max_subscriptions_per_socket = max_subscriptions_per_socket;
+      _shards.clear();
+      _hash_ring.clear();
+      while (_shards.size() < count) {
+        add_shard();
+      }
     }
 
     /**
-     * Poll the websocket for new messages.
+     * Returns the number of subscriptions on each websocket in the pool.
      */
-    void poll() {
-      if (_rpc_web_socket.is_connected()) {
-        _rpc_web_socket.poll();
+    std::vector<size_t> websocket_shard_loads() const {
+      std::vector<size_t> loads;
+      for (auto& snapshot : socket_snapshots()) {
+        loads.push_back(snapshot.subscriptions);
       }
+      return loads;
     }
 
     /**
-     * Add an account change listener.
+     * Enables or disables automatic websocket reconnects.
+     *
+     * @param enabled Whether to reconnect and replay subscriptions after an error
+     * @param min_backoff_ms Delay before the first reconnect attempt
+     * @param max_backoff_ms Upper bound for the exponential backoff between attempts
+     */
+    void set_auto_reconnect(bool enabled, uint64_t min_backoff_ms = 100, uint64_t max_backoff_ms = 5000) {
+      run_on_network_thread([=]() {
+        configure_sockets([=](websockets::WebSocketClient& socket) {
+          socket.set_reconnect(enabled, min_backoff_ms, max_backoff_ms);
+        });
+      });
+    }
+
+    /**
+     * Add a listener for subscription gaps. The callback is called once for each
+     * socket that reconnects, on the first notification on that socket, with the
+     * slots it may have missed and the accounts and programs it carries.
+     *
+     * @param callback The callback function to call with the gap
+     */
+    void on_subscription_gap(std::function<void(const SubscriptionGap&)> callback) {
+      _on_subscription_gap = callback;
+    }
+
+    /**
+     * Add an account change listener. Listeners on the same account share one
+     * server subscription, and each update is decoded once.
      *
      * @param account_id The account to listen for changes
      * @param callback The callback function to call when the account changes
@@ -2588,16 +5806,127 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @return The subscription ID. This can be used to remove the listener with remove_account_change_listener
     */
     int on_account_change(PublicKey account_id, std::function<void(Result<Account>)> callback) {
-      return _rpc_web_socket.subscribe("accountSubscribe", {
+      return subscribe<Account>("accountSubscribe", {
           account_id.to_base58(),
           {
             {"encoding", "base64"},
             {"commitment", _commitment},
           },
-        }, [callback](const json& j) {
-          callback(Result<Account>(j));
+        }, callback, &_account_subscriptions, account_id);
+    }
+
+    /**
+     * Add account change listeners for many accounts at once. The subscribe frames
+     * go out in a few large writes, and on_live reports once the server has
+     * confirmed every subscription (or it failed or timed out), so startup takes
+     * one or two round trips instead of one per account.
+     *
+     * @param account_ids The accounts to listen for changes
+     * @param callback The callback function to call when one of the accounts changes
+     * @param on_live Called with the listener ids that are live, failed or timed out
+     * @param timeout_ms How long to wait for the confirmations
+     *
+     * @return The subscription IDs, in the same order as account_ids
+    */
+    std::vector<int> subscribe_many(const std::vector<PublicKey>& account_ids, std::function<void(const PublicKey&, Result<Account>)> callback, std::function<void(const websockets::SubscribeReport&)> on_live = nullptr, uint64_t timeout_ms = 5000) {
+      std::vector<int> subscription_ids;
+      // Each listener with the channel whose server subscription decides whether it is live
+      std::vector<std::pair<int, int>> channels;
+      std::vector<std::function<void()>> batch;
+      for (auto& account_id : account_ids) {
+        int subscription_id = subscribe<Account>("accountSubscribe", {
+            account_id.to_base58(),
+            {
+              {"encoding", "base64"},
+              {"commitment", _commitment},
+            },
+          }, [callback, account_id](Result<Account> result) {
+            callback(account_id, std::move(result));
+          }, &_account_subscriptions, account_id, &batch);
+        subscription_ids.push_back(subscription_id);
+        channels.push_back({ subscription_id, _listeners[subscription_id] });
+      }
+
+      run_on_network_thread([this, batch = std::move(batch), channels, on_live, timeout_ms]() {
+        for (auto& shard : _shards) {
+          shard.socket->begin_batch();
         }
-      );
+        for (auto& subscribe_on_socket : batch) {
+          subscribe_on_socket();
+        }
+        for (auto& shard : _shards) {
+          shard.socket->end_batch();
+        }
+
+        // Listeners on a channel the server already confirmed are live now; the rest
+        // wait for the outcome of their channel's subscription, which may be shared
+        auto report = std::make_shared<websockets::SubscribeReport>();
+        auto waiting = std::make_shared<std::map<int, std::vector<int>>>();
+        std::vector<std::vector<int>> pending(_shards.size());
+        for (auto& [listener_id, channel_id] : channels) {
+          auto placement = _placements.find(channel_id);
+          if (placement == _placements.end()) {
+            report->failed.push_back(listener_id);
+          } else if (_shards[placement->second.shard].socket->is_confirmed(channel_id)) {
+            report->confirmed.push_back(listener_id);
+          } else {
+            auto& listeners = (*waiting)[channel_id];
+            if (listeners.empty()) {
+              pending[placement->second.shard].push_back(channel_id);
+            }
+            listeners.push_back(listener_id);
+          }
+        }
+
+        auto remaining = std::make_shared<size_t>(0);
+        auto done = [this, report, on_live]() {
+          if (on_live) {
+            run_on_strategy_thread([report, on_live]() {
+              on_live(*report);
+            });
+          }
+        };
+        for (size_t i = 0; i < _shards.size(); i++) {
+          if (pending[i].empty()) {
+            continue;
+          }
+          (*remaining)++;
+          _shards[i].socket->track_confirmations(pending[i], timeout_ms, [report, waiting, remaining, done](const websockets::SubscribeReport& shard_report) {
+            auto resolve = [&](const std::vector<int>& channel_ids, std::vector<int>& listener_ids) {
+              for (int channel_id : channel_ids) {
+                auto& listeners = (*waiting)[channel_id];
+                listener_ids.insert(listener_ids.end(), listeners.begin(), listeners.end());
+              }
+            };
+            resolve(shard_report.confirmed, report->confirmed);
+            resolve(shard_report.failed, report->failed);
+            resolve(shard_report.timed_out, report->timed_out);
+            report->elapsed_us = std::max(report->elapsed_us, shard_report.elapsed_us);
+            if (--(*remaining) == 0) {
+              done();
+            }
+          });
+        }
+        if (*remaining == 0) {
+          done();
+        }
+      });
+      return subscription_ids;
+    }
+
+    /**
+     * Add an account change listener that keeps only the latest state of the
+     * account in store. Drain the store at the consumer's pace.
+     *
+     * @param account_id The account to listen for changes
+     * @param store The store to keep the latest account state in; it must outlive the listener
+     *
+     * @return The subscription ID. This can be used to remove the listener with remove_account_change_listener
+    */
+    int on_account_change(PublicKey account_id, LatestAccountStore& store) {
+      return on_account_change(account_id, [&store, account_id](Result<Account> result) {
+        store.update(account_id, std::move(result));
+      });
     }
 
     /**
@@ -2608,7 +5937,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @return True if the listener was removed, false if the subscription_id was not found
     */
     void remove_account_listener(int subscription_id) {
-      _rpc_web_socket.unsubscribe(subscription_id, "accountUnsubscribe");
+      unsubscribe(subscription_id, "accountUnsubscribe", &_account_subscriptions);
     }
 
     //TODO
@@ -2648,7 +5977,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @return The subscription ID. This can be used to remove the listener with remove_on_logs_listener
     */
     int on_logs(PublicKey account_id, std::function<void(Result<Logs>)> callback) {
-      return _rpc_web_socket.subscribe("logsSubscribe", {
+      return subscribe<Logs>("logsSubscribe", {
           "mentions",
           {
             {"mentions", account_id.to_base58()}
@@ -2656,10 +5985,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
           {
             {"commitment", _commitment }
           },
-        }, [callback](const json& j) {
-          callback(Result<Logs>(j));
-        }
-      );
+        }, callback, &_logs_subscriptions, account_id);
     }
 
 
@@ -2671,7 +5997,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @return true if the listener was removed, false if the subscription_id was not found
     */
     void remove_on_logs_listener(int subscription_id) {
-      _rpc_web_socket.unsubscribe(subscription_id, "logsUnsubscribe");
+      unsubscribe(subscription_id, "logsUnsubscribe", &_logs_subscriptions);
     }
 
     /**
@@ -2683,16 +6009,41 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @return The subscription ID. This can be used to remove the listener with remove_program_account_listener
     */
     int on_program_account_change(PublicKey program_id, std::function<void(Result<Account>)> callback) {
-      return _rpc_web_socket.subscribe("programSubscribe", {
+      return subscribe<Account>("programSubscribe", {
           program_id.to_base58(),
           {
             {"encoding", "base64"},
             {"commitment", _commitment},
           },
-        }, [callback](const json& j) {
-          callback(Result<Account>(j));
-        }
-      );
+        }, callback, &_program_subscriptions, program_id);
+    }
+
+    /**
+     * Add a program account change listener that keeps only the latest state of
+     * each program account in store. Drain the store at the consumer's pace.
+     *
+     * @param program_id The program id to listen for
+     * @param store The store to keep the latest account states in; it must outlive the listener
+     *
+     * @return The subscription ID. This can be used to remove the listener with remove_program_account_listener
+    */
+    int on_program_account_change(PublicKey program_id, LatestAccountStore& store) {
+      return subscribe<AccountInfo>("programSubscribe", {
+          program_id.to_base58(),
+          {
+            {"encoding", "base64"},
+            {"commitment", _commitment},
+          },
+        }, [&store](Result<AccountInfo> result) {
+          if (!result.ok()) {
+            return;
+          }
+          Result<Account> account;
+          account._context = result._context;
+          account._stamps = result._stamps;
+          account._result = std::move(result._result->account);
+          store.update(result._result->pubkey, std::move(account));
+        }, &_program_subscriptions, program_id);
     }
 
     /**
@@ -2703,7 +6054,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @return true if the listener was removed, false if the subscription_id was not found
     */
     void remove_program_account_change_listnener(int subscription_id) {
-      _rpc_web_socket.unsubscribe(subscription_id, "programUnsubscribe");
+      unsubscribe(subscription_id, "programUnsubscribe", &_program_subscriptions);
     }
 
     /**
@@ -2714,11 +6065,8 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @return The subscription ID. This can be used to remove the listener with remove_slot_change_listener
     */
     int on_slot_change(std::function<void(Result<SlotInfo>)> callback) {
-      return _rpc_web_socket.subscribe("slotSubscribe", {
-        }, [callback](const json& j) {
-          callback(j);
-        }
-      );
+      return subscribe<SlotInfo>("slotSubscribe", {
+        }, callback);
     }
 
     /**
@@ -2729,7 +6077,7 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
      * @return true if the listener was removed, false if the subscription_id was not found
     */
     void remove_slot_change_listener(int subscription_id) {
-      _rpc_web_socket.unsubscribe(subscription_id, "slotUnsubscribe");
+      unsubscribe(subscription_id, "slotUnsubscribe");
     }
 
     //TODO
@@ -2781,9 +6129,8 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
     /**
      * Public key that identifies the System program
      */
-    static const PublicKey program_id;
+    static constexpr PublicKey program_id = SYSTEM_PROGRAM;
   };
-  const PublicKey SystemProgram::program_id = PublicKey("11111111111111111111111111111111");
 
   namespace token {
 
@@ -2805,37 +6152,13 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
       const PublicKey& program_id = TOKEN_PROGRAM_ID,
       const PublicKey& associated_token_program_id = ASSOCIATED_TOKEN_PROGRAM_ID
     ) {
-      json accounts = {
-        {
-          { "pubkey", payer.to_base58() },
-          { "isSigner", true },
-          { "isWritable", true },
-        },
-        {
-          { "pubkey", associated_token.to_base58() },
-          { "isSigner", false },
-          { "isWritable", true },
-        },
-        {
-          { "pubkey", owner.to_base58() },
-          { "isSigner", false },
-          { "isWritable", false },
-        },
-        {
-          { "pubkey", mint.to_base58() },
-          { "isSigner", false },
-          { "isWritable", false },
-        },
-        {
-          { "pubkey", SYSTEM_PROGRAM.to_base58() },
-          { "isSigner", false },
-          { "isWritable", false },
-        },
-        {
-          { "pubkey", program_id.to_base58() },
-          { "isSigner", false },
-          { "isWritable", false },
-        },
+      std::vector<Transaction::Message::Instruction::AccountMeta> accounts = {
+        { payer, true, true },
+        { associated_token, false, true },
+        { owner, false, false },
+        { mint, false, false },
+        { SYSTEM_PROGRAM, false, false },
+        { program_id, false, false },
       };
 
       return {
@@ -2898,17 +6221,63 @@ curl http://localhost:8899 -X POST -H "Content-Type: application/json" -d '
       }
 
       std::tuple<PublicKey, uint8_t> pda = PublicKey::find_program_address(
-        {
-          owner.to_buffer(),
-          program_id.to_buffer(),
-          mint.to_buffer()
-        },
+        { owner, program_id, mint },
         associated_token_program_id
       );
 
       return std::get<0>(pda);
     }
 
+    /**
+     * Returns the associated token account of each (owner, mint) pair, derived on a
+     * pool of threads.
+     *
+     * @param owners_and_mints The (owner, mint) pairs
+     * @param count The number of pairs
+     * @param addresses Receives count addresses, in order
+     * @param allow_owner_off_curve Allow the owners to be off curve
+     * @param program_id SPL Token program account
+     * @param associated_token_program_id SPL Associated Token program account
+     * @param threads The number of threads, 0 for one per core
+     */
+    void get_associated_token_addresses(
+      const std::pair<PublicKey, PublicKey>* owners_and_mints,
+      size_t count,
+      PublicKey* addresses,
+      const bool& allow_owner_off_curve = false,
+      const PublicKey& program_id = TOKEN_PROGRAM_ID,
+      const PublicKey& associated_token_program_id = ASSOCIATED_TOKEN_PROGRAM_ID,
+      size_t threads = 0
+    ) {
+      many::parallel_for(count, [&](size_t i) {
+        addresses[i] = get_associated_token_address(
+          owners_and_mints[i].second,
+          owners_and_mints[i].first,
+          allow_owner_off_curve,
+          program_id,
+          associated_token_program_id
+        );
+      }, threads);
+    }
+
+    std::vector<PublicKey> get_associated_token_addresses(
+      const std::vector<std::pair<PublicKey, PublicKey>>& owners_and_mints,
+      const bool& allow_owner_off_curve = false,
+      const PublicKey& program_id = TOKEN_PROGRAM_ID,
+      const PublicKey& associated_token_program_id = ASSOCIATED_TOKEN_PROGRAM_ID
+    ) {
+      std::vector<PublicKey> addresses(owners_and_mints.size());
+      get_associated_token_addresses(
+        owners_and_mints.data(),
+        owners_and_mints.size(),
+        addresses.data(),
+        allow_owner_off_curve,
+        program_id,
+        associated_token_program_id
+      );
+      return addresses;
+    }
+
     /**
     * Create and initialize a new associated token account
     *
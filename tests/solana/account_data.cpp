@@ -0,0 +1,139 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+using namespace solana;
+
+TEST_CASE("AccountData decodes base64 on first access") {
+  std::vector<uint8_t> bytes;
+  for (int i = 0; i < 165; i++) {
+    bytes.push_back((uint8_t)(i * 7));
+  }
+  std::string text = base64::encode(bytes);
+
+  AccountData data = AccountData::from_base64(text);
+  ASSERT(data.size() == 165);
+  ASSERT(data.to_base64() == text);
+
+  uint8_t window[8];
+  ASSERT(data.read(64, window, 8) == 8);
+  ASSERT(memcmp(window, bytes.data() + 64, 8) == 0);
+  ASSERT(data.read(160, window, 8) == 5);
+  ASSERT(memcmp(window, bytes.data() + 160, 5) == 0);
+  ASSERT(data.read(165, window, 8) == 0);
+
+  ASSERT(data.bytes() == bytes);
+  ASSERT(data[100] == bytes[100]);
+  ASSERT(data.read(1, window, 3) == 3);
+  ASSERT(memcmp(window, bytes.data() + 1, 3) == 0);
+  ASSERT(data.to_base64() == text);
+  ASSERT(data == AccountData(bytes));
+}
+
+TEST_CASE("AccountData reads every offset of padded data") {
+  for (size_t length = 0; length < 8; length++) {
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i < length; i++) {
+      bytes.push_back((uint8_t)(0xA0 + i));
+    }
+    AccountData data = AccountData::from_base64(base64::encode(bytes));
+    ASSERT(data.size() == length);
+    for (size_t offset = 0; offset < length; offset++) {
+      uint8_t byte;
+      ASSERT(data.read(offset, &byte, 1) == 1);
+      ASSERT(byte == bytes[offset]);
+    }
+    ASSERT(data.bytes() == bytes);
+  }
+}
+
+TEST_CASE("AccountData copies pending and decoded data") {
+  std::vector<uint8_t> bytes = { 1, 2, 3, 4, 5 };
+  AccountData pending = AccountData::from_base64(base64::encode(bytes));
+  AccountData copy = pending;
+  ASSERT(copy.bytes() == bytes);
+  ASSERT(pending.to_base64() == base64::encode(bytes));
+
+  AccountData decoded = pending;
+  ASSERT(decoded.size() == 5);
+  AccountData moved = std::move(decoded);
+  ASSERT(moved == AccountData(bytes));
+  copy = AccountData::from_base64(base64::encode(std::vector<uint8_t>{ 9 }));
+  ASSERT(copy.size() == 1);
+  ASSERT(copy[0] == 9);
+}
+
+TEST_CASE("AccountData is empty once moved from") {
+  std::vector<uint8_t> bytes = { 1, 2, 3, 4, 5 };
+  for (bool decoded : { false, true }) {
+    AccountData data = AccountData::from_base64(base64::encode(bytes));
+    if (decoded) {
+      ASSERT(data.bytes() == bytes);
+    }
+    AccountData moved = std::move(data);
+    ASSERT(moved.bytes() == bytes);
+    ASSERT(data.empty());
+    ASSERT(data.bytes().empty());
+    data.data();
+    ASSERT(data.to_base64() == "");
+    ASSERT(data == AccountData());
+
+    AccountData assigned;
+    assigned = std::move(moved);
+    ASSERT(assigned.bytes() == bytes);
+    ASSERT(moved.empty());
+    ASSERT(moved.bytes().empty());
+
+    AccountData& self = assigned;
+    assigned = std::move(self);
+    ASSERT(assigned.bytes() == bytes);
+  }
+}
+
+TEST_CASE("AccountData rejects text that is not base64") {
+  AccountData data = AccountData::from_base64(base64::encode(std::vector<uint8_t>{ 1, 2, 3 }));
+  for (std::string text : { "AQID\xff===", "AQIDBA", "AQ=D", "AQ\x80" "D" }) {
+    CHECK_THROWS(data.assign_base64(text));
+  }
+  ASSERT(data.bytes() == std::vector<uint8_t>({ 1, 2, 3 }));
+  CHECK_THROWS(AccountData::from_base64("!!!!"));
+}
+
+TEST_CASE("AccountData can be read from several threads before its first decode") {
+  std::vector<uint8_t> bytes;
+  for (int i = 0; i < 4096; i++) {
+    bytes.push_back((uint8_t)(i * 13));
+  }
+  std::string text = base64::encode(bytes);
+
+  const int threads = 8;
+  std::atomic<int> errors{0};
+  for (int round = 0; round < 200; round++) {
+    const AccountData data = AccountData::from_base64(text);
+    std::atomic<int> ready{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < threads; t++) {
+      readers.emplace_back([&, t]() {
+        ready++;
+        while (ready < threads) {
+        }
+        uint8_t window[16];
+        switch (t % 4) {
+          case 0: errors += data.bytes() != bytes; break;
+          case 1: errors += data[4000] != bytes[4000] || data.data()[7] != bytes[7]; break;
+          case 2: errors += data.read(1000, window, 16) != 16 || memcmp(window, &bytes[1000], 16) != 0; break;
+          case 3: errors += AccountData(data).to_base64() != text || data.to_base64() != text; break;
+        }
+      });
+    }
+    for (auto& reader : readers) {
+      reader.join();
+    }
+  }
+  ASSERT(errors == 0);
+}
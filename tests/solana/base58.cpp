@@ -0,0 +1,108 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+using namespace solana;
+
+template <size_t N>
+void check_matches_generic() {
+  std::array<uint8_t, N> value;
+  char text[base58::FixedWidth<N>::MAX_ENCODED_SIZE];
+  for (size_t round = 0; round < 500; round++) {
+    for (size_t i = 0; i < N; i++) {
+      value[i] = (uint8_t)(round * 131 + i * 29 + (round >> 2));
+    }
+    // Cover leading zero bytes, all-zero and all-0xff values
+    size_t zeros = round % (N + 1);
+    for (size_t i = 0; i < zeros; i++) {
+      value[i] = 0;
+    }
+    if (round == 1) {
+      value.fill(0xff);
+    }
+
+    std::string expected = base58::encode(value);
+    size_t size = base58::encode_fixed<N>(value.data(), text);
+    ASSERT(std::string(text, size) == expected);
+
+    std::array<uint8_t, N> decoded;
+    ASSERT(base58::decode_fixed<N>(expected.data(), expected.size(), decoded.data()));
+    ASSERT(decoded == value);
+  }
+}
+
+TEST_CASE("Fixed-width base58 matches the generic codec") {
+  check_matches_generic<32>();
+  check_matches_generic<64>();
+}
+
+TEST_CASE("Fixed-width base58 rejects invalid text") {
+  uint8_t bytes[32];
+  std::string invalid = "So1111111111111111111111111111111111111111I";
+  ASSERT(!base58::decode_32(invalid.data(), invalid.size(), bytes));
+  std::string too_large = std::string(44, 'z');
+  ASSERT(!base58::decode_32(too_large.data(), too_large.size(), bytes));
+  std::string ones = std::string(50, '1');
+  ASSERT(base58::decode_32(ones.data(), ones.size(), bytes));
+  ASSERT(PublicKey(ones) == PublicKey());
+}
+
+TEST_CASE("PublicKey base58 round trip and batch") {
+  std::vector<PublicKey> keys = {
+    PublicKey("So11111111111111111111111111111111111111112"),
+    PublicKey("11111111111111111111111111111111"),
+    PublicKey("TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA"),
+  };
+  std::vector<std::string> encoded = to_base58(keys);
+  ASSERT(encoded[0] == "So11111111111111111111111111111111111111112");
+  ASSERT(encoded[1] == "11111111111111111111111111111111");
+  ASSERT(encoded[2] == "TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA");
+
+  std::vector<uint8_t> packed(keys.size() * 32);
+  ASSERT(base58::decode_batch<32>(encoded.data(), encoded.size(), packed.data()) == keys.size());
+  ASSERT(PublicKey(packed.data() + 64) == keys[2]);
+}
+
+TEST_CASE("PublicKey literals are decoded at compile time") {
+  constexpr PublicKey token_program = "TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA"_pk;
+  static_assert(token_program == TOKEN_PROGRAM_ID);
+  static_assert(SYSTEM_PROGRAM == PublicKey());
+  static_assert(SystemProgram::program_id == SYSTEM_PROGRAM);
+
+  ASSERT(token_program == PublicKey("TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA"));
+  ASSERT(NATIVE_MINT == PublicKey("So11111111111111111111111111111111111111112"));
+  ASSERT(ASSOCIATED_TOKEN_PROGRAM_ID.to_base58() == "ATokenGPvbdGVxr1b2hvZbsiqW5xWH25efTNsLJA8knL");
+  ASSERT(SYSVAR_RENT_PUBKEY.to_base58() == "SysvarRent111111111111111111111111111111111");
+}
+
+TEST_CASE("PublicKey literals must be the canonical encoding") {
+  static_assert("11111111111111111111111111111111"_pk == PublicKey());
+  static_assert("So11111111111111111111111111111111111111112"_pk.bytes[0] == 0x06);
+  static_assert("So11111111111111111111111111111111111111112"_pk.bytes[31] == 0x01);
+  // One and two leading zero bytes, and the longest encoding
+  static_assert("1thX6LZfHDZZKUs92febYZhYRcXddmzfzF2NvTkPNE"_pk.bytes[0] == 0x00);
+  static_assert("1thX6LZfHDZZKUs92febYZhYRcXddmzfzF2NvTkPNE"_pk.bytes[1] == 0x01);
+  static_assert("11tJ93RwaVfE1PEMxd5rpZZuPtLCwbEaDCrNBhAy8Cv"_pk.bytes[1] == 0x00);
+  static_assert("11tJ93RwaVfE1PEMxd5rpZZuPtLCwbEaDCrNBhAy8Cv"_pk.bytes[2] == 0xff);
+  static_assert("JEKNVnkbo3jma5nREBBJCDoXFVeKkD56V3xKrvRmWxFG"_pk.bytes[0] == 0xff);
+  static_assert("JEKNVnkbo3jma5nREBBJCDoXFVeKkD56V3xKrvRmWxFG"_pk.bytes[31] == 0xff);
+  ASSERT("1thX6LZfHDZZKUs92febYZhYRcXddmzfzF2NvTkPNE"_pk.to_base58() == "1thX6LZfHDZZKUs92febYZhYRcXddmzfzF2NvTkPNE");
+
+  // The same checks fail to compile for a literal; at run time they throw
+  for (std::string text : {
+    "",
+    "1So11111111111111111111111111111111111111112",
+    "111111111111111111111111111111111",
+    "2",
+    "1JEKNVnkbo3jma5nREBBJCDoXFVeKkD56V3xKrvRmWxFG",
+    "JEKNVnkbo3jma5nREBBJCDoXFVeKkD56V3xKrvRmWxFH",
+    "So1111111111111111111111111111111111111111O",
+  }) {
+    CHECK_THROWS(base58::decode_constexpr<32>(text.data(), text.size()));
+  }
+}
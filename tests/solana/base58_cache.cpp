@@ -0,0 +1,69 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+using namespace solana;
+
+PublicKey key_for(uint64_t i) {
+  std::array<uint8_t, PUBLIC_KEY_LENGTH> bytes{};
+  for (size_t j = 0; j < bytes.size(); j++) {
+    bytes[j] = (uint8_t)((i + 1) * 2654435761u >> (j % 4 * 8)) ^ (uint8_t)(j * 13);
+  }
+  return PublicKey(bytes);
+}
+
+std::string encode(const PublicKey& key) {
+  return base58::encode(key.bytes);
+}
+
+TEST_CASE("Base58Cache returns the encoding and evicts past its capacity") {
+  Base58Cache cache(1024);
+  for (int round = 0; round < 3; round++) {
+    for (uint64_t i = 0; i < 32; i++) {
+      ASSERT(cache.get(key_for(i)) == encode(key_for(i)));
+    }
+  }
+  ASSERT(cache.misses() == 32);
+  ASSERT(cache.hits() == 64);
+
+  Base58Cache small(64);
+  for (uint64_t i = 0; i < 1000; i++) {
+    ASSERT(small.get(key_for(i)) == encode(key_for(i)));
+    ASSERT(small.get(key_for(i)) == encode(key_for(i)));
+  }
+  ASSERT(small.hits() == 1000 && small.misses() == 1000);
+}
+
+TEST_CASE("Base58Cache is shared across threads") {
+  Base58Cache cache(256);
+  std::atomic<bool> ok{true};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&, t]() {
+      for (uint64_t i = 0; i < 20000; i++) {
+        PublicKey key = key_for((i * 7 + t) % 400);
+        if (cache.get(key) != encode(key)) {
+          ok = false;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT(ok);
+}
+
+TEST_CASE("PublicKey::to_base58 uses the global cache once enabled") {
+  Base58Cache::enable(128);
+  ASSERT(TOKEN_PROGRAM_ID.to_base58() == "TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA");
+  ASSERT(TOKEN_PROGRAM_ID.to_base58() == "TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA");
+  ASSERT(Base58Cache::global().hits() >= 1);
+  Base58Cache::disable();
+  ASSERT(SYSTEM_PROGRAM.to_base58() == "11111111111111111111111111111111");
+}
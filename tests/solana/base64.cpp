@@ -22,3 +22,81 @@ TEST_CASE("Decode base64") {
   ASSERT(length == 5);
   ASSERT(memcmp(buffer, "hello", 5) == 0);
 }
+
+TEST_CASE("Validate base64") {
+  ASSERT(base64::is_valid("", 0));
+  ASSERT(base64::is_valid("aGVsbG8=", 8));
+  ASSERT(base64::is_valid("aGVsbA==", 8));
+  ASSERT(base64::is_valid("aGVs+/8=", 8));
+  ASSERT(!base64::is_valid("aGVsbG8", 7));
+  ASSERT(!base64::is_valid("aGVs=G8=", 8));
+  ASSERT(!base64::is_valid("aGVsb===", 8));
+  ASSERT(!base64::is_valid("aGVs\xffG8=", 8));
+  ASSERT(!base64::is_valid("aGVs bG8", 8));
+}
+
+std::vector<base64::Kernel> supported_kernels() {
+  std::vector<base64::Kernel> kernels;
+  for (auto kernel : { base64::Kernel::Scalar, base64::Kernel::SSE41, base64::Kernel::AVX2 }) {
+    if (base64::kernel_supported(kernel)) {
+      kernels.push_back(kernel);
+    }
+  }
+  return kernels;
+}
+
+TEST_CASE("base64 kernels match the scalar codec") {
+  base64::Kernel selected = base64::kernel();
+  std::vector<uint8_t> data(1000);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = (uint8_t)(i * 167 + (i >> 3));
+  }
+
+  for (size_t length : { 0, 1, 2, 3, 11, 12, 16, 23, 24, 28, 31, 32, 47, 48, 95, 96, 165, 256, 999, 1000 }) {
+    std::vector<uint8_t> input(data.begin(), data.begin() + length);
+    base64::kernel() = base64::Kernel::Scalar;
+    std::string expected = base64::encode(input);
+
+    for (auto kernel : supported_kernels()) {
+      base64::kernel() = kernel;
+      ASSERT(base64::encode(input) == expected);
+      ASSERT(base64::decode(expected) == input);
+    }
+  }
+
+  std::vector<uint8_t> all(256);
+  for (size_t i = 0; i < all.size(); i++) {
+    all[i] = (uint8_t)i;
+  }
+  for (auto kernel : supported_kernels()) {
+    base64::kernel() = kernel;
+    ASSERT(base64::decode(base64::encode(all)) == all);
+  }
+  base64::kernel() = selected;
+}
+
+TEST_CASE("base64 streams match one-shot") {
+  std::vector<uint8_t> data(10000);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = (uint8_t)(i * 31 + 7);
+  }
+  std::string text = base64::encode(data);
+
+  for (size_t chunk : { 1, 2, 5, 64, 4097 }) {
+    base64::StreamEncoder encoder;
+    std::string encoded;
+    for (size_t i = 0; i < data.size(); i += chunk) {
+      encoder.update(data.data() + i, std::min(chunk, data.size() - i), encoded);
+    }
+    encoder.finish(encoded);
+    ASSERT(encoded == text);
+
+    base64::StreamDecoder decoder;
+    std::vector<uint8_t> decoded;
+    for (size_t i = 0; i < text.size(); i += chunk) {
+      decoder.update(text.data() + i, std::min(chunk, text.size() - i), decoded);
+    }
+    ASSERT(decoder.finish());
+    ASSERT(decoded == data);
+  }
+}
@@ -26,3 +26,50 @@ TEST_CASE("find_program_address with a nonce") {
   ASSERT(std::get<0>(pda).to_base58() == "GXLbx3CbJuTTtJDZeS1PGzwJJ5jGYVEqcXum7472kpUp");
   ASSERT(std::get<1>(pda) == 254);
 }
+
+TEST_CASE("is_on_curve agrees with point decompression") {
+  size_t on_curve = 0;
+  for (int i = 0; i < 2000; i++) {
+    PublicKey key;
+    randombytes_buf(key.bytes.data(), key.bytes.size());
+    libsodium::ge25519_p3 point;
+    bool decodes = libsodium::ge25519_is_canonical(key.bytes.data()) && libsodium::ge25519_frombytes(&point, key.bytes.data()) == 0;
+    ASSERT(key.is_on_curve() == decodes);
+    on_curve += decodes;
+  }
+  ASSERT(on_curve > 800 && on_curve < 1200);
+  ASSERT(Keypair::generate().public_key.is_on_curve());
+  ASSERT(!PublicKey("FGnnqkzkXUGKD7wtgJCqTemU3WZ6yYqkYJ8xoQoXVvUG").is_on_curve());
+}
+
+TEST_CASE("find_program_address seeds match the vector overload") {
+  PublicKey program_id("ATokenGPvbdGVxr1b2hvZbsiqW5xWH25efTNsLJA8knL");
+  PublicKey owner("8VBafTNv1F8k5Bg7DTVwhitw3MGAMTmekHsgLuMJxLC8");
+  PublicKey mint("EPjFWdd5AufqSSqeM2qN1xzybapC8G4wEGGkZwyTDt1v");
+  std::string label = "metadata";
+  auto expected = PublicKey::find_program_address({ owner.to_buffer(), mint.to_buffer(), std::vector<uint8_t>(label.begin(), label.end()) }, program_id);
+  auto pda = PublicKey::find_program_address({ owner, mint, "metadata" }, program_id);
+  ASSERT(pda == expected);
+  ASSERT(PublicKey::create_program_address({ owner, mint, label, PublicKey::Seed(&std::get<1>(pda), 1) }, program_id) == std::get<0>(pda));
+}
+
+TEST_CASE("ProgramAddressCache returns the searched address") {
+  PublicKey program_id("ATokenGPvbdGVxr1b2hvZbsiqW5xWH25efTNsLJA8knL");
+  std::vector<PublicKey> owners(64);
+  std::vector<std::tuple<PublicKey, uint8_t>> expected;
+  for (auto& owner : owners) {
+    randombytes_buf(owner.bytes.data(), owner.bytes.size());
+    expected.push_back(PublicKey::find_program_address({ owner }, program_id));
+  }
+
+  ProgramAddressCache::enable(16);
+  for (int round = 0; round < 2; round++) {
+    for (size_t i = 0; i < owners.size(); i++) {
+      ASSERT(PublicKey::find_program_address({ owners[i] }, program_id) == expected[i]);
+      ASSERT(PublicKey::find_program_address({ owners[i] }, program_id) == expected[i]);
+    }
+  }
+  ASSERT(ProgramAddressCache::global().hits() >= owners.size() * 2);
+  ASSERT(ProgramAddressCache::global().misses() >= owners.size());
+  ProgramAddressCache::disable();
+}
@@ -42,3 +42,28 @@ TEST_CASE("get_associated_token_address 7TrFa6HZCve8eWRg24Q895kDAzg1pK6pWXisZffY
   std::tuple<PublicKey, uint8_t> pda = PublicKey::find_program_address({ owner.to_buffer(), program_id.to_buffer(), mint.to_buffer() }, associated_token_program_id);
   ASSERT(std::get<0>(pda) == PublicKey("G5HV3HSNg5rv4ARm5EW75KtRP9e28StqUvpAvF7kWkao"));
 }
+
+TEST_CASE("get_associated_token_addresses matches get_associated_token_address") {
+  std::vector<std::pair<PublicKey, PublicKey>> owners_and_mints;
+  for (int i = 0; i < 500; i++) {
+    owners_and_mints.push_back({ Keypair::generate().public_key, i % 2 ? mint : PublicKey("EPjFWdd5AufqSSqeM2qN1xzybapC8G4wEGGkZwyTDt1v") });
+  }
+  std::vector<PublicKey> addresses(owners_and_mints.size());
+  token::get_associated_token_addresses(owners_and_mints.data(), owners_and_mints.size(), addresses.data(), false, program_id, associated_token_program_id, 4);
+  for (size_t i = 0; i < owners_and_mints.size(); i++) {
+    ASSERT(addresses[i] == token::get_associated_token_address(owners_and_mints[i].second, owners_and_mints[i].first));
+  }
+  ASSERT(token::get_associated_token_addresses(owners_and_mints) == addresses);
+
+  std::vector<std::vector<PublicKey::Seed>> seeds;
+  for (auto& owner_and_mint : owners_and_mints) {
+    seeds.push_back({ owner_and_mint.first, program_id, owner_and_mint.second });
+  }
+  auto pdas = PublicKey::find_program_addresses(seeds, associated_token_program_id);
+  for (size_t i = 0; i < pdas.size(); i++) {
+    ASSERT(std::get<0>(pdas[i]) == addresses[i]);
+  }
+
+  owners_and_mints[300].first = std::get<0>(pdas[0]);
+  CHECK_THROWS(token::get_associated_token_addresses(owners_and_mints));
+}
@@ -0,0 +1,59 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+using namespace solana;
+
+TEST_CASE("adding a node only moves keys onto the new node") {
+  HashRing ring;
+  for (size_t node = 0; node < 4; node++) {
+    ring.add(node);
+  }
+
+  std::vector<std::string> keys;
+  std::vector<size_t> before;
+  std::vector<size_t> counts(4);
+  for (int i = 0; i < 10000; i++) {
+    keys.push_back(Keypair::generate().public_key.to_base58());
+    before.push_back(ring.find(keys.back()));
+    counts[before.back()]++;
+  }
+  for (size_t count : counts) {
+    CHECK(count > 10000 / 4 / 2);
+  }
+
+  ring.add(4);
+  size_t moved = 0;
+  for (size_t i = 0; i < keys.size(); i++) {
+    size_t after = ring.find(keys[i]);
+    if (after != before[i]) {
+      CHECK(after == 4);
+      moved++;
+    }
+  }
+  // About a fifth of the keys belong to the new node
+  CHECK(moved > 10000 / 5 / 2);
+  CHECK(moved < 10000 / 5 * 2);
+}
+
+TEST_CASE("find skips nodes that are not accepted") {
+  HashRing ring;
+  for (size_t node = 0; node < 3; node++) {
+    ring.add(node);
+  }
+
+  for (int i = 0; i < 1000; i++) {
+    std::string key = std::to_string(i);
+    size_t home = ring.find(key);
+    auto other = ring.find(key, [&](size_t node) { return node != home; });
+    REQUIRE(other);
+    CHECK(*other != home);
+    CHECK(*ring.find(key, [](size_t) { return true; }) == home);
+  }
+  CHECK(!ring.find("key", [](size_t) { return false; }));
+}
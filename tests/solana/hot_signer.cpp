@@ -0,0 +1,29 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+using namespace solana;
+
+TEST_CASE("HotSigner signs like Keypair::sign") {
+  for (int i = 0; i < 8; i++) {
+    auto keypair = Keypair::generate();
+    HotSigner signer(keypair);
+    ASSERT(signer.public_key() == keypair.public_key);
+
+    for (size_t size : { 0, 1, 64, 200, 1232 }) {
+      std::vector<uint8_t> message(size);
+      for (size_t j = 0; j < size; j++) {
+        message[j] = (uint8_t)(j * 7 + i);
+      }
+      uint8_t signature[crypto_sign_BYTES];
+      signer.sign(message, signature);
+      ASSERT(std::string((char*)signature, sizeof(signature)) == keypair.sign(message));
+      ASSERT(crypto_sign_verify_detached(signature, message.data(), message.size(), keypair.public_key.bytes.data()) == 0);
+    }
+  }
+}
@@ -0,0 +1,53 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+using namespace solana;
+
+Result<Account> account_at(uint64_t slot, uint64_t lamports) {
+  Result<Account> result;
+  result._context = Context{ slot };
+  result._result = Account();
+  result._result->lamports = lamports;
+  return result;
+}
+
+TEST_CASE("LatestAccountStore keeps the newest state per account") {
+  PublicKey a("So11111111111111111111111111111111111111112");
+  PublicKey b("11111111111111111111111111111111");
+
+  LatestAccountStore store;
+  ASSERT(store.update(a, account_at(10, 1)));
+  ASSERT(store.update(b, account_at(10, 2)));
+  ASSERT(store.update(a, account_at(12, 3)));
+  ASSERT(!store.update(a, account_at(11, 4)));
+  ASSERT(store.dirty_count() == 2);
+  ASSERT(store.conflated() == 1);
+  ASSERT(store.stale() == 1);
+
+  std::vector<std::pair<PublicKey, uint64_t>> drained;
+  size_t count = store.drain([&](const PublicKey& account_id, const Result<Account>& account) {
+    drained.push_back({ account_id, account._result->lamports });
+  });
+  ASSERT(count == 2);
+  ASSERT(drained[0].first == a && drained[0].second == 3);
+  ASSERT(drained[1].first == b && drained[1].second == 2);
+  ASSERT(store.dirty_count() == 0);
+  ASSERT(store.latest(a)->_result->lamports == 3);
+}
+
+TEST_CASE("LatestAccountStore drains at most max accounts") {
+  LatestAccountStore store;
+  store.update(PublicKey("So11111111111111111111111111111111111111112"), account_at(1, 1));
+  store.update(PublicKey("11111111111111111111111111111111"), account_at(1, 1));
+
+  ASSERT(store.drain([](const PublicKey&, const Result<Account>&) {}, 1) == 1);
+  ASSERT(store.dirty_count() == 1);
+  ASSERT(store.drain([](const PublicKey&, const Result<Account>&) {}) == 1);
+  ASSERT(store.dirty_count() == 0);
+}
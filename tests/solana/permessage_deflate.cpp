@@ -0,0 +1,108 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#define MANY_PERMESSAGE_DEFLATE
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+using namespace solana;
+
+/**
+ * Returns the bytes as a string, for the samples from RFC 7692 section 7.2.3.
+ */
+std::string bytes(std::initializer_list<uint8_t> values) {
+  return std::string(values.begin(), values.end());
+}
+
+std::string inflate(websockets::Inflater& inflater, const std::string& payload, bool reset_context = false) {
+  REQUIRE(inflater.inflate(payload.data(), payload.size(), reset_context));
+  return std::string(inflater.data(), inflater.size());
+}
+
+TEST_CASE("inflates a compressed message") {
+  websockets::Inflater inflater;
+  CHECK(inflate(inflater, bytes({ 0xf2, 0x48, 0xcd, 0xc9, 0xc9, 0x07, 0x00 })) == "Hello");
+}
+
+TEST_CASE("inflates a message that refers back to the previous one") {
+  websockets::Inflater inflater;
+  CHECK(inflate(inflater, bytes({ 0xf2, 0x48, 0xcd, 0xc9, 0xc9, 0x07, 0x00 })) == "Hello");
+  CHECK(inflate(inflater, bytes({ 0xf2, 0x00, 0x11, 0x00, 0x00 })) == "Hello");
+
+  // Without the previous message the back reference points nowhere
+  std::string second = bytes({ 0xf2, 0x00, 0x11, 0x00, 0x00 });
+  CHECK(!inflater.inflate(second.data(), second.size(), true));
+}
+
+TEST_CASE("inflates a message with no compression") {
+  websockets::Inflater inflater;
+  CHECK(inflate(inflater, bytes({ 0x00, 0x05, 0x00, 0xfa, 0xff, 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x00 })) == "Hello");
+}
+
+TEST_CASE("inflates a message with BFINAL set and keeps going") {
+  websockets::Inflater inflater;
+  CHECK(inflate(inflater, bytes({ 0xf3, 0x48, 0xcd, 0xc9, 0xc9, 0x07, 0x00, 0x00 })) == "Hello");
+  CHECK(inflate(inflater, bytes({ 0xf2, 0x48, 0xcd, 0xc9, 0xc9, 0x07, 0x00 })) == "Hello");
+}
+
+TEST_CASE("keeps the context of a message with BFINAL set") {
+  websockets::Inflater inflater;
+  CHECK(inflate(inflater, bytes({ 0xf3, 0x48, 0xcd, 0xc9, 0xc9, 0x07, 0x00, 0x00 })) == "Hello");
+  CHECK(inflate(inflater, bytes({ 0xf2, 0x00, 0x11, 0x00, 0x00 })) == "Hello");
+}
+
+/**
+ * Compresses a message the way a server does for permessage-deflate, without the
+ * 00 00 ff ff tail.
+ */
+std::string deflate_message(const std::string& message) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  REQUIRE(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+  std::string payload(deflateBound(&stream, message.size()) + 16, '\0');
+  stream.next_in = (Bytef*)message.data();
+  stream.avail_in = (uInt)message.size();
+  stream.next_out = (Bytef*)&payload[0];
+  stream.avail_out = (uInt)payload.size();
+  REQUIRE(deflate(&stream, Z_SYNC_FLUSH) == Z_OK);
+  payload.resize(payload.size() - stream.avail_out);
+  deflateEnd(&stream);
+  REQUIRE(payload.substr(payload.size() - 4) == bytes({ 0x00, 0x00, 0xff, 0xff }));
+  payload.resize(payload.size() - 4);
+  return payload;
+}
+
+TEST_CASE("inflates a message many times larger than its payload") {
+  std::string message;
+  for (int i = 0; i < 20000; i++) {
+    message += "{\"lamports\":" + std::to_string(i % 7) + "}";
+  }
+  std::string payload = deflate_message(message);
+  REQUIRE(payload.size() * 4 + 1024 < message.size());
+
+  websockets::Inflater inflater;
+  CHECK(inflate(inflater, payload) == message);
+}
+
+TEST_CASE("rejects a message that inflates past the maximum size") {
+  websockets::Inflater inflater(65536);
+  CHECK(inflate(inflater, deflate_message(std::string(65536, 'a'))) == std::string(65536, 'a'));
+
+  // A few kilobytes that would inflate to 8 MB
+  std::string bomb = deflate_message(std::string(8 * 1048576, '\0'));
+  CHECK(bomb.size() < 16384);
+  CHECK(!inflater.inflate(bomb.data(), bomb.size(), false));
+
+  // The stream starts over for the next message
+  CHECK(inflate(inflater, bytes({ 0xf2, 0x48, 0xcd, 0xc9, 0xc9, 0x07, 0x00 })) == "Hello");
+}
+
+TEST_CASE("rejects a corrupt payload") {
+  websockets::Inflater inflater;
+  std::string payload = bytes({ 0xff, 0xff, 0xff, 0xff });
+  CHECK(!inflater.inflate(payload.data(), payload.size(), false));
+}
@@ -0,0 +1,80 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+using namespace solana;
+
+PublicKey key_for(uint64_t i) {
+  std::array<uint8_t, PUBLIC_KEY_LENGTH> bytes{};
+  for (size_t j = 0; j < bytes.size(); j++) {
+    bytes[j] = (uint8_t)((i * 2654435761u) >> (j % 4 * 8)) ^ (uint8_t)j;
+  }
+  // Keys that share their leading bytes, like vanity keys
+  if (i % 3 == 0) {
+    memset(bytes.data(), 0xAB, 16);
+  }
+  return PublicKey(bytes);
+}
+
+TEST_CASE("PublicKey is trivially copyable and ordered by bytes") {
+  static_assert(std::is_trivially_copyable<PublicKey>::value);
+  static_assert(alignof(PublicKey) == 32 && sizeof(PublicKey) == 32);
+
+  for (uint64_t i = 0; i < 200; i++) {
+    PublicKey a = key_for(i), b = key_for(i * 7 + 1);
+    ASSERT((a < b) == std::lexicographical_compare(a.bytes.begin(), a.bytes.end(), b.bytes.begin(), b.bytes.end()));
+    ASSERT((a == b) == (a.bytes == b.bytes));
+    ASSERT((a != b) != (a == b));
+  }
+  ASSERT(std::hash<PublicKey>()(key_for(3)) == std::hash<PublicKey>()(PublicKey(key_for(3).bytes.data())));
+}
+
+TEST_CASE("PubkeyMap matches std::map") {
+  PubkeyMap<uint64_t> map;
+  std::map<PublicKey, uint64_t> expected;
+  for (uint64_t i = 0; i < 20000; i++) {
+    PublicKey key = key_for(i % 3001);
+    switch (i % 5) {
+      case 0:
+      case 1:
+        ASSERT(map.insert(key, i).second == expected.insert({ key, i }).second);
+        break;
+      case 2:
+        map[key] += 1;
+        expected[key] += 1;
+        break;
+      case 3:
+        ASSERT(map.erase(key) == (expected.erase(key) == 1));
+        break;
+      default:
+        ASSERT(map.contains(key) == (expected.count(key) == 1));
+        break;
+    }
+    ASSERT(map.size() == expected.size());
+  }
+
+  size_t count = 0;
+  for (auto& [key, value] : map) {
+    ASSERT(expected.at(key) == value);
+    count++;
+  }
+  ASSERT(count == expected.size());
+
+  map.clear();
+  ASSERT(map.empty() && !map.find(key_for(1)));
+}
+
+TEST_CASE("PubkeySet") {
+  PubkeySet set(100);
+  ASSERT(set.insert(NATIVE_MINT));
+  ASSERT(!set.insert(NATIVE_MINT));
+  ASSERT(set.insert(SYSTEM_PROGRAM));
+  ASSERT(set.contains(NATIVE_MINT) && !set.contains(TOKEN_PROGRAM_ID));
+  ASSERT(set.erase(NATIVE_MINT) && !set.erase(NATIVE_MINT));
+  ASSERT(set.size() == 1 && *set.begin() == SYSTEM_PROGRAM);
+}
@@ -0,0 +1,90 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+using namespace solana;
+
+template <typename T>
+T decode(const std::string& response) {
+  T result;
+  sax::decode(response.data(), response.size(), result);
+  return result;
+}
+
+TEST_CASE("sax::decode program accounts") {
+  std::string response = R"({"jsonrpc":"2.0","result":[
+    {"account":{"data":["AQID","base64"],"executable":false,"lamports":15298080,"owner":"TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA","rentEpoch":28,"space":3},"pubkey":"So11111111111111111111111111111111111111112"},
+    {"account":{"data":["","base64"],"executable":true,"lamports":1,"owner":"11111111111111111111111111111111","rentEpoch":18446744073709551615,"space":0},"pubkey":"11111111111111111111111111111111"}
+  ],"id":1})";
+
+  auto expected = json::parse(response).get<Result<std::vector<AccountInfo>>>();
+  auto result = decode<Result<std::vector<AccountInfo>>>(response);
+
+  ASSERT(!result._context);
+  ASSERT(result.ok());
+  ASSERT(result._result->size() == 2);
+  for (size_t i = 0; i < 2; i++) {
+    auto& a = result._result->at(i);
+    auto& b = expected._result->at(i);
+    ASSERT(a.pubkey == b.pubkey);
+    ASSERT(a.account.lamports == b.account.lamports);
+    ASSERT(a.account.owner == b.account.owner);
+    ASSERT(a.account.data == b.account.data);
+    ASSERT(a.account.executable == b.account.executable);
+    ASSERT(a.account.rent_epoch == b.account.rent_epoch);
+  }
+}
+
+TEST_CASE("sax::decode context and value") {
+  auto account = decode<Result<Account>>(R"({"jsonrpc":"2.0","result":{"context":{"apiVersion":"1.14.5","slot":134461197},"value":{"data":["AQID","base64"],"executable":false,"lamports":42,"owner":"11111111111111111111111111111111","rentEpoch":0}},"id":1})");
+  ASSERT(account._context->slot == 134461197);
+  ASSERT(account._result->lamports == 42);
+  ASSERT(account._result->data.bytes() == std::vector<uint8_t>({ 1, 2, 3 }));
+
+  auto missing = decode<Result<Account>>(R"({"jsonrpc":"2.0","result":{"context":{"slot":1},"value":null},"id":1})");
+  ASSERT(missing._context->slot == 1);
+  ASSERT(!missing.ok());
+
+  auto balance = decode<Result<uint64_t>>(R"({"jsonrpc":"2.0","result":{"context":{"slot":1},"value":0},"id":1})");
+  ASSERT(balance.ok() && balance._result.value() == 0);
+
+  auto token_balance = decode<Result<TokenBalance>>(R"({"jsonrpc":"2.0","result":{"context":{"slot":1},"value":{"amount":"9864","decimals":2,"uiAmount":98.64,"uiAmountString":"98.64"}},"id":1})");
+  ASSERT(token_balance._result->amount == 9864);
+  ASSERT(token_balance._result->decimals == 2);
+}
+
+TEST_CASE("sax::decode plain results and errors") {
+  auto slot = decode<Result<uint64_t>>(R"({"jsonrpc":"2.0","result":1234,"id":1})");
+  ASSERT(slot._result.value() == 1234);
+
+  auto version = decode<Result<Version>>(R"({"jsonrpc":"2.0","result":{"feature-set":2891131721,"solana-core":"1.16.7"},"id":1})");
+  ASSERT(version._result->feature_set == 2891131721);
+  ASSERT(version._result->version == "1.16.7");
+
+  auto error = decode<Result<uint64_t>>(R"({"jsonrpc":"2.0","error":{"code":-32602,"message":"Invalid param"},"id":1})");
+  ASSERT(!error.ok());
+  ASSERT(error._error->code == -32602);
+  ASSERT(error._error->message == "Invalid param");
+}
+
+TEST_CASE("sax::decode allocates from the current arena") {
+  std::string response = R"({"jsonrpc":"2.0","result":{"context":{"slot":1},"value":{"data":["AQIDBAUGBwgJCgsMDQ4PEBESExQVFhcYGRobHB0eHyA=","base64"],"executable":false,"lamports":42,"owner":"11111111111111111111111111111111","rentEpoch":0}},"id":1})";
+
+  Arena arena(4096);
+  for (int i = 0; i < 3; i++) {
+    Arena::Scope scope(arena);
+    auto account = decode<Result<Account>>(response);
+    ASSERT(account._result->lamports == 42);
+    ASSERT(arena.bytes_served() > 0);
+  }
+  ASSERT(arena.bytes_served() == 0);
+  ASSERT(arena.stats().cycles == 3);
+  ASSERT(arena.stats().last_cycle_bytes > 0);
+  ASSERT(arena.stats().peak_cycle_bytes == arena.stats().last_cycle_bytes);
+  ASSERT(arena.stats().reserved_bytes == 4096);
+}
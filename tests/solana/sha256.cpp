@@ -0,0 +1,75 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+using namespace solana;
+
+std::vector<sha256::Kernel> supported_kernels() {
+  std::vector<sha256::Kernel> kernels;
+  for (auto kernel : { sha256::Kernel::Scalar, sha256::Kernel::SHANI }) {
+    if (sha256::kernel_supported(kernel)) {
+      kernels.push_back(kernel);
+    }
+  }
+  return kernels;
+}
+
+std::string hex_digest(const std::string& message) {
+  uint8_t digest[32];
+  sha256::hash(message.data(), message.size(), digest);
+  char hex[65];
+  sodium_bin2hex(hex, sizeof(hex), digest, sizeof(digest));
+  return hex;
+}
+
+TEST_CASE("sha256 kernels match the NIST vectors") {
+  sha256::Kernel selected = sha256::kernel();
+  std::vector<std::pair<std::string, std::string>> vectors = {
+    { "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+    { "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+    { "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+    { std::string(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+  };
+  for (auto kernel : supported_kernels()) {
+    sha256::kernel() = kernel;
+    for (auto& [message, digest] : vectors) {
+      ASSERT(hex_digest(message) == digest);
+    }
+  }
+  sha256::kernel() = selected;
+}
+
+TEST_CASE("sha256 kernels match OpenSSL around the padding boundaries") {
+  sha256::Kernel selected = sha256::kernel();
+  std::string data(1000, '\0');
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = (char)(i * 167 + (i >> 3));
+  }
+
+  for (size_t length : { 0, 1, 54, 55, 56, 57, 63, 64, 65, 119, 120, 127, 128, 129, 183, 184, 999, 1000 }) {
+    uint8_t expected[32];
+    SHA256((const unsigned char*)data.data(), length, expected);
+
+    for (auto kernel : supported_kernels()) {
+      sha256::kernel() = kernel;
+      uint8_t digest[32];
+      sha256::hash(data.data(), length, digest);
+      ASSERT(memcmp(digest, expected, 32) == 0);
+
+      // The same message fed in uneven pieces
+      sha256::State state;
+      for (size_t offset = 0; offset < length; offset += 7) {
+        state.update(data.data() + offset, std::min<size_t>(7, length - offset));
+      }
+      state.finish(digest);
+      ASSERT(memcmp(digest, expected, 32) == 0);
+    }
+  }
+  sha256::kernel() = selected;
+}
@@ -0,0 +1,198 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+using namespace solana;
+
+TEST_CASE("multi-scalar multiplication sums to the identity") {
+  uint8_t base[32];
+  memset(base, 0x66, sizeof(base));
+  base[0] = 0x58;
+  libsodium::ge25519_p3 points[3];
+  for (auto& point : points) {
+    ASSERT(libsodium::ge25519_frombytes(&point, base) == 0);
+  }
+
+  uint8_t a[64] = {}, b[64] = {}, scalars[96];
+  randombytes_buf(a, 64);
+  randombytes_buf(b, 64);
+  crypto_core_ed25519_scalar_reduce(scalars, a);
+  crypto_core_ed25519_scalar_reduce(scalars + 32, b);
+  uint8_t sum[32];
+  crypto_core_ed25519_scalar_add(sum, scalars, scalars + 32);
+  crypto_core_ed25519_scalar_negate(scalars + 64, sum);
+
+  libsodium::ge25519_p2 r;
+  libsodium::ge25519_multi_scalarmult_vartime(&r, scalars, points, 3);
+  ASSERT(libsodium::ge25519_p2_is_identity(&r));
+  libsodium::ge25519_multi_scalarmult_vartime(&r, scalars, points, 2);
+  ASSERT(!libsodium::ge25519_p2_is_identity(&r));
+}
+
+TEST_CASE("SignatureBatch finds the bad signatures") {
+  SignatureBatch batch;
+  std::vector<std::vector<uint8_t>> messages;
+  std::vector<std::string> signatures;
+  std::vector<PublicKey> keys;
+  for (size_t i = 0; i < 150; i++) {
+    auto keypair = Keypair::generate();
+    std::vector<uint8_t> message(i + 1, (uint8_t)i);
+    signatures.push_back(keypair.sign(message));
+    keys.push_back(keypair.public_key);
+    messages.push_back(message);
+  }
+  signatures[3][5] ^= 1;
+  messages[70][0] ^= 1;
+  // s + L encodes the same scalar non-canonically
+  uint8_t s[32];
+  memcpy(s, signatures[100].data() + 32, 32);
+  static const uint8_t L[32] = { 0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x10 };
+  unsigned carry = 0;
+  for (int j = 0; j < 32; j++) {
+    carry += s[j] + L[j];
+    signatures[100][32 + j] = (char)carry;
+    carry >>= 8;
+  }
+
+  for (size_t i = 0; i < signatures.size(); i++) {
+    batch.add((const uint8_t*)signatures[i].data(), keys[i], messages[i]);
+  }
+  std::vector<bool> valid;
+  ASSERT(!batch.verify(valid));
+  ASSERT(valid.size() == 150);
+  for (size_t i = 0; i < valid.size(); i++) {
+    ASSERT(valid[i] == (i != 3 && i != 70 && i != 100));
+    ASSERT(valid[i] == (crypto_sign_verify_detached((const uint8_t*)signatures[i].data(), messages[i].data(), messages[i].size(), keys[i].bytes.data()) == 0));
+  }
+
+  batch.clear();
+  for (size_t i = 0; i < signatures.size(); i++) {
+    if (valid[i]) {
+      batch.add((const uint8_t*)signatures[i].data(), keys[i], messages[i]);
+    }
+  }
+  ASSERT(batch.size() == 147);
+  ASSERT(batch.verify());
+}
+
+/**
+ * Signs message by hand with nonce point r * B + torsion, for a key whose point is
+ * the keypair's plus key_torsion. Both torsion points may be null.
+ */
+std::string sign_with_torsion(const Keypair& keypair, const std::vector<uint8_t>& message, const uint8_t* torsion, const uint8_t* key_torsion, PublicKey& public_key) {
+  uint8_t hash[64], a[64] = {};
+  crypto_hash_sha512(hash, keypair.secret_key.data(), 32);
+  hash[0] &= 248;
+  hash[31] &= 127;
+  hash[31] |= 64;
+  memcpy(a, hash, 32);
+  crypto_core_ed25519_scalar_reduce(a, a);
+
+  public_key = keypair.public_key;
+  if (key_torsion != nullptr) {
+    ASSERT(crypto_core_ed25519_add(public_key.bytes.data(), keypair.public_key.bytes.data(), key_torsion) == 0);
+  }
+
+  uint8_t r[32], R[32], k[32], ka[32];
+  crypto_core_ed25519_scalar_random(r);
+  ASSERT(crypto_scalarmult_ed25519_base_noclamp(R, r) == 0);
+  if (torsion != nullptr) {
+    ASSERT(crypto_core_ed25519_add(R, R, torsion) == 0);
+  }
+  crypto_hash_sha512_state state;
+  crypto_hash_sha512_init(&state);
+  crypto_hash_sha512_update(&state, R, 32);
+  crypto_hash_sha512_update(&state, public_key.bytes.data(), 32);
+  crypto_hash_sha512_update(&state, message.data(), message.size());
+  crypto_hash_sha512_final(&state, hash);
+  crypto_core_ed25519_scalar_reduce(k, hash);
+
+  std::string signature(64, '\0');
+  memcpy(&signature[0], R, 32);
+  crypto_core_ed25519_scalar_mul(ka, k, a);
+  crypto_core_ed25519_scalar_add((uint8_t*)&signature[32], r, ka);
+  return signature;
+}
+
+TEST_CASE("SignatureBatch verifies torsion components up to the cofactor") {
+  // A point of order 8
+  uint8_t torsion[32];
+  ASSERT(sodium_hex2bin(torsion, 32, "c7176a703d4dd84fba3c0b760d10670f2a2053fa2c39ccc64ec7fd7792ac037a", 64, nullptr, nullptr, nullptr) == 0);
+  ASSERT(crypto_core_ed25519_is_valid_point(torsion) == 0);
+
+  auto keypair = Keypair::generate();
+  std::vector<uint8_t> message = { 1, 2, 3 };
+  SignatureBatch batch;
+  std::vector<std::string> signatures;
+  std::vector<PublicKey> keys;
+  auto add = [&](const std::string& signature, const PublicKey& public_key) {
+    signatures.push_back(signature);
+    keys.push_back(public_key);
+    batch.add((const uint8_t*)signature.data(), public_key, message);
+  };
+  for (int i = 0; i < 8; i++) {
+    add(keypair.sign(message), keypair.public_key);
+  }
+  PublicKey public_key;
+
+  // R with a torsion component holds only up to the cofactor
+  add(sign_with_torsion(keypair, message, torsion, nullptr, public_key), public_key);
+
+  // So does a key with a torsion component, unless the torsion drops out of k * A
+  std::string signature;
+  do {
+    signature = sign_with_torsion(keypair, message, nullptr, torsion, public_key);
+  } while (crypto_sign_verify_detached((const uint8_t*)signature.data(), message.data(), message.size(), public_key.bytes.data()) == 0);
+  add(signature, public_key);
+  do {
+    signature = sign_with_torsion(keypair, message, nullptr, torsion, public_key);
+  } while (crypto_sign_verify_detached((const uint8_t*)signature.data(), message.data(), message.size(), public_key.bytes.data()) != 0);
+  add(signature, public_key);
+
+  // A passing chunk accepts all of them, though libsodium rejects the first two
+  std::vector<bool> valid;
+  ASSERT(batch.verify(valid));
+  for (size_t i = 0; i < signatures.size(); i++) {
+    ASSERT(valid[i]);
+    ASSERT((crypto_sign_verify_detached((const uint8_t*)signatures[i].data(), message.data(), message.size(), keys[i].bytes.data()) == 0) == (i < 8 || i == 10));
+  }
+
+  // A failing chunk falls back to libsodium for every signature in it
+  std::string bad = keypair.sign(message);
+  bad[40] ^= 1;
+  add(bad, keypair.public_key);
+  ASSERT(!batch.verify(valid));
+  for (size_t i = 0; i < valid.size(); i++) {
+    ASSERT(valid[i] == (crypto_sign_verify_detached((const uint8_t*)signatures[i].data(), message.data(), message.size(), keys[i].bytes.data()) == 0));
+    ASSERT(valid[i] == (i < 8 || i == 10));
+  }
+}
+
+TEST_CASE("CompiledTransaction::verify_signatures") {
+  auto payer = Keypair::generate();
+  CompiledTransaction transaction;
+  transaction.message.header.num_required_signatures = 1;
+  transaction.message.header.num_readonly_signed_accounts = 0;
+  transaction.message.header.num_readonly_unsigned_accounts = 1;
+  transaction.message.account_keys = { payer.public_key, SYSTEM_PROGRAM };
+  transaction.message.recent_blockhash = NATIVE_MINT;
+  transaction.message.instructions.push_back({ { 0 }, { 1, 2, 3 }, 1 });
+
+  std::vector<uint8_t> serialized_message;
+  transaction.message.serialize(serialized_message);
+  transaction.sign(serialized_message, { payer });
+  ASSERT(transaction.verify_signatures());
+
+  char encoded[base58::FixedWidth<64>::MAX_ENCODED_SIZE];
+  size_t length = base58::encode_64((const uint8_t*)transaction.signatures[0].data(), encoded);
+  transaction.signatures[0] = std::string(encoded, length);
+  ASSERT(transaction.verify_signatures());
+
+  transaction.message.instructions[0].data[0] = 9;
+  ASSERT(!transaction.verify_signatures());
+}
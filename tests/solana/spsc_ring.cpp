@@ -0,0 +1,85 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+using namespace solana;
+
+TEST_CASE("SpscRing keeps order across wraparound") {
+  SpscRing<int> ring(5);
+  CHECK(ring.capacity() == 8);
+
+  int value;
+  CHECK(!ring.try_pop(value));
+  int next_push = 0;
+  int next_pop = 0;
+  for (int round = 0; round < 100; round++) {
+    // Fill the ring, then take back a varying number of items
+    while (ring.try_push(int(next_push))) {
+      next_push++;
+    }
+    CHECK(ring.size() == 8);
+    int pops = 1 + round % 8;
+    for (int i = 0; i < pops; i++) {
+      REQUIRE(ring.try_pop(value));
+      CHECK(value == next_pop++);
+    }
+    CHECK(ring.size() == 8 - pops);
+  }
+  while (ring.try_pop(value)) {
+    CHECK(value == next_pop++);
+  }
+  CHECK(next_pop == next_push);
+  CHECK(ring.size() == 0);
+}
+
+TEST_CASE("SpscRing try_pop from the producer and consumer hands out each item once") {
+  // The producer discards the oldest item when the ring is full, as DropOldest does
+  const int count = 200000;
+  SpscRing<int> ring(16);
+  std::atomic<bool> done{false};
+  std::vector<int> consumed;
+  std::thread consumer([&]() {
+    int value;
+    while (!done.load() || ring.size() > 0) {
+      if (ring.try_pop(value)) {
+        consumed.push_back(value);
+      }
+    }
+  });
+
+  std::vector<int> discarded;
+  for (int i = 0; i < count; i++) {
+    int value;
+    while (!ring.try_push(int(i))) {
+      if (ring.try_pop(value)) {
+        discarded.push_back(value);
+      }
+    }
+  }
+  done = true;
+  consumer.join();
+
+  CHECK(consumed.size() + discarded.size() == (size_t)count);
+  CHECK(std::is_sorted(consumed.begin(), consumed.end()));
+  CHECK(std::is_sorted(discarded.begin(), discarded.end()));
+  std::vector<int> all(consumed);
+  all.insert(all.end(), discarded.begin(), discarded.end());
+  std::sort(all.begin(), all.end());
+  CHECK(std::adjacent_find(all.begin(), all.end()) == all.end());
+}
+
+TEST_CASE("SpscRing releases popped values") {
+  SpscRing<std::shared_ptr<int>> ring(4);
+  auto value = std::make_shared<int>(1);
+  ring.try_push(std::shared_ptr<int>(value));
+  CHECK(value.use_count() == 2);
+  std::shared_ptr<int> popped;
+  ring.try_pop(popped);
+  popped.reset();
+  CHECK(value.use_count() == 1);
+}
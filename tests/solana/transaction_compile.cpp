@@ -0,0 +1,42 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+using namespace solana;
+
+TEST_CASE("compile merges account flags") {
+  Keypair payer = Keypair::generate();
+  PublicKey program_a("TokenkegQfeZyiNwAJbNbGKPFXCWuBvf9Ss623VQ5DA");
+  PublicKey program_b("ATokenGPvbdGVxr1b2hvZbsiqW5xWH25efTNsLJA8knL");
+  PublicKey signer = Keypair::generate().public_key;
+  PublicKey account = Keypair::generate().public_key;
+  PublicKey readonly = Keypair::generate().public_key;
+
+  Transaction transaction;
+  transaction.add({ program_a, { { account, false, false }, { signer, true, false }, { readonly, false, false } }, { 1 } });
+  transaction.add({ program_b, { { account, false, true }, { payer.public_key, false, false }, { program_a, false, false } }, { 2, 3 } });
+
+  auto message = transaction.message.compile({ payer });
+  ASSERT(message.account_keys.size() == 6);
+  ASSERT(message.account_keys[0] == payer.public_key);
+  ASSERT(message.account_keys[1] == signer);
+  ASSERT(message.account_keys[2] == account);
+  ASSERT(message.header.num_required_signatures == 2);
+  ASSERT(message.header.num_readonly_signed_accounts == 1);
+  ASSERT(message.header.num_readonly_unsigned_accounts == 3);
+
+  ASSERT(message.instructions.size() == 2);
+  auto& first = message.instructions[0];
+  ASSERT(message.account_keys[first.program_id_index] == program_a);
+  ASSERT((first.accounts == std::vector<uint8_t>{ 2, 1, (uint8_t)(std::find(message.account_keys.begin(), message.account_keys.end(), readonly) - message.account_keys.begin()) }));
+  ASSERT((first.data == std::vector<uint8_t>{ 1 }));
+  auto& second = message.instructions[1];
+  ASSERT(message.account_keys[second.program_id_index] == program_b);
+  ASSERT(message.account_keys[second.accounts[1]] == payer.public_key);
+  ASSERT(message.account_keys[second.accounts[2]] == program_a);
+}
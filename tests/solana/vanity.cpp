@@ -0,0 +1,93 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+using namespace solana;
+
+TEST_CASE("vanity Pattern screens keys like their base58 text") {
+  std::vector<vanity::Pattern> patterns = {
+    vanity::Pattern("A"),
+    vanity::Pattern("zz"),
+    vanity::Pattern("5"),
+    vanity::Pattern("", "x"),
+    vanity::Pattern("", "Ab1", true),
+    vanity::Pattern("b", "c", true),
+    vanity::Pattern("1"),
+  };
+  std::vector<size_t> matches(patterns.size());
+  for (int i = 0; i < 200000; i++) {
+    PublicKey key;
+    randombytes_buf(key.bytes.data(), key.bytes.size());
+    for (size_t j = 0; j < patterns.size(); j++) {
+      bool match = patterns[j].matches(key);
+      ASSERT((patterns[j].candidate(key.bytes.data()) || !match));
+      matches[j] += match;
+    }
+  }
+  ASSERT(matches[0] > 1000);
+  ASSERT(matches[1] > 0);
+  ASSERT(matches[3] > 1000);
+
+  ASSERT(vanity::Pattern("So1111").matches(PublicKey("So11111111111111111111111111111111111111112")));
+  ASSERT(vanity::Pattern("so", "112", true).candidate(PublicKey("So11111111111111111111111111111111111111112").bytes.data()));
+  ASSERT(!vanity::Pattern("Tok").candidate(PublicKey("So11111111111111111111111111111111111111112").bytes.data()));
+  CHECK_THROWS(vanity::Pattern("0"));
+  CHECK_THROWS(vanity::Pattern("", "Il"));
+  CHECK_THROWS(vanity::Pattern("", "0abcdefghijk"));
+}
+
+TEST_CASE("vanity Pattern rejects prefixes no key has") {
+  CHECK_THROWS(vanity::Pattern(std::string(44, 'z')));
+  CHECK_THROWS(vanity::Pattern(std::string(44, 'Z')));
+  vanity::Pattern("5", "", true);
+  vanity::Pattern(std::string(43, '1'));
+}
+
+TEST_CASE("vanity Pattern expands only the screened end of a long suffix") {
+  vanity::Pattern pattern("", "abcdefghijkmnopqrstuvwxyz", true);
+  PublicKey key;
+  randombytes_buf(key.bytes.data(), key.bytes.size());
+  ASSERT(!pattern.matches(key));
+}
+
+TEST_CASE("vanity search finds a matching keypair") {
+  uint64_t reported = 0;
+  Keypair keypair = vanity::search("a", "Z", true, 2, [&](const vanity::Progress& progress) {
+    reported = progress.attempts;
+  }, 0.0);
+  std::string text = keypair.public_key.to_base58();
+  ASSERT((text[0] == 'a' || text[0] == 'A'));
+  ASSERT((text.back() == 'z' || text.back() == 'Z'));
+  ASSERT(Keypair::from_seed(keypair.secret_key.data()).public_key == keypair.public_key);
+  ASSERT(reported > 0);
+}
+
+TEST_CASE("vanity search does not hold up parallel_for on other threads") {
+  std::atomic<bool> searching{false};
+  std::atomic<bool> stop{false};
+  std::thread searcher([&]() {
+    CHECK_THROWS(vanity::search("zzzzzzzz", "", false, 2, [&](const vanity::Progress&) {
+      searching = true;
+      if (stop) {
+        throw std::runtime_error("stopped");
+      }
+    }, 0.0));
+  });
+  while (!searching) {
+    std::this_thread::yield();
+  }
+
+  std::vector<size_t> squares(1000);
+  many::parallel_for(squares.size(), [&](size_t i) {
+    squares[i] = i * i;
+  }, 2, 16);
+  ASSERT(squares[999] == 999 * 999);
+
+  stop = true;
+  searcher.join();
+}
@@ -0,0 +1,1198 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "../doctest.h"
+
+#define MANY_PERMESSAGE_DEFLATE
+
+#include "../../src/json.hpp"
+
+using json = nlohmann::json;
+
+#include "../../src/solana.hpp"
+
+#include <netinet/in.h>
+#include <poll.h>
+
+using namespace solana;
+
+/**
+ * A websocket server on 127.0.0.1 that serves one client at a time from its own
+ * thread. It records every text frame the client sends, answers pings, and can
+ * confirm subscriptions on its own.
+ */
+class FakeServer {
+  int _listen = -1;
+  int _client = -1;
+  int _silent = -1;
+  std::vector<int> _fillers;
+  uint16_t _port = 0;
+  std::thread _thread;
+  std::atomic<bool> _stop{false};
+  std::atomic<bool> _accepting{true};
+  std::mutex _mutex;
+  std::vector<json> _received;
+  std::string _buffer;
+  int64_t _next_server_id = 1000;
+  std::map<std::string, int64_t> _server_ids;
+  z_stream _deflater;
+  bool _deflating = false;
+  bool _no_context_takeover = false;
+
+public:
+
+  /** Confirm each subscribe with a new server id */
+  std::atomic<bool> auto_confirm{true};
+  /** Answer pings with pongs */
+  std::atomic<bool> answer_pings{true};
+  /** Answer upgrade requests; when false a connection is accepted and left hanging */
+  std::atomic<bool> answer_handshakes{true};
+  /** Accept permessage-deflate when the client offers it */
+  std::atomic<bool> deflate{false};
+  /** Number of completed handshakes */
+  std::atomic<int> connections{0};
+  /** Number of reads that returned data from the client */
+  std::atomic<int> reads{0};
+
+  FakeServer() {
+    _listen = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT(bind(_listen, (sockaddr*)&addr, sizeof(addr)) == 0);
+    socklen_t length = sizeof(addr);
+    getsockname(_listen, (sockaddr*)&addr, &length);
+    _port = ntohs(addr.sin_port);
+    ASSERT(listen(_listen, 4) == 0);
+    _thread = std::thread([this]() { run(); });
+  }
+
+  ~FakeServer() {
+    _stop = true;
+    _thread.join();
+    drop_client();
+    close_silent();
+    for (int filler : _fillers) {
+      close(filler);
+    }
+    close(_listen);
+    if (_deflating) {
+      deflateEnd(&_deflater);
+    }
+  }
+
+  /**
+   * Returns the url to give the client, which connects to the port after it.
+   */
+  std::string url() const {
+    return "ws://127.0.0.1:" + std::to_string(_port - 1);
+  }
+
+  /**
+   * Returns the rpc endpoint to give a Connection, which derives the websocket url from it.
+   */
+  std::string http_url() const {
+    return "http://127.0.0.1:" + std::to_string(_port - 1);
+  }
+
+  /**
+   * Returns the server id of the latest confirmed subscribe with the given method, or 0.
+   */
+  int64_t server_id(const std::string& method) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _server_ids.find(method);
+    return it == _server_ids.end() ? 0 : it->second;
+  }
+
+  /**
+   * Sends a notification on a server subscription.
+   */
+  void notify(const std::string& method, int64_t server_id, const json& result) {
+    send({ {"jsonrpc", "2.0"}, {"method", method}, {"params", { {"subscription", server_id}, {"result", result} }} });
+  }
+
+  void send(const json& message) {
+    send_frame(0x1, message.dump());
+  }
+
+  /**
+   * Sends a message compressed with permessage-deflate, reusing the context of the
+   * previous messages unless the client asked for server_no_context_takeover.
+   */
+  void send_compressed(const json& message) {
+    std::string text = message.dump();
+    std::string payload;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      REQUIRE(_deflating);
+      if (_no_context_takeover) {
+        deflateReset(&_deflater);
+      }
+      payload.resize(deflateBound(&_deflater, text.size()) + 16);
+      _deflater.next_in = (Bytef*)text.data();
+      _deflater.avail_in = (uInt)text.size();
+      _deflater.next_out = (Bytef*)&payload[0];
+      _deflater.avail_out = (uInt)payload.size();
+      REQUIRE(::deflate(&_deflater, Z_SYNC_FLUSH) == Z_OK);
+      // Drop the 00 00 ff ff tail of the flush, as RFC 7692 requires
+      payload.resize(payload.size() - _deflater.avail_out - 4);
+    }
+    send_frame(0x1, payload, true);
+  }
+
+  /**
+   * Returns true if the client asked the server not to reuse its context.
+   */
+  bool no_context_takeover() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _no_context_takeover;
+  }
+
+  void send_frame(uint8_t opcode, const std::string& payload, bool rsv1 = false) {
+    std::string frame;
+    frame += (char)(0x80 | (rsv1 ? 0x40 : 0) | opcode);
+    if (payload.size() <= 125) {
+      frame += (char)payload.size();
+    } else {
+      frame += (char)126;
+      frame += (char)(payload.size() >> 8);
+      frame += (char)(payload.size() & 0xFF);
+    }
+    frame += payload;
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_client != -1) {
+      ::write(_client, frame.data(), frame.size());
+    }
+  }
+
+  /**
+   * Closes the client's connection, as a server restart would.
+   */
+  void drop_client() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_client != -1) {
+      close(_client);
+      _client = -1;
+    }
+    _buffer.clear();
+  }
+
+  /**
+   * Closes the connection left hanging while answer_handshakes was false.
+   */
+  void close_silent() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_silent != -1) {
+      close(_silent);
+      _silent = -1;
+    }
+  }
+
+  /**
+   * Stops accepting and fills the accept queue, so the kernel drops further SYNs
+   * and the next connect hangs until it gives up.
+   */
+  void fill_backlog() {
+    _accepting = false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(_port);
+    for (int i = 0; i < 16; i++) {
+      int filler = socket(AF_INET, SOCK_STREAM, 0);
+      fcntl(filler, F_SETFL, O_NONBLOCK);
+      ::connect(filler, (sockaddr*)&addr, sizeof(addr));
+      _fillers.push_back(filler);
+    }
+  }
+
+  std::vector<json> received() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _received;
+  }
+
+  /**
+   * Returns the messages received with the given method.
+   */
+  std::vector<json> received(const std::string& method) {
+    std::vector<json> messages;
+    for (auto& message : received()) {
+      if (message.value("method", "") == method) {
+        messages.push_back(message);
+      }
+    }
+    return messages;
+  }
+
+private:
+
+  void run() {
+    while (!_stop) {
+      struct pollfd fds[2] = { { _accepting ? _listen : -1, POLLIN, 0 }, { -1, POLLIN, 0 } };
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        fds[1].fd = _client;
+      }
+      if (::poll(fds, 2, 5) <= 0) {
+        continue;
+      }
+      if (fds[0].revents & POLLIN) {
+        accept_client();
+      }
+      if (fds[1].fd != -1 && (fds[1].revents & (POLLIN | POLLHUP))) {
+        char data[65536];
+        ssize_t length = ::read(fds[1].fd, data, sizeof(data));
+        if (length <= 0) {
+          drop_client();
+          continue;
+        }
+        reads++;
+        _buffer.append(data, length);
+        while (read_frame()) {
+        }
+      }
+    }
+  }
+
+  void accept_client() {
+    int client = accept(_listen, nullptr, nullptr);
+    std::string request;
+    char data[4096];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+      ssize_t length = ::read(client, data, sizeof(data));
+      if (length <= 0) {
+        close(client);
+        return;
+      }
+      request.append(data, length);
+    }
+    if (!answer_handshakes) {
+      close_silent();
+      std::lock_guard<std::mutex> lock(_mutex);
+      _silent = client;
+      return;
+    }
+    size_t start = request.find("Sec-WebSocket-Key: ") + 19;
+    std::string key = request.substr(start, request.find("\r\n", start) - start) + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    unsigned char sha1[20];
+    SHA1((const unsigned char*)key.data(), key.size(), sha1);
+    std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+      "Sec-WebSocket-Accept: " + base64::encode(sha1, 20) + "\r\n";
+    bool compress = deflate && request.find("permessage-deflate") != std::string::npos;
+    bool no_context_takeover = request.find("server_no_context_takeover") != std::string::npos;
+    if (compress) {
+      response += std::string("Sec-WebSocket-Extensions: permessage-deflate") + (no_context_takeover ? "; server_no_context_takeover" : "") + "\r\n";
+    }
+    response += "\r\n";
+    ::write(client, response.data(), response.size());
+    drop_client();
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_deflating) {
+      deflateEnd(&_deflater);
+      _deflating = false;
+    }
+    if (compress) {
+      memset(&_deflater, 0, sizeof(_deflater));
+      ASSERT(deflateInit2(&_deflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+      _deflating = true;
+      _no_context_takeover = no_context_takeover;
+    }
+    _client = client;
+    connections++;
+  }
+
+  /**
+   * Decodes one masked client frame from the buffer, or returns false if it is incomplete.
+   */
+  bool read_frame() {
+    if (_buffer.size() < 2) {
+      return false;
+    }
+    uint8_t opcode = _buffer[0] & 0x0F;
+    size_t length = _buffer[1] & 0x7F;
+    size_t offset = 2;
+    if (length == 126) {
+      if (_buffer.size() < 4) {
+        return false;
+      }
+      length = ((uint8_t)_buffer[2] << 8) | (uint8_t)_buffer[3];
+      offset = 4;
+    }
+    if (_buffer.size() < offset + 4 + length) {
+      return false;
+    }
+    std::string payload = _buffer.substr(offset + 4, length);
+    for (size_t i = 0; i < length; i++) {
+      payload[i] ^= _buffer[offset + i % 4];
+    }
+    _buffer.erase(0, offset + 4 + length);
+
+    if (opcode == 0x1) {
+      json message = json::parse(payload);
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _received.push_back(message);
+      }
+      std::string method = message.value("method", "");
+      if (auto_confirm && method.size() > 9 && method.substr(method.size() - 9) == "Subscribe") {
+        int64_t server_id = _next_server_id++;
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          _server_ids[method] = server_id;
+        }
+        send({ {"jsonrpc", "2.0"}, {"result", server_id}, {"id", message["id"]} });
+      }
+    } else if (opcode == 0x9 && answer_pings) {
+      send_frame(0xA, payload);
+    }
+    return true;
+  }
+};
+
+/**
+ * Polls until done() returns true or the timeout passes, and returns done().
+ */
+template <typename F>
+bool poll_until(websockets::WebSocketClient& client, F done, int timeout_ms = 2000) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (!done() && std::chrono::steady_clock::now() < deadline) {
+    client.poll();
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  return done();
+}
+
+TEST_CASE("unsubscribe before the confirmation cancels the subscription on the server") {
+  FakeServer server;
+  server.auto_confirm = false;
+  websockets::WebSocketClient client(server.url());
+  REQUIRE(client.connect());
+
+  int notifications = 0;
+  int id = client.subscribe("accountSubscribe", { "11111111111111111111111111111111" }, [&](json) { notifications++; });
+  REQUIRE(poll_until(client, [&]() { return server.received("accountSubscribe").size() == 1; }));
+
+  client.unsubscribe(id, "accountUnsubscribe");
+  CHECK(client.subscription_count() == 0);
+  CHECK(server.received("accountUnsubscribe").empty());
+
+  server.send({ {"jsonrpc", "2.0"}, {"result", 42}, {"id", id} });
+  REQUIRE(poll_until(client, [&]() { return server.received("accountUnsubscribe").size() == 1; }));
+  CHECK(server.received("accountUnsubscribe")[0]["params"] == json({ 42 }));
+
+  server.send({ {"jsonrpc", "2.0"}, {"method", "accountNotification"}, {"params", { {"subscription", 42}, {"result", {}} }} });
+  poll_until(client, []() { return false; }, 50);
+  CHECK(notifications == 0);
+}
+
+TEST_CASE("unsubscribe after the confirmation is sent straight away") {
+  FakeServer server;
+  websockets::WebSocketClient client(server.url());
+  REQUIRE(client.connect());
+
+  int id = client.subscribe("accountSubscribe", { "11111111111111111111111111111111" }, [](json) {});
+  poll_until(client, [&]() { return false; }, 50);
+  client.unsubscribe(id, "accountUnsubscribe");
+  REQUIRE(poll_until(client, [&]() { return server.received("accountUnsubscribe").size() == 1; }));
+  CHECK(server.received("accountUnsubscribe")[0]["params"] == json({ 1000 }));
+}
+
+TEST_CASE("reconnect replays subscriptions and routes notifications by the new server ids") {
+  FakeServer server;
+  websockets::WebSocketClient client(server.url());
+  client.set_reconnect(true, 10, 100);
+  REQUIRE(client.connect());
+
+  std::vector<uint64_t> downtimes;
+  client.on_reconnect([&](uint64_t downtime_ms) { downtimes.push_back(downtime_ms); });
+  int notifications = 0;
+  client.subscribe("slotSubscribe", nullptr, [&](json) { notifications++; });
+  REQUIRE(poll_until(client, [&]() { return server.received("slotSubscribe").size() == 1; }));
+
+  server.drop_client();
+  REQUIRE(poll_until(client, [&]() { return server.connections == 2 && client.is_connected(); }));
+  CHECK(downtimes.size() == 1);
+  REQUIRE(poll_until(client, [&]() { return server.received("slotSubscribe").size() == 2; }));
+  poll_until(client, []() { return false; }, 50);
+
+  // The replayed subscribe was confirmed as 1001, so notifications for 1000 are stale
+  server.send({ {"jsonrpc", "2.0"}, {"method", "slotNotification"}, {"params", { {"subscription", 1000}, {"result", {}} }} });
+  server.send({ {"jsonrpc", "2.0"}, {"method", "slotNotification"}, {"params", { {"subscription", 1001}, {"result", {}} }} });
+  REQUIRE(poll_until(client, [&]() { return notifications == 1; }));
+  poll_until(client, []() { return false; }, 50);
+  CHECK(notifications == 1);
+}
+
+TEST_CASE("reconnect does not block poll while the handshake is outstanding") {
+  FakeServer server;
+  websockets::WebSocketClient client(server.url());
+  client.set_reconnect(true, 10, 100);
+  REQUIRE(client.connect());
+  client.subscribe("slotSubscribe", nullptr, [](json) {});
+
+  server.answer_handshakes = false;
+  server.drop_client();
+  REQUIRE(poll_until(client, [&]() { return client.is_reconnecting(); }));
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+  while (std::chrono::steady_clock::now() < deadline) {
+    auto start = std::chrono::steady_clock::now();
+    client.poll();
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50));
+    CHECK(!client.is_connected());
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // Subscriptions made meanwhile are sent with the replay
+  client.subscribe("rootSubscribe", nullptr, [](json) {});
+
+  server.answer_handshakes = true;
+  server.close_silent();
+  REQUIRE(poll_until(client, [&]() { return client.is_connected(); }));
+  REQUIRE(poll_until(client, [&]() { return server.received("rootSubscribe").size() == 1; }));
+  CHECK(server.received("slotSubscribe").size() == 2);
+}
+
+TEST_CASE("heartbeat counts a pong that arrived while the client was busy") {
+  FakeServer server;
+  websockets::WebSocketClient client(server.url());
+  client.set_heartbeat(20, 30);
+  REQUIRE(client.connect());
+
+  // Each gap is longer than the pong timeout, but the pong is already waiting in the socket
+  for (int i = 0; i < 8; i++) {
+    client.poll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  }
+  CHECK(client.is_connected());
+  CHECK(server.connections == 1);
+  CHECK(client.rtt_us() > 0);
+}
+
+TEST_CASE("heartbeat reconnects when pongs stop") {
+  FakeServer server;
+  server.answer_pings = false;
+  websockets::WebSocketClient client(server.url());
+  client.set_heartbeat(20, 50);
+  client.set_reconnect(true, 10, 100);
+  REQUIRE(client.connect());
+  CHECK(poll_until(client, [&]() { return server.connections == 2; }));
+}
+
+TEST_CASE("permessage-deflate messages are inflated with the context of earlier messages") {
+  FakeServer server;
+  server.deflate = true;
+  websockets::WebSocketClient client(server.url());
+  client.set_permessage_deflate(true);
+  REQUIRE(client.connect());
+  CHECK(client.is_deflate_active());
+  CHECK(!server.no_context_takeover());
+
+  std::vector<uint64_t> slots;
+  client.subscribe("slotSubscribe", nullptr, [&](json params) { slots.push_back(params["result"]["slot"]); });
+  REQUIRE(poll_until(client, [&]() { return server.server_id("slotSubscribe") != 0; }));
+  poll_until(client, []() { return false; }, 20);
+
+  for (uint64_t slot = 100; slot < 103; slot++) {
+    server.send_compressed({ {"jsonrpc", "2.0"}, {"method", "slotNotification"}, {"params", { {"subscription", server.server_id("slotSubscribe")}, {"result", { {"slot", slot}, {"parent", slot - 1}, {"root", slot - 32} }} }} });
+  }
+  REQUIRE(poll_until(client, [&]() { return slots.size() == 3; }));
+  CHECK(slots == std::vector<uint64_t>{ 100, 101, 102 });
+  CHECK(client.deflate_stats().messages == 3);
+  // Later messages mostly refer back to the first one
+  CHECK(client.deflate_stats().ratio() > 2.0);
+
+  // While a reconnect is in flight the connection has no extension, and the stats stay
+  client.set_reconnect(true, 10, 100);
+  server.answer_handshakes = false;
+  server.drop_client();
+  REQUIRE(poll_until(client, [&]() { return client.is_reconnecting(); }));
+  CHECK(!client.is_deflate_active());
+  CHECK(client.deflate_stats().messages == 3);
+  server.answer_handshakes = true;
+  server.close_silent();
+  REQUIRE(poll_until(client, [&]() { return client.is_connected(); }));
+  CHECK(client.is_deflate_active());
+}
+
+TEST_CASE("permessage-deflate without context takeover inflates each message on its own") {
+  FakeServer server;
+  server.deflate = true;
+  websockets::WebSocketClient client(server.url());
+  client.set_permessage_deflate(true, false);
+  REQUIRE(client.connect());
+  CHECK(client.is_deflate_active());
+  CHECK(server.no_context_takeover());
+
+  int notifications = 0;
+  client.subscribe("slotSubscribe", nullptr, [&](json) { notifications++; });
+  REQUIRE(poll_until(client, [&]() { return server.server_id("slotSubscribe") != 0; }));
+  poll_until(client, []() { return false; }, 20);
+
+  for (uint64_t slot = 100; slot < 103; slot++) {
+    server.send_compressed({ {"jsonrpc", "2.0"}, {"method", "slotNotification"}, {"params", { {"subscription", server.server_id("slotSubscribe")}, {"result", { {"slot", slot}, {"parent", slot - 1}, {"root", slot - 32} }} }} });
+  }
+  REQUIRE(poll_until(client, [&]() { return notifications == 3; }));
+  CHECK(client.deflate_stats().messages == 3);
+  CHECK(client.is_connected());
+}
+
+TEST_CASE("permessage-deflate drops the socket on a message that inflates past the buffer") {
+  FakeServer server;
+  server.deflate = true;
+  websockets::WebSocketClient client(server.url());
+  client.set_permessage_deflate(true);
+  client.set_reconnect(true, 10, 100);
+  REQUIRE(client.connect());
+
+  int notifications = 0;
+  client.subscribe("slotSubscribe", nullptr, [&](json) { notifications++; });
+  REQUIRE(poll_until(client, [&]() { return server.server_id("slotSubscribe") != 0; }));
+
+  server.send_compressed({ {"jsonrpc", "2.0"}, {"method", "slotNotification"}, {"params", { {"subscription", server.server_id("slotSubscribe")}, {"result", std::string(4 * 1048576, 'a')} }} });
+  REQUIRE(poll_until(client, [&]() { return server.connections == 2 && server.received("slotSubscribe").size() == 2; }));
+  CHECK(notifications == 0);
+
+  poll_until(client, []() { return false; }, 20);
+  server.send_compressed({ {"jsonrpc", "2.0"}, {"method", "slotNotification"}, {"params", { {"subscription", server.server_id("slotSubscribe")}, {"result", { {"slot", 1}, {"parent", 0}, {"root", 0} }} }} });
+  CHECK(poll_until(client, [&]() { return notifications == 1; }));
+}
+
+/**
+ * Returns accountSubscribe subscriptions for new accounts.
+ */
+std::vector<websockets::WebSocketClient::Subscription> account_subscriptions(size_t count) {
+  std::vector<websockets::WebSocketClient::Subscription> subscriptions;
+  for (size_t i = 0; i < count; i++) {
+    subscriptions.push_back({ "accountSubscribe", { Keypair::generate().public_key.to_base58() }, [](json) {}, nullptr });
+  }
+  return subscriptions;
+}
+
+TEST_CASE("subscribe_many sends the subscribes in one write and reports once all are live") {
+  FakeServer server;
+  websockets::WebSocketClient client(server.url());
+  REQUIRE(client.connect());
+  poll_until(client, []() { return false; }, 20);
+
+  int reads = server.reads;
+  std::vector<websockets::SubscribeReport> reports;
+  auto ids = client.subscribe_many(account_subscriptions(50), 1000, [&](const websockets::SubscribeReport& report) { reports.push_back(report); });
+  REQUIRE(ids.size() == 50);
+  REQUIRE(poll_until(client, [&]() { return reports.size() == 1; }));
+  CHECK(server.received("accountSubscribe").size() == 50);
+  CHECK(server.reads - reads <= 2);
+
+  CHECK(reports[0].live());
+  std::vector<int> confirmed = reports[0].confirmed;
+  std::sort(confirmed.begin(), confirmed.end());
+  CHECK(confirmed == ids);
+  CHECK(client.subscription_count() == 50);
+}
+
+TEST_CASE("subscribe_many reports failed and unconfirmed subscriptions") {
+  FakeServer server;
+  server.auto_confirm = false;
+  websockets::WebSocketClient client(server.url());
+  REQUIRE(client.connect());
+
+  std::vector<websockets::SubscribeReport> reports;
+  auto ids = client.subscribe_many(account_subscriptions(3), 100, [&](const websockets::SubscribeReport& report) { reports.push_back(report); });
+  REQUIRE(poll_until(client, [&]() { return server.received("accountSubscribe").size() == 3; }));
+
+  server.send({ {"jsonrpc", "2.0"}, {"result", 7}, {"id", ids[0]} });
+  server.send({ {"jsonrpc", "2.0"}, {"error", { {"code", -32602}, {"message", "Invalid params"} }}, {"id", ids[1]} });
+  REQUIRE(poll_until(client, [&]() { return reports.size() == 1; }));
+  CHECK(!reports[0].live());
+  CHECK(reports[0].confirmed == std::vector<int>{ ids[0] });
+  CHECK(reports[0].failed == std::vector<int>{ ids[1] });
+  CHECK(reports[0].timed_out == std::vector<int>{ ids[2] });
+}
+
+TEST_CASE("a rejected unsubscribe is not taken for a rejected subscribe") {
+  FakeServer server;
+  server.auto_confirm = false;
+  websockets::WebSocketClient client(server.url());
+  REQUIRE(client.connect());
+
+  int id = client.subscribe("accountSubscribe", { "11111111111111111111111111111111" }, [](json) {});
+  REQUIRE(poll_until(client, [&]() { return server.received("accountSubscribe").size() == 1; }));
+  server.send({ {"jsonrpc", "2.0"}, {"result", 7}, {"id", id} });
+  REQUIRE(poll_until(client, [&]() { return client.is_confirmed(id); }));
+  client.unsubscribe(id, "accountUnsubscribe");
+  REQUIRE(poll_until(client, [&]() { return server.received("accountUnsubscribe").size() == 1; }));
+  json unsubscribe_id = server.received("accountUnsubscribe")[0]["id"];
+  CHECK(unsubscribe_id != json(id));
+
+  std::vector<websockets::SubscribeReport> reports;
+  auto ids = client.subscribe_many(account_subscriptions(1), 1000, [&](const websockets::SubscribeReport& report) { reports.push_back(report); });
+  REQUIRE(poll_until(client, [&]() { return server.received("accountSubscribe").size() == 2; }));
+  server.send({ {"jsonrpc", "2.0"}, {"error", { {"code", -32602}, {"message", "Invalid params"} }}, {"id", unsubscribe_id} });
+  poll_until(client, []() { return false; }, 50);
+  CHECK(reports.empty());
+
+  server.send({ {"jsonrpc", "2.0"}, {"result", 8}, {"id", ids[0]} });
+  REQUIRE(poll_until(client, [&]() { return reports.size() == 1; }));
+  CHECK(reports[0].live());
+}
+
+/**
+ * Polls a connection until done() returns true or the timeout passes, and returns done().
+ */
+template <typename F>
+bool poll_until(Connection& connection, F done, int timeout_ms = 2000) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (!done() && std::chrono::steady_clock::now() < deadline) {
+    connection.poll();
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  return done();
+}
+
+TEST_CASE("stale detection follows the slot of each socket, not account traffic") {
+  FakeServer server;
+  Connection connection(server.http_url());
+  connection.set_stale_timeout(100);
+  connection.on_account_change(Keypair::generate().public_key, [](Result<Account>) {});
+  REQUIRE(poll_until(connection, [&]() { return server.server_id("slotSubscribe") != 0; }));
+
+  // The account stays quiet while the slot advances, so the socket is healthy
+  uint64_t slot = 100;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(400);
+  while (std::chrono::steady_clock::now() < deadline) {
+    server.notify("slotNotification", server.server_id("slotSubscribe"), { {"slot", slot++}, {"parent", 0}, {"root", 0} });
+    poll_until(connection, []() { return false; }, 20);
+  }
+  CHECK(server.connections == 1);
+
+  // Once the slot stops advancing, the socket is restarted and its subscriptions replayed
+  REQUIRE(poll_until(connection, [&]() { return server.connections == 2; }));
+  CHECK(poll_until(connection, [&]() { return server.received("accountSubscribe").size() == 2 && server.received("slotSubscribe").size() == 2; }));
+}
+
+/**
+ * Returns an account notification result at the given slot.
+ */
+json account_result(uint64_t slot) {
+  return {
+    {"context", { {"slot", slot} }},
+    {"value", {
+      {"data", { "", "base64" }},
+      {"executable", false},
+      {"lamports", 1000},
+      {"owner", "11111111111111111111111111111111"},
+      {"rentEpoch", 0},
+      {"space", 0},
+    }},
+  };
+}
+
+TEST_CASE("activity timeout restarts a socket whose feed goes silent while its slot advances") {
+  FakeServer server;
+  Connection connection(server.http_url());
+  int subscription_id = connection.on_program_account_change(Keypair::generate().public_key, [](Result<Account>) {});
+  connection.set_activity_timeout(subscription_id, 100);
+  REQUIRE(poll_until(connection, [&]() { return server.server_id("slotSubscribe") != 0; }));
+
+  std::string account = Keypair::generate().public_key.to_base58();
+  uint64_t slot = 100;
+  auto advance = [&](bool notify, int duration_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(duration_ms);
+    while (std::chrono::steady_clock::now() < deadline && server.connections == 1) {
+      server.notify("slotNotification", server.server_id("slotSubscribe"), { {"slot", slot}, {"parent", 0}, {"root", 0} });
+      if (notify) {
+        json result = account_result(slot);
+        result["value"] = { {"pubkey", account}, {"account", result["value"]} };
+        server.notify("programNotification", server.server_id("programSubscribe"), result);
+      }
+      slot++;
+      poll_until(connection, []() { return false; }, 20);
+    }
+  };
+
+  // The program delivers as the slot advances, so the feed is healthy
+  advance(true, 400);
+  CHECK(server.connections == 1);
+
+  // Silence with no slot progress is left to the heartbeat
+  poll_until(connection, []() { return false; }, 300);
+  CHECK(server.connections == 1);
+
+  // The slot keeps advancing but the program feed has died, so the socket is restarted
+  advance(false, 400);
+  CHECK(server.connections == 2);
+  CHECK(poll_until(connection, [&]() { return server.received("programSubscribe").size() == 2 && server.received("slotSubscribe").size() == 2; }));
+}
+
+TEST_CASE("subscription gap starts at the slot the socket dropped at") {
+  FakeServer server;
+  Connection connection(server.http_url());
+  connection.set_auto_reconnect(true, 10, 100);
+  PublicKey account_id = Keypair::generate().public_key;
+  int updates = 0;
+  connection.on_account_change(account_id, [&](Result<Account>) { updates++; });
+  std::vector<SubscriptionGap> gaps;
+  connection.on_subscription_gap([&](const SubscriptionGap& gap) { gaps.push_back(gap); });
+  REQUIRE(poll_until(connection, [&]() { return server.server_id("accountSubscribe") != 0; }));
+
+  server.notify("accountNotification", server.server_id("accountSubscribe"), account_result(100));
+  REQUIRE(poll_until(connection, [&]() { return updates == 1; }));
+
+  server.drop_client();
+  REQUIRE(poll_until(connection, [&]() { return server.received("accountSubscribe").size() == 2; }));
+  poll_until(connection, []() { return false; }, 50);
+  CHECK(gaps.empty());
+
+  server.notify("accountNotification", server.server_id("accountSubscribe"), account_result(150));
+  REQUIRE(poll_until(connection, [&]() { return updates == 2; }));
+  REQUIRE(gaps.size() == 1);
+  CHECK(gaps[0].last_slot == 100);
+  CHECK(gaps[0].resume_slot == 150);
+  CHECK(gaps[0].accounts == std::vector<PublicKey>{ account_id });
+
+  // Only the first notification after the reconnect reports the gap
+  server.notify("accountNotification", server.server_id("accountSubscribe"), account_result(151));
+  REQUIRE(poll_until(connection, [&]() { return updates == 3; }));
+  CHECK(gaps.size() == 1);
+}
+
+/**
+ * Waits without polling until done() returns true or the timeout passes, and returns done().
+ */
+template <typename F>
+bool wait_until(F done, int timeout_ms = 2000) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (!done() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  return done();
+}
+
+TEST_CASE("DropOldest never discards subscription gaps") {
+  FakeServer server;
+  Connection connection(server.http_url());
+  connection.set_auto_reconnect(true, 10, 100);
+  NetworkThreadOptions options;
+  options.capacity = 4;
+  options.overflow = OverflowPolicy::DropOldest;
+  connection.start_network_thread(options);
+
+  int updates = 0;
+  connection.on_account_change(Keypair::generate().public_key, [&](Result<Account>) { updates++; });
+  std::vector<SubscriptionGap> gaps;
+  connection.on_subscription_gap([&](const SubscriptionGap& gap) { gaps.push_back(gap); });
+  REQUIRE(wait_until([&]() { return server.server_id("accountSubscribe") != 0; }));
+
+  server.notify("accountNotification", server.server_id("accountSubscribe"), account_result(100));
+  REQUIRE(poll_until(connection, [&]() { return updates == 1; }));
+
+  server.drop_client();
+  REQUIRE(wait_until([&]() { return server.received("accountSubscribe").size() == 2; }));
+  for (uint64_t slot = 150; slot < 200; slot++) {
+    server.notify("accountNotification", server.server_id("accountSubscribe"), account_result(slot));
+  }
+  REQUIRE(wait_until([&]() { return connection.network_thread_stats().pushed == 51; }));
+
+  connection.poll();
+  REQUIRE(gaps.size() == 1);
+  CHECK(gaps[0].last_slot == 100);
+  CHECK(gaps[0].resume_slot == 150);
+  CHECK(updates == 1 + 4);
+  CHECK(connection.network_thread_stats().dropped == 50 - 4);
+}
+
+TEST_CASE("a message that fails to decode is counted and the network thread carries on") {
+  FakeServer server;
+  Connection connection(server.http_url());
+  connection.start_network_thread();
+
+  int updates = 0;
+  connection.on_account_change(Keypair::generate().public_key, [&](Result<Account>) { updates++; });
+  REQUIRE(wait_until([&]() { return server.server_id("accountSubscribe") != 0; }));
+
+  server.send_frame(0x1, "{\"jsonrpc\":\"2.0\",\"method\":");
+  server.notify("accountNotification", server.server_id("accountSubscribe"), account_result(100));
+  REQUIRE(poll_until(connection, [&]() { return updates == 1; }));
+  CHECK(connection.network_thread_stats().errors == 1);
+  CHECK(server.connections == 1);
+}
+
+TEST_CASE("getters read the state published by the network thread") {
+  FakeServer server;
+  Connection connection(server.http_url());
+  connection.set_heartbeat(10);
+  connection.start_network_thread();
+  CHECK(!connection.is_connected());
+
+  connection.on_account_change(Keypair::generate().public_key, [](Result<Account>) {});
+  CHECK(wait_until([&]() { return connection.is_connected(); }));
+  CHECK(wait_until([&]() { return connection.websocket_shard_loads() == std::vector<size_t>{ 1 }; }));
+  CHECK(wait_until([&]() { return connection.websocket_rtt_us() > 0; }));
+}
+
+TEST_CASE("Block holds the network thread until the strategy thread catches up") {
+  FakeServer server;
+  Connection connection(server.http_url());
+  NetworkThreadOptions options;
+  options.capacity = 4;
+  options.overflow = OverflowPolicy::Block;
+  connection.start_network_thread(options);
+
+  std::vector<uint64_t> slots;
+  connection.on_account_change(Keypair::generate().public_key, [&](Result<Account> result) { slots.push_back(result._context->slot); });
+  REQUIRE(wait_until([&]() { return server.server_id("accountSubscribe") != 0; }));
+
+  for (uint64_t slot = 0; slot < 50; slot++) {
+    server.notify("accountNotification", server.server_id("accountSubscribe"), account_result(slot));
+  }
+  REQUIRE(wait_until([&]() { return connection.network_thread_stats().depth == 4; }));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  CHECK(connection.network_thread_stats().pushed == 4);
+
+  REQUIRE(poll_until(connection, [&]() { return slots.size() == 50; }));
+  for (uint64_t slot = 0; slot < 50; slot++) {
+    CHECK(slots[slot] == slot);
+  }
+  CHECK(connection.network_thread_stats().dropped == 0);
+  CHECK(connection.network_thread_stats().high_water == 4);
+}
+
+TEST_CASE("ConflateByKey delivers the latest update of each account") {
+  FakeServer server;
+  Connection connection(server.http_url());
+  NetworkThreadOptions options;
+  options.overflow = OverflowPolicy::ConflateByKey;
+  connection.start_network_thread(options);
+
+  std::map<std::string, uint64_t> latest;
+  int updates = 0;
+  connection.on_program_account_change(Keypair::generate().public_key, [&](Result<Account> result) {
+    latest[std::to_string(result._context->slot % 2)] = result._context->slot;
+    updates++;
+  });
+  REQUIRE(wait_until([&]() { return server.server_id("programSubscribe") != 0; }));
+
+  std::vector<std::string> accounts = { Keypair::generate().public_key.to_base58(), Keypair::generate().public_key.to_base58() };
+  for (uint64_t slot = 0; slot < 50; slot++) {
+    json result = account_result(slot);
+    result["value"] = { {"pubkey", accounts[slot % 2]}, {"account", result["value"]} };
+    server.notify("programNotification", server.server_id("programSubscribe"), result);
+  }
+  REQUIRE(wait_until([&]() { return connection.network_thread_stats().conflated == 48; }));
+
+  connection.poll();
+  CHECK(updates == 2);
+  CHECK(latest["0"] == 48);
+  CHECK(latest["1"] == 49);
+  CHECK(connection.network_thread_stats().pushed == 2);
+}
+
+TEST_CASE("ConflateByKey drops the mailboxes of accounts once they are delivered") {
+  FakeServer server;
+  Connection connection(server.http_url());
+  NetworkThreadOptions options;
+  options.overflow = OverflowPolicy::ConflateByKey;
+  connection.start_network_thread(options);
+
+  int updates = 0;
+  int listener = connection.on_program_account_change(Keypair::generate().public_key, [&](Result<Account>) { updates++; });
+  REQUIRE(wait_until([&]() { return server.server_id("programSubscribe") != 0; }));
+
+  // Every notification is for a new account, as on a busy program
+  for (int round = 0; round < 20; round++) {
+    for (uint64_t slot = 0; slot < 50; slot++) {
+      json result = account_result(slot);
+      result["value"] = { {"pubkey", Keypair::generate().public_key.to_base58()}, {"account", result["value"]} };
+      server.notify("programNotification", server.server_id("programSubscribe"), result);
+    }
+    REQUIRE(poll_until(connection, [&]() { return updates == 50 * (round + 1); }));
+  }
+  CHECK(connection.network_thread_stats().mailboxes < 200);
+  CHECK(connection.network_thread_stats().conflated == 0);
+
+  connection.remove_program_account_change_listnener(listener);
+  CHECK(wait_until([&]() { return connection.network_thread_stats().mailboxes == 0; }));
+}
+
+TEST_CASE("listeners on one account share a subscription until the last one leaves") {
+  FakeServer server;
+  Connection connection(server.http_url());
+  PublicKey account_id = Keypair::generate().public_key;
+
+  int first_updates = 0;
+  int second_updates = 0;
+  int first = connection.on_account_change(account_id, [&](Result<Account>) { first_updates++; });
+  int second = connection.on_account_change(account_id, [&](Result<Account>) { second_updates++; });
+  CHECK(first != second);
+  REQUIRE(poll_until(connection, [&]() { return server.server_id("accountSubscribe") != 0; }));
+  poll_until(connection, []() { return false; }, 20);
+  CHECK(server.received("accountSubscribe").size() == 1);
+
+  server.notify("accountNotification", server.server_id("accountSubscribe"), account_result(1));
+  REQUIRE(poll_until(connection, [&]() { return first_updates == 1 && second_updates == 1; }));
+
+  connection.remove_account_listener(first);
+  poll_until(connection, []() { return false; }, 20);
+  CHECK(server.received("accountUnsubscribe").empty());
+
+  server.notify("accountNotification", server.server_id("accountSubscribe"), account_result(2));
+  REQUIRE(poll_until(connection, [&]() { return second_updates == 2; }));
+  CHECK(first_updates == 1);
+
+  connection.remove_account_listener(second);
+  REQUIRE(poll_until(connection, [&]() { return server.received("accountUnsubscribe").size() == 1; }));
+  CHECK(server.received("accountUnsubscribe")[0]["params"] == json({ server.server_id("accountSubscribe") }));
+}
+
+TEST_CASE("a listener can remove itself from its callback") {
+  FakeServer server;
+  Connection connection(server.http_url());
+  PublicKey account_id = Keypair::generate().public_key;
+
+  int updates = 0;
+  int other_updates = 0;
+  int listener = 0;
+  listener = connection.on_account_change(account_id, [&](Result<Account>) {
+    updates++;
+    connection.remove_account_listener(listener);
+  });
+  connection.on_account_change(account_id, [&](Result<Account>) { other_updates++; });
+  REQUIRE(poll_until(connection, [&]() { return server.server_id("accountSubscribe") != 0; }));
+
+  server.notify("accountNotification", server.server_id("accountSubscribe"), account_result(1));
+  server.notify("accountNotification", server.server_id("accountSubscribe"), account_result(2));
+  REQUIRE(poll_until(connection, [&]() { return other_updates == 2; }));
+  CHECK(updates == 1);
+  CHECK(server.received("accountUnsubscribe").empty());
+}
+
+TEST_CASE("Connection subscribe_many reports listeners that share a subscription as live") {
+  FakeServer server;
+  Connection connection(server.http_url());
+  std::vector<PublicKey> account_ids;
+  for (int i = 0; i < 20; i++) {
+    account_ids.push_back(Keypair::generate().public_key);
+  }
+  connection.on_account_change(account_ids[0], [](Result<Account>) {});
+  REQUIRE(poll_until(connection, [&]() { return server.server_id("accountSubscribe") != 0; }));
+
+  std::vector<PublicKey> updated;
+  std::vector<websockets::SubscribeReport> reports;
+  auto ids = connection.subscribe_many(account_ids, [&](const PublicKey& account_id, Result<Account>) {
+    updated.push_back(account_id);
+  }, [&](const websockets::SubscribeReport& report) {
+    reports.push_back(report);
+  });
+  REQUIRE(ids.size() == 20);
+  REQUIRE(poll_until(connection, [&]() { return reports.size() == 1; }));
+  CHECK(reports[0].live());
+  std::vector<int> confirmed = reports[0].confirmed;
+  std::sort(confirmed.begin(), confirmed.end());
+  std::vector<int> sorted_ids = ids;
+  std::sort(sorted_ids.begin(), sorted_ids.end());
+  CHECK(confirmed == sorted_ids);
+  // The first account already had a server subscription
+  CHECK(server.received("accountSubscribe").size() == 20);
+
+  server.notify("accountNotification", server.server_id("accountSubscribe"), account_result(1));
+  REQUIRE(poll_until(connection, [&]() { return updated.size() == 1; }));
+  CHECK(updated[0] == account_ids.back());
+}
+
+TEST_CASE("Connection subscribe_many reports a shared subscription by the outcome on the server") {
+  FakeServer server;
+  server.auto_confirm = false;
+  Connection connection(server.http_url());
+  std::vector<PublicKey> account_ids = { Keypair::generate().public_key, Keypair::generate().public_key };
+
+  // Listeners on the first account share one subscription, and the server rejects it
+  std::vector<websockets::SubscribeReport> reports;
+  auto ids = connection.subscribe_many({ account_ids[0], account_ids[0], account_ids[1] }, [](const PublicKey&, Result<Account>) {}, [&](const websockets::SubscribeReport& report) {
+    reports.push_back(report);
+  }, 1000);
+  REQUIRE(poll_until(connection, [&]() { return server.received("accountSubscribe").size() == 2; }));
+  auto subscribes = server.received("accountSubscribe");
+  for (auto& subscribe : subscribes) {
+    if (subscribe["params"][0] == account_ids[0].to_base58()) {
+      server.send({ {"jsonrpc", "2.0"}, {"error", { {"code", -32602}, {"message", "Invalid params"} }}, {"id", subscribe["id"]} });
+    } else {
+      server.send({ {"jsonrpc", "2.0"}, {"result", 7}, {"id", subscribe["id"]} });
+    }
+  }
+  REQUIRE(poll_until(connection, [&]() { return reports.size() == 1; }));
+  CHECK(reports[0].confirmed == std::vector<int>{ ids[2] });
+  std::vector<int> failed = reports[0].failed;
+  std::sort(failed.begin(), failed.end());
+  CHECK(failed == std::vector<int>{ ids[0], ids[1] });
+}
+
+TEST_CASE("Connection subscribe_many waits for a subscription made just before") {
+  FakeServer server;
+  server.auto_confirm = false;
+  Connection connection(server.http_url());
+  PublicKey account_id = Keypair::generate().public_key;
+  connection.on_account_change(account_id, [](Result<Account>) {});
+
+  std::vector<websockets::SubscribeReport> reports;
+  auto ids = connection.subscribe_many({ account_id }, [](const PublicKey&, Result<Account>) {}, [&](const websockets::SubscribeReport& report) {
+    reports.push_back(report);
+  }, 100);
+  REQUIRE(poll_until(connection, [&]() { return reports.size() == 1; }));
+  CHECK(reports[0].confirmed.empty());
+  CHECK(reports[0].timed_out == ids);
+  CHECK(server.received("accountSubscribe").size() == 1);
+}
+
+TEST_CASE("Connection subscribe_many reports timeouts") {
+  FakeServer server;
+  server.auto_confirm = false;
+  Connection connection(server.http_url());
+  std::vector<PublicKey> account_ids = { Keypair::generate().public_key, Keypair::generate().public_key };
+
+  std::vector<websockets::SubscribeReport> reports;
+  auto ids = connection.subscribe_many(account_ids, [](const PublicKey&, Result<Account>) {}, [&](const websockets::SubscribeReport& report) {
+    reports.push_back(report);
+  }, 100);
+  REQUIRE(poll_until(connection, [&]() { return reports.size() == 1; }));
+  CHECK(reports[0].confirmed.empty());
+  std::vector<int> timed_out = reports[0].timed_out;
+  std::sort(timed_out.begin(), timed_out.end());
+  CHECK(timed_out == ids);
+}
+
+TEST_CASE("spin mode reads without blocking and still delivers notifications") {
+  FakeServer server;
+  websockets::WebSocketClient client(server.url());
+  client.set_spin(true, 0);
+  client.set_reconnect(true, 10, 100);
+  REQUIRE(client.connect());
+
+  int notifications = 0;
+  client.subscribe("slotSubscribe", nullptr, [&](json) { notifications++; });
+  REQUIRE(poll_until(client, [&]() { return server.server_id("slotSubscribe") != 0; }));
+
+  // Reads that find nothing must not be taken for a failed socket
+  for (int i = 0; i < 10000; i++) {
+    client.poll();
+  }
+  CHECK(client.is_connected());
+
+  server.notify("slotNotification", server.server_id("slotSubscribe"), { {"slot", 1}, {"parent", 0}, {"root", 0} });
+  REQUIRE(poll_until(client, [&]() { return notifications == 1; }));
+
+  // Spin mode carries over to the new socket after a reconnect
+  server.drop_client();
+  REQUIRE(poll_until(client, [&]() { return server.received("slotSubscribe").size() == 2 && client.is_connected(); }));
+  for (int i = 0; i < 10000; i++) {
+    client.poll();
+  }
+  CHECK(client.is_connected());
+  CHECK(server.connections == 2);
+}
+
+TEST_CASE("spin mode with receive timestamps skips the read while the socket is empty") {
+  FakeServer server;
+  websockets::WebSocketClient client(server.url());
+  client.set_spin(true, 0);
+  client.set_receive_timestamps(true);
+  REQUIRE(client.connect());
+
+  uint64_t stamp = 0;
+  client.subscribe("slotSubscribe", nullptr, [&](json) { stamp = client.last_receive_ns(); });
+  REQUIRE(poll_until(client, [&]() { return server.server_id("slotSubscribe") != 0; }));
+
+  for (int i = 0; i < 10000; i++) {
+    client.poll();
+  }
+  CHECK(client.is_connected());
+
+  uint64_t sent = realtime_ns();
+  server.notify("slotNotification", server.server_id("slotSubscribe"), { {"slot", 1}, {"parent", 0}, {"root", 0} });
+  REQUIRE(poll_until(client, [&]() { return stamp != 0; }));
+  CHECK(stamp >= sent);
+  CHECK(stamp <= realtime_ns());
+
+  // The end of the stream is still read, so a closed socket is noticed
+  server.drop_client();
+  CHECK(poll_until(client, [&]() { return !client.is_connected(); }));
+}
+
+TEST_CASE("Connection spin polls on the calling thread until running is cleared") {
+  FakeServer server;
+  Connection connection(server.http_url());
+  connection.set_spin(true, 0);
+
+  std::atomic<int> updates{0};
+  connection.on_account_change(Keypair::generate().public_key, [&](Result<Account>) { updates++; });
+  std::atomic<bool> running{true};
+  std::thread spinner([&]() { connection.spin(running); });
+
+  REQUIRE(wait_until([&]() { return server.server_id("accountSubscribe") != 0; }));
+  for (uint64_t slot = 0; slot < 10; slot++) {
+    server.notify("accountNotification", server.server_id("accountSubscribe"), account_result(slot));
+  }
+  CHECK(wait_until([&]() { return updates == 10; }));
+
+  running = false;
+  spinner.join();
+  CHECK(server.connections == 1);
+}
+
+TEST_CASE("disconnect does not wait for a reconnect stuck in the TCP connect") {
+  FakeServer server;
+  websockets::WebSocketClient client(server.url());
+  client.set_reconnect(true, 10, 100);
+  REQUIRE(client.connect());
+
+  server.fill_backlog();
+  server.drop_client();
+  REQUIRE(poll_until(client, [&]() { return client.is_reconnecting(); }));
+  poll_until(client, []() { return false; }, 50);
+
+  std::atomic<bool> disconnected{false};
+  std::thread disconnecter([&]() {
+    client.disconnect();
+    disconnected = true;
+  });
+  bool returned = wait_until([&]() { return disconnected.load(); }, 1000);
+  disconnecter.join();
+  CHECK(returned);
+  CHECK(!client.is_connected());
+}
+
+TEST_CASE("spin mode reconnect gives up on a hanging handshake") {
+  FakeServer server;
+  websockets::WebSocketClient client(server.url());
+  client.set_spin(true, 0);
+  client.set_reconnect(true, 10, 100);
+  REQUIRE(client.connect());
+  client.subscribe("slotSubscribe", nullptr, [](json) {});
+
+  server.answer_handshakes = false;
+  server.drop_client();
+  REQUIRE(poll_until(client, [&]() { return client.is_reconnecting(); }));
+  poll_until(client, []() { return false; }, 50);
+
+  // The handshake read must not block, or disconnect() waits on the reconnect thread for good
+  std::atomic<bool> disconnected{false};
+  std::thread disconnecter([&]() {
+    client.disconnect();
+    disconnected = true;
+  });
+  bool returned = wait_until([&]() { return disconnected.load(); }, 1000);
+  server.close_silent();
+  disconnecter.join();
+  CHECK(returned);
+  CHECK(!client.is_connected());
+
+  // Spin mode still works on the next connection
+  server.answer_handshakes = true;
+  REQUIRE(client.connect());
+  for (int i = 0; i < 10000; i++) {
+    client.poll();
+  }
+  CHECK(client.is_connected());
+}